@@ -0,0 +1,23 @@
+/* 基准测试的独立入口：把主程序源文件编进同一个翻译单元，只运行其中的 --benchmark 模式，
+   参数与 电表监控.exe --benchmark 相同：electric_bench [--rows N] [结果文件]。
+   非Windows平台由CMake把 bench/posix 放在头文件搜索路径最前面，用POSIX实现主程序用到的Win32函数 */
+#define main electric_monitor_main
+#include "../电表查询.c"
+#undef main
+
+int main(int argc, char *argv[])
+{
+    char **args = malloc(sizeof(char *) * (argc + 2));
+    if (!args)
+        return 1;
+
+    args[0] = argv[0];
+    args[1] = "--benchmark";
+    for (int i = 1; i < argc; i++)
+        args[i + 1] = argv[i];
+    args[argc + 1] = NULL;
+
+    int result = electric_monitor_main(argc + 1, args);
+    free(args);
+    return result;
+}
@@ -0,0 +1,2 @@
+/* 非Windows平台编译基准测试时代替系统头文件，见 win32_posix.h */
+#include "win32_posix.h"
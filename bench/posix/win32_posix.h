@@ -0,0 +1,966 @@
+/* 在Linux等POSIX平台上编译基准测试和测试用的Win32兼容层。
+
+   为什么需要：主程序是单个按Windows编写的源文件，直接调用Win32线程、同步、计时、文件映射、
+   Winsock、WinINet和SChannel。基准测试（electric_bench）和SMTP回环测试（smtp_loopback）要在
+   没有Windows的CI上用CMake编译运行，并且测的必须是主程序的同一份代码，不能是另写的副本。
+   其他做法的问题：在主程序里到处加 #ifdef _WIN32 会把两套实现混进生产代码，之后每次修改都要维护两条路径；
+   用MinGW交叉编译再在Wine下运行，CI要装整套Wine，计时也不代表真实平台。
+   因此把差异集中在这一个头文件里：CMake在非Windows平台上把 bench/posix 放在头文件搜索路径最前面，
+   主程序的 #include <windows.h> 等就落到这里的转发头文件上，主程序本身不需要为Linux做任何修改。
+
+   范围：只实现主程序实际用到的函数，用pthread、clock_gettime、mmap和BSD套接字实现线程、同步、计时、
+   文件和套接字；WinINet和SChannel只提供返回失败的桩函数，基准测试不联网，SMTP回环测试只走明文会话。
+   这里只用于测试和基准测试，不用于发布版本。主程序开始使用新的Win32函数时，在这里补上对应的实现，
+   否则Linux上的ctest会编译失败 */
+#ifndef WIN32_POSIX_H
+#define WIN32_POSIX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+// 基本类型
+typedef unsigned long DWORD;
+typedef uint16_t WORD;
+typedef int BOOL;
+typedef long LONG;
+typedef unsigned int UINT;
+typedef int64_t LONGLONG;
+typedef int64_t LONG64;
+typedef uint64_t ULONGLONG;
+typedef void *LPVOID;
+typedef void *PVOID;
+typedef void *HANDLE;
+typedef const char *LPCSTR;
+typedef char *LPSTR;
+
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define INFINITE 0xFFFFFFFFu
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+
+// 时间
+typedef struct
+{
+    WORD wYear, wMonth, wDayOfWeek, wDay, wHour, wMinute, wSecond, wMilliseconds;
+} SYSTEMTIME;
+
+typedef struct
+{
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef union
+{
+    struct
+    {
+        DWORD LowPart;
+        LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+static inline void win32_fill_system_time(SYSTEMTIME *st, const struct tm *t, long usec)
+{
+    st->wYear = (WORD)(t->tm_year + 1900);
+    st->wMonth = (WORD)(t->tm_mon + 1);
+    st->wDayOfWeek = (WORD)t->tm_wday;
+    st->wDay = (WORD)t->tm_mday;
+    st->wHour = (WORD)t->tm_hour;
+    st->wMinute = (WORD)t->tm_min;
+    st->wSecond = (WORD)t->tm_sec;
+    st->wMilliseconds = (WORD)(usec / 1000);
+}
+
+// MSVC的可重入时间拆分函数（参数顺序与POSIX的_r版本相反），成功返回0
+static inline int localtime_s(struct tm *result, const time_t *value)
+{
+    return localtime_r(value, result) ? 0 : EINVAL;
+}
+
+static inline int gmtime_s(struct tm *result, const time_t *value)
+{
+    return gmtime_r(value, result) ? 0 : EINVAL;
+}
+
+static inline void GetLocalTime(SYSTEMTIME *st)
+{
+    struct timeval tv;
+    struct tm t;
+    gettimeofday(&tv, NULL);
+    localtime_r(&tv.tv_sec, &t);
+    win32_fill_system_time(st, &t, tv.tv_usec);
+}
+
+static inline void GetSystemTime(SYSTEMTIME *st)
+{
+    struct timeval tv;
+    struct tm t;
+    gettimeofday(&tv, NULL);
+    gmtime_r(&tv.tv_sec, &t);
+    win32_fill_system_time(st, &t, tv.tv_usec);
+}
+
+// FILETIME是自1601年起的100纳秒数
+static inline void win32_set_filetime(FILETIME *ft, unsigned long long value)
+{
+    ft->dwLowDateTime = (DWORD)(value & 0xFFFFFFFFu);
+    ft->dwHighDateTime = (DWORD)(value >> 32);
+}
+
+static inline void GetSystemTimeAsFileTime(FILETIME *ft)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    win32_set_filetime(ft, (unsigned long long)tv.tv_sec * 10000000ULL + (unsigned long long)tv.tv_usec * 10ULL +
+                               116444736000000000ULL);
+}
+
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER *counter)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    counter->QuadPart = (LONGLONG)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    return TRUE;
+}
+
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency)
+{
+    frequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+static inline ULONGLONG GetTickCount64(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ULONGLONG)ts.tv_sec * 1000 + (ULONGLONG)ts.tv_nsec / 1000000;
+}
+
+static inline void Sleep(DWORD ms)
+{
+    struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+    if (ms == 0)
+        sched_yield();
+    else
+        nanosleep(&ts, NULL);
+}
+
+// 文件与控制台
+#define MOVEFILE_REPLACE_EXISTING 0x1
+#define MOVEFILE_WRITE_THROUGH 0x8
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_NORMAL 0x80
+
+static inline DWORD GetLastError(void)
+{
+    return (DWORD)errno;
+}
+
+static inline BOOL CreateDirectoryA(const char *path, void *attributes)
+{
+    (void)attributes;
+    return mkdir(path, 0755) == 0;
+}
+
+static inline DWORD GetFileAttributesA(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return INVALID_FILE_ATTRIBUTES;
+    return S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+}
+
+static inline BOOL MoveFileExA(const char *from, const char *to, DWORD flags)
+{
+    (void)flags; // rename本身就会原子地替换目标文件
+    return rename(from, to) == 0;
+}
+
+static inline BOOL DeleteFileA(const char *path)
+{
+    return unlink(path) == 0;
+}
+
+static inline BOOL SetConsoleOutputCP(UINT code_page)
+{
+    (void)code_page;
+    return TRUE;
+}
+
+// 原子操作
+static inline LONG InterlockedIncrement(volatile LONG *p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+static inline LONG InterlockedDecrement(volatile LONG *p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+static inline LONG InterlockedExchange(volatile LONG *p, LONG v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+static inline LONG InterlockedExchangeAdd(volatile LONG *p, LONG v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+static inline LONG InterlockedCompareExchange(volatile LONG *p, LONG exchange, LONG comparand)
+{
+    __atomic_compare_exchange_n(p, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+static inline LONG64 InterlockedIncrement64(volatile LONG64 *p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+static inline LONG64 InterlockedExchange64(volatile LONG64 *p, LONG64 v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+static inline LONG64 InterlockedExchangeAdd64(volatile LONG64 *p, LONG64 v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+static inline LONG64 InterlockedCompareExchange64(volatile LONG64 *p, LONG64 exchange, LONG64 comparand)
+{
+    __atomic_compare_exchange_n(p, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+static inline void *InterlockedExchangePointer(void *volatile *p, void *v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+
+// 临界区（Windows的临界区可重入）
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+static inline void InitializeCriticalSection(CRITICAL_SECTION *section)
+{
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(section, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+static inline void DeleteCriticalSection(CRITICAL_SECTION *section) { pthread_mutex_destroy(section); }
+static inline void EnterCriticalSection(CRITICAL_SECTION *section) { pthread_mutex_lock(section); }
+static inline void LeaveCriticalSection(CRITICAL_SECTION *section) { pthread_mutex_unlock(section); }
+
+/* 线程、事件和信号量共用一种句柄：count是可等待的计数，
+   线程结束时置1且不再清零，自动重置事件被等到后清零，信号量每次等到减1 */
+typedef DWORD (*LPTHREAD_START_ROUTINE)(LPVOID);
+
+enum
+{
+    WIN32_HANDLE_THREAD,
+    WIN32_HANDLE_EVENT,
+    WIN32_HANDLE_SEMAPHORE,
+    WIN32_HANDLE_FILE,
+    WIN32_HANDLE_MAPPING
+};
+
+typedef struct
+{
+    int kind;
+    int manualReset;
+    LONG count;
+    volatile LONG references; // 线程句柄由创建方和线程本身各持有一份
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+    LPTHREAD_START_ROUTINE start;
+    LPVOID param;
+    int fd; // 文件和文件映射句柄持有的描述符
+} Win32Handle;
+
+static inline Win32Handle *win32_handle_new(int kind, LONG count, int manual_reset)
+{
+    Win32Handle *handle = (Win32Handle *)calloc(1, sizeof(Win32Handle));
+    if (!handle)
+        return NULL;
+    handle->kind = kind;
+    handle->count = count;
+    handle->manualReset = manual_reset;
+    handle->references = 1;
+    pthread_mutex_init(&handle->lock, NULL);
+    pthread_cond_init(&handle->changed, NULL);
+    return handle;
+}
+
+static inline void win32_handle_release(Win32Handle *handle)
+{
+    if (InterlockedDecrement(&handle->references) > 0)
+        return;
+    if (handle->kind == WIN32_HANDLE_FILE || handle->kind == WIN32_HANDLE_MAPPING)
+        close(handle->fd);
+    pthread_mutex_destroy(&handle->lock);
+    pthread_cond_destroy(&handle->changed);
+    free(handle);
+}
+
+static inline void win32_handle_signal(Win32Handle *handle, LONG count)
+{
+    pthread_mutex_lock(&handle->lock);
+    handle->count += count;
+    pthread_cond_broadcast(&handle->changed);
+    pthread_mutex_unlock(&handle->lock);
+}
+
+static inline void *win32_thread_main(void *param)
+{
+    Win32Handle *handle = (Win32Handle *)param;
+    handle->start(handle->param);
+    win32_handle_signal(handle, 1);
+    win32_handle_release(handle);
+    return NULL;
+}
+
+static inline HANDLE CreateThread(void *attributes, size_t stack_size, LPTHREAD_START_ROUTINE start,
+                                  LPVOID param, DWORD flags, DWORD *thread_id)
+{
+    (void)attributes;
+    (void)stack_size;
+    (void)flags;
+    (void)thread_id;
+    Win32Handle *handle = win32_handle_new(WIN32_HANDLE_THREAD, 0, 1);
+    if (!handle)
+        return NULL;
+    handle->start = start;
+    handle->param = param;
+    handle->references = 2;
+    if (pthread_create(&handle->thread, NULL, win32_thread_main, handle) != 0)
+    {
+        handle->references = 1;
+        win32_handle_release(handle);
+        return NULL;
+    }
+    pthread_detach(handle->thread);
+    return handle;
+}
+
+static inline HANDLE CreateEventA(void *attributes, BOOL manual_reset, BOOL initial_state, LPCSTR name)
+{
+    (void)attributes;
+    (void)name;
+    return win32_handle_new(WIN32_HANDLE_EVENT, initial_state ? 1 : 0, manual_reset);
+}
+
+static inline HANDLE CreateSemaphoreA(void *attributes, LONG initial_count, LONG maximum_count, LPCSTR name)
+{
+    (void)attributes;
+    (void)maximum_count;
+    (void)name;
+    return win32_handle_new(WIN32_HANDLE_SEMAPHORE, initial_count, 0);
+}
+
+static inline BOOL SetEvent(HANDLE handle)
+{
+    Win32Handle *event = (Win32Handle *)handle;
+    pthread_mutex_lock(&event->lock);
+    event->count = 1;
+    pthread_cond_broadcast(&event->changed);
+    pthread_mutex_unlock(&event->lock);
+    return TRUE;
+}
+
+static inline BOOL ResetEvent(HANDLE handle)
+{
+    Win32Handle *event = (Win32Handle *)handle;
+    pthread_mutex_lock(&event->lock);
+    event->count = 0;
+    pthread_mutex_unlock(&event->lock);
+    return TRUE;
+}
+
+static inline BOOL ReleaseSemaphore(HANDLE handle, LONG count, LONG *previous)
+{
+    Win32Handle *semaphore = (Win32Handle *)handle;
+    pthread_mutex_lock(&semaphore->lock);
+    if (previous)
+        *previous = semaphore->count;
+    semaphore->count += count;
+    pthread_cond_broadcast(&semaphore->changed);
+    pthread_mutex_unlock(&semaphore->lock);
+    return TRUE;
+}
+
+static inline DWORD WaitForSingleObject(HANDLE handle, DWORD ms)
+{
+    Win32Handle *object = (Win32Handle *)handle;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (ms != INFINITE)
+    {
+        deadline.tv_sec += ms / 1000;
+        deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&object->lock);
+    int rc = 0;
+    while (object->count == 0 && rc == 0)
+        rc = ms == INFINITE ? pthread_cond_wait(&object->changed, &object->lock)
+                            : pthread_cond_timedwait(&object->changed, &object->lock, &deadline);
+    DWORD result = object->count > 0 ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+    if (result == WAIT_OBJECT_0 && !object->manualReset)
+        object->count--;
+    pthread_mutex_unlock(&object->lock);
+    return result;
+}
+
+static inline DWORD WaitForMultipleObjects(DWORD count, const HANDLE *handles, BOOL wait_all, DWORD ms)
+{
+    (void)wait_all; // 主程序只用它等待一组线程全部结束
+    for (DWORD i = 0; i < count; i++)
+    {
+        if (WaitForSingleObject(handles[i], ms) != WAIT_OBJECT_0)
+            return WAIT_TIMEOUT;
+    }
+    return WAIT_OBJECT_0;
+}
+
+static inline BOOL CloseHandle(HANDLE handle)
+{
+    win32_handle_release((Win32Handle *)handle);
+    return TRUE;
+}
+
+/* 临时文件和只读文件映射：FILE_FLAG_DELETE_ON_CLOSE在打开后立即unlink，
+   描述符和映射保持文件内容可读；UnmapViewOfFile需要映射长度，由一张小表按地址记录 */
+#define MAX_PATH 260
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define GENERIC_READ 0x80000000u
+#define DELETE 0x00010000u
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_DELETE 0x4
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_TEMPORARY 0x100
+#define FILE_FLAG_DELETE_ON_CLOSE 0x04000000u
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x4
+#define WIN32_MAX_VIEWS 256
+
+static inline DWORD GetTempPathA(DWORD size, char *buffer)
+{
+    const char *dir = getenv("TMPDIR");
+    int written = snprintf(buffer, size, "%s/", dir && dir[0] ? dir : "/tmp");
+    return written > 0 && (DWORD)written < size ? (DWORD)written : 0;
+}
+
+static inline UINT GetTempFileNameA(const char *dir, const char *prefix, UINT unique, char *path)
+{
+    (void)unique;
+    snprintf(path, MAX_PATH, "%s%.3sXXXXXX", dir, prefix);
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 0;
+    close(fd);
+    return 1;
+}
+
+static inline HANDLE CreateFileA(const char *path, DWORD access, DWORD share, void *security,
+                                 DWORD disposition, DWORD flags, HANDLE template_file)
+{
+    (void)access;
+    (void)share;
+    (void)security;
+    (void)disposition;
+    (void)template_file;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return INVALID_HANDLE_VALUE;
+    if (flags & FILE_FLAG_DELETE_ON_CLOSE)
+        unlink(path);
+    Win32Handle *handle = win32_handle_new(WIN32_HANDLE_FILE, 0, 0);
+    if (!handle)
+    {
+        close(fd);
+        return INVALID_HANDLE_VALUE;
+    }
+    handle->fd = fd;
+    return handle;
+}
+
+static inline BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER *size)
+{
+    struct stat st;
+    if (fstat(((Win32Handle *)file)->fd, &st) != 0)
+        return FALSE;
+    size->QuadPart = st.st_size;
+    return TRUE;
+}
+
+static inline HANDLE CreateFileMappingA(HANDLE file, void *security, DWORD protect,
+                                        DWORD size_high, DWORD size_low, const char *name)
+{
+    (void)security;
+    (void)protect;
+    (void)size_high;
+    (void)size_low;
+    (void)name;
+    int fd = dup(((Win32Handle *)file)->fd);
+    if (fd < 0)
+        return NULL;
+    Win32Handle *handle = win32_handle_new(WIN32_HANDLE_MAPPING, 0, 0);
+    if (!handle)
+    {
+        close(fd);
+        return NULL;
+    }
+    handle->fd = fd;
+    return handle;
+}
+
+static struct
+{
+    void *address;
+    size_t length;
+} win32_views[WIN32_MAX_VIEWS];
+static pthread_mutex_t win32_views_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void *MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, size_t length)
+{
+    (void)access;
+    (void)offset_high;
+    (void)offset_low;
+    struct stat st;
+    int fd = ((Win32Handle *)mapping)->fd;
+    if (length == 0 && fstat(fd, &st) == 0)
+        length = (size_t)st.st_size;
+    if (length == 0)
+        return NULL;
+
+    void *view = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED)
+        return NULL;
+    pthread_mutex_lock(&win32_views_lock);
+    for (int i = 0; i < WIN32_MAX_VIEWS; i++)
+    {
+        if (!win32_views[i].address)
+        {
+            win32_views[i].address = view;
+            win32_views[i].length = length;
+            pthread_mutex_unlock(&win32_views_lock);
+            return view;
+        }
+    }
+    pthread_mutex_unlock(&win32_views_lock);
+    munmap(view, length);
+    return NULL;
+}
+
+static inline BOOL UnmapViewOfFile(const void *view)
+{
+    pthread_mutex_lock(&win32_views_lock);
+    for (int i = 0; i < WIN32_MAX_VIEWS; i++)
+    {
+        if (win32_views[i].address == view)
+        {
+            munmap(win32_views[i].address, win32_views[i].length);
+            win32_views[i].address = NULL;
+            pthread_mutex_unlock(&win32_views_lock);
+            return TRUE;
+        }
+    }
+    pthread_mutex_unlock(&win32_views_lock);
+    return FALSE;
+}
+
+static inline DWORD GetCurrentThreadId(void)
+{
+    return (DWORD)(uintptr_t)pthread_self();
+}
+
+// 系统与进程信息
+typedef struct
+{
+    DWORD dwOemId;
+    DWORD dwPageSize;
+    void *lpMinimumApplicationAddress;
+    void *lpMaximumApplicationAddress;
+    uintptr_t dwActiveProcessorMask;
+    DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+
+typedef struct
+{
+    DWORD cb;
+    DWORD PageFaultCount;
+    size_t PeakWorkingSetSize;
+    size_t WorkingSetSize;
+    size_t QuotaPeakPagedPoolUsage;
+    size_t QuotaPagedPoolUsage;
+    size_t QuotaPeakNonPagedPoolUsage;
+    size_t QuotaNonPagedPoolUsage;
+    size_t PagefileUsage;
+    size_t PeakPagefileUsage;
+} PROCESS_MEMORY_COUNTERS;
+
+static inline void GetSystemInfo(SYSTEM_INFO *info)
+{
+    memset(info, 0, sizeof(SYSTEM_INFO));
+    info->dwPageSize = (DWORD)sysconf(_SC_PAGESIZE);
+    info->dwNumberOfProcessors = (DWORD)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+static inline HANDLE GetCurrentProcess(void)
+{
+    return (HANDLE)-1;
+}
+
+static inline BOOL GetProcessMemoryInfo(HANDLE process, PROCESS_MEMORY_COUNTERS *counters, DWORD size)
+{
+    (void)process;
+    (void)size;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    memset(counters, 0, sizeof(PROCESS_MEMORY_COUNTERS));
+    counters->PeakWorkingSetSize = (size_t)usage.ru_maxrss * 1024;
+
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    counters->WorkingSetSize = (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+    return TRUE;
+}
+
+static inline BOOL GetProcessTimes(HANDLE process, FILETIME *creation, FILETIME *exit, FILETIME *kernel, FILETIME *user)
+{
+    (void)process;
+    (void)creation;
+    (void)exit;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    win32_set_filetime(kernel, (unsigned long long)usage.ru_stime.tv_sec * 10000000ULL + (unsigned long long)usage.ru_stime.tv_usec * 10ULL);
+    win32_set_filetime(user, (unsigned long long)usage.ru_utime.tv_sec * 10000000ULL + (unsigned long long)usage.ru_utime.tv_usec * 10ULL);
+    return TRUE;
+}
+
+static inline BOOL GetProcessHandleCount(HANDLE process, DWORD *count)
+{
+    (void)process;
+    int entries = 0;
+    DIR *fds = opendir("/proc/self/fd");
+    if (fds)
+    {
+        while (readdir(fds))
+            entries++;
+        closedir(fds);
+    }
+    *count = (DWORD)(entries > 3 ? entries - 3 : 0); // 去掉 . 、.. 和opendir自己的描述符
+    return TRUE;
+}
+
+// Winsock
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#define WSAEINPROGRESS EINPROGRESS
+#define WSAEINTR EINTR
+#define SD_SEND SHUT_WR
+#define SD_BOTH SHUT_RDWR
+#define MAKEWORD(low, high) ((WORD)(((low) & 0xff) | (((high) & 0xff) << 8)))
+
+typedef struct
+{
+    WORD wVersion;
+} WSADATA;
+
+static inline int WSAStartup(WORD version, WSADATA *data)
+{
+    data->wVersion = version;
+    return 0;
+}
+
+static inline int WSACleanup(void) { return 0; }
+static inline int WSAGetLastError(void) { return errno; }
+static inline int closesocket(SOCKET socket) { return close(socket); }
+
+static inline int ioctlsocket(SOCKET socket, long command, unsigned long *argument)
+{
+    (void)command; // 主程序只用FIONBIO切换非阻塞
+    int flags = fcntl(socket, F_GETFL, 0);
+    return fcntl(socket, F_SETFL, *argument ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+}
+
+// WinINet：只有桩函数
+typedef void *HINTERNET;
+typedef unsigned short INTERNET_PORT;
+#define INTERNET_OPEN_TYPE_PRECONFIG 0
+#define INTERNET_SERVICE_HTTP 3
+#define INTERNET_FLAG_RELOAD 0x80000000u
+#define INTERNET_FLAG_NO_CACHE_WRITE 0x04000000u
+#define INTERNET_FLAG_SECURE 0x00800000u
+#define INTERNET_FLAG_KEEP_CONNECTION 0x00400000u
+#define HTTP_ADDREQ_FLAG_ADD 0x20000000u
+#define HTTP_QUERY_STATUS_CODE 19
+#define HTTP_QUERY_FLAG_NUMBER 0x20000000u
+
+typedef struct
+{
+    DWORD dwStructSize;
+    LPSTR lpszScheme;
+    DWORD dwSchemeLength;
+    int nScheme;
+    LPSTR lpszHostName;
+    DWORD dwHostNameLength;
+    INTERNET_PORT nPort;
+    LPSTR lpszUserName;
+    DWORD dwUserNameLength;
+    LPSTR lpszPassword;
+    DWORD dwPasswordLength;
+    LPSTR lpszUrlPath;
+    DWORD dwUrlPathLength;
+    LPSTR lpszExtraInfo;
+    DWORD dwExtraInfoLength;
+} URL_COMPONENTSA;
+
+static inline HINTERNET InternetOpenA(LPCSTR agent, DWORD access, LPCSTR proxy, LPCSTR bypass, DWORD flags)
+{
+    (void)agent;
+    (void)access;
+    (void)proxy;
+    (void)bypass;
+    (void)flags;
+    return NULL;
+}
+
+static inline BOOL InternetCrackUrlA(LPCSTR url, DWORD length, DWORD flags, URL_COMPONENTSA *components)
+{
+    (void)url;
+    (void)length;
+    (void)flags;
+    (void)components;
+    return FALSE;
+}
+
+static inline HINTERNET InternetConnectA(HINTERNET internet, LPCSTR host, INTERNET_PORT port, LPCSTR user,
+                                         LPCSTR password, DWORD service, DWORD flags, uintptr_t context)
+{
+    (void)internet;
+    (void)host;
+    (void)port;
+    (void)user;
+    (void)password;
+    (void)service;
+    (void)flags;
+    (void)context;
+    return NULL;
+}
+
+static inline HINTERNET HttpOpenRequestA(HINTERNET connection, LPCSTR verb, LPCSTR path, LPCSTR version,
+                                         LPCSTR referrer, LPCSTR *accept_types, DWORD flags, uintptr_t context)
+{
+    (void)connection;
+    (void)verb;
+    (void)path;
+    (void)version;
+    (void)referrer;
+    (void)accept_types;
+    (void)flags;
+    (void)context;
+    return NULL;
+}
+
+static inline BOOL HttpAddRequestHeadersA(HINTERNET request, LPCSTR headers, DWORD length, DWORD modifiers)
+{
+    (void)request;
+    (void)headers;
+    (void)length;
+    (void)modifiers;
+    return FALSE;
+}
+
+static inline BOOL HttpSendRequestA(HINTERNET request, LPCSTR headers, DWORD headers_length, LPVOID body, DWORD body_length)
+{
+    (void)request;
+    (void)headers;
+    (void)headers_length;
+    (void)body;
+    (void)body_length;
+    return FALSE;
+}
+
+static inline BOOL HttpQueryInfoA(HINTERNET request, DWORD level, LPVOID buffer, DWORD *length, DWORD *index)
+{
+    (void)request;
+    (void)level;
+    (void)buffer;
+    (void)length;
+    (void)index;
+    return FALSE;
+}
+
+static inline BOOL InternetReadFile(HINTERNET file, LPVOID buffer, DWORD length, DWORD *read)
+{
+    (void)file;
+    (void)buffer;
+    (void)length;
+    *read = 0;
+    return FALSE;
+}
+
+static inline BOOL InternetCloseHandle(HINTERNET internet)
+{
+    (void)internet;
+    return TRUE;
+}
+
+// SSPI/SChannel：只有桩函数，TLS握手总是失败
+typedef long SECURITY_STATUS;
+typedef char SEC_CHAR;
+
+typedef struct
+{
+    uintptr_t dwLower;
+    uintptr_t dwUpper;
+} CredHandle, CtxtHandle;
+
+typedef struct
+{
+    unsigned long cbBuffer;
+    unsigned long BufferType;
+    void *pvBuffer;
+} SecBuffer;
+
+typedef struct
+{
+    unsigned long ulVersion;
+    unsigned long cBuffers;
+    SecBuffer *pBuffers;
+} SecBufferDesc;
+
+typedef struct
+{
+    unsigned long cbHeader;
+    unsigned long cbTrailer;
+    unsigned long cbMaximumMessage;
+    unsigned long cBuffers;
+    unsigned long cbBlockSize;
+} SecPkgContext_StreamSizes;
+
+typedef struct
+{
+    DWORD dwVersion;
+    DWORD cCreds;
+    void *paCred;
+    void *hRootStore;
+    DWORD cMappers;
+    void *aphMappers;
+    DWORD cSupportedAlgs;
+    void *palgSupportedAlgs;
+    DWORD grbitEnabledProtocols;
+    DWORD dwMinimumCipherStrength;
+    DWORD dwMaximumCipherStrength;
+    DWORD dwSessionLifespan;
+    DWORD dwFlags;
+    DWORD dwCredFormat;
+} SCHANNEL_CRED;
+
+#define SEC_E_OK 0
+#define SEC_I_CONTINUE_NEEDED 0x00090312L
+#define SEC_E_INCOMPLETE_MESSAGE ((long)0x80090318L)
+#define SEC_E_UNSUPPORTED_FUNCTION ((long)0x80090302L)
+#define SECBUFFER_VERSION 0
+#define SECBUFFER_EMPTY 0
+#define SECBUFFER_DATA 1
+#define SECBUFFER_TOKEN 2
+#define SECBUFFER_EXTRA 5
+#define SECBUFFER_STREAM_TRAILER 6
+#define SECBUFFER_STREAM_HEADER 7
+#define SECPKG_CRED_OUTBOUND 2
+#define SECPKG_ATTR_STREAM_SIZES 4
+#define ISC_REQ_REPLAY_DETECT 0x4
+#define ISC_REQ_SEQUENCE_DETECT 0x8
+#define ISC_REQ_CONFIDENTIALITY 0x10
+#define ISC_REQ_ALLOCATE_MEMORY 0x100
+#define ISC_REQ_EXTENDED_ERROR 0x4000
+#define ISC_REQ_STREAM 0x8000
+#define UNISP_NAME_A "Microsoft Unified Security Protocol Provider"
+#define SCHANNEL_CRED_VERSION 4
+#define SCH_CRED_NO_DEFAULT_CREDS 0x10
+#define SCH_CRED_AUTO_CRED_VALIDATION 0x20
+#define SCH_USE_STRONG_CRYPTO 0x00400000
+
+static inline SECURITY_STATUS AcquireCredentialsHandleA(void *principal, const char *package, unsigned long usage,
+                                                        void *logon_id, void *auth_data, void *get_key,
+                                                        void *get_key_argument, CredHandle *credential, void *expiry)
+{
+    (void)principal;
+    (void)package;
+    (void)usage;
+    (void)logon_id;
+    (void)auth_data;
+    (void)get_key;
+    (void)get_key_argument;
+    (void)credential;
+    (void)expiry;
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+static inline SECURITY_STATUS InitializeSecurityContextA(CredHandle *credential, CtxtHandle *context, SEC_CHAR *target,
+                                                         unsigned long flags, unsigned long reserved1, unsigned long data_rep,
+                                                         SecBufferDesc *input, unsigned long reserved2, CtxtHandle *new_context,
+                                                         SecBufferDesc *output, DWORD *attributes, void *expiry)
+{
+    (void)credential;
+    (void)context;
+    (void)target;
+    (void)flags;
+    (void)reserved1;
+    (void)data_rep;
+    (void)input;
+    (void)reserved2;
+    (void)new_context;
+    (void)output;
+    (void)attributes;
+    (void)expiry;
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+static inline SECURITY_STATUS QueryContextAttributesA(CtxtHandle *context, unsigned long attribute, void *buffer)
+{
+    (void)context;
+    (void)attribute;
+    (void)buffer;
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+static inline SECURITY_STATUS EncryptMessage(CtxtHandle *context, unsigned long qop, SecBufferDesc *message, unsigned long sequence)
+{
+    (void)context;
+    (void)qop;
+    (void)message;
+    (void)sequence;
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+static inline SECURITY_STATUS DecryptMessage(CtxtHandle *context, SecBufferDesc *message, unsigned long sequence, unsigned long *qop)
+{
+    (void)context;
+    (void)message;
+    (void)sequence;
+    (void)qop;
+    return SEC_E_UNSUPPORTED_FUNCTION;
+}
+
+static inline SECURITY_STATUS FreeContextBuffer(void *buffer) { (void)buffer; return SEC_E_OK; }
+static inline SECURITY_STATUS DeleteSecurityContext(CtxtHandle *context) { (void)context; return SEC_E_OK; }
+static inline SECURITY_STATUS FreeCredentialsHandle(CredHandle *credential) { (void)credential; return SEC_E_OK; }
+
+#endif
@@ -0,0 +1,203 @@
+/* SMTP客户端的本机回环测试：测试线程在127.0.0.1上扮演SMTP服务器，按脚本应答并记录客户端发来的全部内容，
+   检查EHLO、AUTH PLAIN、PIPELINING下的MAIL/RCPT/DATA、DATA中的点号转义，以及STARTTLS不可用时不发送凭据。
+   与基准测试一样把主程序源文件编进同一个翻译单元，非Windows平台通过 bench/posix 编译 */
+#define main electric_monitor_main
+#include "../电表查询.c"
+#undef main
+
+#define STAND_IN_PLAIN 0            // EHLO宣告AUTH和PIPELINING，接受邮件
+#define STAND_IN_NO_STARTTLS 1      // EHLO不宣告STARTTLS
+#define STAND_IN_STARTTLS_REFUSED 2 // 宣告STARTTLS，但对STARTTLS命令回复454
+
+/* 替身服务器：只处理一个连接，received记录客户端发来的全部字节 */
+typedef struct
+{
+    SOCKET listener;
+    int mode;
+    char received[65536];
+    size_t receivedLength;
+} StandIn;
+
+static int failures = 0;
+
+/* 记录一项检查的结果 */
+static void check(int condition, const char *what)
+{
+    printf("%s %s\n", condition ? "PASS" : "FAIL", what);
+    if (!condition)
+        failures++;
+}
+
+/* 替身服务器发送一条应答 */
+static void stand_in_reply(SOCKET socket, const char *reply)
+{
+    send(socket, reply, (int)strlen(reply), 0);
+}
+
+/* 替身服务器线程：逐行处理命令，DATA之后一直读到结束行 */
+static DWORD WINAPI stand_in_thread(LPVOID param)
+{
+    StandIn *server = (StandIn *)param;
+    SOCKET client = accept(server->listener, NULL, NULL);
+    if (client == INVALID_SOCKET)
+        return 0;
+
+    stand_in_reply(client, "220 stand-in ESMTP\r\n");
+    size_t processed = 0; // received中已处理到的位置
+    int in_data = 0;
+    int open = 1;
+    while (open)
+    {
+        int received = recv(client, server->received + server->receivedLength,
+                            (int)(sizeof(server->received) - 1 - server->receivedLength), 0);
+        if (received <= 0)
+            break;
+        server->receivedLength += received;
+        server->received[server->receivedLength] = '\0';
+
+        for (;;)
+        {
+            char *start = server->received + processed;
+            if (in_data)
+            {
+                char *end = strstr(start, "\r\n.\r\n");
+                if (!end)
+                    break;
+                processed = (size_t)(end - server->received) + 5;
+                in_data = 0;
+                stand_in_reply(client, "250 queued\r\n");
+                continue;
+            }
+
+            char *line_end = strstr(start, "\r\n");
+            if (!line_end)
+                break;
+            processed = (size_t)(line_end - server->received) + 2;
+
+            if (strncmp(start, "EHLO ", 5) == 0)
+            {
+                if (server->mode == STAND_IN_PLAIN)
+                    stand_in_reply(client, "250-stand-in\r\n250-PIPELINING\r\n250 AUTH LOGIN PLAIN\r\n");
+                else if (server->mode == STAND_IN_NO_STARTTLS)
+                    stand_in_reply(client, "250-stand-in\r\n250 AUTH PLAIN\r\n");
+                else
+                    stand_in_reply(client, "250-stand-in\r\n250-STARTTLS\r\n250 AUTH PLAIN\r\n");
+            }
+            else if (strncmp(start, "AUTH PLAIN ", 11) == 0)
+                stand_in_reply(client, "235 accepted\r\n");
+            else if (strncmp(start, "STARTTLS", 8) == 0)
+                stand_in_reply(client, "454 TLS not available\r\n");
+            else if (strncmp(start, "MAIL FROM:", 10) == 0 || strncmp(start, "RCPT TO:", 8) == 0)
+                stand_in_reply(client, "250 ok\r\n");
+            else if (strncmp(start, "DATA", 4) == 0)
+            {
+                stand_in_reply(client, "354 go ahead\r\n");
+                in_data = 1;
+                processed = (size_t)(line_end - server->received); // 从DATA行的换行开始查找结束行，空邮件也能匹配
+            }
+            else if (strncmp(start, "QUIT", 4) == 0)
+            {
+                stand_in_reply(client, "221 bye\r\n");
+                open = 0;
+                break;
+            }
+            else
+                stand_in_reply(client, "500 unrecognized\r\n");
+        }
+    }
+    closesocket(client);
+    return 0;
+}
+
+/* 用指定模式运行一次会话：启动替身服务器，执行smtp_open，成功时发送message，返回smtp_open的结果 */
+static int run_session(StandIn *server, int mode, int security, const char *message, int *sent)
+{
+    memset(server, 0, sizeof(StandIn));
+    server->mode = mode;
+    server->listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_length = sizeof(address);
+    if (server->listener == INVALID_SOCKET ||
+        bind(server->listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listener, 1) != 0 ||
+        getsockname(server->listener, (struct sockaddr *)&address, &address_length) != 0)
+    {
+        printf("FAIL 无法在127.0.0.1上监听\n");
+        failures++;
+        return 0;
+    }
+
+    HANDLE thread = CreateThread(NULL, 0, stand_in_thread, server, 0, NULL);
+
+    Config config;
+    memset(&config, 0, sizeof(config));
+    strcpy(config.smtpServer, "127.0.0.1");
+    config.smtpPort = ntohs(address.sin_port);
+    config.smtpSecurity = security;
+    strcpy(config.emailAccount, "meter@example.com");
+    strcpy(config.emailAuthCode, "secret");
+
+    SmtpSession session;
+    int opened = smtp_open(&session, &config);
+    *sent = 0;
+    if (opened && message)
+    {
+        char *recipients[] = {"a@example.com", "b@example.com"};
+        PageBuffer body;
+        page_buffer_init(&body);
+        page_buffer_append(&body, message, strlen(message));
+        *sent = smtp_send_mail(&session, config.emailAccount, recipients, 2, &body);
+        page_buffer_free(&body);
+    }
+    smtp_close(&session);
+
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+    closesocket(server->listener);
+    return opened;
+}
+
+int main(void)
+{
+    set_console_utf8();
+    metric_init();
+    log_set_level(LOG_LEVEL_ALERT);
+    if (!winsock_init())
+        return 1;
+
+    static StandIn server;
+    int sent;
+
+    // 明文会话（本机中继允许登录）：EHLO、AUTH PLAIN、管道化的信封命令和点号转义
+    const char *message = "Subject: test\r\n\r\nline one\r\n.hidden\r\n.\r\n..two\r\nno newline";
+    int opened = run_session(&server, STAND_IN_PLAIN, SMTP_SECURITY_NONE, message, &sent);
+    check(opened, "本机明文会话登录成功");
+    check(strncmp(server.received, "EHLO ", 5) == 0, "连接后首先发送EHLO");
+    check(strstr(server.received, "\r\nAUTH PLAIN AG1ldGVyQGV4YW1wbGUuY29tAHNlY3JldA==\r\n") != NULL,
+          "AUTH PLAIN携带Base64编码的\\0账号\\0授权码");
+    check(strstr(server.received, "MAIL FROM:<meter@example.com>\r\nRCPT TO:<a@example.com>\r\n"
+                                  "RCPT TO:<b@example.com>\r\nDATA\r\n") != NULL,
+          "服务器支持PIPELINING时信封命令一次写出");
+    check(sent == 2, "两个收件人都被接受");
+    check(strstr(server.received, "\r\n\r\nline one\r\n..hidden\r\n..\r\n...two\r\nno newline\r\n.\r\n") != NULL,
+          "DATA中以'.'开头的行加倍，末尾补换行后以'.'行结束");
+    check(strstr(server.received, "\r\nQUIT\r\n") != NULL, "会话以QUIT结束");
+
+    // 要求STARTTLS但服务器没有宣告：不发送STARTTLS，也不发送凭据
+    opened = run_session(&server, STAND_IN_NO_STARTTLS, SMTP_SECURITY_STARTTLS, NULL, &sent);
+    check(!opened, "服务器不支持STARTTLS时会话失败");
+    check(strstr(server.received, "AUTH") == NULL, "不支持STARTTLS时没有发送凭据");
+
+    // 服务器宣告了STARTTLS却拒绝执行：同样不能退回明文登录
+    opened = run_session(&server, STAND_IN_STARTTLS_REFUSED, SMTP_SECURITY_STARTTLS, NULL, &sent);
+    check(!opened, "STARTTLS被拒绝时会话失败");
+    check(strstr(server.received, "\r\nSTARTTLS\r\n") != NULL, "宣告STARTTLS时发送了STARTTLS");
+    check(strstr(server.received, "AUTH") == NULL, "STARTTLS被拒绝时没有发送凭据");
+
+    printf("%s: %d 项检查失败\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
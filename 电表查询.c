@@ -1,17 +1,185 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#ifndef FD_SETSIZE
+#define FD_SETSIZE 1024
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
 #include <windows.h>
 #include <wininet.h>
+#define SECURITY_WIN32
+#include <security.h>
+#include <schannel.h>
+#include <psapi.h>
 #include <sqlite3.h>
+#include <zlib.h>
 #include <signal.h>
 
 #pragma comment(lib, "wininet.lib")
 #pragma comment(lib, "sqlite3.lib")
+#pragma comment(lib, "zlib.lib")
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "secur32.lib")
+#pragma comment(lib, "psapi.lib")
+
+// 线程局部变量：MSVC用__declspec(thread)，C11编译器用_Thread_local，按C99编译的GCC/Clang用__thread
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL __thread
+#endif
 
 #define BUFFER_SIZE 4096
 #define CONFIG_SIZE 1024
 #define MAX_RETRY_COUNT 3
+#define HTTP_MAX_CLIENTS 1000
+#define HTTP_REQUEST_SIZE 8192
+#define HTTP_KEEPALIVE_TIMEOUT 60
+#define SSE_PING_INTERVAL 30
+#define SSE_MAX_BACKLOG (256 * 1024)
+#define HISTORY_PAGE_SIZE 200
+// 历史页面按PAGE_STREAM_CHUNK分块写入文件和gzip流，内存占用与行数无关，上限只决定页面大小（每条约90字节，10万条约9 MB）；
+// 警报页面仍在内存中整体渲染，每条约300字节，1000条约0.3 MB
+#define HISTORY_MAX_ROWS 100000
+#define PAGE_STREAM_CHUNK (64 * 1024)
+#define ALERTS_MAX_ROWS 1000       // 警报页面和alerts.json都只列出最近的这些警报
+#define CHART_POINTS 500
+#define CHART_RANGE_COUNT 5
+#define CHART_MIN_BUCKET 60
+#define ARCHIVE_PAGE_SIZE 1000
+#define ARCHIVE_MAX_WORKERS 64
+#define PAGE_BUFFER_POOL_SIZE 4
+#define PAGE_BUFFER_POOL_MAX (2 * 1024 * 1024) // 容量超过此值的缓冲区用完即释放，不留在线程的缓冲区池中
+#define RENDER_MAX_WORKERS 4
+
+/* 网页输出模式（WEB_RENDER_MODE） */
+#define RENDER_MODE_HTML 1
+#define RENDER_MODE_JSON 2
+
+// SMTP连接加密方式
+#define SMTP_SECURITY_STARTTLS 0
+#define SMTP_SECURITY_SSL 1
+#define SMTP_SECURITY_NONE 2
+#define SMTP_BUFFER_SIZE 32768
+#define SMTP_TIMEOUT_MS 30000
+#define SMTP_MAX_RECIPIENTS 32
+#define OUTBOX_BATCH_SIZE 16
+#define OUTBOX_MAX_ATTEMPTS 10
+#define OUTBOX_RETRY_BASE 30       // 首次重试间隔（秒），之后每次翻倍
+#define OUTBOX_RETRY_MAX 3600      // 最长重试间隔（秒）
+#define OUTBOX_IDLE_WAIT_MS 60000
+#define DIGEST_MAX_GROUPS 16       // 每轮最多汇总的收件人组数
+
+// 本地通知出口（NOTIFY_SOCKET / NOTIFY_WEBHOOK）
+#define NOTIFY_SINK_UNIX 0
+#define NOTIFY_SINK_WEBHOOK 1
+#define NOTIFY_MAX_SINKS 2
+#define NOTIFY_QUEUE_LIMIT (256 * 1024) // 每个出口待发与正在投递的事件合计上限，超出后丢弃新事件
+#define NOTIFY_TIMEOUT_MS 5000
+#define NOTIFY_RETRY_MIN_MS 1000
+#define NOTIFY_RETRY_MAX_MS 60000
+
+// 异步日志
+#define LOG_FILE_NAME "monitor.log"
+#define LOG_RING_SLOTS 1024        // 环形缓冲区槽位数，必须是2的幂
+#define LOG_MESSAGE_SIZE 480
+#define LOG_FLUSH_INTERVAL_MS 200
+#define LOG_ROTATE_KEEP 3          // 轮转后保留的旧日志文件数
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_ALERT 4
+
+// 二进制事件日志（EVENT_LOG）的事件编号，解码时按event_types中的定义格式化
+#define EVENT_RING_SLOTS 4096      // 必须是2的幂
+#define EVENT_LOG_MAGIC "EMEVLOG"  // 事件日志文件头的标识（含结尾的\0共8字节）
+#define EVENT_LOG_VERSION 1        // 记录布局或事件定义不兼容地改变时加1
+#define EVENT_SESSION 0
+#define EVENT_FETCH_ATTEMPT 1
+#define EVENT_FETCH_OK 2
+#define EVENT_FETCH_FAILED 3
+#define EVENT_FETCH_GAVE_UP 4
+#define EVENT_HTTP_ERROR 5
+#define EVENT_HTTP_RESPONSE 6
+#define EVENT_READING 7
+#define EVENT_ALERT 8
+#define EVENT_ALERT_CLEARED 9
+#define EVENT_RENDER 10
+#define EVENT_EMAIL 11
+#define EVENT_TYPE_COUNT 12
+
+// 运行指标（/metrics 与 METRICS_FILE）
+#define METRIC_STAGE_CYCLE 0
+#define METRIC_STAGE_HTTP 1
+#define METRIC_STAGE_PARSE 2
+#define METRIC_STAGE_SAVE 3
+#define METRIC_STAGE_RENDER 4
+#define METRIC_STAGE_EMAIL 5
+#define METRIC_STAGE_COUNT 6
+#define METRIC_FETCH_ATTEMPTS 0
+#define METRIC_FETCH_RETRIES 1
+#define METRIC_FETCH_FAILURES 2
+#define METRIC_ALERTS 3
+#define METRIC_EMAILS_SENT 4
+#define METRIC_EMAILS_FAILED 5
+#define METRIC_COUNTER_COUNT 6
+#define METRIC_SUB_BITS 4          // 每个2的幂区间再分16格，相对误差约6%
+#define METRIC_BUCKETS 544         // 覆盖1微秒到约19小时
+#define METRIC_MAX_THREADS 32
+
+// 跨度追踪（TRACE_FILE），输出Chrome trace_event JSON
+#define TRACE_BUFFER_SPANS 4096    // 每个线程的跨度缓冲区，必须是2的幂
+#define TRACE_MAX_THREADS 32
+
+// 基准测试模式（--benchmark）
+#define BENCH_DIR "benchmark"
+#define BENCH_RESULTS BENCH_DIR "/results.jsonl"
+#define BENCH_SAMPLES 7
+#define BENCH_MIN_SAMPLE_MS 20     // 单个样本至少运行的时间，过快的操作重复多次
+#define BENCH_DEFAULT_ROWS 1000000
+
+// 负载测试模式（--load-test）
+#define LOAD_DIR "loadtest"
+#define LOAD_RESULTS LOAD_DIR "/results.jsonl"
+#define LOAD_MAX_WORKERS 64
+#define LOAD_MAX_STEPS 16
+#define LOAD_LOW_ENERGY_THRESHOLD 10.0 // 与config.txt示例相同的低电量阈值
+
+// 模拟模式（--simulate），使用虚拟时钟
+#define SIM_DIR "simulation"
+#define SIM_DB SIM_DIR "/simulation.db"
+#define SIM_WEB SIM_DIR "/web"
+#define SIM_DEFAULT_DAYS 90
+
+// 响应捕获（CAPTURE_FILE）与回放（--replay）
+#define CAPTURE_MAGIC 0x50414345u  // 每条记录开头的标记，"ECAP"，回放遇到损坏的记录时据此找到下一条
+#define REPLAY_DIR "replay"
+#define REPLAY_DB REPLAY_DIR "/replay.db"
+#define REPLAY_WEB REPLAY_DIR "/web"
+
+// 警报规则（ALERT_RULE）可比较的指标
+#define ALERT_MAX_RULES 16
+#define ALERT_METRIC_ENERGY 0      // 剩余电量（度），低于触发
+#define ALERT_METRIC_AMOUNT 1      // 剩余金额（元），低于触发
+#define ALERT_METRIC_RATE 2        // 日均用电速率（度/天），高于触发
+#define ALERT_METRIC_ETA 3         // 按当前速率预计用完的小时数，低于触发
+#define ALERT_METRIC_COUNT 4
+#define ALERT_RATE_SMOOTHING 0.3   // 用电速率的指数平滑系数
+
+// 一轮渲染中可并行执行的页面任务
+#define RENDER_TASK_INDEX 0
+#define RENDER_TASK_HISTORY 1
+#define RENDER_TASK_ALERTS 2
+#define RENDER_TASK_DATA_FILES 3
+#define RENDER_TASK_COUNT 4
 
 /* 电表数据结构 */
 typedef struct
@@ -23,11 +191,36 @@ typedef struct
     char meterStatus[100];
     char meterUpdateTime[50];
     char systemTime[50];
+    char meterId[32];       // 接口返回的电表编号（meterid），同一数据库记录多块电表时据此区分
     // 用于HTML生成的额外字段
     int id;
     char record_time[50];
 } ElectricMeter;
 
+/* 编译后的警报规则：比较统一成"sign*指标值 <= trigger"，低于型sign为1，高于型为-1 */
+typedef struct
+{
+    char name[32];
+    int metric;
+    double sign;
+    double trigger;   // 已乘以sign
+    double clear;     // 已乘以sign，sign*指标值大于它时恢复（滞回）
+    int maxNotify;    // 一次越限期间最多提醒几次（每次查询提醒一次）
+    int urgent;       // 静默时段内照常提醒
+} AlertRule;
+
+/* 警报规则的运行状态，以及计算用电速率用的上一次读数 */
+typedef struct
+{
+    int active[ALERT_MAX_RULES];
+    int notified[ALERT_MAX_RULES];
+    double values[ALERT_METRIC_COUNT];
+    int hasLast;
+    long long lastTime;
+    double lastConsumption;
+    double rate;      // 平滑后的用电速率（度/天），未知时为NAN
+} AlertState;
+
 /* 配置结构 */
 typedef struct
 {
@@ -37,47 +230,1473 @@ typedef struct
     char dbPath[256];
     char smtpServer[100];
     int smtpPort;
+    int smtpSecurity;
     char emailAccount[100];
     char emailAuthCode[100];
     char emailReceivers[512];
     char webPath[256];
+    int httpPort;
+    int renderMode;
+    AlertRule alertRules[ALERT_MAX_RULES];
+    int alertRuleCount;
+    int quietStart;   // 静默时段开始小时，与结束小时相同表示不启用
+    int quietEnd;
+    int digestWindow; // 警报汇总窗口（分钟），0为每条警报单独发送
+    char notifySocket[256];
+    char notifyWebhook[256];
+    int logLevel;
+    int logMaxSize;   // 日志文件轮转大小（MB），0为不轮转
+    char eventLogPath[256]; // 二进制事件日志路径，空为不启用
+    char metricsFile[256];  // 每轮写出的指标文件，空为不写
+    char traceFile[256];    // Chrome trace_event JSON输出路径，空为不启用追踪
+    char captureFile[256];  // 原始响应捕获文件，空为不捕获
 } Config;
 
+/* 日志环形缓冲区的一个槽位，sequence标记槽位当前可写还是可读 */
+typedef struct
+{
+    volatile LONG sequence;
+    char time[24];
+    char level[8];
+    char message[LOG_MESSAGE_SIZE];
+} LogRecord;
+
+/* 二进制事件日志中的一条记录（固定40字节，文件中按此布局顺序存放） */
+typedef struct
+{
+    unsigned long long time;      // QueryPerformanceCounter计数
+    unsigned short id;
+    unsigned short thread;        // 线程ID的低16位
+    unsigned int reserved;
+    long long args[3];            // 按事件定义解释为整数或按位存放的double
+} EventRecord;
+
+/* 事件日志文件头：新文件开头写一次，解码时据此确认版本和记录长度 */
+typedef struct
+{
+    char magic[8];                // EVENT_LOG_MAGIC
+    unsigned int version;         // EVENT_LOG_VERSION
+    unsigned int recordSize;      // sizeof(EventRecord)
+} EventLogHeader;
+
+/* 事件环形缓冲区的一个槽位 */
+typedef struct
+{
+    volatile LONG sequence;
+    EventRecord record;
+} EventSlot;
+
+/* 事件定义：参数类型（i整数、d浮点）、JSON字段名和文字模板（{}为参数占位） */
+typedef struct
+{
+    const char *name;
+    const char *types;
+    const char *fields[3];
+    const char *text;
+} EventType;
+
+/* 一个线程的指标分片：只有所属线程写入，导出时汇总所有分片 */
+typedef struct
+{
+    volatile LONG64 counts[METRIC_STAGE_COUNT][METRIC_BUCKETS];
+    volatile LONG64 sum[METRIC_STAGE_COUNT];     // 微秒
+    volatile LONG64 max[METRIC_STAGE_COUNT];
+    volatile LONG64 counters[METRIC_COUNTER_COUNT];
+} MetricShard;
+
+/* 一个已结束的跨度，名称等字符串都是静态常量 */
+typedef struct
+{
+    const char *name;
+    const char *category;
+    const char *argName;         // 可为NULL
+    long long arg;
+    ULONGLONG start;
+    ULONGLONG end;
+} TraceSpan;
+
+/* 一个线程的跨度缓冲区：所属线程推进head，日志线程推进tail */
+typedef struct
+{
+    TraceSpan spans[TRACE_BUFFER_SPANS];
+    volatile LONG head;
+    volatile LONG tail;
+    DWORD thread;
+    const char *threadName;
+    int nameWritten;             // 只由日志线程访问
+} TraceBuffer;
+
+/* 负载测试参数 */
+typedef struct
+{
+    int meterCounts[LOAD_MAX_STEPS]; // 依次测试的模拟电表数量
+    int meterCountCount;
+    int seconds;                 // 每档运行时间
+    int workers;
+    int latencyMs;               // 伪上游的基础延迟
+    int jitterMs;                // 在基础延迟上随机增加0~jitterMs
+    int errorPerMille;           // 千分之几的请求返回HTTP 500或缺少字段的响应
+    int payloadBytes;            // 正常响应的大致大小
+    int port;                    // 伪上游端口，0为自动分配
+} LoadTestOptions;
+
+/* 负载测试的一个工作线程 */
+typedef struct
+{
+    const LoadTestOptions *options;
+    const Config *config;
+    int meters;
+    volatile LONG *next;
+    ULONGLONG deadline;
+    long long completed;
+    long long httpErrors;           // 请求失败或非2xx状态码（伪上游注入的500）
+    long long parseErrors;          // 响应缺少读数字段
+    long long saveErrors;
+    LONG64 latency[METRIC_BUCKETS]; // 单个电表流水线耗时直方图（微秒）
+} LoadWorker;
+
+/* 模拟模式的参数 */
+typedef struct
+{
+    int days;
+    int interval;        // 轮询间隔（分钟）
+    long long start;     // 虚拟时钟的起点（Unix时间）
+    int renderEvery;     // 每隔多少次轮询渲染一轮页面，0表示每个模拟日一次
+    unsigned int seed;
+} SimulationOptions;
+
+/* 捕获文件中一条记录的记录头（不压缩），后跟length字节单独压缩的原始响应 */
+typedef struct
+{
+    unsigned int magic;
+    unsigned int length;     // 压缩后的字节数
+    unsigned int rawLength;  // 原始响应的字节数
+    unsigned int crc;        // 捕获时间和原始响应的CRC32，同时校验解压结果和记录边界
+    long long unixMs;        // 捕获时的Unix毫秒时间
+} CaptureHeader;
+
+/* 页面输出缓冲区（先在内存中渲染，再整体发布） */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed;  // 任一次追加因内存不足失败后置1，内容已不完整，发布时整页放弃
+} PageBuffer;
+
+/* 内存中已渲染页面的不可变快照（引用计数，供内置HTTP服务直接发送） */
+typedef struct
+{
+    volatile LONG refCount;
+    char name[64];
+    char etag[24];
+    const char *contentType;
+    const char *cacheControl;
+    char *body;
+    size_t bodyLength;
+    char *gzip;
+    size_t gzipLength;
+    int mapped;  // body和gzip映射自临时文件（分块发布的页面），释放时解除映射而不是free
+} PageSnapshot;
+
+/* 分块发布中的页面：边渲染边写入发布目录的临时文件和gzip流，同时在系统临时目录留一份副本供内存缓存映射 */
+typedef struct
+{
+    char name[64];
+    char filepath[512];
+    char gzPath[520];
+    char tempPath[600];
+    char tempGzPath[600];
+    char snapshotPath[MAX_PATH];
+    char snapshotGzPath[MAX_PATH];
+    FILE *html;
+    FILE *gzip;
+    FILE *snapshotHtml;
+    FILE *snapshotGzip;
+    z_stream deflate;
+    int deflateReady;
+    unsigned long long hash;  // 已写出内容的FNV-1a哈希，完成后作为ETag
+    int failed;
+} PageStream;
+
+/* 本地通知出口：deliver负责把一批NDJSON事件送到AF_UNIX套接字或webhook */
+typedef struct NotifySink
+{
+    char target[256];             // 套接字路径或webhook地址
+    char host[128];
+    char port[8];
+    char path[256];
+    SOCKET socket;                // AF_UNIX出口保持长连接
+    int (*deliver)(struct NotifySink *sink, const PageBuffer *batch);
+    CRITICAL_SECTION lock;
+    PageBuffer pending;           // 待发事件，受lock保护
+    PageBuffer inflight;          // 投递线程正在发送或等待重试的一批
+    size_t inflightLength;        // inflight的长度，受lock保护，供入队时计入上限
+    volatile LONG dropped;
+    int failures;
+    ULONGLONG retryAt;
+} NotifySink;
+
+/* 内置HTTP服务的客户端连接 */
+typedef struct
+{
+    SOCKET socket;
+    char request[HTTP_REQUEST_SIZE];
+    size_t requestLength;
+    PageBuffer head;
+    size_t headSent;
+    PageSnapshot *snapshot;
+    const char *body;
+    size_t bodyLength;
+    size_t bodySent;
+    int closeAfterSend;
+    int eventStream;
+    ULONGLONG lastActive;
+} HttpClient;
+
+/* 图表曲线上的一个点（时间为Unix秒） */
+typedef struct
+{
+    long long time;
+    double value;
+} ChartPoint;
+
+/* 一条曲线的增量LTTB降采样状态：按绝对时间分桶，已定稿的桶之后不再变化 */
+typedef struct
+{
+    ChartPoint *points;   // 已定稿的点，每个非空桶一个
+    int count;
+    int capacity;
+    ChartPoint selected;  // 最近定稿的点，作为下一个桶的三角形顶点
+    int hasSelected;
+    ChartPoint *pending;  // 尚未定稿的原始读数（最多两个非空桶）
+    int pendingCount;
+    int pendingCapacity;
+} ChartSeries;
+
+/* 一个时间范围的图表数据（剩余电量、累计用电两条曲线） */
+typedef struct
+{
+    const char *name;
+    const char *label;
+    long long seconds;    // 0表示全部数据
+    long long width;      // 桶宽（秒）
+    sqlite3_int64 lastId; // 已处理的最大记录ID
+    long long latestTime;
+    ChartSeries energy;
+    ChartSeries consumption;
+} ChartRange;
+
+/* 一轮渲染使用的数据库只读快照：统计数据在同一个读事务中查出，
+   参与渲染的工作线程在自己的连接上另开读事务，只读取ID不超过maxId/maxAlertId的记录，看到与统计一致的数据 */
+typedef struct
+{
+    sqlite3 *db; // 当前线程的渲染连接，读事务保持到快照关闭；render_snapshot_connect得到的副本中是工作线程自己的连接
+    const char *dbPath;
+    int recordCount;
+    int maxId;
+    int maxAlertId;
+    double latestEnergy;
+    double latestConsumption;
+    double dailyConsumption;
+    double weeklyConsumption;
+    int alertCount;
+} RenderSnapshot;
+
+/* 交给后台渲染线程的一次渲染任务 */
+typedef struct
+{
+    ElectricMeter meter;
+    double threshold;
+    ULONGLONG postedAt; // 投递时刻（GetTickCount64），用于统计排队时间
+} RenderJob;
+
+/* 一轮渲染的任务表：各页面互不依赖，由渲染线程和渲染工作线程共同领取执行 */
+typedef struct
+{
+    const Config *config;
+    const RenderSnapshot *snapshot; // 各任务按快照的ID上界读取，工作线程在自己的连接上读取
+    const ElectricMeter *meter;
+    double threshold;
+    int tasks[RENDER_TASK_COUNT];
+    int results[RENDER_TASK_COUNT]; // 各任务是否成功，由领取该任务的线程写入，本轮结束后读取
+    int taskCount;
+    volatile LONG nextTask;         // 下一个待领取的任务下标
+    volatile LONG participants;     // 尚未退出本轮的线程数，归零时本轮结束
+    HANDLE done;
+} RenderBatch;
+
+/* 与SMTP服务器的一个会话，所有收件人共用；TLS握手后读写都经过SChannel加解密 */
+typedef struct
+{
+    SOCKET socket;
+    int tls;
+    int tlsPending;               // 已开始TLS握手但未完成，连接上不能再发送明文命令
+    CredHandle credentials;
+    CtxtHandle context;
+    int hasCredentials;
+    int hasContext;
+    SecPkgContext_StreamSizes sizes;
+    char *tlsIn;                  // 已收到尚未解密的密文
+    size_t tlsInLength;
+    char in[SMTP_BUFFER_SIZE];    // 已解密尚未读取的明文
+    size_t inLength;
+    int pipelining;               // 服务器支持的扩展
+    int startTls;
+    int authPlain;
+    int authLogin;
+    char reply[1024];             // 最近一次应答的全文，用于判断扩展和记录日志
+} SmtpSession;
+
+/* 发件箱中的一封待发邮件 */
+typedef struct
+{
+    sqlite3_int64 id;
+    sqlite3_int64 createdAt;
+    int attempts;
+    char recipients[512];
+    char subject[256];
+    PageBuffer body;              // HTML正文（入队时已渲染好）
+} OutboxMessage;
+
+/* 历史归档中的一个月份，作为一个渲染任务交给工作线程 */
+typedef struct
+{
+    char month[8];               // YYYY-MM
+    sqlite3_int64 firstId;
+    sqlite3_int64 lastId;
+    int recordCount;
+    int pageCount;
+    double minEnergy;
+    double maxEnergy;
+    double consumption;          // 本月用电量（累计用电的增量）
+    unsigned long long *pageHashes; // 本次各分页的内容哈希，写入新清单
+    int written;                 // 本次实际重写的分页数
+    int failed;
+} ArchiveMonth;
+
+/* 归档清单中的一项：页面文件名及其内容哈希 */
+typedef struct
+{
+    char name[32];
+    unsigned long long hash;
+} ArchiveEntry;
+
+/* 一次归档构建的共享状态：月份列表在启动工作线程前确定，之后只读 */
+typedef struct
+{
+    const char *dbPath;
+    char archivePath[300];
+    sqlite3_int64 snapshotId;    // 确定月份列表时的最大记录ID，所有线程只读取不超过它的记录
+    ArchiveMonth *months;
+    int monthCount;
+    volatile LONG nextMonth;     // 下一个待领取的月份下标
+    ArchiveEntry *previous;      // 上次构建的清单（按文件名排序）
+    int previousCount;
+} ArchiveBuild;
+
 /* 全局变量 */
 static volatile int keep_running = 1;
 
+/* 异步日志：生产者无锁写入环形缓冲区，日志线程批量写入保持打开的文件 */
+static LogRecord log_ring[LOG_RING_SLOTS];
+static volatile LONG log_ring_tail = 0;    // 下一个写入位置（多个生产者竞争）
+static volatile LONG log_ring_head = 0;    // 下一个读取位置（只由日志线程推进，线程退出后由stop_logger补取）
+static volatile LONG log_min_level = LOG_LEVEL_INFO;
+static volatile LONG log_dropped = 0;
+static volatile LONG log_dropped_total = 0;
+static HANDLE log_wakeup = NULL;
+static HANDLE log_thread_handle = NULL;
+static volatile LONG log_stopping = 0;
+static FILE *log_file = NULL;
+static long log_file_size = 0;
+static long log_max_size = 0;
+
+/* 二进制事件日志：与文本日志共用日志线程写盘 */
+static EventSlot event_ring[EVENT_RING_SLOTS];
+static volatile LONG event_ring_tail = 0;
+static volatile LONG event_ring_head = 0;
+static volatile LONG event_dropped = 0;
+static volatile LONG event_log_enabled = 0;
+static FILE *event_file = NULL;
+
+/* 运行指标：每个线程一个分片，超过上限的线程共用溢出分片并改用原子操作 */
+static MetricShard *metric_shards[METRIC_MAX_THREADS];
+static volatile LONG metric_shard_count = 0;
+static MetricShard metric_overflow;
+static THREAD_LOCAL MetricShard *metric_shard = NULL;
+static LONG64 metric_frequency = 1; // 由metric_init在启动时设置
+static volatile LONG64 metric_last_cycle_us = 0;
+static int metric_interval_seconds = 0;
+
+/* 跨度追踪：未启用时每个跨度只多一次判断 */
+static volatile LONG trace_enabled = 0;
+static TraceBuffer *trace_buffers[TRACE_MAX_THREADS];
+static volatile LONG trace_buffer_count = 0;
+static THREAD_LOCAL TraceBuffer *trace_buffer = NULL;
+static volatile LONG trace_dropped = 0;
+static ULONGLONG trace_origin = 0;
+static double trace_frequency = 1;
+static FILE *trace_file = NULL;
+
+/* 负载测试用的本机伪上游 */
+static SOCKET fake_upstream_socket = INVALID_SOCKET;
+static HANDLE fake_upstream_thread_handle = NULL;
+static volatile LONG fake_upstream_stopping = 0;
+static volatile LONG fake_upstream_requests = 0;
+static const LoadTestOptions *fake_upstream_options = NULL;
+
+/* 程序时钟：clock_virtual为1时所有"当前时间"取虚拟时钟，等待只推进时钟不睡眠 */
+static volatile LONG clock_virtual = 0;
+static volatile LONG64 clock_virtual_ms = 0;
+
+/* 原始响应捕获文件，只由轮询线程写入 */
+static FILE *capture_file = NULL;
+static long capture_records = 0;
+
+static const EventType event_types[EVENT_TYPE_COUNT] = {
+    {"session", "iii", {"frequency", "counter", "unix_ms"}, "监控进程启动"},
+    {"fetch_attempt", "i", {"attempt"}, "第{}次尝试获取数据"},
+    {"fetch_ok", "ii", {"attempt", "elapsed_ms"}, "数据获取成功 (第{}次尝试，耗时{} ms)"},
+    {"fetch_failed", "ii", {"attempt", "reason"}, "第{}次尝试失败（原因{}: 1=HTTP请求失败 2=JSON解析失败）"},
+    {"fetch_gave_up", "i", {"attempts"}, "所有{}次重试均已失败"},
+    {"http_error", "ii", {"stage", "error"}, "HTTP请求失败（阶段{}: 1=打开 2=解析URL 3=连接 4=创建请求 5=发送 6=状态码 7=响应超长），错误代码{}"},
+    {"http_response", "ii", {"bytes", "elapsed_ms"}, "HTTP响应{}字节，耗时{} ms"},
+    {"reading", "ddd", {"energy", "amount", "consumption"}, "读数: 剩余电量{}度，剩余金额{}元，累计用电{}kWh"},
+    {"alert", "idi", {"rule", "value", "notified"}, "警报规则#{}触发，指标值{}，第{}次提醒"},
+    {"alert_cleared", "i", {"rule"}, "警报规则#{}恢复正常"},
+    {"render", "iii", {"tasks", "pages", "elapsed_ms"}, "本轮渲染{}个任务，发布{}个页面，耗时{} ms"},
+    {"email", "iii", {"outbox_id", "delivered", "attempts"}, "发件箱邮件#{}投递结果{}（第{}次尝试）"},
+};
+
+/* 已渲染页面缓存 */
+static PageSnapshot **page_cache = NULL;
+static int page_cache_count = 0;
+static int page_cache_capacity = 0;
+static CRITICAL_SECTION page_cache_lock;
+
+/* 内置HTTP服务 */
+static SOCKET http_listen_socket = INVALID_SOCKET;
+static HANDLE http_server_thread_handle = NULL;
+
+/* 待推送给SSE客户端的事件 */
+static PageBuffer sse_pending;
+static CRITICAL_SECTION sse_lock;
+static long sse_event_id = 0;
+
+/* 已写出的JSON历史分页中最大的记录ID，之前的分页不再重写 */
+static int json_history_last_id = 0;
+
+/* 后台渲染线程：单槽邮箱只保留最新一次待渲染的读数，渲染期间到达的旧读数直接被覆盖 */
+static RenderJob *volatile render_mailbox = NULL;
+static HANDLE render_wakeup = NULL;
+static HANDLE render_thread_handle = NULL;
+static volatile LONG render_stopping = 0;
+static volatile LONG render_superseded = 0;
+
+/* 渲染工作线程池：与渲染线程一起并行渲染同一轮中的各个页面 */
+static RenderBatch *volatile render_batch = NULL;
+static HANDLE render_pool_wakeup = NULL;
+static HANDLE render_workers[RENDER_MAX_WORKERS];
+static int render_worker_count = 0;
+static volatile LONG render_pool_stopping = 0;
+static volatile LONG render_pages_published = 0;
+
+/* 上一轮渲染时的数据版本，数据未变化的页面本轮不再重新渲染。
+   警报按最大ID比较：页面只列出最近ALERTS_MAX_ROWS条，总数可能不变而内容已滚动 */
+static int rendered_max_id = -1;
+static int rendered_max_alert_id = -1;
+
+/* 本线程的只读渲染连接：渲染线程和每个渲染工作线程第一次渲染时打开，之后每轮复用 */
+static THREAD_LOCAL sqlite3 *render_db = NULL;
+static THREAD_LOCAL char render_db_path[MAX_PATH];
+
+/* 发件箱投递线程 */
+static HANDLE outbox_wakeup = NULL;
+static HANDLE outbox_thread_handle = NULL;
+static volatile LONG outbox_stopping = 0;
+static long outbox_last_latency = 0; // 最近一封邮件从入队到送达的秒数
+
+/* 本地通知出口和投递线程 */
+static NotifySink notify_sinks[NOTIFY_MAX_SINKS];
+static int notify_sink_count = 0;
+static HANDLE notify_wakeup = NULL;
+static HANDLE notify_thread_handle = NULL;
+static volatile LONG notify_stopping = 0;
+
+/* 每个线程缓存的空闲页面缓冲区 */
+static THREAD_LOCAL PageBuffer page_buffer_pool[PAGE_BUFFER_POOL_SIZE];
+static THREAD_LOCAL int page_buffer_pool_count = 0;
+
+/* 历史图表各时间范围的降采样缓存 */
+static ChartRange chart_ranges[CHART_RANGE_COUNT] = {
+    {"day", "24小时", 86400},
+    {"week", "7天", 7 * 86400},
+    {"month", "30天", 30 * 86400},
+    {"year", "1年", 365 * 86400},
+    {"all", "全部", 0},
+};
+
+/* 各页面共用的样式表，按内容哈希命名后发布，浏览器可长期缓存 */
+static const char app_css[] =
+    ":root {\n"
+    "    --bg-primary: #f5f5f5;\n"
+    "    --bg-secondary: white;\n"
+    "    --text-primary: #2c3e50;\n"
+    "    --text-secondary: #7f8c8d;\n"
+    "    --border-color: #ecf0f1;\n"
+    "    --header-bg: #2c3e50;\n"
+    "    --nav-bg: #34495e;\n"
+    "    --card-shadow: 0 2px 10px rgba(0,0,0,0.1);\n"
+    "}\n"
+    "\n"
+    ".page-alerts {\n"
+    "    --header-bg: #e74c3c;\n"
+    "    --nav-bg: #c0392b;\n"
+    "}\n"
+    "\n"
+    ".dark-mode {\n"
+    "    --bg-primary: #1a1a1a;\n"
+    "    --bg-secondary: #2d2d2d;\n"
+    "    --text-primary: #ffffff;\n"
+    "    --text-secondary: #b0b0b0;\n"
+    "    --border-color: #404040;\n"
+    "    --header-bg: #1a1a1a;\n"
+    "    --nav-bg: #2d2d2d;\n"
+    "    --card-shadow: 0 2px 10px rgba(0,0,0,0.3);\n"
+    "}\n"
+    "\n"
+    ".page-alerts.dark-mode {\n"
+    "    --header-bg: #c0392b;\n"
+    "    --nav-bg: #a93226;\n"
+    "}\n"
+    "\n"
+    "/* 公共布局 */\n"
+    "* { margin: 0; padding: 0; box-sizing: border-box; transition: background-color 0.3s, color 0.3s; }\n"
+    "body { font-family: 'Microsoft YaHei', Arial, sans-serif; background: var(--bg-primary); color: var(--text-primary); min-height: 100vh; padding: 20px; }\n"
+    ".container { max-width: 1400px; margin: 0 auto; background: var(--bg-secondary); border-radius: 10px; box-shadow: var(--card-shadow); overflow: hidden; }\n"
+    ".page-index .container { max-width: 1000px; }\n"
+    ".page-alerts .container { max-width: 1200px; }\n"
+    ".header { background: var(--header-bg); color: white; padding: 20px; text-align: center; position: relative; }\n"
+    ".header h1 { font-size: 2em; margin-bottom: 10px; }\n"
+    ".theme-toggle { position: absolute; top: 20px; right: 20px; background: rgba(255,255,255,0.2); border: none; color: white; padding: 8px 12px; border-radius: 20px; cursor: pointer; font-size: 14px; }\n"
+    ".theme-toggle:hover { background: rgba(255,255,255,0.3); }\n"
+    ".nav { background: var(--nav-bg); padding: 10px; text-align: center; }\n"
+    ".nav a { color: white; text-decoration: none; margin: 0 15px; padding: 5px 10px; border-radius: 3px; }\n"
+    ".nav a:hover { background: rgba(255,255,255,0.2); }\n"
+    ".content { padding: 20px; }\n"
+    ".footer { background: var(--header-bg); color: white; text-align: center; padding: 15px; margin-top: 20px; }\n"
+    ".update-time { text-align: center; color: var(--text-secondary); margin: 10px 0; }\n"
+    ".section-title { font-size: 1.5em; color: var(--text-primary); margin: 20px 0 15px 0; padding-bottom: 10px; border-bottom: 2px solid var(--border-color); }\n"
+    ".page-alerts .section-title { color: #e74c3c; }\n"
+    "\n"
+    "/* 统计卡片 */\n"
+    ".stats-grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(200px, 1fr)); gap: 15px; margin-bottom: 20px; }\n"
+    ".stat-card { background: var(--bg-secondary); padding: 15px; border-radius: 8px; box-shadow: 0 2px 5px rgba(0,0,0,0.1); text-align: center; border-top: 4px solid #3498db; }\n"
+    ".stat-card.energy { border-top-color: #e74c3c; }\n"
+    ".stat-card.amount { border-top-color: #27ae60; }\n"
+    ".stat-card.consumption { border-top-color: #f39c12; }\n"
+    ".stat-card.price { border-top-color: #9b59b6; }\n"
+    ".stat-card.records { border-top-color: #3498db; }\n"
+    ".stat-card.alerts { border-top-color: #e74c3c; }\n"
+    ".page-history .stat-card.energy { border-top-color: #27ae60; }\n"
+    ".stat-value { font-size: 1.8em; font-weight: bold; margin: 8px 0; }\n"
+    ".energy-value { color: #e74c3c; }\n"
+    ".amount-value { color: #27ae60; }\n"
+    ".consumption-value { color: #f39c12; }\n"
+    ".price-value { color: #9b59b6; }\n"
+    ".stat-label { color: var(--text-secondary); font-size: 0.9em; }\n"
+    "\n"
+    "/* 实时监控页面 */\n"
+    ".status-card { background: var(--bg-secondary); border-radius: 8px; padding: 20px; margin-bottom: 20px; border-left: 5px solid #3498db; box-shadow: 0 2px 5px rgba(0,0,0,0.1); }\n"
+    ".status-card.low-energy { border-left-color: #e74c3c; background: var(--bg-secondary); }\n"
+    ".status-header { display: flex; justify-content: space-between; align-items: center; margin-bottom: 15px; }\n"
+    ".status-title { font-size: 1.5em; color: var(--text-primary); font-weight: bold; }\n"
+    ".status-badge { padding: 5px 10px; border-radius: 15px; font-weight: bold; }\n"
+    ".section-title .status-badge { font-size: 0.7em; vertical-align: middle; }\n"
+    ".badge-normal { background: #27ae60; color: white; }\n"
+    ".badge-low { background: #e74c3c; color: white; }\n"
+    ".info-table { width: 100%; border-collapse: collapse; background: var(--bg-secondary); border-radius: 8px; overflow: hidden; box-shadow: 0 2px 5px rgba(0,0,0,0.1); }\n"
+    ".info-table th, .info-table td { padding: 12px; text-align: left; border-bottom: 1px solid var(--border-color); }\n"
+    ".info-table th { background: var(--nav-bg); color: white; font-weight: 600; }\n"
+    ".alert-banner { background: #e74c3c; color: white; padding: 12px; text-align: center; border-radius: 6px; margin: 15px 0; }\n"
+    "\n"
+    "/* 历史图表 */\n"
+    ".chart-ranges { margin-bottom: 10px; }\n"
+    ".chart-ranges button { background: var(--bg-secondary); color: var(--text-primary); border: 1px solid var(--border-color); padding: 6px 14px; border-radius: 4px; margin-right: 6px; cursor: pointer; }\n"
+    ".chart-ranges button.active { background: var(--nav-bg); color: white; }\n"
+    ".chart-grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(320px, 1fr)); gap: 20px; margin-bottom: 30px; }\n"
+    ".chart-card { background: var(--bg-secondary); padding: 15px; border-radius: 8px; box-shadow: var(--card-shadow); }\n"
+    ".chart-card canvas { width: 100%; height: 220px; display: block; margin-top: 8px; }\n"
+    "\n"
+    "/* 历史记录表格 */\n"
+    ".history-table { width: 100%; table-layout: fixed; border-collapse: collapse; background: var(--bg-secondary); border-radius: 8px; overflow: hidden; box-shadow: 0 2px 5px rgba(0,0,0,0.1); margin-bottom: 20px; }\n"
+    ".history-table th, .history-table td { padding: 12px; text-align: left; border-bottom: 1px solid var(--border-color); }\n"
+    ".history-table th { background: var(--nav-bg); color: white; font-weight: 600; position: sticky; top: 0; }\n"
+    ".history-table tr:hover { background: var(--bg-primary); }\n"
+    ".history-table td { white-space: nowrap; overflow: hidden; text-overflow: ellipsis; }\n"
+    ".history-table td.spacer { padding: 0; border: 0; }\n"
+    ".history-table th.sorted-asc::after { content: ' ▲'; }\n"
+    ".history-table th.sorted-desc::after { content: ' ▼'; }\n"
+    "tr.low-energy { background-color: rgba(231, 76, 60, 0.1) !important; }\n"
+    ".table-container { max-height: 600px; overflow-y: auto; margin-bottom: 30px; }\n"
+    ".pager { text-align: center; margin-bottom: 10px; color: var(--text-secondary); }\n"
+    ".pager button { background: var(--nav-bg); color: white; border: none; padding: 5px 12px; border-radius: 3px; cursor: pointer; margin: 0 10px; }\n"
+    ".pager button:disabled { opacity: 0.4; cursor: default; }\n"
+    "\n"
+    "/* 警报记录页面 */\n"
+    ".stats-card { background: rgba(231, 76, 60, 0.1); padding: 20px; border-radius: 8px; border-left: 5px solid #e74c3c; margin-bottom: 20px; }\n"
+    ".stats-value { font-size: 2em; font-weight: bold; color: #e74c3c; }\n"
+    ".stats-label { color: var(--text-secondary); font-size: 1em; }\n"
+    ".alerts-table { width: 100%; border-collapse: collapse; background: var(--bg-secondary); border-radius: 8px; overflow: hidden; box-shadow: 0 2px 5px rgba(0,0,0,0.1); }\n"
+    ".alerts-table th, .alerts-table td { padding: 12px; text-align: left; border-bottom: 1px solid var(--border-color); }\n"
+    ".alerts-table th { background: var(--nav-bg); color: white; font-weight: 600; }\n"
+    ".alerts-table tr:hover { background: var(--bg-primary); }\n"
+    ".alert-critical { background-color: rgba(231, 76, 60, 0.1) !important; font-weight: bold; color: #e74c3c; }\n";
+
+/* 各页面共用的脚本：主题切换、表格排序、实时更新及仪表盘外壳逻辑 */
+static const char app_js[] =
+    "// 主题切换功能\n"
+    "function toggleTheme() {\n"
+    "    document.body.classList.toggle('dark-mode');\n"
+    "    const button = document.querySelector('.theme-toggle');\n"
+    "    if (document.body.classList.contains('dark-mode')) {\n"
+    "        button.textContent = '☀️ 明亮模式';\n"
+    "        localStorage.setItem('theme', 'dark');\n"
+    "    } else {\n"
+    "        button.textContent = '🌙 暗黑模式';\n"
+    "        localStorage.setItem('theme', 'light');\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// 加载保存的主题\n"
+    "document.addEventListener('DOMContentLoaded', function() {\n"
+    "    const savedTheme = localStorage.getItem('theme');\n"
+    "    if (savedTheme === 'dark') {\n"
+    "        document.body.classList.add('dark-mode');\n"
+    "        document.querySelector('.theme-toggle').textContent = '☀️ 明亮模式';\n"
+    "    }\n"
+    "});\n"
+    "\n"
+    "// 历史记录虚拟表格：数据按列保存在数值数组中，只为可见区域创建表格行\n"
+    "// rows为 [id, 记录时间, 剩余电量, 剩余金额, 累计用电, 电价, 状态, 更新时间] 数组，新记录在前\n"
+    "function createHistoryTable(table, rows) {\n"
+    "    const container = table.parentElement;\n"
+    "    const tbody = table.querySelector('tbody');\n"
+    "    const headers = table.querySelectorAll('th');\n"
+    "    const numeric = [true, false, true, true, true, true, false, false];\n"
+    "    const digits = [0, 0, 2, 2, 2, 4, 0, 0];\n"
+    "    const overscan = 10;\n"
+    "    \n"
+    "    // 按时间先后存储，新记录追加在末尾\n"
+    "    let capacity = Math.max(64, rows.length);\n"
+    "    let length = 0;\n"
+    "    let columns = numeric.map(function(isNumber) { return isNumber ? new Float64Array(capacity) : new Array(capacity); });\n"
+    "    // 每列一份按该列升序排列的存储下标，首次按该列排序时建立，之后一直复用\n"
+    "    const sortIndex = numeric.map(function() { return null; });\n"
+    "    let sortColumn = -1;\n"
+    "    let sortAscending = true;\n"
+    "    let rowHeight = 0;\n"
+    "    let scheduled = false;\n"
+    "    \n"
+    "    const topSpacer = makeSpacer();\n"
+    "    const bottomSpacer = makeSpacer();\n"
+    "    const rowPool = [];\n"
+    "    \n"
+    "    function compare(column, a, b) {\n"
+    "        const values = columns[column];\n"
+    "        const x = values[a];\n"
+    "        const y = values[b];\n"
+    "        if (x < y) return -1;\n"
+    "        if (x > y) return 1;\n"
+    "        return a - b;\n"
+    "    }\n"
+    "    \n"
+    "    function buildIndex(column) {\n"
+    "        const index = new Uint32Array(length);\n"
+    "        for (let i = 0; i < length; i++) index[i] = i;\n"
+    "        index.sort(function(a, b) { return compare(column, a, b); });\n"
+    "        sortIndex[column] = index;\n"
+    "    }\n"
+    "    \n"
+    "    // 新记录二分插入已建立的索引，不必整列重排\n"
+    "    function insertIntoIndex(column, position) {\n"
+    "        const index = sortIndex[column];\n"
+    "        let low = 0;\n"
+    "        let high = index.length;\n"
+    "        while (low < high) {\n"
+    "            const mid = (low + high) >>> 1;\n"
+    "            if (compare(column, index[mid], position) < 0) low = mid + 1;\n"
+    "            else high = mid;\n"
+    "        }\n"
+    "        const grown = new Uint32Array(index.length + 1);\n"
+    "        grown.set(index.subarray(0, low), 0);\n"
+    "        grown[low] = position;\n"
+    "        grown.set(index.subarray(low), low + 1);\n"
+    "        sortIndex[column] = grown;\n"
+    "    }\n"
+    "    \n"
+    "    // 显示位置 -> 存储下标：未排序时新记录在前\n"
+    "    function storageAt(position) {\n"
+    "        if (sortColumn < 0) return length - 1 - position;\n"
+    "        const index = sortIndex[sortColumn];\n"
+    "        return sortAscending ? index[position] : index[length - 1 - position];\n"
+    "    }\n"
+    "    \n"
+    "    function formatCell(column, position) {\n"
+    "        const value = columns[column][position];\n"
+    "        return numeric[column] ? value.toFixed(digits[column]) : value;\n"
+    "    }\n"
+    "    \n"
+    "    // 占位行撑起不可见部分的高度，滚动条长度与完整表格一致\n"
+    "    function makeSpacer() {\n"
+    "        const row = document.createElement('tr');\n"
+    "        const cell = document.createElement('td');\n"
+    "        cell.className = 'spacer';\n"
+    "        cell.colSpan = numeric.length;\n"
+    "        row.appendChild(cell);\n"
+    "        return row;\n"
+    "    }\n"
+    "    \n"
+    "    function makeRow() {\n"
+    "        const row = document.createElement('tr');\n"
+    "        for (let i = 0; i < numeric.length; i++) row.appendChild(document.createElement('td'));\n"
+    "        return row;\n"
+    "    }\n"
+    "    \n"
+    "    function render() {\n"
+    "        scheduled = false;\n"
+    "        if (!rowHeight) {\n"
+    "            const probe = makeRow();\n"
+    "            probe.cells[0].textContent = '0';\n"
+    "            tbody.appendChild(probe);\n"
+    "            rowHeight = probe.getBoundingClientRect().height || 45;\n"
+    "            tbody.removeChild(probe);\n"
+    "        }\n"
+    "        \n"
+    "        const headerHeight = table.tHead ? table.tHead.offsetHeight : 0;\n"
+    "        const scrollTop = Math.max(0, container.scrollTop - headerHeight);\n"
+    "        const first = Math.max(0, Math.floor(scrollTop / rowHeight) - overscan);\n"
+    "        const visible = Math.ceil(container.clientHeight / rowHeight) + overscan * 2;\n"
+    "        const last = Math.min(length, first + visible);\n"
+    "        \n"
+    "        while (rowPool.length < last - first) rowPool.push(makeRow());\n"
+    "        \n"
+    "        const fragment = document.createDocumentFragment();\n"
+    "        topSpacer.cells[0].style.height = (first * rowHeight) + 'px';\n"
+    "        fragment.appendChild(topSpacer);\n"
+    "        for (let i = first; i < last; i++) {\n"
+    "            const row = rowPool[i - first];\n"
+    "            const position = storageAt(i);\n"
+    "            for (let column = 0; column < numeric.length; column++) {\n"
+    "                row.cells[column].textContent = formatCell(column, position);\n"
+    "            }\n"
+    "            row.className = columns[2][position] < 50 ? 'low-energy' : '';\n"
+    "            fragment.appendChild(row);\n"
+    "        }\n"
+    "        bottomSpacer.cells[0].style.height = ((length - last) * rowHeight) + 'px';\n"
+    "        fragment.appendChild(bottomSpacer);\n"
+    "        \n"
+    "        tbody.textContent = '';\n"
+    "        tbody.appendChild(fragment);\n"
+    "    }\n"
+    "    \n"
+    "    function scheduleRender() {\n"
+    "        if (scheduled) return;\n"
+    "        scheduled = true;\n"
+    "        requestAnimationFrame(render);\n"
+    "    }\n"
+    "    \n"
+    "    function append(row) {\n"
+    "        if (length === capacity) {\n"
+    "            capacity *= 2;\n"
+    "            columns = columns.map(function(values, column) {\n"
+    "                if (!numeric[column]) return values;\n"
+    "                const grown = new Float64Array(capacity);\n"
+    "                grown.set(values);\n"
+    "                return grown;\n"
+    "            });\n"
+    "        }\n"
+    "        for (let column = 0; column < numeric.length; column++) columns[column][length] = row[column];\n"
+    "        length++;\n"
+    "    }\n"
+    "    \n"
+    "    for (let i = rows.length - 1; i >= 0; i--) append(rows[i]);\n"
+    "    \n"
+    "    // 点击表头按该列排序，再次点击切换升序/降序\n"
+    "    headers.forEach(function(header, column) {\n"
+    "        header.style.cursor = 'pointer';\n"
+    "        header.addEventListener('click', function() {\n"
+    "            if (sortColumn === column) {\n"
+    "                sortAscending = !sortAscending;\n"
+    "            } else {\n"
+    "                if (headers[sortColumn]) headers[sortColumn].classList.remove('sorted-asc', 'sorted-desc');\n"
+    "                sortColumn = column;\n"
+    "                sortAscending = true;\n"
+    "                if (!sortIndex[column]) buildIndex(column);\n"
+    "            }\n"
+    "            header.classList.toggle('sorted-asc', sortAscending);\n"
+    "            header.classList.toggle('sorted-desc', !sortAscending);\n"
+    "            container.scrollTop = 0;\n"
+    "            scheduleRender();\n"
+    "        });\n"
+    "    });\n"
+    "    \n"
+    "    container.addEventListener('scroll', scheduleRender, { passive: true });\n"
+    "    window.addEventListener('resize', scheduleRender);\n"
+    "    render();\n"
+    "    \n"
+    "    return {\n"
+    "        // 追加一条新记录（格式同rows中的一行）\n"
+    "        add: function(row) {\n"
+    "            append(row);\n"
+    "            for (let column = 0; column < numeric.length; column++) {\n"
+    "                if (sortIndex[column]) insertIntoIndex(column, length - 1);\n"
+    "            }\n"
+    "            scheduleRender();\n"
+    "        }\n"
+    "    };\n"
+    "}\n"
+    "\n"
+    "// 历史图表：服务端已按时间范围降采样（LTTB，约500点），这里只负责绘制\n"
+    "// 每条曲线为 [时间, 数值, 时间, 数值, ...]，时间为Unix秒（UTC）\n"
+    "function createHistoryCharts(data) {\n"
+    "    const charts = [\n"
+    "        { canvas: document.getElementById('energy-chart'), key: 'energy', color: '#27ae60' },\n"
+    "        { canvas: document.getElementById('consumption-chart'), key: 'consumption', color: '#3498db' }\n"
+    "    ];\n"
+    "    const buttons = document.getElementById('chart-ranges');\n"
+    "    let current = data.ranges[0];\n"
+    "    \n"
+    "    function formatTime(seconds) {\n"
+    "        return new Date(seconds * 1000).toISOString().slice(0, 16).replace('T', ' ');\n"
+    "    }\n"
+    "    \n"
+    "    function draw(chart) {\n"
+    "        const canvas = chart.canvas;\n"
+    "        const series = current[chart.key];\n"
+    "        const ratio = window.devicePixelRatio || 1;\n"
+    "        const width = canvas.clientWidth;\n"
+    "        const height = canvas.clientHeight;\n"
+    "        canvas.width = width * ratio;\n"
+    "        canvas.height = height * ratio;\n"
+    "        const context = canvas.getContext('2d');\n"
+    "        context.setTransform(ratio, 0, 0, ratio, 0, 0);\n"
+    "        context.clearRect(0, 0, width, height);\n"
+    "        \n"
+    "        const style = getComputedStyle(document.body);\n"
+    "        context.fillStyle = style.getPropertyValue('--text-secondary');\n"
+    "        context.font = '12px sans-serif';\n"
+    "        if (series.length < 4) {\n"
+    "            context.fillText('暂无数据', width / 2 - 24, height / 2);\n"
+    "            return;\n"
+    "        }\n"
+    "        \n"
+    "        let minTime = series[0], maxTime = series[series.length - 2];\n"
+    "        let minValue = Infinity, maxValue = -Infinity;\n"
+    "        for (let i = 1; i < series.length; i += 2) {\n"
+    "            minValue = Math.min(minValue, series[i]);\n"
+    "            maxValue = Math.max(maxValue, series[i]);\n"
+    "        }\n"
+    "        if (maxTime === minTime) maxTime = minTime + 1;\n"
+    "        if (maxValue === minValue) { maxValue += 1; minValue -= 1; }\n"
+    "        \n"
+    "        const left = 50, right = 10, top = 10, bottom = 24;\n"
+    "        const plotWidth = width - left - right;\n"
+    "        const plotHeight = height - top - bottom;\n"
+    "        const x = function(t) { return left + (t - minTime) / (maxTime - minTime) * plotWidth; };\n"
+    "        const y = function(v) { return top + (maxValue - v) / (maxValue - minValue) * plotHeight; };\n"
+    "        \n"
+    "        context.fillText(maxValue.toFixed(1), 4, top + 10);\n"
+    "        context.fillText(minValue.toFixed(1), 4, top + plotHeight);\n"
+    "        context.fillText(formatTime(minTime), left, height - 6);\n"
+    "        const endLabel = formatTime(maxTime);\n"
+    "        context.fillText(endLabel, width - right - context.measureText(endLabel).width, height - 6);\n"
+    "        \n"
+    "        context.strokeStyle = style.getPropertyValue('--border-color');\n"
+    "        context.strokeRect(left, top, plotWidth, plotHeight);\n"
+    "        \n"
+    "        context.strokeStyle = chart.color;\n"
+    "        context.lineWidth = 1.5;\n"
+    "        context.beginPath();\n"
+    "        context.moveTo(x(series[0]), y(series[1]));\n"
+    "        for (let i = 2; i < series.length; i += 2) context.lineTo(x(series[i]), y(series[i + 1]));\n"
+    "        context.stroke();\n"
+    "    }\n"
+    "    \n"
+    "    function drawAll() {\n"
+    "        charts.forEach(draw);\n"
+    "    }\n"
+    "    \n"
+    "    data.ranges.forEach(function(range) {\n"
+    "        const button = document.createElement('button');\n"
+    "        button.textContent = range.label;\n"
+    "        button.addEventListener('click', function() {\n"
+    "            current = range;\n"
+    "            buttons.querySelectorAll('button').forEach(function(b) { b.classList.toggle('active', b === button); });\n"
+    "            drawAll();\n"
+    "        });\n"
+    "        if (range === current) button.classList.add('active');\n"
+    "        buttons.appendChild(button);\n"
+    "    });\n"
+    "    \n"
+    "    window.addEventListener('resize', drawAll);\n"
+    "    document.querySelector('.theme-toggle').addEventListener('click', drawAll);\n"
+    "    drawAll();\n"
+    "    \n"
+    "    return {\n"
+    "        // 实时读数追加到每个范围的曲线末尾，刷新页面后由服务端重新降采样\n"
+    "        add: function(time, energy, consumption) {\n"
+    "            data.ranges.forEach(function(range) {\n"
+    "                range.energy.push(time, energy);\n"
+    "                range.consumption.push(time, consumption);\n"
+    "            });\n"
+    "            drawAll();\n"
+    "        }\n"
+    "    };\n"
+    "}\n"
+    "\n"
+    "// 实时更新：内置HTTP服务通过SSE推送新读数和警报，页面就地更新；\n"
+    "// 事件流不可用（如由静态Web服务器提供页面）时退回每5分钟刷新\n"
+    "function connectLiveUpdates(handlers) {\n"
+    "    var reloadTimer = setTimeout(function() { location.reload(); }, 300000);\n"
+    "    if (!window.EventSource) return;\n"
+    "    var source = new EventSource('events');\n"
+    "    var opened = false;\n"
+    "    source.onopen = function() {\n"
+    "        // 断线重连后期间的事件已丢失，整页刷新一次重新同步\n"
+    "        if (opened) location.reload();\n"
+    "        opened = true;\n"
+    "        clearTimeout(reloadTimer);\n"
+    "    };\n"
+    "    source.onerror = function() {\n"
+    "        if (source.readyState === EventSource.CLOSED) {\n"
+    "            clearTimeout(reloadTimer);\n"
+    "            reloadTimer = setTimeout(function() { location.reload(); }, 300000);\n"
+    "        }\n"
+    "    };\n"
+    "    Object.keys(handlers).forEach(function(name) {\n"
+    "        source.addEventListener(name, function(e) { handlers[name](JSON.parse(e.data)); });\n"
+    "    });\n"
+    "}\n"
+    "\n"
+    "function appendCells(row, values) {\n"
+    "    values.forEach(function(value) {\n"
+    "        const cell = document.createElement('td');\n"
+    "        cell.textContent = value;\n"
+    "        row.appendChild(cell);\n"
+    "    });\n"
+    "}\n"
+    "\n"
+    "// 实时监控页面：收到新读数时就地更新页面数值\n"
+    "function applyReading(r) {\n"
+    "    document.getElementById('live-energy').textContent = r.energy.toFixed(2) + ' 度';\n"
+    "    document.getElementById('live-amount').textContent = r.amount.toFixed(2) + ' 元';\n"
+    "    document.getElementById('live-consumption').textContent = r.consumption.toFixed(2) + ' kWh';\n"
+    "    document.getElementById('live-price').textContent = r.price.toFixed(4) + ' 元/度';\n"
+    "    document.getElementById('live-status').textContent = r.status;\n"
+    "    document.getElementById('live-update-time').textContent = r.updateTime;\n"
+    "    document.getElementById('live-system-time').textContent = r.systemTime;\n"
+    "    document.getElementById('live-page-time').textContent = r.systemTime;\n"
+    "    \n"
+    "    const card = document.getElementById('status-card');\n"
+    "    const badge = document.getElementById('status-badge');\n"
+    "    card.className = 'status-card ' + (r.low ? 'low-energy' : 'normal');\n"
+    "    badge.className = 'status-badge ' + (r.low ? 'badge-low' : 'badge-normal');\n"
+    "    badge.textContent = r.low ? '⚠️ 低电量' : '✅ 正常';\n"
+    "    \n"
+    "    let banner = document.getElementById('alert-banner');\n"
+    "    if (r.low) {\n"
+    "        if (!banner) {\n"
+    "            banner = document.createElement('div');\n"
+    "            banner.id = 'alert-banner';\n"
+    "            banner.className = 'alert-banner';\n"
+    "            card.appendChild(banner);\n"
+    "        }\n"
+    "        banner.innerHTML = '<strong>⚠️ 低电量警告！</strong> 剩余 ' + r.energy.toFixed(2) + ' 度电，请及时充值！';\n"
+    "    } else if (banner) {\n"
+    "        banner.remove();\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// 历史记录页面：收到新读数时加入虚拟表格和图表\n"
+    "function addHistoryRow(historyTable, historyCharts, r) {\n"
+    "    historyTable.add([r.id, r.recordTime, r.energy, r.amount, r.consumption, r.price, r.status, r.updateTime]);\n"
+    "    historyCharts.add(Date.parse(r.recordTime.replace(' ', 'T') + 'Z') / 1000, r.energy, r.consumption);\n"
+    "    \n"
+    "    const countElement = document.getElementById('history-count');\n"
+    "    countElement.textContent = (parseInt(countElement.textContent, 10) + 1) + ' 条';\n"
+    "    document.getElementById('history-consumption').textContent = r.consumption.toFixed(2) + ' kWh';\n"
+    "}\n"
+    "\n"
+    "// 警报记录页面：收到新警报时在表格顶部插入一行\n"
+    "function addAlertRow(a) {\n"
+    "    const tbody = document.querySelector('.alerts-table tbody');\n"
+    "    const empty = document.getElementById('no-alerts');\n"
+    "    if (empty) empty.remove();\n"
+    "    \n"
+    "    const row = document.createElement('tr');\n"
+    "    row.className = 'alert-critical';\n"
+    "    appendCells(row, [a.id, a.time, a.energy.toFixed(2) + ' 度', a.threshold.toFixed(1) + ' 度', a.message, a.updateTime]);\n"
+    "    tbody.insertBefore(row, tbody.firstChild);\n"
+    "    \n"
+    "    const countElement = document.getElementById('alert-count');\n"
+    "    countElement.textContent = (parseInt(countElement.textContent, 10) + 1) + ' 次';\n"
+    "}\n"
+    "\n"
+    "// 静态外壳页面app.html：页面本身不变，数据全部来自监控程序写出的JSON文件\n"
+    "function startDashboard() {\n"
+    "    const state = { lastId: -1, page: 0, pageCount: 0 };\n"
+    "    \n"
+    "    function fetchJson(name) {\n"
+    "        return fetch(name, { cache: 'no-cache' }).then(function(response) {\n"
+    "            if (!response.ok) throw new Error(name + ': ' + response.status);\n"
+    "            return response.json();\n"
+    "        });\n"
+    "    }\n"
+    "    \n"
+    "    function fillRows(tbody, rows, format) {\n"
+    "        const fragment = document.createDocumentFragment();\n"
+    "        rows.forEach(function(row) {\n"
+    "            const tr = document.createElement('tr');\n"
+    "            appendCells(tr, format(row));\n"
+    "            if (row.lowEnergy) tr.className = 'low-energy';\n"
+    "            fragment.appendChild(tr);\n"
+    "        });\n"
+    "        tbody.textContent = '';\n"
+    "        tbody.appendChild(fragment);\n"
+    "    }\n"
+    "    \n"
+    "    function showLatest(r) {\n"
+    "        document.getElementById('latest-energy').textContent = r.energy.toFixed(2) + ' 度';\n"
+    "        document.getElementById('latest-amount').textContent = r.amount.toFixed(2) + ' 元';\n"
+    "        document.getElementById('latest-consumption').textContent = r.consumption.toFixed(2) + ' kWh';\n"
+    "        document.getElementById('latest-price').textContent = r.price.toFixed(4) + ' 元/度';\n"
+    "        document.getElementById('latest-status').textContent = r.status;\n"
+    "        document.getElementById('latest-update-time').textContent = r.updateTime;\n"
+    "        const badge = document.getElementById('status-badge');\n"
+    "        badge.className = 'status-badge ' + (r.low ? 'badge-low' : 'badge-normal');\n"
+    "        badge.textContent = r.low ? '⚠️ 低电量' : '✅ 正常';\n"
+    "    }\n"
+    "    \n"
+    "    // 历史分页文件: history-N.json，每行为 [id, 记录时间, 剩余电量, 剩余金额, 累计用电, 电价, 状态, 更新时间]\n"
+    "    function loadHistoryPage(page) {\n"
+    "        if (page < 1 || page > state.pageCount) return;\n"
+    "        fetchJson('history-' + page + '.json').then(function(data) {\n"
+    "            state.page = page;\n"
+    "            const rows = data.rows.slice().reverse();\n"
+    "            rows.forEach(function(row) { row.lowEnergy = row[2] < 50; });\n"
+    "            fillRows(document.getElementById('history-body'), rows, function(row) {\n"
+    "                return [row[0], row[1], row[2].toFixed(2), row[3].toFixed(2), row[4].toFixed(2), row[5].toFixed(4), row[6], row[7]];\n"
+    "            });\n"
+    "            document.getElementById('page-number').textContent = state.pageCount - page + 1;\n"
+    "            document.getElementById('newer-page').disabled = (page >= state.pageCount);\n"
+    "            document.getElementById('older-page').disabled = (page <= 1);\n"
+    "        }).catch(function() {});\n"
+    "    }\n"
+    "    \n"
+    "    function refresh() {\n"
+    "        fetchJson('latest.json').then(function(latest) {\n"
+    "            if (latest.id === state.lastId) return;\n"
+    "            state.lastId = latest.id;\n"
+    "            showLatest(latest);\n"
+    "            \n"
+    "            fetchJson('history-index.json').then(function(index) {\n"
+    "                const followNewest = (state.page === 0 || state.page === state.pageCount);\n"
+    "                state.pageCount = index.pages;\n"
+    "                document.getElementById('history-count').textContent = index.count + ' 条';\n"
+    "                document.getElementById('page-count').textContent = index.pages;\n"
+    "                if (followNewest) loadHistoryPage(index.pages);\n"
+    "            }).catch(function() {});\n"
+    "            \n"
+    "            fetchJson('alerts.json').then(function(alerts) {\n"
+    "                document.getElementById('alert-count').textContent = alerts.count + ' 次';\n"
+    "                fillRows(document.getElementById('alerts-body'), alerts.rows, function(row) {\n"
+    "                    return [row[0], row[1], row[2].toFixed(2) + ' 度', row[3].toFixed(1) + ' 度', row[4], row[5]];\n"
+    "                });\n"
+    "            }).catch(function() {});\n"
+    "        }).catch(function() {});\n"
+    "    }\n"
+    "    \n"
+    "    document.getElementById('newer-page').addEventListener('click', function() { loadHistoryPage(state.page + 1); });\n"
+    "    document.getElementById('older-page').addEventListener('click', function() { loadHistoryPage(state.page - 1); });\n"
+    "    \n"
+    "    // 每分钟检查一次latest.json，只有数据变化时才拉取其余文件\n"
+    "    refresh();\n"
+    "    setInterval(refresh, 60000);\n"
+    "}\n";
+
+/* 带内容哈希的静态资源文件名，如 app.0123456789abcdef.css */
+static char app_css_name[32];
+static char app_js_name[32];
+
+/* 静态仪表盘外壳页面：只写一次，数据由浏览器从JSON文件读取后渲染（%s依次为样式表和脚本文件名） */
+static const char dashboard_shell_html[] =
+    "<!DOCTYPE html>\n"
+    "<html lang=\"zh-CN\">\n"
+    "<head>\n"
+    "    <meta charset=\"UTF-8\">\n"
+    "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+    "    <title>电表监控系统</title>\n"
+    "    <link rel=\"stylesheet\" href=\"%s\">\n"
+    "</head>\n"
+    "<body class=\"page-app\">\n"
+    "    <div class=\"container\">\n"
+    "        <div class=\"header\">\n"
+    "            <h1>⚡ 电表监控系统</h1>\n"
+    "            <div>实时电力监控</div>\n"
+    "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
+    "        </div>\n"
+    "        \n"
+    "        <div class=\"nav\">\n"
+    "            <a href=\"#latest\">实时监控</a>\n"
+    "            <a href=\"#history\">历史记录</a>\n"
+    "            <a href=\"#alerts\">警报记录</a>\n"
+    "        </div>\n"
+    "        \n"
+    "        <div class=\"content\">\n"
+    "            <div class=\"section-title\" id=\"latest\">📊 当前电表状态 <span class=\"status-badge\" id=\"status-badge\"></span></div>\n"
+    "            <div class=\"stats-grid\">\n"
+    "                <div class=\"stat-card energy\">\n"
+    "                    <div class=\"stat-label\">剩余电量</div>\n"
+    "                    <div class=\"stat-value\" id=\"latest-energy\">-</div>\n"
+    "                    <div>Remaining Energy</div>\n"
+    "                </div>\n"
+    "                <div class=\"stat-card amount\">\n"
+    "                    <div class=\"stat-label\">剩余金额</div>\n"
+    "                    <div class=\"stat-value\" id=\"latest-amount\">-</div>\n"
+    "                    <div>Remaining Amount</div>\n"
+    "                </div>\n"
+    "                <div class=\"stat-card consumption\">\n"
+    "                    <div class=\"stat-label\">累计用电</div>\n"
+    "                    <div class=\"stat-value\" id=\"latest-consumption\">-</div>\n"
+    "                    <div>Total Consumption</div>\n"
+    "                </div>\n"
+    "                <div class=\"stat-card price\">\n"
+    "                    <div class=\"stat-label\">当前电价</div>\n"
+    "                    <div class=\"stat-value\" id=\"latest-price\">-</div>\n"
+    "                    <div>Current Price</div>\n"
+    "                </div>\n"
+    "                <div class=\"stat-card\">\n"
+    "                    <div class=\"stat-label\">总记录数</div>\n"
+    "                    <div class=\"stat-value\" id=\"history-count\">-</div>\n"
+    "                    <div>Total Records</div>\n"
+    "                </div>\n"
+    "                <div class=\"stat-card energy\">\n"
+    "                    <div class=\"stat-label\">总警报次数</div>\n"
+    "                    <div class=\"stat-value\" id=\"alert-count\">-</div>\n"
+    "                    <div>Total Alerts</div>\n"
+    "                </div>\n"
+    "            </div>\n"
+    "            <div class=\"update-time\">电表状态: <span id=\"latest-status\">-</span> | 数据更新时间: <span id=\"latest-update-time\">-</span></div>\n"
+    "            \n"
+    "            <div class=\"section-title\" id=\"history\">📈 历史记录</div>\n"
+    "            <div class=\"pager\">\n"
+    "                <button id=\"newer-page\">较新</button>\n"
+    "                第 <span id=\"page-number\">-</span> / <span id=\"page-count\">-</span> 页\n"
+    "                <button id=\"older-page\">较早</button>\n"
+    "            </div>\n"
+    "            <div class=\"table-container\">\n"
+    "                <table class=\"history-table\">\n"
+    "                    <thead>\n"
+    "                        <tr>\n"
+    "                            <th>ID</th>\n"
+    "                            <th>记录时间</th>\n"
+    "                            <th>剩余电量 (度)</th>\n"
+    "                            <th>剩余金额 (元)</th>\n"
+    "                            <th>累计用电 (kWh)</th>\n"
+    "                            <th>电价 (元/度)</th>\n"
+    "                            <th>电表状态</th>\n"
+    "                            <th>数据更新时间</th>\n"
+    "                        </tr>\n"
+    "                    </thead>\n"
+    "                    <tbody id=\"history-body\"></tbody>\n"
+    "                </table>\n"
+    "            </div>\n"
+    "            \n"
+    "            <div class=\"section-title\" id=\"alerts\">📋 警报记录</div>\n"
+    "            <div class=\"table-container\">\n"
+    "                <table class=\"history-table\">\n"
+    "                    <thead>\n"
+    "                        <tr>\n"
+    "                            <th>ID</th>\n"
+    "                            <th>警报时间</th>\n"
+    "                            <th>剩余电量</th>\n"
+    "                            <th>阈值</th>\n"
+    "                            <th>警报信息</th>\n"
+    "                            <th>数据更新时间</th>\n"
+    "                        </tr>\n"
+    "                    </thead>\n"
+    "                    <tbody id=\"alerts-body\"></tbody>\n"
+    "                </table>\n"
+    "            </div>\n"
+    "        </div>\n"
+    "        \n"
+    "        <div class=\"footer\">\n"
+    "            <p>QAQmolingQAQ</p>\n"
+    "            <p>https://github.com/QAQmolingQAQ/sdipct_electric_monitor-</p>\n"
+    "        </div>\n"
+    "    </div>\n"
+    "    \n"
+    "    <script src=\"%s\"></script>\n"
+    "    <script>\n"
+    "        startDashboard();\n"
+    "    </script>\n"
+    "</body>\n"
+    "</html>\n";
+
 /* 函数声明 */
 void set_console_utf8(void);
 void pause_program(void);
 const char *get_current_time(void);
+void format_time(char *out, size_t out_size);
+
+// 程序时钟
+long long clock_now_ms(void);
+long long clock_now(void);
+void clock_split(long long seconds, int local, SYSTEMTIME *st);
+void clock_local_time(SYSTEMTIME *st);
+void clock_system_time(SYSTEMTIME *st);
+void clock_sql_time(char *out, size_t out_size, long long offset);
+void clock_sleep(DWORD milliseconds);
+void clock_wait(int seconds);
+void clock_use_virtual(long long start_ms);
 void create_directory(const char *dirname);
+void page_buffer_init(PageBuffer *buffer);
+void page_buffer_free(PageBuffer *buffer);
+void page_buffer_take(PageBuffer *buffer);
+void page_buffer_return(PageBuffer *buffer);
+int page_buffer_reserve(PageBuffer *buffer, size_t extra);
+int page_buffer_append(PageBuffer *buffer, const char *data, size_t length);
+int page_buffer_printf(PageBuffer *buffer, const char *format, ...);
+int gzip_compress(const char *data, size_t length, int level, PageBuffer *out);
+int write_file_atomic(const char *filepath, const char *data, size_t length);
+int publish_page(const char *web_path, const char *name, const PageBuffer *page);
+int publish_page_if_changed(const char *web_path, const char *name, const PageBuffer *page);
+int page_stream_open(PageStream *stream, const char *web_path, const char *name);
+void page_stream_write(PageStream *stream, PageBuffer *chunk);
+int page_stream_publish(PageStream *stream, PageBuffer *rest);
+void page_stream_discard(PageStream *stream);
+int page_stream_deflate(PageStream *stream, const char *data, size_t length, int flush);
+int page_stream_close_files(PageStream *stream);
+void init_static_assets(void);
+int publish_static_asset(const char *web_path, const char *name, const char *data, size_t length);
+int publish_static_assets(const char *web_path);
+unsigned long long hash_bytes(const void *data, size_t length);
+unsigned long long hash_bytes_continue(unsigned long long hash, const void *data, size_t length);
+const char *content_type_for_name(const char *name);
+void page_cache_init(void);
+void page_cache_store(const char *name, const PageBuffer *body, const PageBuffer *gzip);
+void page_cache_store_files(const char *name, const char *etag, const char *body_path, const char *gzip_path);
+PageSnapshot *page_snapshot_new(const char *name);
+void page_cache_insert(PageSnapshot *snapshot);
+char *map_snapshot_file(const char *path, size_t *length);
+void cache_rendered_page(const char *name, const PageBuffer *page);
+PageSnapshot *page_cache_acquire(const char *name);
+void page_snapshot_release(PageSnapshot *snapshot);
+int page_buffer_append_json_string(PageBuffer *buffer, const char *text);
+int render_meter_json(PageBuffer *buffer, const ElectricMeter *meter, double threshold);
+int render_alert_json(PageBuffer *buffer, const ElectricMeter *alert);
+void sse_broadcast(const char *event, const PageBuffer *data);
+int start_http_server(const Config *config);
+void stop_http_server(void);
+DWORD WINAPI http_server_thread(LPVOID param);
+int http_get_header(const char *request, const char *name, char *value, size_t value_size);
+int http_client_prepare_response(HttpClient *client);
+int http_client_send(HttpClient *client);
+void http_client_close(HttpClient *client);
 int read_config(const char *filename, Config *config);
 int validate_config(const Config *config);
 int init_database(const char *db_path);
-int save_to_database(const char *db_path, const ElectricMeter *meter);
-int save_alert_to_database(const char *db_path, const ElectricMeter *meter, double threshold);
+int save_to_database(const char *db_path, ElectricMeter *meter);
+int save_alert_to_database(const char *db_path, const ElectricMeter *meter, double threshold, const char *message, ElectricMeter *alert);
 void parse_curl_command(const char *curl_cmd, char *url, char *post_data, char *headers);
 int http_post_request(const char *url, const char *post_data, const char *headers, char *response, int response_size);
 int parse_json_response(const char *json_str, ElectricMeter *meter);
 int get_electric_meter_data_with_retry(const Config *config, ElectricMeter *meter);
-int send_email(const Config *config, const ElectricMeter *meter, double threshold);
-int generate_html_page(const char *web_path, const ElectricMeter *meter, double threshold);
+
+// 进程内SMTP客户端
+int base64_encode(PageBuffer *out, const unsigned char *data, size_t length, int line_length);
+int append_encoded_header(PageBuffer *out, const char *text);
+int winsock_init(void);
+void winsock_cleanup(void);
+int socket_send_all(SOCKET socket, const char *data, size_t length);
+int smtp_write(SmtpSession *session, const char *data, size_t length);
+int smtp_fill(SmtpSession *session);
+int smtp_read_reply(SmtpSession *session);
+int smtp_command(SmtpSession *session, const char *format, ...);
+int smtp_tls_handshake(SmtpSession *session, const char *host);
+int smtp_peer_is_loopback(const SmtpSession *session);
+int smtp_ehlo(SmtpSession *session);
+int smtp_authenticate(SmtpSession *session, const char *user, const char *password);
+int smtp_open(SmtpSession *session, const Config *config);
+int smtp_send_mail(SmtpSession *session, const char *from, char **recipients, int recipient_count, const PageBuffer *message);
+int smtp_write_data(SmtpSession *session, const char *data, size_t length);
+void smtp_close(SmtpSession *session);
+int render_alert_email(PageBuffer *html, const ElectricMeter *meter, const char *rule_name, const char *reason);
+int build_mime_message(PageBuffer *message, const char *from, char **recipients, int recipient_count,
+                       const char *subject, const PageBuffer *html, const char *message_id);
 void display_meter_info(const ElectricMeter *meter, double threshold);
 void write_log(const char *level, const char *message);
 void signal_handler(int signal);
+
+// 异步日志
+int start_logger(const Config *config);
+void stop_logger(void);
+void shutdown_threads(void);
+int log_level_value(const char *level);
+void log_set_level(int level);
+void log_open_file(void);
+void log_rotate(void);
+void log_drain(PageBuffer *file_lines, PageBuffer *console_lines);
+void log_write_lines(const PageBuffer *file_lines, const PageBuffer *console_lines);
+DWORD WINAPI log_thread(LPVOID param);
+
+// 二进制事件日志
+int start_event_log(const char *path);
+void event_log_header(EventLogHeader *header);
+void event_flush(void);
+void log_event(int id, long long a, long long b, long long c);
+long long event_double(double value);
+void event_drain(PageBuffer *batch);
+void format_event_text(PageBuffer *out, const EventType *type, const EventRecord *record);
+int decode_event_log(const char *path, int json);
+
+// 运行指标
+void metric_init(void);
+ULONGLONG metric_clock(void);
+int metric_bucket_index(unsigned long long value);
+unsigned long long metric_bucket_upper(int index);
+MetricShard *metric_local_shard(void);
+void metric_observe(int stage, ULONGLONG started);
+void metric_add(int counter, LONG64 n);
+int render_metrics(PageBuffer *out);
+int write_metrics_file(const char *path);
+
+// 跨度追踪
+int start_trace(const char *path);
+void finish_trace(void);
+TraceBuffer *trace_local_buffer(void);
+static inline ULONGLONG trace_begin(void);
+static inline void trace_end(const char *name, const char *category, ULONGLONG started, const char *arg_name, long long arg);
+void trace_record(const char *name, const char *category, ULONGLONG started, const char *arg_name, long long arg);
+void trace_name_thread(const char *name);
+void trace_drain(PageBuffer *batch);
+
+// 基准测试模式
+int run_benchmarks(const char *out_path, int rows);
+int bench_run(FILE *out, const char *name, const char *variant, long long rows, int (*run)(void *), void *arg);
+int bench_build_database(const char *path, int rows);
+double bench_seconds(ULONGLONG started);
+int bench_compare_double(const void *a, const void *b);
+int bench_parse(void *arg);
+int bench_insert(void *arg);
+int bench_daily(void *arg);
+int bench_weekly(void *arg);
+int bench_snapshot(void *arg);
+int bench_history(void *arg);
+
+// 负载测试模式
+int parse_load_test_options(int argc, char *argv[], LoadTestOptions *options, const char **out_path);
+int run_load_test(LoadTestOptions *options, const char *out_path);
+int run_load_step(FILE *out, LoadTestOptions *options, int meters);
+DWORD WINAPI load_test_worker(LPVOID param);
+double load_test_quantile(const LONG64 *counts, LONG64 total, double quantile);
+LONG64 metric_stage_total(int stage, LONG64 *sum);
+LONG64 metric_counter_total(int counter);
+int start_fake_upstream(LoadTestOptions *options);
+void stop_fake_upstream(void);
+DWORD WINAPI fake_upstream_thread(LPVOID param);
+DWORD WINAPI fake_upstream_connection(LPVOID param);
+
+// 模拟模式
+int parse_simulation_options(int argc, char *argv[], SimulationOptions *options);
+int run_simulation(Config *config, const SimulationOptions *options);
+unsigned int simulation_random(unsigned int *state);
+double simulation_load_kw(int hour);
+void process_reading(const Config *config, AlertState *alert_state, ElectricMeter *meter, int interactive);
+
+// 响应捕获与回放
+int start_capture(const char *path);
+void capture_response(const char *response, size_t length);
+void finish_capture(void);
+int capture_read_record(FILE *capture, z_stream *stream, CaptureHeader *header, char *response, size_t size);
+int parse_replay_options(int argc, char *argv[], const char **capture_path, int *render_every);
+int run_replay(Config *config, const char *capture_path, int render_every);
 void start_monitoring(const Config *config);
 
+// 本地通知出口
+int start_notify_sinks(const Config *config);
+void stop_notify_sinks(void);
+int notify_sink_add(int kind, const char *target);
+void notify_publish(const char *type, const PageBuffer *data);
+int notify_unix_deliver(NotifySink *sink, const PageBuffer *batch);
+int notify_webhook_deliver(NotifySink *sink, const PageBuffer *batch);
+DWORD WINAPI notify_thread(LPVOID param);
+
+// 警报规则
+int compile_alert_rule(const char *text, AlertRule *rule);
+void alert_state_init(AlertState *state);
+void alert_update_metrics(AlertState *state, const ElectricMeter *meter, long long now);
+int in_quiet_hours(const Config *config, int hour);
+int evaluate_alert_rules(const Config *config, AlertState *state, const ElectricMeter *meter, long long now, int hour, int *fired);
+void describe_alert_rule(const AlertRule *rule, double value, char *out, size_t out_size);
+
+// 后台渲染线程
+int start_render_thread(const Config *config);
+void stop_render_thread(void);
+int post_render_job(const ElectricMeter *meter, double threshold);
+void render_cycle(const Config *config, const ElectricMeter *meter, double threshold);
+DWORD WINAPI render_thread(LPVOID param);
+int start_render_pool(void);
+void stop_render_pool(void);
+DWORD WINAPI render_worker(LPVOID param);
+void run_render_batch(RenderBatch *batch);
+void render_batch_work(RenderBatch *batch, const RenderSnapshot *view);
+int run_render_task(const RenderBatch *batch, int task, const RenderSnapshot *view);
+
 // 新增HTML生成函数声明
-int read_database_records(const char *db_path, ElectricMeter **records, int *count);
-int read_alerts_records(const char *db_path, ElectricMeter **records, int *count);
-int generate_complete_html_pages(const char *web_path, const ElectricMeter *current_meter, double threshold);
-int generate_index_html(const char *web_path, const ElectricMeter *meter, double threshold);
-int generate_history_html(const char *web_path, ElectricMeter *records, int count, ElectricMeter *alerts, int alert_count);
-int generate_alerts_html(const char *web_path, ElectricMeter *alerts, int count);
+sqlite3 *render_connection(const char *db_path);
+void render_connection_close(void);
+int render_snapshot_open(RenderSnapshot *snapshot, const char *db_path);
+int render_snapshot_connect(const RenderSnapshot *snapshot, RenderSnapshot *view);
+void render_snapshot_close(RenderSnapshot *snapshot);
+int generate_index_html(const char *web_path, const ElectricMeter *meter, double threshold, const RenderSnapshot *snapshot);
+int generate_history_html(const char *web_path, const RenderSnapshot *snapshot);
+int generate_alerts_html(const char *web_path, const RenderSnapshot *snapshot);
+
+// JSON数据文件与静态外壳页面
+int generate_data_files(const char *web_path, const RenderSnapshot *snapshot, const ElectricMeter *meter, double threshold);
+int generate_dashboard_shell(const char *web_path);
+int generate_history_json_page(sqlite3 *db, const char *web_path, int page_number, int max_id);
+int generate_alerts_json(sqlite3 *db, const char *web_path, int max_alert_id);
+
+// 完整历史归档（批处理模式）
+int build_history_archive(const Config *config);
+DWORD WINAPI archive_worker(LPVOID param);
+void render_archive_month(ArchiveBuild *build, sqlite3_stmt *stmt, ArchiveMonth *month, PageBuffer *page, PageBuffer *compressed);
+void archive_page_begin(PageBuffer *page, const ArchiveMonth *month, int page_number);
+void archive_page_end(PageBuffer *page, const ArchiveMonth *month, int page_number);
+int render_archive_index(PageBuffer *page, const ArchiveBuild *build);
+int publish_archive_page(const ArchiveBuild *build, const char *name, const PageBuffer *page, PageBuffer *compressed, unsigned long long *hash_out, int *written);
+int compare_archive_entries(const void *a, const void *b);
+int load_archive_manifest(ArchiveBuild *build);
+int save_archive_manifest(const ArchiveBuild *build, const ArchiveEntry *index_entry);
+
+// 历史图表降采样
+void chart_series_reset(ChartSeries *series);
+ChartPoint chart_select_point(const ChartPoint *a, const ChartPoint *candidates, int count, double c_time, double c_value);
+int chart_bucket_end(const ChartSeries *series, long long width, int start);
+int chart_series_add(ChartSeries *series, long long width, long long time, double value);
+int chart_series_tail(const ChartSeries *series, long long width, ChartPoint *out);
+void chart_series_trim(ChartSeries *series, long long start);
+int update_chart_series(sqlite3 *db, int max_id);
+void render_chart_series(PageBuffer *buffer, const ChartRange *range, const ChartSeries *series);
+int render_chart_json(PageBuffer *buffer);
 
 // 新增精确计算函数声明
-double calculate_daily_consumption_from_db(const char *db_path);
-double calculate_weekly_consumption_from_db(const char *db_path);
+double calculate_daily_consumption_from_db(sqlite3 *db);
+double calculate_weekly_consumption_from_db(sqlite3 *db);
 
 /* 信号处理函数 */
 void signal_handler(int signal)
@@ -89,2064 +1708,8419 @@ void signal_handler(int signal)
     }
 }
 
-/* 日志函数 */
-void write_log(const char *level, const char *message)
+/* 日志级别名称转换为数值，未知级别按INFO处理 */
+int log_level_value(const char *level)
 {
-    FILE *log_file = fopen("monitor.log", "a");
-    if (log_file)
-    {
-        fprintf(log_file, "[%s] %s: %s\n", get_current_time(), level, message);
-        fclose(log_file);
-    }
-    printf("[%s] %s\n", level, message);
+    if (_stricmp(level, "DEBUG") == 0)
+        return LOG_LEVEL_DEBUG;
+    if (_stricmp(level, "WARN") == 0)
+        return LOG_LEVEL_WARN;
+    if (_stricmp(level, "ERROR") == 0)
+        return LOG_LEVEL_ERROR;
+    if (_stricmp(level, "ALERT") == 0)
+        return LOG_LEVEL_ALERT;
+    return LOG_LEVEL_INFO;
 }
 
-/* 设置控制台编码 */
-void set_console_utf8(void)
+/* 运行中调整日志级别，低于该级别的记录在调用方直接丢弃 */
+void log_set_level(int level)
 {
-    system("chcp 65001 > nul");
-    SetConsoleOutputCP(65001);
+    InterlockedExchange(&log_min_level, level);
 }
 
-/* 暂停程序 */
-void pause_program(void)
+/* 日志函数：日志线程运行时只把记录放进无锁环形缓冲区，由日志线程批量写文件和控制台 */
+void write_log(const char *level, const char *message)
 {
-    printf("\n按任意键退出程序...\n");
-    system("pause > nul");
-}
+    if (log_level_value(level) < log_min_level)
+        return;
 
-/* 获取当前时间字符串 */
-const char *get_current_time(void)
-{
-    static char time_str[50];
-    SYSTEMTIME st;
-    GetLocalTime(&st);
-    sprintf(time_str, "%04d-%02d-%02d %02d:%02d:%02d",
-            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
-    return time_str;
+    if (!log_thread_handle)
+    {
+        // 日志线程启动前和停止后直接写入
+        FILE *log_file = fopen(LOG_FILE_NAME, "a");
+        if (log_file)
+        {
+            fprintf(log_file, "[%s] %s: %s\n", get_current_time(), level, message);
+            fclose(log_file);
+        }
+        printf("[%s] %s\n", level, message);
+        return;
+    }
+
+    // 有界多生产者队列：槽位的sequence等于写入位置时可写，等于位置+1时可读
+    LogRecord *record;
+    LONG position = InterlockedCompareExchange(&log_ring_tail, 0, 0);
+    for (;;)
+    {
+        record = &log_ring[position & (LOG_RING_SLOTS - 1)];
+        LONG diff = record->sequence - position;
+        if (diff == 0)
+        {
+            LONG seen = InterlockedCompareExchange(&log_ring_tail, position + 1, position);
+            if (seen == position)
+                break;
+            position = seen;
+        }
+        else if (diff < 0)
+        {
+            InterlockedIncrement(&log_dropped); // 缓冲区已满
+            return;
+        }
+        else
+        {
+            position = InterlockedCompareExchange(&log_ring_tail, 0, 0);
+        }
+    }
+
+    format_time(record->time, sizeof(record->time));
+    snprintf(record->level, sizeof(record->level), "%s", level);
+    size_t length = strlen(message);
+    if (length < sizeof(record->message))
+    {
+        memcpy(record->message, message, length + 1);
+    }
+    else
+    {
+        // 超长消息截断并以"…"结尾，截断点退到UTF-8字符边界，避免半个汉字
+        size_t keep = sizeof(record->message) - sizeof("…");
+        while (keep > 0 && ((unsigned char)message[keep] & 0xC0) == 0x80)
+            keep--;
+        memcpy(record->message, message, keep);
+        memcpy(record->message + keep, "…", sizeof("…"));
+    }
+    InterlockedExchange(&record->sequence, position + 1);
+
+    // 错误和警报尽快落盘；缓冲区过半时提前唤醒，其余等定时刷新。
+    // log_ring_head由日志线程推进，用带屏障的读取，避免生产者看到过时的值而漏掉唤醒
+    LONG head = InterlockedCompareExchange(&log_ring_head, 0, 0);
+    if (log_level_value(level) >= LOG_LEVEL_ERROR || position - head >= LOG_RING_SLOTS / 2)
+        SetEvent(log_wakeup);
 }
 
-/* 创建目录 */
-void create_directory(const char *dirname)
+/* 打开日志文件（追加），记录当前大小用于按大小轮转 */
+void log_open_file(void)
 {
-    CreateDirectoryA(dirname, NULL);
+    log_file = fopen(LOG_FILE_NAME, "a");
+    log_file_size = 0;
+    if (log_file)
+    {
+        fseek(log_file, 0, SEEK_END);
+        log_file_size = ftell(log_file);
+    }
 }
 
-/* 验证配置 */
-int validate_config(const Config *config)
+/* 日志文件超过上限时轮转：monitor.log -> monitor.log.1 -> ... -> monitor.log.N */
+void log_rotate(void)
 {
-    if (config->monitorInterval <= 0)
+    char from[64], to[64];
+    fclose(log_file);
+    for (int i = LOG_ROTATE_KEEP - 1; i >= 1; i--)
     {
-        printf("错误: 监控间隔必须大于0\n");
-        return 0;
+        snprintf(from, sizeof(from), "%s.%d", LOG_FILE_NAME, i);
+        snprintf(to, sizeof(to), "%s.%d", LOG_FILE_NAME, i + 1);
+        MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
     }
-    if (config->lowEnergyThreshold <= 0)
+    snprintf(to, sizeof(to), "%s.1", LOG_FILE_NAME);
+    MoveFileExA(LOG_FILE_NAME, to, MOVEFILE_REPLACE_EXISTING);
+    log_open_file();
+}
+
+/* 取出环形缓冲区中所有已写好的记录，分别格式化为文件行和控制台行 */
+void log_drain(PageBuffer *file_lines, PageBuffer *console_lines)
+{
+    for (;;)
     {
-        printf("错误: 低电量阈值必须大于0\n");
-        return 0;
+        LogRecord *record = &log_ring[log_ring_head & (LOG_RING_SLOTS - 1)];
+        if (record->sequence != log_ring_head + 1)
+            break;
+        page_buffer_printf(file_lines, "[%s] %s: %s\n", record->time, record->level, record->message);
+        page_buffer_printf(console_lines, "[%s] %s\n", record->level, record->message);
+        InterlockedExchange(&record->sequence, log_ring_head + LOG_RING_SLOTS);
+        log_ring_head++;
     }
-    if (strlen(config->curlCommand) == 0)
+
+    LONG dropped = InterlockedExchange(&log_dropped, 0);
+    if (dropped > 0)
     {
-        printf("错误: CURL命令不能为空\n");
-        return 0;
+        char time_str[32];
+        format_time(time_str, sizeof(time_str));
+        InterlockedExchangeAdd(&log_dropped_total, dropped);
+        page_buffer_printf(file_lines, "[%s] WARN: 日志缓冲区已满，丢弃 %ld 条记录（累计 %ld 条）\n",
+                           time_str, (long)dropped, (long)log_dropped_total);
+        page_buffer_printf(console_lines, "[WARN] 日志缓冲区已满，丢弃 %ld 条记录\n", (long)dropped);
     }
-    if (strlen(config->dbPath) == 0)
+
+    dropped = InterlockedExchange(&event_dropped, 0);
+    if (dropped > 0)
     {
-        printf("错误: 数据库路径不能为空\n");
-        return 0;
+        char time_str[32];
+        format_time(time_str, sizeof(time_str));
+        page_buffer_printf(file_lines, "[%s] WARN: 事件缓冲区已满，丢弃 %ld 个事件\n", time_str, (long)dropped);
+        page_buffer_printf(console_lines, "[WARN] 事件缓冲区已满，丢弃 %ld 个事件\n", (long)dropped);
     }
-    return 1;
 }
 
-/* 读取配置文件 */
-int read_config(const char *filename, Config *config)
+/* 把取出的记录写入日志文件和控制台，文件超过上限时轮转 */
+void log_write_lines(const PageBuffer *file_lines, const PageBuffer *console_lines)
 {
-    FILE *file = fopen(filename, "r");
-    if (!file)
+    if (file_lines->length == 0)
+        return;
+
+    if (!log_file)
+        log_open_file();
+    if (log_file)
     {
-        printf("无法打开配置文件: %s\n", filename);
-        return 0;
+        fwrite(file_lines->data, 1, file_lines->length, log_file);
+        fflush(log_file);
+        log_file_size += (long)file_lines->length;
+        if (log_max_size > 0 && log_file_size >= log_max_size)
+            log_rotate();
     }
+    fwrite(console_lines->data, 1, console_lines->length, stdout);
+    fflush(stdout);
+}
 
-    char line[CONFIG_SIZE];
-    int found_interval = 0;
-    int found_threshold = 0;
-    int found_curl = 0;
-
-    // 设置默认值
-    strcpy(config->dbPath, "electric_data.db");
-    strcpy(config->smtpServer, "smtp.qq.com");
-    config->smtpPort = 587;
-    strcpy(config->emailAccount, "");
-    strcpy(config->emailAuthCode, "");
-    strcpy(config->emailReceivers, "");
-    strcpy(config->webPath, "web");
-
-    while (fgets(line, sizeof(line), file))
+/* 日志线程：定时或被唤醒时把缓冲区中的记录一次性写入保持打开的日志文件 */
+DWORD WINAPI log_thread(LPVOID param)
+{
+    (void)param;
+    PageBuffer file_lines, console_lines, events, spans;
+    page_buffer_init(&file_lines);
+    page_buffer_init(&console_lines);
+    page_buffer_init(&events);
+    page_buffer_init(&spans);
+
+    while (1)
     {
-        line[strcspn(line, "\r\n")] = 0;
-
-        if (line[0] == '\0' || line[0] == '#')
-            continue;
+        int stopping = log_stopping;
+        file_lines.length = 0;
+        console_lines.length = 0;
+        log_drain(&file_lines, &console_lines);
 
-        if (strstr(line, "MONITOR_INTERVAL") != NULL)
-        {
-            if (sscanf(line, "MONITOR_INTERVAL=%d", &config->monitorInterval) == 1)
-            {
-                found_interval = 1;
-            }
-        }
-        else if (strstr(line, "LOW_ENERGY_THRESHOLD") != NULL)
-        {
-            if (sscanf(line, "LOW_ENERGY_THRESHOLD=%lf", &config->lowEnergyThreshold) == 1)
-            {
-                found_threshold = 1;
-            }
-        }
-        else if (strstr(line, "CURL_COMMAND") != NULL)
-        {
-            char *equals = strchr(line, '=');
-            if (equals)
-            {
-                strcpy(config->curlCommand, equals + 1);
-                found_curl = 1;
-            }
-        }
-        else if (strstr(line, "DATABASE_PATH") != NULL)
+        if (event_file)
         {
-            char *equals = strchr(line, '=');
-            if (equals)
+            events.length = 0;
+            event_drain(&events);
+            if (events.length > 0)
             {
-                strcpy(config->dbPath, equals + 1);
+                fwrite(events.data, 1, events.length, event_file);
+                fflush(event_file);
             }
         }
-        else if (strstr(line, "SMTP_SERVER") != NULL)
+
+        if (trace_file)
         {
-            char *equals = strchr(line, '=');
-            if (equals)
+            spans.length = 0;
+            trace_drain(&spans);
+            if (spans.length > 0)
             {
-                strcpy(config->smtpServer, equals + 1);
+                fwrite(spans.data, 1, spans.length, trace_file);
+                fflush(trace_file);
             }
         }
-        else if (strstr(line, "SMTP_PORT") != NULL)
+
+        log_write_lines(&file_lines, &console_lines);
+
+        if (stopping)
+            break;
+        WaitForSingleObject(log_wakeup, LOG_FLUSH_INTERVAL_MS);
+    }
+
+    page_buffer_free(&file_lines);
+    page_buffer_free(&console_lines);
+    page_buffer_free(&events);
+    page_buffer_free(&spans);
+    return 0;
+}
+
+/* 启动日志线程，按配置设置日志级别和轮转大小 */
+int start_logger(const Config *config)
+{
+    log_set_level(config->logLevel);
+    log_max_size = (long)config->logMaxSize * 1024 * 1024;
+
+    for (LONG i = 0; i < LOG_RING_SLOTS; i++)
+        log_ring[i].sequence = i;
+    log_ring_tail = 0;
+    log_ring_head = 0;
+    log_open_file();
+
+    if (config->eventLogPath[0] && !start_event_log(config->eventLogPath))
+        printf("⚠️ 无法打开事件日志: %s\n", config->eventLogPath);
+    if (config->traceFile[0] && !start_trace(config->traceFile))
+        printf("⚠️ 无法打开追踪文件: %s\n", config->traceFile);
+
+    log_stopping = 0;
+    log_wakeup = CreateEventA(NULL, FALSE, FALSE, NULL);
+    log_thread_handle = log_wakeup ? CreateThread(NULL, 0, log_thread, NULL, 0, NULL) : NULL;
+    if (!log_thread_handle)
+    {
+        if (log_wakeup)
+            CloseHandle(log_wakeup);
+        log_wakeup = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* 停止日志线程：写出剩余记录并关闭日志文件，之后的日志直接写入。
+   程序退出时通过shutdown_threads调用，保证写日志的后台线程都已经停止 */
+void stop_logger(void)
+{
+    if (!log_thread_handle)
+        return;
+
+    HANDLE thread = log_thread_handle;
+    InterlockedExchange(&event_log_enabled, 0);
+    InterlockedExchange(&trace_enabled, 0);
+    InterlockedExchange(&log_stopping, 1);
+    SetEvent(log_wakeup);
+    WaitForSingleObject(thread, INFINITE);
+    // 先让后续日志改走直接写入，再关闭文件
+    log_thread_handle = NULL;
+    CloseHandle(thread);
+    CloseHandle(log_wakeup);
+    log_wakeup = NULL;
+
+    // 日志线程最后一次取出之后、句柄清空之前写入的记录还留在缓冲区里，在调用方线程补写；
+    // 已占用槽位但还没写完的记录要等对应的生产者写完
+    PageBuffer file_lines, console_lines;
+    page_buffer_init(&file_lines);
+    page_buffer_init(&console_lines);
+    LONG tail;
+    do
+    {
+        log_drain(&file_lines, &console_lines);
+        tail = InterlockedCompareExchange(&log_ring_tail, 0, 0);
+        if (log_ring_head != tail)
+            Sleep(0);
+    } while (log_ring_head != tail);
+    log_write_lines(&file_lines, &console_lines);
+    page_buffer_free(&file_lines);
+    page_buffer_free(&console_lines);
+
+    if (log_file)
+        fclose(log_file);
+    log_file = NULL;
+    event_flush();
+    finish_trace();
+}
+/* 记录一个二进制事件：只取计数器时间并把整型参数拷进环形缓冲区，格式化推迟到解码时 */
+void log_event(int id, long long a, long long b, long long c)
+{
+    if (!event_log_enabled)
+        return;
+
+    EventSlot *slot;
+    LONG position = event_ring_tail;
+    for (;;)
+    {
+        slot = &event_ring[position & (EVENT_RING_SLOTS - 1)];
+        LONG diff = slot->sequence - position;
+        if (diff == 0)
         {
-            char *equals = strchr(line, '=');
-            if (equals)
-            {
-                config->smtpPort = atoi(equals + 1);
-            }
+            LONG seen = InterlockedCompareExchange(&event_ring_tail, position + 1, position);
+            if (seen == position)
+                break;
+            position = seen;
         }
-        else if (strstr(line, "EMAIL_ACCOUNT") != NULL)
+        else if (diff < 0)
         {
-            char *equals = strchr(line, '=');
-            if (equals)
-            {
-                strcpy(config->emailAccount, equals + 1);
-            }
+            InterlockedIncrement(&event_dropped);
+            return;
         }
-        else if (strstr(line, "EMAIL_AUTH_CODE") != NULL)
+        else
         {
-            char *equals = strchr(line, '=');
-            if (equals)
-            {
-                strcpy(config->emailAuthCode, equals + 1);
-            }
-        }
-        else if (strstr(line, "EMAIL_RECEIVERS") != NULL)
-        {
-            char *equals = strchr(line, '=');
-            if (equals)
-            {
-                strcpy(config->emailReceivers, equals + 1);
-            }
-        }
-        else if (strstr(line, "WEB_PATH") != NULL)
-        {
-            char *equals = strchr(line, '=');
-            if (equals)
-            {
-                strcpy(config->webPath, equals + 1);
-            }
+            position = event_ring_tail;
         }
     }
 
-    fclose(file);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    slot->record.time = (unsigned long long)counter.QuadPart;
+    slot->record.id = (unsigned short)id;
+    slot->record.thread = (unsigned short)GetCurrentThreadId();
+    slot->record.reserved = 0;
+    slot->record.args[0] = a;
+    slot->record.args[1] = b;
+    slot->record.args[2] = c;
+    InterlockedExchange(&slot->sequence, position + 1);
+}
 
-    if (!found_interval || !found_threshold || !found_curl)
+/* double参数按位存进事件的整型参数槽 */
+long long event_double(double value)
+{
+    long long bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/* 取出环形缓冲区中所有已写好的事件，追加到batch */
+void event_drain(PageBuffer *batch)
+{
+    for (;;)
     {
-        printf("配置文件缺少必要参数\n");
-        printf("需要: MONITOR_INTERVAL, LOW_ENERGY_THRESHOLD, CURL_COMMAND\n");
-        return 0;
+        EventSlot *slot = &event_ring[event_ring_head & (EVENT_RING_SLOTS - 1)];
+        if (slot->sequence != event_ring_head + 1)
+            break;
+        page_buffer_append(batch, (const char *)&slot->record, sizeof(EventRecord));
+        InterlockedExchange(&slot->sequence, event_ring_head + EVENT_RING_SLOTS);
+        event_ring_head++;
     }
+}
 
-    if (!validate_config(config))
+/* 停止日志线程后补写事件缓冲区中剩余的事件并关闭事件日志：
+   日志线程最后一次取出之后才写完的事件同样要等对应的生产者写完 */
+void event_flush(void)
+{
+    if (!event_file)
+        return;
+
+    PageBuffer events;
+    page_buffer_init(&events);
+    LONG tail;
+    do
     {
-        return 0;
-    }
+        event_drain(&events);
+        tail = InterlockedCompareExchange(&event_ring_tail, 0, 0);
+        if (event_ring_head != tail)
+            Sleep(0);
+    } while (event_ring_head != tail);
+    if (events.length > 0)
+        fwrite(events.data, 1, events.length, event_file);
+    page_buffer_free(&events);
+
+    fclose(event_file);
+    event_file = NULL;
+}
 
-    return 1;
+/* 填写当前版本的事件日志文件头 */
+void event_log_header(EventLogHeader *header)
+{
+    memset(header, 0, sizeof(EventLogHeader));
+    memcpy(header->magic, EVENT_LOG_MAGIC, sizeof(header->magic));
+    header->version = EVENT_LOG_VERSION;
+    header->recordSize = sizeof(EventRecord);
 }
 
-/* 初始化数据库 */
-int init_database(const char *db_path)
+/* 打开二进制事件日志并写入会话事件（计数器频率、基准计数和对应的Unix毫秒时间）。
+   新文件先写文件头；已有文件的文件头与当前版本不同时不追加，避免一个文件里混有两种布局 */
+int start_event_log(const char *path)
 {
-    sqlite3 *db;
-    char *err_msg = 0;
-    int rc;
+    event_file = fopen(path, "a+b");
+    if (!event_file)
+        return 0;
 
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK)
+    EventLogHeader expected, existing;
+    event_log_header(&expected);
+    fseek(event_file, 0, SEEK_END);
+    if (ftell(event_file) == 0)
     {
-        printf("数据库打开失败: %s\n", sqlite3_errmsg(db));
-        return 0;
+        fwrite(&expected, sizeof(expected), 1, event_file);
+        fflush(event_file);
     }
-
-    const char *sql = "CREATE TABLE IF NOT EXISTS electric_data ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                      "record_time DATETIME DEFAULT CURRENT_TIMESTAMP,"
-                      "remaining_energy REAL NOT NULL,"
-                      "remaining_amount REAL NOT NULL,"
-                      "total_consumption REAL NOT NULL,"
-                      "price REAL NOT NULL,"
-                      "meter_status TEXT,"
-                      "meter_update_time TEXT,"
-                      "system_time TEXT);";
-
-    rc = sqlite3_exec(db, sql, 0, 0, &err_msg);
-    if (rc != SQLITE_OK)
+    else
     {
-        printf("创建表失败: %s\n", err_msg);
-        sqlite3_free(err_msg);
-        sqlite3_close(db);
-        return 0;
+        fseek(event_file, 0, SEEK_SET);
+        if (fread(&existing, sizeof(existing), 1, event_file) != 1 ||
+            memcmp(&existing, &expected, sizeof(expected)) != 0)
+        {
+            char log_msg[320];
+            snprintf(log_msg, sizeof(log_msg), "事件日志 %s 不是当前版本（%d）的格式，请换一个文件名", path, EVENT_LOG_VERSION);
+            write_log("ERROR", log_msg);
+            fclose(event_file);
+            event_file = NULL;
+            return 0;
+        }
+        fseek(event_file, 0, SEEK_END);
     }
 
-    const char *sql2 = "CREATE TABLE IF NOT EXISTS low_energy_alerts ("
-                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                       "alert_time DATETIME DEFAULT CURRENT_TIMESTAMP,"
-                       "remaining_energy REAL NOT NULL,"
-                       "threshold REAL NOT NULL,"
-                       "alert_message TEXT,"
-                       "meter_update_time TEXT);";
+    for (LONG i = 0; i < EVENT_RING_SLOTS; i++)
+        event_ring[i].sequence = i;
+    event_ring_tail = 0;
+    event_ring_head = 0;
 
-    rc = sqlite3_exec(db, sql2, 0, 0, &err_msg);
-    if (rc != SQLITE_OK)
-    {
-        printf("创建警报表失败: %s\n", err_msg);
-        sqlite3_free(err_msg);
-        sqlite3_close(db);
-        return 0;
-    }
+    LARGE_INTEGER frequency, counter;
+    FILETIME now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    GetSystemTimeAsFileTime(&now);
+    long long unix_ms = (long long)((((unsigned long long)now.dwHighDateTime << 32) | now.dwLowDateTime) / 10000ULL) - 11644473600000LL;
 
-    sqlite3_close(db);
-    printf("数据库初始化成功: %s\n", db_path);
+    event_log_enabled = 1;
+    log_event(EVENT_SESSION, frequency.QuadPart, counter.QuadPart, unix_ms);
     return 1;
 }
 
-/* 保存电表数据到数据库 */
-int save_to_database(const char *db_path, const ElectricMeter *meter)
+/* 按{}占位符把事件参数格式化成文字说明 */
+void format_event_text(PageBuffer *out, const EventType *type, const EventRecord *record)
 {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    int rc;
-
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK)
+    int arg = 0;
+    for (const char *p = type->text; *p; p++)
     {
-        write_log("ERROR", "无法打开数据库");
-        return 0;
+        if (p[0] == '{' && p[1] == '}' && type->types[arg])
+        {
+            double value;
+            memcpy(&value, &record->args[arg], sizeof(value));
+            if (type->types[arg] == 'd')
+                page_buffer_printf(out, "%.2f", value);
+            else
+                page_buffer_printf(out, "%lld", record->args[arg]);
+            arg++;
+            p++;
+        }
+        else
+        {
+            page_buffer_append(out, p, 1);
+        }
     }
+}
 
-    const char *sql = "INSERT INTO electric_data (remaining_energy, remaining_amount, total_consumption, price, meter_status, meter_update_time, system_time) "
-                      "VALUES (?, ?, ?, ?, ?, ?, ?);";
-
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK)
+/* 解码二进制事件日志，按文本行或JSON行输出到标准输出 */
+int decode_event_log(const char *path, int json)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
     {
-        sqlite3_close(db);
-        write_log("ERROR", "准备SQL语句失败");
+        printf("无法打开事件日志: %s\n", path);
         return 0;
     }
 
-    sqlite3_bind_double(stmt, 1, meter->remainingEnergy);
-    sqlite3_bind_double(stmt, 2, meter->remainingAmount);
-    sqlite3_bind_double(stmt, 3, meter->totalConsumption);
-    sqlite3_bind_double(stmt, 4, meter->price);
-    sqlite3_bind_text(stmt, 5, meter->meterStatus, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 6, meter->meterUpdateTime, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 7, meter->systemTime, -1, SQLITE_STATIC);
-
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE)
+    EventLogHeader header, expected;
+    event_log_header(&expected);
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
     {
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        write_log("ERROR", "执行SQL语句失败");
+        printf("不是事件日志文件: %s\n", path);
+        fclose(file);
         return 0;
     }
-
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    write_log("INFO", "电表数据保存到数据库成功");
-    return 1;
-}
-
-/* 保存低电量警报到数据库 */
-int save_alert_to_database(const char *db_path, const ElectricMeter *meter, double threshold)
-{
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    int rc;
-
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK)
+    if (header.version != expected.version || header.recordSize != expected.recordSize)
     {
-        write_log("ERROR", "无法打开数据库保存警报");
+        printf("事件日志版本 %u（记录 %u 字节）与本程序支持的版本 %u（记录 %u 字节）不同: %s\n",
+               header.version, header.recordSize, expected.version, expected.recordSize, path);
+        fclose(file);
         return 0;
     }
 
-    char alert_msg[256];
-    snprintf(alert_msg, sizeof(alert_msg), "低电量警报: 剩余%.2f度电", meter->remainingEnergy);
+    static EventRecord records[4096];
+    static char output[1 << 20];
+    setvbuf(stdout, output, _IOFBF, sizeof(output));
 
-    const char *sql = "INSERT INTO low_energy_alerts (remaining_energy, threshold, alert_message, meter_update_time) VALUES (?, ?, ?, ?);";
+    PageBuffer line;
+    page_buffer_init(&line);
+    double frequency = 0;
+    long long base_counter = 0, base_ms = 0;
+    long long cached_second = -1;
+    char second_text[32] = "";
+    size_t count;
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK)
+    while ((count = fread(records, sizeof(EventRecord), sizeof(records) / sizeof(records[0]), file)) > 0)
     {
-        sqlite3_close(db);
-        write_log("ERROR", "准备警报SQL语句失败");
-        return 0;
-    }
+        for (size_t i = 0; i < count; i++)
+        {
+            const EventRecord *record = &records[i];
+            if (record->id >= EVENT_TYPE_COUNT)
+                continue;
+            const EventType *type = &event_types[record->id];
+            if (record->id == EVENT_SESSION)
+            {
+                frequency = (double)record->args[0];
+                base_counter = record->args[1];
+                base_ms = record->args[2];
+            }
 
-    sqlite3_bind_double(stmt, 1, meter->remainingEnergy);
-    sqlite3_bind_double(stmt, 2, threshold);
-    sqlite3_bind_text(stmt, 3, alert_msg, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, meter->meterUpdateTime, -1, SQLITE_STATIC);
+            long long ms = frequency > 0
+                ? base_ms + (long long)((double)((long long)record->time - base_counter) * 1000.0 / frequency)
+                : 0;
+            // 同一秒内的事件复用格式化好的日期时间
+            if (ms / 1000 != cached_second)
+            {
+                cached_second = ms / 1000;
+                time_t seconds = (time_t)cached_second;
+                struct tm local;
+                if (localtime_s(&local, &seconds) == 0)
+                    strftime(second_text, sizeof(second_text), "%Y-%m-%d %H:%M:%S", &local);
+            }
 
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE)
-    {
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        write_log("ERROR", "执行警报SQL语句失败");
-        return 0;
+            line.length = 0;
+            if (json)
+            {
+                page_buffer_printf(&line, "{\"time\":\"%s.%03d\",\"ms\":%lld,\"event\":\"%s\",\"thread\":%u",
+                                   second_text, (int)(ms % 1000), ms, type->name, (unsigned)record->thread);
+                for (int arg = 0; type->types[arg]; arg++)
+                {
+                    double value;
+                    memcpy(&value, &record->args[arg], sizeof(value));
+                    if (type->types[arg] == 'd' && !isfinite(value))
+                        page_buffer_printf(&line, ",\"%s\":null", type->fields[arg]); // JSON没有NaN和无穷大
+                    else if (type->types[arg] == 'd')
+                        page_buffer_printf(&line, ",\"%s\":%.4f", type->fields[arg], value);
+                    else
+                        page_buffer_printf(&line, ",\"%s\":%lld", type->fields[arg], record->args[arg]);
+                }
+                page_buffer_printf(&line, "}\n");
+            }
+            else
+            {
+                page_buffer_printf(&line, "[%s.%03d] %s: ", second_text, (int)(ms % 1000), type->name);
+                format_event_text(&line, type, record);
+                page_buffer_append(&line, "\n", 1);
+            }
+            fwrite(line.data, 1, line.length, stdout);
+        }
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    write_log("ALERT", "低电量警报保存到数据库");
+    fflush(stdout);
+    page_buffer_free(&line);
+    fclose(file);
     return 1;
 }
 
-/* 从curl命令中提取URL和参数 */
-void parse_curl_command(const char *curl_cmd, char *url, char *post_data, char *headers)
+/* 启动时读取一次计数器频率，之后各处按metric_frequency把计数差换算成时间 */
+void metric_init(void)
 {
-    url[0] = '\0';
-    post_data[0] = '\0';
-    headers[0] = '\0';
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    metric_frequency = frequency.QuadPart;
+}
 
-    const char *url_start = strstr(curl_cmd, "\"http");
-    if (!url_start)
-        return;
+/* 读取高精度计数器，作为阶段耗时的起点 */
+ULONGLONG metric_clock(void)
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (ULONGLONG)counter.QuadPart;
+}
 
-    const char *url_end = strchr(url_start + 1, '\"');
-    if (!url_end)
-        return;
+/* 把微秒耗时映射到直方图桶：16微秒以下逐微秒一格，之后每个2的幂区间再均分16格 */
+int metric_bucket_index(unsigned long long value)
+{
+    if (value < (1ULL << METRIC_SUB_BITS))
+        return (int)value;
+    int msb = 63;
+    while (!(value >> msb))
+        msb--;
+    int shift = msb - METRIC_SUB_BITS;
+    int index = (shift + 1) * (1 << METRIC_SUB_BITS) + (int)((value >> shift) & ((1 << METRIC_SUB_BITS) - 1));
+    return index < METRIC_BUCKETS ? index : METRIC_BUCKETS - 1;
+}
 
-    int url_len = url_end - url_start - 1;
-    strncpy(url, url_start + 1, url_len);
-    url[url_len] = '\0';
+/* 直方图桶的上界（微秒，不含） */
+unsigned long long metric_bucket_upper(int index)
+{
+    if (index < (1 << METRIC_SUB_BITS))
+        return (unsigned long long)index + 1;
+    int shift = index / (1 << METRIC_SUB_BITS) - 1;
+    unsigned long long sub = (unsigned long long)(index % (1 << METRIC_SUB_BITS));
+    return (((1ULL << METRIC_SUB_BITS) + sub + 1) << shift);
+}
 
-    const char *data_start = strstr(curl_cmd, "--data-raw");
-    if (data_start)
+/* 取本线程的指标分片，第一次使用时分配并登记；登记满后改用需要原子操作的共享分片 */
+MetricShard *metric_local_shard(void)
+{
+    if (metric_shard)
+        return metric_shard;
+
+    MetricShard *shard = calloc(1, sizeof(MetricShard));
+    LONG slot = shard ? InterlockedIncrement(&metric_shard_count) - 1 : METRIC_MAX_THREADS;
+    if (slot < METRIC_MAX_THREADS)
     {
-        data_start = strchr(data_start, '\"');
-        if (data_start)
-        {
-            const char *data_end = strchr(data_start + 1, '\"');
-            if (data_end)
-            {
-                int data_len = data_end - data_start - 1;
-                strncpy(post_data, data_start + 1, data_len);
-                post_data[data_len] = '\0';
-            }
-        }
+        metric_shards[slot] = shard;
+    }
+    else
+    {
+        free(shard);
+        shard = &metric_overflow;
     }
+    metric_shard = shard;
+    return shard;
 }
 
-/* 使用WinINet发送HTTP请求 */
-int http_post_request(const char *url, const char *post_data, const char *headers, char *response, int response_size)
+/* 记录一个阶段从started到现在的耗时 */
+void metric_observe(int stage, ULONGLONG started)
 {
-    HINTERNET hInternet = NULL;
-    HINTERNET hConnect = NULL;
-    HINTERNET hRequest = NULL;
-
-    int result = 0;
-    DWORD bytesRead;
-    DWORD totalBytesRead = 0;
-    char buffer[1024];
+    LONG64 elapsed = (LONG64)((metric_clock() - started) * 1000000ULL / (ULONGLONG)metric_frequency);
+    int index = metric_bucket_index((unsigned long long)elapsed);
+    MetricShard *shard = metric_local_shard();
 
-    hInternet = InternetOpenA("ElectricMonitor", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
-    if (!hInternet)
+    if (shard == &metric_overflow)
     {
-        write_log("ERROR", "InternetOpenA 失败");
-        return 0;
+        InterlockedIncrement64(&shard->counts[stage][index]);
+        InterlockedExchangeAdd64(&shard->sum[stage], elapsed);
+        LONG64 seen = shard->max[stage];
+        while (elapsed > seen)
+        {
+            LONG64 previous = InterlockedCompareExchange64(&shard->max[stage], elapsed, seen);
+            if (previous == seen)
+                break;
+            seen = previous;
+        }
+        return;
     }
 
-    URL_COMPONENTSA urlComp;
-    memset(&urlComp, 0, sizeof(urlComp));
-    urlComp.dwStructSize = sizeof(urlComp);
+    // 分片只由本线程写入，普通的对齐64位读写即可，导出线程读到的是某一时刻的值
+    shard->counts[stage][index] = shard->counts[stage][index] + 1;
+    shard->sum[stage] = shard->sum[stage] + elapsed;
+    if (elapsed > shard->max[stage])
+        shard->max[stage] = elapsed;
+}
 
-    char host[256] = {0};
-    char path[1024] = {0};
-    urlComp.lpszHostName = host;
-    urlComp.dwHostNameLength = sizeof(host);
-    urlComp.lpszUrlPath = path;
-    urlComp.dwUrlPathLength = sizeof(path);
+/* 计数器加n */
+void metric_add(int counter, LONG64 n)
+{
+    MetricShard *shard = metric_local_shard();
+    if (shard == &metric_overflow)
+        InterlockedExchangeAdd64(&shard->counters[counter], n);
+    else
+        shard->counters[counter] = shard->counters[counter] + n;
+}
 
-    if (!InternetCrackUrlA(url, (DWORD)strlen(url), 0, &urlComp))
+/* 汇总所有分片，按Prometheus文本格式输出 */
+int render_metrics(PageBuffer *out)
+{
+    static const char *stage_names[METRIC_STAGE_COUNT] = {"cycle", "http_request", "parse_json", "save_database", "render_pages", "send_email"};
+    static const char *counter_names[METRIC_COUNTER_COUNT] = {
+        "electric_monitor_fetch_attempts_total", "electric_monitor_fetch_retries_total",
+        "electric_monitor_fetch_failures_total", "electric_monitor_alerts_total",
+        "electric_monitor_emails_sent_total", "electric_monitor_emails_failed_total"};
+    static const char *counter_help[METRIC_COUNTER_COUNT] = {
+        "获取电表数据的尝试次数", "获取失败后的重试次数", "所有重试均失败的轮询次数",
+        "触发的警报提醒次数", "发件箱成功投递的邮件数", "发件箱投递失败的次数"};
+    static const double bounds[] = {0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300, 600};
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+    const int bound_count = (int)(sizeof(bounds) / sizeof(bounds[0]));
+
+    LONG shard_count = metric_shard_count < METRIC_MAX_THREADS ? metric_shard_count : METRIC_MAX_THREADS;
+    MetricShard *shards[METRIC_MAX_THREADS + 1];
+    int used = 0;
+    for (LONG i = 0; i < shard_count; i++)
     {
-        write_log("ERROR", "InternetCrackUrlA 失败");
-        InternetCloseHandle(hInternet);
-        return 0;
+        if (metric_shards[i])
+            shards[used++] = metric_shards[i];
     }
+    shards[used++] = &metric_overflow;
 
-    hConnect = InternetConnectA(hInternet, host, urlComp.nPort, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
-    if (!hConnect)
+    // 先把各分片汇总到本地，直方图和分位数两部分都从汇总结果输出
+    LONG64 counts[METRIC_STAGE_COUNT][METRIC_BUCKETS];
+    LONG64 totals[METRIC_STAGE_COUNT] = {0}, sums[METRIC_STAGE_COUNT] = {0}, maxes[METRIC_STAGE_COUNT] = {0};
+    memset(counts, 0, sizeof(counts));
+    for (int stage = 0; stage < METRIC_STAGE_COUNT; stage++)
     {
-        write_log("ERROR", "InternetConnectA 失败");
-        InternetCloseHandle(hInternet);
-        return 0;
+        for (int s = 0; s < used; s++)
+        {
+            for (int b = 0; b < METRIC_BUCKETS; b++)
+                counts[stage][b] += shards[s]->counts[stage][b];
+            sums[stage] += shards[s]->sum[stage];
+            if (shards[s]->max[stage] > maxes[stage])
+                maxes[stage] = shards[s]->max[stage];
+        }
+        for (int b = 0; b < METRIC_BUCKETS; b++)
+            totals[stage] += counts[stage][b];
     }
 
-    DWORD flags = INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE;
-    if (urlComp.nPort == 443)
+    page_buffer_printf(out, "# HELP electric_monitor_stage_duration_seconds 各处理阶段耗时\n"
+                            "# TYPE electric_monitor_stage_duration_seconds histogram\n");
+    for (int stage = 0; stage < METRIC_STAGE_COUNT; stage++)
     {
-        flags |= INTERNET_FLAG_SECURE;
+        // 桶上界不超过le的计数累加到该le
+        LONG64 cumulative = 0;
+        int bucket = 0;
+        for (int i = 0; i < bound_count; i++)
+        {
+            unsigned long long limit = (unsigned long long)(bounds[i] * 1000000.0);
+            while (bucket < METRIC_BUCKETS && metric_bucket_upper(bucket) <= limit)
+                cumulative += counts[stage][bucket++];
+            page_buffer_printf(out, "electric_monitor_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %lld\n",
+                               stage_names[stage], bounds[i], (long long)cumulative);
+        }
+        page_buffer_printf(out,
+                           "electric_monitor_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lld\n"
+                           "electric_monitor_stage_duration_seconds_sum{stage=\"%s\"} %.6f\n"
+                           "electric_monitor_stage_duration_seconds_count{stage=\"%s\"} %lld\n",
+                           stage_names[stage], (long long)totals[stage],
+                           stage_names[stage], sums[stage] / 1000000.0,
+                           stage_names[stage], (long long)totals[stage]);
     }
 
-    hRequest = HttpOpenRequestA(hConnect, "POST", path, NULL, NULL, NULL, flags, 0);
-    if (!hRequest)
+    // 分位数按细粒度桶计算，相对误差约6%
+    page_buffer_printf(out, "# HELP electric_monitor_stage_duration_quantile_seconds 各处理阶段耗时分位数\n"
+                            "# TYPE electric_monitor_stage_duration_quantile_seconds gauge\n");
+    for (int stage = 0; stage < METRIC_STAGE_COUNT; stage++)
     {
-        write_log("ERROR", "HttpOpenRequestA 失败");
-        InternetCloseHandle(hConnect);
-        InternetCloseHandle(hInternet);
-        return 0;
+        if (totals[stage] == 0)
+            continue;
+        double max = maxes[stage] / 1000000.0;
+        for (int q = 0; q < (int)(sizeof(quantiles) / sizeof(quantiles[0])); q++)
+        {
+            LONG64 rank = (LONG64)ceil(quantiles[q] * totals[stage]), seen = 0;
+            int b = 0;
+            while (b < METRIC_BUCKETS - 1 && seen + counts[stage][b] < rank)
+                seen += counts[stage][b++];
+            double value = metric_bucket_upper(b) / 1000000.0;
+            page_buffer_printf(out, "electric_monitor_stage_duration_quantile_seconds{stage=\"%s\",quantile=\"%g\"} %.6f\n",
+                               stage_names[stage], quantiles[q], value < max ? value : max);
+        }
     }
 
-    char full_headers[2048] = "Content-Type: application/x-www-form-urlencoded\r\n";
-    if (headers && strlen(headers) > 0)
+    // 最大值单独成一个指标族，样本不能混在上面分位数族的行之间
+    page_buffer_printf(out, "# HELP electric_monitor_stage_duration_max_seconds 各处理阶段的最长耗时\n"
+                            "# TYPE electric_monitor_stage_duration_max_seconds gauge\n");
+    for (int stage = 0; stage < METRIC_STAGE_COUNT; stage++)
     {
-        strcat(full_headers, headers);
+        if (totals[stage] > 0)
+            page_buffer_printf(out, "electric_monitor_stage_duration_max_seconds{stage=\"%s\"} %.6f\n",
+                               stage_names[stage], maxes[stage] / 1000000.0);
     }
 
-    HttpAddRequestHeadersA(hRequest, full_headers, (DWORD)strlen(full_headers), HTTP_ADDREQ_FLAG_ADD);
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+    {
+        LONG64 value = 0;
+        for (int s = 0; s < used; s++)
+            value += shards[s]->counters[c];
+        page_buffer_printf(out, "# HELP %s %s\n# TYPE %s counter\n%s %lld\n",
+                           counter_names[c], counter_help[c], counter_names[c], counter_names[c], (long long)value);
+    }
 
-    if (!HttpSendRequestA(hRequest, NULL, 0, (LPVOID)post_data, (DWORD)strlen(post_data)))
+    return page_buffer_printf(out,
+                              "# HELP electric_monitor_last_cycle_seconds 最近一轮轮询（获取、入库、警报、提交渲染）耗时\n"
+                              "# TYPE electric_monitor_last_cycle_seconds gauge\n"
+                              "electric_monitor_last_cycle_seconds %.6f\n"
+                              "# HELP electric_monitor_interval_seconds 配置的轮询间隔\n"
+                              "# TYPE electric_monitor_interval_seconds gauge\n"
+                              "electric_monitor_interval_seconds %d\n"
+                              "# HELP electric_monitor_log_dropped_total 日志缓冲区已满时丢弃的日志条数\n"
+                              "# TYPE electric_monitor_log_dropped_total counter\n"
+                              "electric_monitor_log_dropped_total %ld\n",
+                              metric_last_cycle_us / 1000000.0, metric_interval_seconds, (long)log_dropped_total);
+}
+
+/* 把指标写到METRICS_FILE（先写临时文件再替换，读取方不会读到半个文件） */
+int write_metrics_file(const char *path)
+{
+    PageBuffer page;
+    page_buffer_take(&page);
+    render_metrics(&page);
+
+    char temp_path[300];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    int written = file && page.data && fwrite(page.data, 1, page.length, file) == page.length;
+    if (file)
+        written = (fclose(file) == 0) && written;
+    page_buffer_return(&page);
+
+    if (!written || !MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING))
     {
-        DWORD error = GetLastError();
-        char error_msg[256];
-        snprintf(error_msg, sizeof(error_msg), "HttpSendRequestA 失败，错误代码: %lu", error);
-        write_log("ERROR", error_msg);
-        InternetCloseHandle(hRequest);
-        InternetCloseHandle(hConnect);
-        InternetCloseHandle(hInternet);
+        write_log("ERROR", "写入指标文件失败");
         return 0;
     }
+    return 1;
+}
 
-    while (InternetReadFile(hRequest, buffer, sizeof(buffer) - 1, &bytesRead) && bytesRead > 0)
+/* 取本线程的追踪缓冲区，第一次使用时分配并登记；线程数超过上限时返回NULL，该线程的跨度被丢弃 */
+TraceBuffer *trace_local_buffer(void)
+{
+    if (trace_buffer)
+        return trace_buffer;
+
+    TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+    if (!buffer)
+        return NULL;
+    buffer->thread = GetCurrentThreadId();
+    LONG slot = InterlockedIncrement(&trace_buffer_count) - 1;
+    if (slot >= TRACE_MAX_THREADS)
     {
-        if (totalBytesRead + bytesRead < (DWORD)response_size)
+        free(buffer);
+        return NULL;
+    }
+    trace_buffers[slot] = buffer;
+    trace_buffer = buffer;
+    return buffer;
+}
+
+/* 用一个跨度包住一条语句：未启用追踪时只判断一次trace_enabled就执行语句，没有结束时的第二次判断。
+   语句在两个分支中各展开一份，arg在语句之后求值，可以引用语句的结果。
+   语句里不能有跳出宏的break/continue/return，跨越提前返回的整段流程仍用trace_begin/trace_end */
+#define TRACE_SPAN(name, category, arg_name, arg, statement)            \
+    do                                                                  \
+    {                                                                   \
+        if (trace_enabled)                                              \
+        {                                                               \
+            ULONGLONG trace_started = metric_clock();                   \
+            statement;                                                  \
+            trace_record(name, category, trace_started, arg_name, arg); \
+        }                                                               \
+        else                                                            \
+        {                                                               \
+            statement;                                                  \
+        }                                                               \
+    } while (0)
+
+/* 开始一段跨度，返回起点计数；未启用追踪时返回0。只用于每轮或每次尝试一次的整段流程，
+   关闭追踪时开始和结束各有一次判断 */
+static inline ULONGLONG trace_begin(void)
+{
+    return trace_enabled ? metric_clock() : 0;
+}
+
+/* 结束跨度，started为0时什么也不做；同样内联，只有真正记录时才调用trace_record */
+static inline void trace_end(const char *name, const char *category, ULONGLONG started, const char *arg_name, long long arg)
+{
+    if (started)
+        trace_record(name, category, started, arg_name, arg);
+}
+
+/* 把名称、起止计数和一个整型参数写进本线程的缓冲区 */
+void trace_record(const char *name, const char *category, ULONGLONG started, const char *arg_name, long long arg)
+{
+    ULONGLONG ended = metric_clock();
+    TraceBuffer *buffer = trace_local_buffer();
+    if (!buffer || buffer->head - buffer->tail >= TRACE_BUFFER_SPANS)
+    {
+        InterlockedIncrement(&trace_dropped);
+        return;
+    }
+
+    TraceSpan *span = &buffer->spans[buffer->head & (TRACE_BUFFER_SPANS - 1)];
+    span->name = name;
+    span->category = category;
+    span->argName = arg_name;
+    span->arg = arg;
+    span->start = started;
+    span->end = ended;
+    InterlockedExchange(&buffer->head, buffer->head + 1);
+}
+
+/* 给本线程起一个在追踪视图中显示的名字 */
+void trace_name_thread(const char *name)
+{
+    if (!trace_enabled)
+        return;
+    TraceBuffer *buffer = trace_local_buffer();
+    if (buffer)
+        buffer->threadName = name;
+}
+
+/* 取出各线程缓冲区中已结束的跨度，按trace_event格式追加到batch */
+void trace_drain(PageBuffer *batch)
+{
+    LONG count = trace_buffer_count < TRACE_MAX_THREADS ? trace_buffer_count : TRACE_MAX_THREADS;
+    for (LONG i = 0; i < count; i++)
+    {
+        TraceBuffer *buffer = trace_buffers[i];
+        if (!buffer)
+            continue;
+
+        if (buffer->threadName && !buffer->nameWritten)
         {
-            memcpy(response + totalBytesRead, buffer, bytesRead);
-            totalBytesRead += bytesRead;
+            page_buffer_printf(batch, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s\"}},\n",
+                               (unsigned long)buffer->thread, buffer->threadName);
+            buffer->nameWritten = 1;
         }
-        else
+
+        LONG head = buffer->head;
+        for (LONG position = buffer->tail; position != head; position++)
         {
-            break;
+            const TraceSpan *span = &buffer->spans[position & (TRACE_BUFFER_SPANS - 1)];
+            double ts = (double)(LONG64)(span->start - trace_origin) * 1000000.0 / trace_frequency;
+            double dur = (double)(span->end - span->start) * 1000000.0 / trace_frequency;
+            page_buffer_printf(batch, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lu",
+                               span->name, span->category, ts, dur, (unsigned long)buffer->thread);
+            if (span->argName)
+                page_buffer_printf(batch, ",\"args\":{\"%s\":%lld}", span->argName, span->arg);
+            page_buffer_append(batch, "},\n", 3);
         }
+        InterlockedExchange(&buffer->tail, head);
     }
+}
 
-    response[totalBytesRead] = '\0';
-    result = 1;
+/* 打开追踪文件（每次启动覆盖），写入数组开头和进程名 */
+int start_trace(const char *path)
+{
+    trace_file = fopen(path, "wb");
+    if (!trace_file)
+        return 0;
 
-    if (hRequest)
-        InternetCloseHandle(hRequest);
-    if (hConnect)
-        InternetCloseHandle(hConnect);
-    if (hInternet)
-        InternetCloseHandle(hInternet);
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    trace_frequency = (double)frequency.QuadPart;
+    trace_origin = metric_clock();
+    fputs("[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"电表监控\"}},\n", trace_file);
+    fflush(trace_file);
+    trace_enabled = 1;
+    return 1;
+}
 
-    return result;
+/* 日志线程退出后写出剩余跨度并补上数组结尾 */
+void finish_trace(void)
+{
+    if (!trace_file)
+        return;
+
+    PageBuffer batch;
+    page_buffer_init(&batch);
+    trace_drain(&batch);
+    page_buffer_printf(&batch, "{\"name\":\"dropped_spans\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"dropped\":%ld}}\n]\n",
+                       (double)(LONG64)(metric_clock() - trace_origin) * 1000000.0 / trace_frequency, (long)trace_dropped);
+    fwrite(batch.data, 1, batch.length, trace_file);
+    page_buffer_free(&batch);
+    fclose(trace_file);
+    trace_file = NULL;
 }
 
-/* 解析JSON响应 */
-int parse_json_response(const char *json_str, ElectricMeter *meter)
+
+/* 设置控制台编码 */
+void set_console_utf8(void)
 {
-    memset(meter, 0, sizeof(ElectricMeter));
+    system("chcp 65001 > nul");
+    SetConsoleOutputCP(65001);
+}
 
-    if (strlen(json_str) == 0)
+/* 暂停程序 */
+void pause_program(void)
+{
+    printf("\n按任意键退出程序...\n");
+    system("pause > nul");
+}
+
+/* 把当前本地时间格式化到调用方提供的缓冲区 */
+void format_time(char *out, size_t out_size)
+{
+    SYSTEMTIME st;
+    clock_local_time(&st);
+    snprintf(out, out_size, "%04d-%02d-%02d %02d:%02d:%02d",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+}
+
+/* 获取当前时间字符串 */
+const char *get_current_time(void)
+{
+    // 每个线程使用自己的缓冲区，渲染线程和轮询线程互不覆盖
+    static THREAD_LOCAL char time_str[50];
+    format_time(time_str, sizeof(time_str));
+    return time_str;
+}
+
+/* 当前Unix时间（毫秒）：默认取系统时间，模拟和回放模式下取虚拟时钟 */
+long long clock_now_ms(void)
+{
+    if (clock_virtual)
+        return clock_virtual_ms;
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return (long long)((((unsigned long long)now.dwHighDateTime << 32) | now.dwLowDateTime) / 10000ULL) - 11644473600000LL;
+}
+
+/* 当前Unix时间（秒）：默认取系统时间，模拟和回放模式下取虚拟时钟 */
+long long clock_now(void)
+{
+    if (clock_virtual)
+        return clock_virtual_ms / 1000;
+    return (long long)time(NULL);
+}
+
+/* 把Unix时间拆成SYSTEMTIME，local为1时按本地时区 */
+void clock_split(long long seconds, int local, SYSTEMTIME *st)
+{
+    // localtime/gmtime返回共享的静态结构，渲染线程和轮询线程同时调用会互相覆盖，改用可重入的_s版本
+    time_t value = (time_t)seconds;
+    struct tm parts;
+    memset(st, 0, sizeof(SYSTEMTIME));
+    if ((local ? localtime_s(&parts, &value) : gmtime_s(&parts, &value)) != 0)
+        return;
+    st->wYear = (WORD)(parts.tm_year + 1900);
+    st->wMonth = (WORD)(parts.tm_mon + 1);
+    st->wDayOfWeek = (WORD)parts.tm_wday;
+    st->wDay = (WORD)parts.tm_mday;
+    st->wHour = (WORD)parts.tm_hour;
+    st->wMinute = (WORD)parts.tm_min;
+    st->wSecond = (WORD)parts.tm_sec;
+}
+
+/* 当前本地时间，替代GetLocalTime */
+void clock_local_time(SYSTEMTIME *st)
+{
+    if (clock_virtual)
+        clock_split(clock_now(), 1, st);
+    else
+        GetLocalTime(st);
+}
+
+/* 当前UTC时间，替代GetSystemTime */
+void clock_system_time(SYSTEMTIME *st)
+{
+    if (clock_virtual)
+        clock_split(clock_now(), 0, st);
+    else
+        GetSystemTime(st);
+}
+
+/* 当前时间加offset秒，格式与SQLite的CURRENT_TIMESTAMP相同（UTC），用于绑定到SQL中的时间参数 */
+void clock_sql_time(char *out, size_t out_size, long long offset)
+{
+    SYSTEMTIME st;
+    clock_split(clock_now() + offset, 0, &st);
+    snprintf(out, out_size, "%04d-%02d-%02d %02d:%02d:%02d",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+}
+
+/* 等待指定毫秒：虚拟时钟直接向前推进，不真正睡眠 */
+void clock_sleep(DWORD milliseconds)
+{
+    if (clock_virtual)
+        InterlockedExchangeAdd64(&clock_virtual_ms, (LONG64)milliseconds);
+    else
+        Sleep(milliseconds);
+}
+
+/* 轮询间隔的等待：系统时钟下分段睡眠以便响应Ctrl+C，虚拟时钟下一次推进完 */
+void clock_wait(int seconds)
+{
+    if (clock_virtual)
     {
-        write_log("ERROR", "JSON响应为空");
-        return 0;
+        clock_sleep((DWORD)seconds * 1000);
+        return;
     }
+    for (int i = 0; i < seconds && keep_running; i++)
+        Sleep(1000); // 每秒检查一次
+}
 
-    // 查找data字段
-    const char *data_start = strstr(json_str, "\"data\"");
-    if (!data_start)
+/* 切换到虚拟时钟并拨到start_ms（Unix毫秒时间） */
+void clock_use_virtual(long long start_ms)
+{
+    InterlockedExchange64(&clock_virtual_ms, (LONG64)start_ms);
+    InterlockedExchange(&clock_virtual, 1);
+}
+
+/* 创建目录 */
+void create_directory(const char *dirname)
+{
+    CreateDirectoryA(dirname, NULL);
+}
+
+/* FNV-1a 64位哈希，用于生成ETag */
+unsigned long long hash_bytes(const void *data, size_t length)
+{
+    return hash_bytes_continue(14695981039346656037ULL, data, length);
+}
+
+/* 在已有哈希值上继续累加数据，分块计算的结果与整体调用hash_bytes相同 */
+unsigned long long hash_bytes_continue(unsigned long long hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < length; i++)
     {
-        write_log("ERROR", "未找到data字段");
-        return 0;
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
 
-    const char *shengyu_str = strstr(data_start, "\"shengyu\"");
-    const char *leiji_str = strstr(data_start, "\"leiji\"");
-    const char *price_str = strstr(data_start, "\"price\"");
-    const char *zhuangtai_str = strstr(data_start, "\"zhuangtai\"");
+/* 根据文件名判断Content-Type */
+const char *content_type_for_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    if (strcmp(name, "metrics") == 0)
+        return "text/plain; version=0.0.4; charset=utf-8";
+    if (!ext)
+        return "application/octet-stream";
+    if (strcmp(ext, ".html") == 0)
+        return "text/html; charset=utf-8";
+    if (strcmp(ext, ".json") == 0)
+        return "application/json; charset=utf-8";
+    if (strcmp(ext, ".css") == 0)
+        return "text/css; charset=utf-8";
+    if (strcmp(ext, ".js") == 0)
+        return "application/javascript; charset=utf-8";
+    return "application/octet-stream";
+}
 
-    if (shengyu_str)
+/* 初始化页面缓存 */
+void page_cache_init(void)
+{
+    InitializeCriticalSection(&page_cache_lock);
+    page_cache = NULL;
+    page_cache_count = 0;
+    page_cache_capacity = 0;
+}
+
+/* 释放页面快照的一个引用，最后一个引用释放时回收内存 */
+void page_snapshot_release(PageSnapshot *snapshot)
+{
+    if (snapshot && InterlockedDecrement(&snapshot->refCount) == 0)
     {
-        char shengyu_value[50];
-        if (sscanf(shengyu_str, "\"shengyu\":\"%[^\"]\"", shengyu_value) == 1)
+        if (snapshot->mapped)
         {
-            meter->remainingEnergy = atof(shengyu_value);
+            // 映射的临时文件以FILE_FLAG_DELETE_ON_CLOSE打开，解除最后一个映射后由系统删除
+            if (snapshot->body)
+                UnmapViewOfFile(snapshot->body);
+            if (snapshot->gzip)
+                UnmapViewOfFile(snapshot->gzip);
         }
-    }
-    else
-    {
-        write_log("ERROR", "未找到剩余电量字段");
-        return 0;
-    }
-
-    if (leiji_str)
-    {
-        char leiji_value[50];
-        if (sscanf(leiji_str, "\"leiji\":\"%[^\"]\"", leiji_value) == 1)
+        else
         {
-            meter->totalConsumption = atof(leiji_value);
+            free(snapshot->body);
+            free(snapshot->gzip);
         }
+        free(snapshot);
     }
+}
 
-    if (price_str)
+/* 创建一个页面快照，按名称设置Content-Type和缓存策略，内容由调用者填写 */
+PageSnapshot *page_snapshot_new(const char *name)
+{
+    PageSnapshot *snapshot = calloc(1, sizeof(PageSnapshot));
+    if (!snapshot)
+        return NULL;
+
+    snapshot->refCount = 1;
+    strncpy(snapshot->name, name, sizeof(snapshot->name) - 1);
+    snapshot->contentType = content_type_for_name(name);
+    // 带内容哈希的静态资源内容永不变化，允许浏览器长期缓存
+    if (strcmp(name, app_css_name) == 0 || strcmp(name, app_js_name) == 0)
+        snapshot->cacheControl = "public, max-age=31536000, immutable";
+    else
+        snapshot->cacheControl = "no-cache";
+    return snapshot;
+}
+
+/* 把快照放入页面缓存，替换同名旧快照 */
+void page_cache_insert(PageSnapshot *snapshot)
+{
+    PageSnapshot *old = NULL;
+    EnterCriticalSection(&page_cache_lock);
+    int slot = -1;
+    for (int i = 0; i < page_cache_count; i++)
     {
-        char price_value[50];
-        if (sscanf(price_str, "\"price\":\"%[^\"]\"", price_value) == 1)
+        if (strcmp(page_cache[i]->name, snapshot->name) == 0)
         {
-            meter->price = atof(price_value);
-            meter->remainingAmount = meter->remainingEnergy * meter->price;
+            slot = i;
+            break;
         }
     }
-
-    if (zhuangtai_str)
+    if (slot < 0)
     {
-        const char *status_start = strchr(zhuangtai_str, ':');
-        if (status_start)
+        // 新页面：追加到缓存末尾，容量不足时扩容
+        if (page_cache_count == page_cache_capacity)
         {
-            status_start++;
-            const char *quote1 = strchr(status_start, '\"');
-            if (quote1)
+            int new_capacity = page_cache_capacity ? page_cache_capacity * 2 : 32;
+            PageSnapshot **grown = realloc(page_cache, new_capacity * sizeof(PageSnapshot *));
+            if (grown)
             {
-                const char *quote2 = strchr(quote1 + 1, '\"');
-                if (quote2)
-                {
-                    size_t len = quote2 - quote1 - 1;
-                    if (len < sizeof(meter->meterStatus) - 1)
-                    {
-                        strncpy(meter->meterStatus, quote1 + 1, len);
-                        meter->meterStatus[len] = '\0';
-                    }
-                }
+                page_cache = grown;
+                page_cache_capacity = new_capacity;
             }
         }
+        if (page_cache_count < page_cache_capacity)
+        {
+            slot = page_cache_count++;
+            page_cache[slot] = NULL;
+        }
     }
+    if (slot >= 0)
+    {
+        old = page_cache[slot];
+        page_cache[slot] = snapshot;
+    }
+    else
+    {
+        old = snapshot;
+    }
+    LeaveCriticalSection(&page_cache_lock);
 
-    SYSTEMTIME st;
-    GetLocalTime(&st);
-    sprintf(meter->systemTime, "%04d-%02d-%02d %02d:%02d:%02d",
-            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
-
-    strcpy(meter->meterUpdateTime, meter->systemTime);
-
-    return 1;
+    // 正在发送旧快照的连接仍持有引用，不受影响
+    page_snapshot_release(old);
 }
 
-/* 获取电表数据（带重试机制） */
-int get_electric_meter_data_with_retry(const Config *config, ElectricMeter *meter)
+/* 将渲染好的页面（及其gzip版本）存为新快照，替换同名旧快照 */
+void page_cache_store(const char *name, const PageBuffer *body, const PageBuffer *gzip)
 {
-    char url[512] = {0};
-    char post_data[512] = {0};
-    char headers[1024] = {0};
-    char response[BUFFER_SIZE] = {0};
+    PageSnapshot *snapshot = page_snapshot_new(name);
+    if (!snapshot)
+        return;
+    snprintf(snapshot->etag, sizeof(snapshot->etag), "\"%016llx\"", hash_bytes(body->data, body->length));
 
-    parse_curl_command(config->curlCommand, url, post_data, headers);
+    snapshot->body = malloc(body->length + 1);
+    if (gzip && gzip->length > 0)
+        snapshot->gzip = malloc(gzip->length);
+    if (!snapshot->body || (gzip && gzip->length > 0 && !snapshot->gzip))
+    {
+        page_snapshot_release(snapshot);
+        return;
+    }
 
-    if (strlen(url) == 0)
+    memcpy(snapshot->body, body->data, body->length);
+    snapshot->body[body->length] = '\0';
+    snapshot->bodyLength = body->length;
+    if (snapshot->gzip)
     {
-        write_log("ERROR", "无法从CURL命令中解析URL");
-        return 0;
+        memcpy(snapshot->gzip, gzip->data, gzip->length);
+        snapshot->gzipLength = gzip->length;
     }
+    page_cache_insert(snapshot);
+}
 
-    for (int attempt = 1; attempt <= MAX_RETRY_COUNT; attempt++)
+/* 把临时文件映射为只读内存：映射由页面快照持有，文件在最后一个句柄和映射关闭后删除 */
+char *map_snapshot_file(const char *path, size_t *length)
+{
+    *length = 0;
+    HANDLE file = CreateFileA(path, GENERIC_READ | DELETE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (file == INVALID_HANDLE_VALUE)
     {
-        char attempt_msg[128];
-        snprintf(attempt_msg, sizeof(attempt_msg), "第%d次尝试获取数据 (共%d次)...", attempt, MAX_RETRY_COUNT);
-        write_log("INFO", attempt_msg);
-        printf("%s\n", attempt_msg);
+        DeleteFileA(path);
+        return NULL;
+    }
 
-        if (http_post_request(url, post_data, headers, response, BUFFER_SIZE))
-        {
-            if (parse_json_response(response, meter))
-            {
-                char success_msg[128];
-                snprintf(success_msg, sizeof(success_msg), "数据获取成功 (第%d次尝试)", attempt);
-                write_log("INFO", success_msg);
-                printf("✅ %s\n", success_msg);
-                return 1;
-            }
-            else
-            {
-                char parse_error_msg[128];
-                snprintf(parse_error_msg, sizeof(parse_error_msg), "JSON解析失败 (第%d次尝试)", attempt);
-                write_log("ERROR", parse_error_msg);
-                printf("❌ %s\n", parse_error_msg);
-            }
-        }
-        else
+    char *view = NULL;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
         {
-            char http_error_msg[128];
-            snprintf(http_error_msg, sizeof(http_error_msg), "HTTP请求失败 (第%d次尝试)", attempt);
-            write_log("ERROR", http_error_msg);
-            printf("❌ %s\n", http_error_msg);
-        }
-
-        // 如果不是最后一次尝试，等待后重试
-        if (attempt < MAX_RETRY_COUNT)
-        {
-            printf("⏳ 等待3秒后重试...\n");
-            write_log("INFO", "等待3秒后重试");
-            Sleep(3000); // 等待3秒
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
         }
     }
-
-    write_log("ERROR", "所有重试次数已用完，数据获取失败");
-    printf("❌ 所有%d次重试均已失败，跳过本次数据获取\n", MAX_RETRY_COUNT);
-    return 0;
+    CloseHandle(file);
+    if (view)
+        *length = (size_t)size.QuadPart;
+    return view;
 }
 
-/* 发送邮件主函数（带时间延迟） */
-int send_email(const Config *config, const ElectricMeter *meter, double threshold)
+/* 分块发布的页面存为快照：正文和gzip版本映射自临时文件，不占用堆内存 */
+void page_cache_store_files(const char *name, const char *etag, const char *body_path, const char *gzip_path)
 {
-    printf("检查邮件配置...\n");
-    printf("发件人: %s\n", config->emailAccount);
-    printf("收件人: %s\n", config->emailReceivers);
-    printf("SMTP服务器: %s:%d\n", config->smtpServer, config->smtpPort);
+    PageSnapshot *snapshot = page_snapshot_new(name);
+    if (!snapshot)
+    {
+        DeleteFileA(body_path);
+        DeleteFileA(gzip_path);
+        return;
+    }
+    snapshot->mapped = 1;
+    snprintf(snapshot->etag, sizeof(snapshot->etag), "%s", etag);
+    snapshot->body = map_snapshot_file(body_path, &snapshot->bodyLength);
+    snapshot->gzip = map_snapshot_file(gzip_path, &snapshot->gzipLength);
+    if (!snapshot->body)
+    {
+        write_log("WARNING", "无法映射页面快照，内置HTTP服务继续使用上一版本");
+        page_snapshot_release(snapshot);
+        return;
+    }
+    page_cache_insert(snapshot);
+}
 
-    // 检查邮箱配置是否完整
-    if (strlen(config->emailAccount) == 0 || strlen(config->emailAuthCode) == 0 ||
-        strlen(config->emailReceivers) == 0)
+/* 只在内存中缓存的页面（如JSON接口）：压缩一次后存入缓存 */
+void cache_rendered_page(const char *name, const PageBuffer *page)
+{
+    if (page->failed)
     {
-        printf("邮箱配置不完整，跳过邮件发送\n");
-        printf("需要配置: EMAIL_ACCOUNT, EMAIL_AUTH_CODE, EMAIL_RECEIVERS\n");
-        return 0;
+        char error_msg[300];
+        snprintf(error_msg, sizeof(error_msg), "页面渲染不完整，保留上一版本: %s", name);
+        write_log("ERROR", error_msg);
+        return;
     }
 
-    printf("准备发送邮件...\n");
-
-    // 创建PowerShell脚本内容 - 添加时间延迟和重试机制
-    char ps_script[8192];
-    snprintf(ps_script, sizeof(ps_script),
-             "[Console]::OutputEncoding = [System.Text.Encoding]::UTF8\n"
-             "[Console]::InputEncoding = [System.Text.Encoding]::UTF8\n"
-             "\n"
-             "function Send-EmailWithRetry {\n"
-             "    param($From, $To, $Subject, $Body, $SmtpServer, $Port, $Credential, $RetryCount = 3)\n"
-             "    \n"
-             "    for ($i = 1; $i -le $RetryCount; $i++) {\n"
-             "        try {\n"
-             "            Write-Output (\"尝试第 $i 次发送给: \" + $To)\n"
-             "            \n"
-             "            # 使用SmtpClient对象，更稳定\n"
-             "            $smtpClient = New-Object System.Net.Mail.SmtpClient($SmtpServer, $Port)\n"
-             "            $smtpClient.EnableSsl = $true\n"
-             "            $smtpClient.Credentials = $Credential\n"
-             "            $smtpClient.Timeout = 30000  # 30秒超时\n"
-             "            \n"
-             "            $mailMessage = New-Object System.Net.Mail.MailMessage\n"
-             "            $mailMessage.From = $From\n"
-             "            $mailMessage.To.Add($To)\n"
-             "            $mailMessage.Subject = $Subject\n"
-             "            $mailMessage.Body = $Body\n"
-             "            $mailMessage.IsBodyHtml = $true\n"
-             "            $mailMessage.BodyEncoding = [System.Text.Encoding]::UTF8\n"
-             "            $mailMessage.SubjectEncoding = [System.Text.Encoding]::UTF8\n"
-             "            \n"
-             "            $smtpClient.Send($mailMessage)\n"
-             "            Write-Output (\"✅ 成功发送给: \" + $To)\n"
-             "            \n"
-             "            # 清理资源\n"
-             "            $mailMessage.Dispose()\n"
-             "            $smtpClient.Dispose()\n"
-             "            \n"
-             "            return $true\n"
-             "            \n"
-             "        } catch {\n"
-             "            Write-Output (\"❌ 第 $i 次发送失败给 \" + $To + \": \" + $_.Exception.Message)\n"
-             "            \n"
-             "            # 清理资源（即使失败也要清理）\n"
-             "            if ($mailMessage) { $mailMessage.Dispose() }\n"
-             "            if ($smtpClient) { $smtpClient.Dispose() }\n"
-             "            \n"
-             "            # 如果不是最后一次尝试，等待后重试\n"
-             "            if ($i -lt $RetryCount) {\n"
-             "                $delaySeconds = 5 * $i  # 递增延迟：5秒, 10秒, 15秒\n"
-             "                Write-Output (\"等待 $delaySeconds 秒后重试...\")\n"
-             "                Start-Sleep -Seconds $delaySeconds\n"
-             "            }\n"
-             "        }\n"
-             "    }\n"
-             "    return $false\n"
-             "}\n"
-             "\n"
-             "Try {\n"
-             "    # 邮件参数\n"
-             "    $EmailFrom = '%s'\n"
-             "    $EmailTo = '%s'\n"
-             "    $Subject = '电表低电量提醒 - 剩余%.2f度电（山东石油化工学院）'\n"
-             "    $SMTPServer = '%s'\n"
-             "    $SMTPPort = %d\n"
-             "    $Username = '%s'\n"
-             "    $Password = '%s'\n"
-             "    \n"
-             "    # 创建邮件内容\n"
-             "    $Body = @\"\n"
-             "<!DOCTYPE html>\n"
-             "<html>\n"
-             "<head>\n"
-             "    <meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\">\n"
-             "    <title>Electric Meter Low Energy Alert</title>\n"
-             "    <style>\n"
-             "        body { font-family: Arial, sans-serif; margin: 20px; background-color: #f5f5f5; }\n"
-             "        .container { background: white; padding: 30px; border-radius: 10px; box-shadow: 0 2px 10px rgba(0,0,0,0.1); max-width: 600px; margin: 0 auto; }\n"
-             "        .header { color: #d63031; font-size: 28px; font-weight: bold; margin-bottom: 25px; text-align: center; border-bottom: 3px solid #d63031; padding-bottom: 15px; }\n"
-             "        .info-table { border-collapse: collapse; width: 100%%; margin: 25px 0; font-size: 16px; }\n"
-             "        .info-table th, .info-table td { border: 2px solid #ddd; padding: 15px; text-align: left; }\n"
-             "        .info-table th { background-color: #f8f9fa; font-weight: bold; width: 30%%; color: #2d3436; }\n"
-             "        .info-table td { background-color: #fff; }\n"
-             "        .warning { color: #d63031; font-weight: bold; font-size: 20px; margin: 25px 0; text-align: center; background: #ffebee; padding: 15px; border-radius: 8px; border-left: 5px solid #d63031; }\n"
-             "        .critical { background-color: #fff5f5 !important; font-weight: bold; color: #d63031; }\n"
-             "        .footer { margin-top: 30px; padding-top: 20px; border-top: 1px solid #ddd; color: #636e72; font-size: 14px; text-align: center; }\n"
-             "        .energy-value { font-size: 24px; font-weight: bold; color: #d63031; }\n"
-             "    </style>\n"
-             "</head>\n"
-             "<body>\n"
-             "    <div class=\"container\">\n"
-             "        <div class=\"header\">⚠️ 电表低电量提醒 Low Energy Alert</div>\n"
-             "        <p>系统检测到电表电量低于设定阈值，请及时充值！System detected low energy, please recharge!</p>\n"
-             "        <table class=\"info-table\">\n"
-             "            <tr><th>剩余电量 Remaining Energy</th><td class=\"critical\"><span class=\"energy-value\">%.2f 度 kWh</span></td></tr>\n"
-             "            <tr><th>剩余金额 Remaining Amount</th><td>%.2f 元 CNY</td></tr>\n"
-             "            <tr><th>累计用电 Total Consumption</th><td>%.2f kWh</td></tr>\n"
-             "            <tr><th>当前电价 Current Price</th><td>%.4f 元/度 CNY/kWh</td></tr>\n"
-             "            <tr><th>电表状态 Meter Status</th><td>%s</td></tr>\n"
-             "            <tr><th>数据更新时间 Data Update Time</th><td>%s</td></tr>\n"
-             "            <tr><th>系统记录时间 System Time</th><td>%s</td></tr>\n"
-             "            <tr><th>低电量阈值 Low Energy Threshold</th><td>%.1f 度 kWh</td></tr>\n"
-             "        </table>\n"
-             "        <div class=\"warning\">⚠️ 紧急：电量已低于设定阈值，请及时充值以避免断电！Urgent: Energy below threshold, please recharge to avoid power outage!</div>\n"
-             "        <div class=\"footer\">此邮件由山东石油化工学院电表监控系统自动生成<br>Auto-generated by Shandong Institute of Petroleum and Chemical Technology Electric Monitor System</div>\n"
-             "    </div>\n"
-             "</body>\n"
-             "</html>\n"
-             "\"@\n"
-             "    \n"
-             "    # 创建凭据\n"
-             "    $secpasswd = ConvertTo-SecureString $Password -AsPlainText -Force\n"
-             "    $cred = New-Object System.Management.Automation.PSCredential ($Username, $secpasswd)\n"
-             "    \n"
-             "    # 分割多个收件人邮箱\n"
-             "    $Recipients = $EmailTo -split ',' | ForEach-Object { $_.Trim() } | Where-Object { $_ -ne '' }\n"
-             "    \n"
-             "    Write-Output (\"开始发送邮件给 \" + $Recipients.Count + \" 个收件人...\")\n"
-             "    \n"
-             "    # 发送邮件给每个收件人\n"
-             "    $successCount = 0\n"
-             "    $recipientIndex = 0\n"
-             "    \n"
-             "    foreach ($recipient in $Recipients) {\n"
-             "        $recipientIndex++\n"
-             "        Write-Output (\"\n处理收件人 $recipientIndex/$($Recipients.Count): \" + $recipient)\n"
-             "        \n"
-             "        # 在收件人之间添加延迟（第一个收件人不需要延迟）\n"
-             "        if ($recipientIndex -gt 1) {\n"
-             "            Write-Output \"等待3秒后发送下一个收件人...\"\n"
-             "            Start-Sleep -Seconds 3\n"
-             "        }\n"
-             "        \n"
-             "        # 发送邮件（带重试机制）\n"
-             "        if (Send-EmailWithRetry -From $EmailFrom -To $recipient -Subject $Subject -Body $Body -SmtpServer $SMTPServer -Port $SMTPPort -Credential $cred -RetryCount 3) {\n"
-             "            $successCount++\n"
-             "        }\n"
-             "    }\n"
-             "    \n"
-             "    Write-Output (\"\\n=== 发送完成 ===\")\n"
-             "    Write-Output (\"成功发送: $successCount/$($Recipients.Count)\")\n"
-             "    \n"
-             "    if ($successCount -eq $Recipients.Count) {\n"
-             "        Write-Output 'SUCCESS_ALL'\n"
-             "    } elseif ($successCount -gt 0) {\n"
-             "        Write-Output 'SUCCESS_PARTIAL'\n"
-             "    } else {\n"
-             "        Write-Output 'FAILED_ALL'\n"
-             "        exit 1\n"
-             "    }\n"
-             "    exit 0\n"
-             "} Catch {\n"
-             "    Write-Output (\"❌ 全局错误: \" + $_.Exception.Message)\n"
-             "    Write-Output (\"   错误类型: \" + $_.Exception.GetType().FullName)\n"
-             "    exit 1\n"
-             "}",
-             config->emailAccount,
-             config->emailReceivers,
-             meter->remainingEnergy,
-             config->smtpServer,
-             config->smtpPort,
-             config->emailAccount,
-             config->emailAuthCode,
-             meter->remainingEnergy,
-             meter->remainingAmount,
-             meter->totalConsumption,
-             meter->price,
-             meter->meterStatus,
-             meter->meterUpdateTime,
-             meter->systemTime,
-             threshold);
+    PageBuffer compressed;
+    page_buffer_take(&compressed);
+    int compressed_ok = gzip_compress(page->data, page->length, Z_DEFAULT_COMPRESSION, &compressed);
+    page_cache_store(name, page, compressed_ok ? &compressed : NULL);
+    page_buffer_return(&compressed);
+}
 
-    // 将PowerShell脚本保存到临时文件
-    FILE *ps_file = fopen("send_email.ps1", "wb");
-    if (!ps_file)
+/* 获取页面快照并增加引用，用完后需调用page_snapshot_release */
+PageSnapshot *page_cache_acquire(const char *name)
+{
+    PageSnapshot *snapshot = NULL;
+    EnterCriticalSection(&page_cache_lock);
+    for (int i = 0; i < page_cache_count; i++)
     {
-        write_log("ERROR", "无法创建PowerShell脚本文件");
-        printf("❌ 无法创建PowerShell脚本文件\n");
+        if (strcmp(page_cache[i]->name, name) == 0)
+        {
+            snapshot = page_cache[i];
+            InterlockedIncrement(&snapshot->refCount);
+            break;
+        }
+    }
+    LeaveCriticalSection(&page_cache_lock);
+    return snapshot;
+}
+
+/* 追加JSON字符串（带引号并转义） */
+int page_buffer_append_json_string(PageBuffer *buffer, const char *text)
+{
+    if (!page_buffer_append(buffer, "\"", 1))
         return 0;
+
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+    {
+        char escaped[8];
+        switch (*p)
+        {
+        case '"':
+            page_buffer_append(buffer, "\\\"", 2);
+            break;
+        case '\\':
+            page_buffer_append(buffer, "\\\\", 2);
+            break;
+        case '\n':
+            page_buffer_append(buffer, "\\n", 2);
+            break;
+        case '\r':
+            page_buffer_append(buffer, "\\r", 2);
+            break;
+        case '\t':
+            page_buffer_append(buffer, "\\t", 2);
+            break;
+        case '<':
+            // 避免内嵌在<script>中的数据提前结束脚本
+            page_buffer_append(buffer, "\\u003c", 6);
+            break;
+        default:
+            if (*p < 0x20)
+            {
+                snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+                page_buffer_append(buffer, escaped, 6);
+            }
+            else
+            {
+                page_buffer_append(buffer, (const char *)p, 1);
+            }
+            break;
+        }
     }
 
-    // 写入UTF-8 BOM
-    unsigned char bom[] = {0xEF, 0xBB, 0xBF};
-    fwrite(bom, 1, 3, ps_file);
-    fprintf(ps_file, "%s", ps_script);
-    fclose(ps_file);
+    return page_buffer_append(buffer, "\"", 1);
+}
+
+/* 将电表读数渲染为JSON对象 */
+int render_meter_json(PageBuffer *buffer, const ElectricMeter *meter, double threshold)
+{
+    page_buffer_printf(buffer, "{\"id\":%d,\"recordTime\":", meter->id);
+    page_buffer_append_json_string(buffer, meter->record_time);
+    page_buffer_printf(buffer,
+                       ",\"energy\":%.2f,\"amount\":%.2f,\"consumption\":%.2f,\"price\":%.4f,\"threshold\":%.1f,\"low\":%s,\"status\":",
+                       meter->remainingEnergy,
+                       meter->remainingAmount,
+                       meter->totalConsumption,
+                       meter->price,
+                       threshold,
+                       (meter->remainingEnergy <= threshold) ? "true" : "false");
+    page_buffer_append_json_string(buffer, meter->meterStatus);
+    page_buffer_printf(buffer, ",\"updateTime\":");
+    page_buffer_append_json_string(buffer, meter->meterUpdateTime);
+    page_buffer_printf(buffer, ",\"systemTime\":");
+    page_buffer_append_json_string(buffer, meter->systemTime);
+    return page_buffer_printf(buffer, "}");
+}
+
+/* 将警报记录渲染为JSON对象（record_time为警报时间，price字段存储阈值，meterStatus存储警报信息） */
+int render_alert_json(PageBuffer *buffer, const ElectricMeter *alert)
+{
+    page_buffer_printf(buffer, "{\"id\":%d,\"time\":", alert->id);
+    page_buffer_append_json_string(buffer, alert->record_time);
+    page_buffer_printf(buffer, ",\"energy\":%.2f,\"threshold\":%.1f,\"message\":",
+                       alert->remainingEnergy, alert->price);
+    page_buffer_append_json_string(buffer, alert->meterStatus);
+    page_buffer_printf(buffer, ",\"updateTime\":");
+    page_buffer_append_json_string(buffer, alert->meterUpdateTime);
+    return page_buffer_printf(buffer, "}");
+}
+
+/* 向所有SSE客户端广播一个事件，由HTTP服务线程在下一轮循环中发送 */
+void sse_broadcast(const char *event, const PageBuffer *data)
+{
+    if (!http_server_thread_handle || !data->data)
+        return;
 
-    // 执行PowerShell脚本
-    printf("正在发送邮件警告...\n");
-    write_log("INFO", "执行PowerShell脚本发送邮件");
+    EnterCriticalSection(&sse_lock);
+    page_buffer_printf(&sse_pending, "id: %ld\nevent: %s\ndata: ", ++sse_event_id, event);
+    page_buffer_append(&sse_pending, data->data, data->length);
+    page_buffer_append(&sse_pending, "\n\n", 2);
+    LeaveCriticalSection(&sse_lock);
+}
 
-    int result = system("powershell -ExecutionPolicy Bypass -File send_email.ps1");
+/* 初始化页面缓冲区 */
+void page_buffer_init(PageBuffer *buffer)
+{
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->failed = 0;
+}
 
-    // 删除临时文件
-    remove("send_email.ps1");
+/* 释放页面缓冲区 */
+void page_buffer_free(PageBuffer *buffer)
+{
+    free(buffer->data);
+    page_buffer_init(buffer);
+}
 
-    if (result == 0)
+/* 从本线程的缓冲区池中取一块空缓冲区：渲染线程每轮复用上一轮已分配的容量，不再反复扩容 */
+void page_buffer_take(PageBuffer *buffer)
+{
+    if (page_buffer_pool_count > 0)
     {
-        write_log("SUCCESS", "邮件警告发送成功");
-        printf("✅ 邮件警告发送成功\n");
-        return 1;
+        *buffer = page_buffer_pool[--page_buffer_pool_count];
+        buffer->length = 0;
+        buffer->failed = 0;
+        buffer->data[0] = '\0';
+        return;
     }
-    else
+    page_buffer_init(buffer);
+}
+
+/* 把缓冲区还给本线程的缓冲区池，池满或缓冲区过大时直接释放 */
+void page_buffer_return(PageBuffer *buffer)
+{
+    if (buffer->data && page_buffer_pool_count < PAGE_BUFFER_POOL_SIZE && buffer->capacity <= PAGE_BUFFER_POOL_MAX)
     {
-        write_log("ERROR", "邮件发送失败");
-        printf("❌ 邮件发送失败，返回码: %d\n", result);
+        page_buffer_pool[page_buffer_pool_count++] = *buffer;
+        page_buffer_init(buffer);
+        return;
+    }
+    page_buffer_free(buffer);
+}
+
+/* 确保缓冲区至少还能容纳extra字节（外加结尾的'\0'） */
+int page_buffer_reserve(PageBuffer *buffer, size_t extra)
+{
+    size_t needed = buffer->length + extra + 1;
+    if (needed <= buffer->capacity)
+        return 1;
 
-        // 提供详细的故障排除建议
-        printf("💡 故障排除建议:\n");
-        printf("   1. 检查SMTP服务器地址和端口是否正确\n");
-        printf("   2. 确认邮箱密码是授权码而不是登录密码\n");
-        printf("   3. 检查网络连接是否正常\n");
-        printf("   4. QQ邮箱需要开启SMTP服务并获取授权码\n");
-        printf("   5. 尝试使用端口465（SSL）或587（TLS）\n");
+    size_t new_capacity = buffer->capacity ? buffer->capacity : 16384;
+    while (new_capacity < needed)
+        new_capacity *= 2;
 
+    char *new_data = realloc(buffer->data, new_capacity);
+    if (!new_data)
+    {
+        // 生成函数大多不检查每次追加的返回值，由failed标记让整页在发布时被丢弃
+        buffer->failed = 1;
+        write_log("ERROR", "页面缓冲区内存分配失败");
         return 0;
     }
+
+    buffer->data = new_data;
+    buffer->capacity = new_capacity;
+    return 1;
 }
 
-/* 读取数据库记录用于生成历史页面 */
-int read_database_records(const char *db_path, ElectricMeter **records, int *count)
+/* 向缓冲区追加原始数据 */
+int page_buffer_append(PageBuffer *buffer, const char *data, size_t length)
 {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    int rc;
+    if (!page_buffer_reserve(buffer, length))
+        return 0;
 
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK)
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return 1;
+}
+
+/* 按格式向缓冲区追加内容，用法与fprintf相同 */
+int page_buffer_printf(PageBuffer *buffer, const char *format, ...)
+{
+    size_t available = buffer->capacity > buffer->length ? buffer->capacity - buffer->length : 0;
+
+    for (;;)
     {
-        write_log("ERROR", "无法打开数据库读取记录");
-        return 0;
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buffer->data ? buffer->data + buffer->length : NULL, available, format, args);
+        va_end(args);
+
+        // 部分Windows运行库在空间不足时返回-1，此时按倍数扩容后重试
+        if (written >= 0 && (size_t)written < available)
+        {
+            buffer->length += written;
+            return 1;
+        }
+
+        size_t extra = written >= 0 ? (size_t)written : (available + 1) * 2;
+        if (!page_buffer_reserve(buffer, extra))
+            return 0;
+        available = buffer->capacity - buffer->length;
     }
+}
 
-    const char *sql = "SELECT id, record_time, remaining_energy, remaining_amount, "
-                      "total_consumption, price, meter_status, meter_update_time, system_time "
-                      "FROM electric_data ORDER BY record_time DESC LIMIT 1000;";
+/* 使用zlib将数据压缩为gzip格式，level为zlib压缩级别 */
+int gzip_compress(const char *data, size_t length, int level, PageBuffer *out)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK)
+    // windowBits加16表示输出gzip头而不是zlib头
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
     {
-        sqlite3_close(db);
-        write_log("ERROR", "准备SQL语句失败");
+        write_log("ERROR", "gzip压缩初始化失败");
         return 0;
     }
 
-    *records = malloc(1000 * sizeof(ElectricMeter));
-    if (!*records)
+    out->length = 0;
+    out->failed = 0;
+    if (!page_buffer_reserve(out, deflateBound(&stream, (uLong)length)))
     {
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        write_log("ERROR", "内存分配失败");
+        deflateEnd(&stream);
         return 0;
     }
 
-    *count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW && *count < 1000)
-    {
-        ElectricMeter *record = &(*records)[*count];
-
-        record->id = sqlite3_column_int(stmt, 0);
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = (uInt)length;
+    stream.next_out = (Bytef *)out->data;
+    stream.avail_out = (uInt)(out->capacity - 1);
 
-        const char *record_time = (const char *)sqlite3_column_text(stmt, 1);
-        strncpy(record->record_time, record_time ? record_time : "", sizeof(record->record_time) - 1);
+    int rc = deflate(&stream, Z_FINISH);
+    out->length = stream.total_out;
+    deflateEnd(&stream);
 
-        record->remainingEnergy = sqlite3_column_double(stmt, 2);
-        record->remainingAmount = sqlite3_column_double(stmt, 3);
-        record->totalConsumption = sqlite3_column_double(stmt, 4);
-        record->price = sqlite3_column_double(stmt, 5);
+    if (rc != Z_STREAM_END)
+    {
+        write_log("ERROR", "gzip压缩失败");
+        return 0;
+    }
+    return 1;
+}
 
-        const char *meter_status = (const char *)sqlite3_column_text(stmt, 6);
-        strncpy(record->meterStatus, meter_status ? meter_status : "", sizeof(record->meterStatus) - 1);
+/* 原子写入文件：先写临时文件，再重命名覆盖目标文件 */
+int write_file_atomic(const char *filepath, const char *data, size_t length)
+{
+    char temp_path[600];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", filepath);
 
-        const char *meter_update_time = (const char *)sqlite3_column_text(stmt, 7);
-        strncpy(record->meterUpdateTime, meter_update_time ? meter_update_time : "", sizeof(record->meterUpdateTime) - 1);
+    FILE *file = fopen(temp_path, "wb");
+    if (!file)
+        return 0;
 
-        const char *system_time = (const char *)sqlite3_column_text(stmt, 8);
-        strncpy(record->systemTime, system_time ? system_time : "", sizeof(record->systemTime) - 1);
+    size_t written = fwrite(data, 1, length, file);
+    int flushed = (fflush(file) == 0);
+    fclose(file);
 
-        (*count)++;
+    if (written != length || !flushed)
+    {
+        DeleteFileA(temp_path);
+        return 0;
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-
-    char success_msg[128];
-    snprintf(success_msg, sizeof(success_msg), "成功读取 %d 条数据库记录", *count);
-    write_log("INFO", success_msg);
+    // 读者要么看到旧文件，要么看到完整的新文件，不会读到写了一半的页面
+    if (!MoveFileExA(temp_path, filepath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFileA(temp_path);
+        return 0;
+    }
     return 1;
 }
 
-/* 读取警报记录 */
-int read_alerts_records(const char *db_path, ElectricMeter **records, int *count)
+/* 发布页面：原子写入HTML文件，并同时生成预压缩的.gz版本 */
+int publish_page(const char *web_path, const char *name, const PageBuffer *page)
 {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    int rc;
+    char filepath[512];
+    char gz_path[520];
+    snprintf(filepath, sizeof(filepath), "%s/%s", web_path, name);
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", filepath);
 
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK)
+    if (!page->data)
+        return 0;
+    if (page->failed)
     {
-        write_log("ERROR", "无法打开数据库读取警报记录");
+        char error_msg[600];
+        snprintf(error_msg, sizeof(error_msg), "页面渲染不完整，保留上一版本: %s", filepath);
+        write_log("ERROR", error_msg);
         return 0;
     }
 
-    const char *sql = "SELECT id, alert_time, remaining_energy, threshold, alert_message, meter_update_time "
-                      "FROM low_energy_alerts ORDER BY alert_time DESC LIMIT 1000;";
+    // 每次内容变化只压缩一次，静态Web服务器可直接发送.gz文件（如nginx的gzip_static）；
+    // 页面每轮都可能重新发布，用默认级别，最高级别的额外压缩率换不回它的CPU开销
+    PageBuffer compressed;
+    page_buffer_take(&compressed);
+    int compressed_ok = gzip_compress(page->data, page->length, Z_DEFAULT_COMPRESSION, &compressed);
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK)
+    // 先替换HTML：它写入失败时.gz仍与旧HTML一致，内存缓存也不更新，下一轮按ETag重试
+    if (!write_file_atomic(filepath, page->data, page->length))
     {
-        sqlite3_close(db);
-        write_log("ERROR", "准备警报SQL语句失败");
+        char error_msg[600];
+        snprintf(error_msg, sizeof(error_msg), "无法写入页面: %s", filepath);
+        write_log("ERROR", error_msg);
+        page_buffer_return(&compressed);
         return 0;
     }
 
-    *records = malloc(1000 * sizeof(ElectricMeter));
-    if (!*records)
+    // .gz写入失败时删除旧的.gz，避免Web服务器继续发送与新HTML不一致的旧压缩版本
+    if (!compressed_ok || !write_file_atomic(gz_path, compressed.data, compressed.length))
     {
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        write_log("ERROR", "内存分配失败");
-        return 0;
+        char error_msg[600];
+        snprintf(error_msg, sizeof(error_msg), "无法写入压缩页面: %s", gz_path);
+        write_log("ERROR", error_msg);
+        DeleteFileA(gz_path);
     }
 
-    *count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW && *count < 1000)
-    {
-        ElectricMeter *record = &(*records)[*count];
-
-        record->id = sqlite3_column_int(stmt, 0);
-
-        const char *alert_time = (const char *)sqlite3_column_text(stmt, 1);
-        strncpy(record->record_time, alert_time ? alert_time : "", sizeof(record->record_time) - 1);
+    // 同一份渲染结果同时放入内存缓存，内置HTTP服务无需再读磁盘
+    page_cache_store(name, page, compressed_ok ? &compressed : NULL);
+    page_buffer_return(&compressed);
+    InterlockedIncrement(&render_pages_published);
+    return 1;
+}
 
-        record->remainingEnergy = sqlite3_column_double(stmt, 2);
-        record->price = sqlite3_column_double(stmt, 3); // 使用price字段存储threshold
+/* 仅当内容与上次发布的不同时才发布页面（按缓存中的ETag比较） */
+int publish_page_if_changed(const char *web_path, const char *name, const PageBuffer *page)
+{
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", hash_bytes(page->data, page->length));
 
-        const char *alert_message = (const char *)sqlite3_column_text(stmt, 4);
-        strncpy(record->meterStatus, alert_message ? alert_message : "", sizeof(record->meterStatus) - 1);
+    PageSnapshot *current = page_cache_acquire(name);
+    int unchanged = current && strcmp(current->etag, etag) == 0;
+    page_snapshot_release(current);
 
-        const char *meter_update_time = (const char *)sqlite3_column_text(stmt, 5);
-        strncpy(record->meterUpdateTime, meter_update_time ? meter_update_time : "", sizeof(record->meterUpdateTime) - 1);
+    if (unchanged)
+        return 1;
+    return publish_page(web_path, name, page);
+}
 
-        (*count)++;
+/* 开始分块发布页面：在发布目录和系统临时目录各打开一组临时文件，并初始化gzip流 */
+int page_stream_open(PageStream *stream, const char *web_path, const char *name)
+{
+    memset(stream, 0, sizeof(*stream));
+    snprintf(stream->name, sizeof(stream->name), "%s", name);
+    snprintf(stream->filepath, sizeof(stream->filepath), "%s/%s", web_path, name);
+    snprintf(stream->gzPath, sizeof(stream->gzPath), "%s.gz", stream->filepath);
+    snprintf(stream->tempPath, sizeof(stream->tempPath), "%s.tmp", stream->filepath);
+    snprintf(stream->tempGzPath, sizeof(stream->tempGzPath), "%s.tmp", stream->gzPath);
+    stream->hash = hash_bytes(NULL, 0);
+
+    char temp_dir[MAX_PATH];
+    if (GetTempPathA(sizeof(temp_dir), temp_dir) &&
+        GetTempFileNameA(temp_dir, "emp", 0, stream->snapshotPath) &&
+        GetTempFileNameA(temp_dir, "emp", 0, stream->snapshotGzPath))
+    {
+        stream->html = fopen(stream->tempPath, "wb");
+        stream->gzip = fopen(stream->tempGzPath, "wb");
+        stream->snapshotHtml = fopen(stream->snapshotPath, "wb");
+        stream->snapshotGzip = fopen(stream->snapshotGzPath, "wb");
+    }
+    if (stream->html && stream->gzip && stream->snapshotHtml && stream->snapshotGzip &&
+        deflateInit2(&stream->deflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+    {
+        stream->deflateReady = 1;
+        return 1;
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    char error_msg[600];
+    snprintf(error_msg, sizeof(error_msg), "无法创建页面临时文件: %s", stream->filepath);
+    write_log("ERROR", error_msg);
+    page_stream_discard(stream);
+    return 0;
+}
 
-    char success_msg[128];
-    snprintf(success_msg, sizeof(success_msg), "成功读取 %d 条警报记录", *count);
-    write_log("INFO", success_msg);
+/* 压缩一段数据并把产生的gzip输出写入两个.gz文件，flush为Z_FINISH时结束gzip流 */
+int page_stream_deflate(PageStream *stream, const char *data, size_t length, int flush)
+{
+    unsigned char out[16384];
+    stream->deflate.next_in = (Bytef *)data;
+    stream->deflate.avail_in = (uInt)length;
+
+    int rc;
+    do
+    {
+        stream->deflate.next_out = out;
+        stream->deflate.avail_out = sizeof(out);
+        rc = deflate(&stream->deflate, flush);
+        if (rc == Z_STREAM_ERROR)
+            return 0;
+        size_t produced = sizeof(out) - stream->deflate.avail_out;
+        if (produced > 0 &&
+            (fwrite(out, 1, produced, stream->gzip) != produced ||
+             fwrite(out, 1, produced, stream->snapshotGzip) != produced))
+            return 0;
+    } while (flush == Z_FINISH ? rc != Z_STREAM_END : stream->deflate.avail_out == 0);
     return 1;
 }
 
-/* 生成完整的HTML页面（包括实时监控、历史记录、警报记录） */
-int generate_complete_html_pages(const char *web_path, const ElectricMeter *current_meter, double threshold)
+/* 写出缓冲区中已渲染的部分并清空缓冲区，缓冲区曾追加失败或写入失败时整页作废 */
+void page_stream_write(PageStream *stream, PageBuffer *chunk)
 {
-    create_directory(web_path);
-
-    // 读取数据库记录
-    ElectricMeter *records = NULL;
-    int record_count = 0;
-    ElectricMeter *alerts = NULL;
-    int alert_count = 0;
+    if (chunk->failed)
+        stream->failed = 1;
+    if (!stream->failed && chunk->length > 0)
+    {
+        stream->hash = hash_bytes_continue(stream->hash, chunk->data, chunk->length);
+        if (fwrite(chunk->data, 1, chunk->length, stream->html) != chunk->length ||
+            fwrite(chunk->data, 1, chunk->length, stream->snapshotHtml) != chunk->length ||
+            !page_stream_deflate(stream, chunk->data, chunk->length, Z_NO_FLUSH))
+            stream->failed = 1;
+    }
 
-    // 读取历史记录
-    read_database_records("electric_data.db", &records, &record_count);
-    read_alerts_records("electric_data.db", &alerts, &alert_count);
+    chunk->length = 0;
+    chunk->failed = 0;
+    if (chunk->data)
+        chunk->data[0] = '\0';
+}
 
-    // 生成实时监控页面
-    generate_index_html(web_path, current_meter, threshold);
+/* 关闭分块发布的文件，返回0表示有文件没能完整写入 */
+int page_stream_close_files(PageStream *stream)
+{
+    FILE **files[] = {&stream->html, &stream->gzip, &stream->snapshotHtml, &stream->snapshotGzip};
+    int ok = 1;
+    for (int i = 0; i < (int)(sizeof(files) / sizeof(files[0])); i++)
+    {
+        if (*files[i] && fclose(*files[i]) != 0)
+            ok = 0;
+        *files[i] = NULL;
+    }
+    if (stream->deflateReady)
+    {
+        deflateEnd(&stream->deflate);
+        stream->deflateReady = 0;
+    }
+    return ok;
+}
 
-    // 生成历史记录页面
-    generate_history_html(web_path, records, record_count, alerts, alert_count);
+/* 放弃分块发布：关闭并删除全部临时文件，已发布的旧页面保持不变 */
+void page_stream_discard(PageStream *stream)
+{
+    page_stream_close_files(stream);
+    const char *paths[] = {stream->tempPath, stream->tempGzPath, stream->snapshotPath, stream->snapshotGzPath};
+    for (int i = 0; i < (int)(sizeof(paths) / sizeof(paths[0])); i++)
+    {
+        if (paths[i][0])
+            DeleteFileA(paths[i]);
+    }
+}
 
-    // 生成警报记录页面
-    generate_alerts_html(web_path, alerts, alert_count);
+/* 完成分块发布：写出剩余内容并结束gzip流，与publish_page一样先替换HTML再替换.gz，
+   然后把系统临时目录中的副本映射为内存缓存中的快照 */
+int page_stream_publish(PageStream *stream, PageBuffer *rest)
+{
+    page_stream_write(stream, rest);
+    if (!stream->failed && !page_stream_deflate(stream, NULL, 0, Z_FINISH))
+        stream->failed = 1;
+    if (!page_stream_close_files(stream))
+        stream->failed = 1;
+
+    char error_msg[600];
+    if (stream->failed)
+    {
+        snprintf(error_msg, sizeof(error_msg), "页面分块写入失败，保留上一版本: %s", stream->filepath);
+        write_log("ERROR", error_msg);
+        page_stream_discard(stream);
+        return 0;
+    }
 
-    // 释放内存
-    if (records)
-        free(records);
-    if (alerts)
-        free(alerts);
+    if (!MoveFileExA(stream->tempPath, stream->filepath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        snprintf(error_msg, sizeof(error_msg), "无法写入页面: %s", stream->filepath);
+        write_log("ERROR", error_msg);
+        page_stream_discard(stream);
+        return 0;
+    }
+    if (!MoveFileExA(stream->tempGzPath, stream->gzPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        snprintf(error_msg, sizeof(error_msg), "无法写入压缩页面: %s", stream->gzPath);
+        write_log("ERROR", error_msg);
+        DeleteFileA(stream->tempGzPath);
+        DeleteFileA(stream->gzPath);
+    }
 
-    write_log("INFO", "完整HTML页面生成完成");
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", stream->hash);
+    page_cache_store_files(stream->name, etag, stream->snapshotPath, stream->snapshotGzPath);
+    InterlockedIncrement(&render_pages_published);
     return 1;
 }
-/* 计算精确的日均用电量 */
-double calculate_daily_consumption_from_db(const char *db_path) {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
-    int rc;
-    double daily_consumption = 5.0; // 默认值
 
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK) {
-        return daily_consumption;
-    }
+/* 根据内容哈希生成共享样式表和脚本的文件名 */
+void init_static_assets(void)
+{
+    snprintf(app_css_name, sizeof(app_css_name), "app.%016llx.css", hash_bytes(app_css, sizeof(app_css) - 1));
+    snprintf(app_js_name, sizeof(app_js_name), "app.%016llx.js", hash_bytes(app_js, sizeof(app_js) - 1));
+}
 
-    // 获取最近144条记录（假设每10分钟一条，约24小时数据）
-    const char *sql = "SELECT record_time, total_consumption FROM electric_data "
-                      "ORDER BY record_time DESC LIMIT 144;";
+/* 发布一个静态资源：文件名已包含内容哈希，同名文件存在即内容相同，不再重写 */
+int publish_static_asset(const char *web_path, const char *name, const char *data, size_t length)
+{
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", web_path, name);
+
+    PageBuffer asset = {(char *)data, length, length, 0};
+    if (GetFileAttributesA(filepath) == INVALID_FILE_ATTRIBUTES)
+        return publish_page(web_path, name, &asset);
+
+    PageSnapshot *cached = page_cache_acquire(name);
+    if (cached)
+    {
+        page_snapshot_release(cached);
+        return 1;
+    }
+    cache_rendered_page(name, &asset);
+    return 1;
+}
+
+/* 发布各页面共用的样式表和脚本 */
+int publish_static_assets(const char *web_path)
+{
+    int css_ok = publish_static_asset(web_path, app_css_name, app_css, sizeof(app_css) - 1);
+    int js_ok = publish_static_asset(web_path, app_js_name, app_js, sizeof(app_js) - 1);
+    if (!css_ok || !js_ok)
+    {
+        write_log("ERROR", "无法写出共享样式表或脚本文件");
+        return 0;
+    }
+    return 1;
+}
+
+/* 验证配置 */
+int validate_config(const Config *config)
+{
+    if (config->monitorInterval <= 0)
+    {
+        printf("错误: 监控间隔必须大于0\n");
+        return 0;
+    }
+    if (config->lowEnergyThreshold <= 0)
+    {
+        printf("错误: 低电量阈值必须大于0\n");
+        return 0;
+    }
+    if (strlen(config->curlCommand) == 0)
+    {
+        printf("错误: CURL命令不能为空\n");
+        return 0;
+    }
+    if (strlen(config->dbPath) == 0)
+    {
+        printf("错误: 数据库路径不能为空\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* 读取配置文件 */
+int read_config(const char *filename, Config *config)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        printf("无法打开配置文件: %s\n", filename);
+        return 0;
+    }
+
+    char line[CONFIG_SIZE];
+    int found_interval = 0;
+    int found_threshold = 0;
+    int found_curl = 0;
+
+    // 设置默认值
+    strcpy(config->dbPath, "electric_data.db");
+    strcpy(config->smtpServer, "smtp.qq.com");
+    config->smtpPort = 587;
+    config->smtpSecurity = SMTP_SECURITY_STARTTLS;
+    int found_security = 0;
+    strcpy(config->emailAccount, "");
+    strcpy(config->emailAuthCode, "");
+    strcpy(config->emailReceivers, "");
+    strcpy(config->webPath, "web");
+    config->httpPort = 0;
+    config->renderMode = RENDER_MODE_HTML;
+    config->alertRuleCount = 0;
+    config->quietStart = 0;
+    config->quietEnd = 0;
+    config->digestWindow = 0;
+    strcpy(config->notifySocket, "");
+    strcpy(config->notifyWebhook, "");
+    config->logLevel = LOG_LEVEL_INFO;
+    config->logMaxSize = 10;
+    strcpy(config->eventLogPath, "");
+    strcpy(config->metricsFile, "");
+    strcpy(config->traceFile, "");
+    strcpy(config->captureFile, "");
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        if (strstr(line, "MONITOR_INTERVAL") != NULL)
+        {
+            if (sscanf(line, "MONITOR_INTERVAL=%d", &config->monitorInterval) == 1)
+            {
+                found_interval = 1;
+            }
+        }
+        else if (strstr(line, "LOW_ENERGY_THRESHOLD") != NULL)
+        {
+            if (sscanf(line, "LOW_ENERGY_THRESHOLD=%lf", &config->lowEnergyThreshold) == 1)
+            {
+                found_threshold = 1;
+            }
+        }
+        else if (strstr(line, "CURL_COMMAND") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strcpy(config->curlCommand, equals + 1);
+                found_curl = 1;
+            }
+        }
+        else if (strstr(line, "DATABASE_PATH") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strcpy(config->dbPath, equals + 1);
+            }
+        }
+        else if (strstr(line, "SMTP_SERVER") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strcpy(config->smtpServer, equals + 1);
+            }
+        }
+        else if (strstr(line, "SMTP_PORT") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                config->smtpPort = atoi(equals + 1);
+            }
+        }
+        else if (strstr(line, "SMTP_SECURITY") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                if (strcmp(equals + 1, "ssl") == 0)
+                    config->smtpSecurity = SMTP_SECURITY_SSL;
+                else if (strcmp(equals + 1, "none") == 0)
+                    config->smtpSecurity = SMTP_SECURITY_NONE;
+                else
+                    config->smtpSecurity = SMTP_SECURITY_STARTTLS;
+                found_security = 1;
+            }
+        }
+        else if (strstr(line, "EMAIL_ACCOUNT") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strcpy(config->emailAccount, equals + 1);
+            }
+        }
+        else if (strstr(line, "EMAIL_AUTH_CODE") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strcpy(config->emailAuthCode, equals + 1);
+            }
+        }
+        else if (strstr(line, "EMAIL_RECEIVERS") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strcpy(config->emailReceivers, equals + 1);
+            }
+        }
+        else if (strstr(line, "WEB_PATH") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strcpy(config->webPath, equals + 1);
+            }
+        }
+        else if (strstr(line, "HTTP_PORT") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                config->httpPort = atoi(equals + 1);
+            }
+        }
+        else if (strstr(line, "WEB_RENDER_MODE") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                if (strcmp(equals + 1, "json") == 0)
+                    config->renderMode = RENDER_MODE_JSON;
+                else if (strcmp(equals + 1, "both") == 0)
+                    config->renderMode = RENDER_MODE_HTML | RENDER_MODE_JSON;
+                else
+                    config->renderMode = RENDER_MODE_HTML;
+            }
+        }
+        else if (strstr(line, "ALERT_RULE") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                if (config->alertRuleCount >= ALERT_MAX_RULES)
+                {
+                    printf("警告: 警报规则超过 %d 条，忽略: %s\n", ALERT_MAX_RULES, equals + 1);
+                }
+                else if (compile_alert_rule(equals + 1, &config->alertRules[config->alertRuleCount]))
+                {
+                    config->alertRuleCount++;
+                }
+                else
+                {
+                    printf("错误: 无法解析警报规则: %s\n", equals + 1);
+                    fclose(file);
+                    return 0;
+                }
+            }
+        }
+        else if (strstr(line, "LOG_LEVEL") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                config->logLevel = log_level_value(equals + 1);
+            }
+        }
+        else if (strstr(line, "LOG_MAX_SIZE") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                config->logMaxSize = atoi(equals + 1);
+            }
+        }
+        else if (strstr(line, "EVENT_LOG") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strncpy(config->eventLogPath, equals + 1, sizeof(config->eventLogPath) - 1);
+            }
+        }
+        else if (strstr(line, "METRICS_FILE") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strncpy(config->metricsFile, equals + 1, sizeof(config->metricsFile) - 1);
+            }
+        }
+        else if (strstr(line, "TRACE_FILE") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strncpy(config->traceFile, equals + 1, sizeof(config->traceFile) - 1);
+            }
+        }
+        else if (strstr(line, "CAPTURE_FILE") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strncpy(config->captureFile, equals + 1, sizeof(config->captureFile) - 1);
+            }
+        }
+        else if (strstr(line, "NOTIFY_SOCKET") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strncpy(config->notifySocket, equals + 1, sizeof(config->notifySocket) - 1);
+            }
+        }
+        else if (strstr(line, "NOTIFY_WEBHOOK") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals)
+            {
+                strncpy(config->notifyWebhook, equals + 1, sizeof(config->notifyWebhook) - 1);
+            }
+        }
+        else if (strstr(line, "ALERT_DIGEST_WINDOW") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            if (equals && atoi(equals + 1) > 0)
+            {
+                config->digestWindow = atoi(equals + 1);
+            }
+        }
+        else if (strstr(line, "ALERT_QUIET_HOURS") != NULL)
+        {
+            char *equals = strchr(line, '=');
+            int start, end;
+            if (equals && sscanf(equals + 1, "%d-%d", &start, &end) == 2 &&
+                start >= 0 && start < 24 && end >= 0 && end < 24)
+            {
+                config->quietStart = start;
+                config->quietEnd = end;
+            }
+        }
+    }
+
+    fclose(file);
+
+    // 未指定加密方式时，465端口按惯例使用隐式TLS
+    if (!found_security && config->smtpPort == 465)
+        config->smtpSecurity = SMTP_SECURITY_SSL;
+
+    if (!found_interval || !found_threshold || !found_curl)
+    {
+        printf("配置文件缺少必要参数\n");
+        printf("需要: MONITOR_INTERVAL, LOW_ENERGY_THRESHOLD, CURL_COMMAND\n");
+        return 0;
+    }
+
+    if (!validate_config(config))
+    {
+        return 0;
+    }
+
+    // 没有配置规则时沿用原来的行为：电量低于阈值每次查询提醒一次，最多3次，恢复后重新计数
+    if (config->alertRuleCount == 0)
+    {
+        AlertRule *rule = &config->alertRules[0];
+        memset(rule, 0, sizeof(AlertRule));
+        strcpy(rule->name, "低电量");
+        rule->metric = ALERT_METRIC_ENERGY;
+        rule->sign = 1.0;
+        rule->trigger = config->lowEnergyThreshold;
+        rule->clear = config->lowEnergyThreshold;
+        rule->maxNotify = 3;
+        config->alertRuleCount = 1;
+    }
+
+    return 1;
+}
+
+/* 初始化数据库 */
+int init_database(const char *db_path)
+{
+    sqlite3 *db;
+    char *err_msg = 0;
+    int rc;
+
+    rc = sqlite3_open(db_path, &db);
+    if (rc != SQLITE_OK)
+    {
+        printf("数据库打开失败: %s\n", sqlite3_errmsg(db));
+        return 0;
+    }
+
+    const char *sql = "CREATE TABLE IF NOT EXISTS electric_data ("
+                      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                      "record_time DATETIME DEFAULT CURRENT_TIMESTAMP,"
+                      "remaining_energy REAL NOT NULL,"
+                      "remaining_amount REAL NOT NULL,"
+                      "total_consumption REAL NOT NULL,"
+                      "price REAL NOT NULL,"
+                      "meter_status TEXT,"
+                      "meter_update_time TEXT,"
+                      "system_time TEXT,"
+                      "meter_id TEXT);";
+
+    rc = sqlite3_exec(db, sql, 0, 0, &err_msg);
+    if (rc != SQLITE_OK)
+    {
+        printf("创建表失败: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_close(db);
+        return 0;
+    }
+
+    // 旧版本建的表没有电表编号列，补上；列已存在时这条语句失败，忽略即可
+    sqlite3_exec(db, "ALTER TABLE electric_data ADD COLUMN meter_id TEXT;", 0, 0, 0);
+
+    const char *sql2 = "CREATE TABLE IF NOT EXISTS low_energy_alerts ("
+                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       "alert_time DATETIME DEFAULT CURRENT_TIMESTAMP,"
+                       "remaining_energy REAL NOT NULL,"
+                       "threshold REAL NOT NULL,"
+                       "alert_message TEXT,"
+                       "meter_update_time TEXT);";
+
+    rc = sqlite3_exec(db, sql2, 0, 0, &err_msg);
+    if (rc != SQLITE_OK)
+    {
+        printf("创建警报表失败: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_close(db);
+        return 0;
+    }
+
+    // 邮件发件箱：警报邮件先入库再由后台线程投递，程序退出后未发出的邮件不会丢失
+    const char *sql3 = "CREATE TABLE IF NOT EXISTS email_outbox ("
+                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       "dedup_key TEXT NOT NULL UNIQUE,"
+                       "created_at INTEGER NOT NULL,"
+                       "next_attempt INTEGER NOT NULL,"
+                       "attempts INTEGER NOT NULL DEFAULT 0,"
+                       "status TEXT NOT NULL DEFAULT 'pending',"
+                       "recipients TEXT NOT NULL,"
+                       "subject TEXT NOT NULL,"
+                       "body TEXT NOT NULL,"
+                       "sent_at INTEGER,"
+                       "last_error TEXT);"
+                       "CREATE INDEX IF NOT EXISTS idx_email_outbox_due ON email_outbox(status, next_attempt);";
+
+    rc = sqlite3_exec(db, sql3, 0, 0, &err_msg);
+    if (rc != SQLITE_OK)
+    {
+        printf("创建发件箱表失败: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_close(db);
+        return 0;
+    }
+
+    // 警报汇总：窗口内的警报按收件人列表攒成一封邮件；digest_id为空表示还未汇总，
+    // 同一收件人同一规则在未汇总期间只保留一条（更新为最新读数并计数）
+    const char *sql4 = "CREATE TABLE IF NOT EXISTS alert_digest_items ("
+                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       "recipients TEXT NOT NULL,"
+                       "condition_key TEXT NOT NULL,"
+                       "created_at INTEGER NOT NULL,"
+                       "updated_at INTEGER NOT NULL,"
+                       "hits INTEGER NOT NULL DEFAULT 1,"
+                       "rule_name TEXT NOT NULL,"
+                       "reason TEXT NOT NULL,"
+                       "remaining_energy REAL,"
+                       "remaining_amount REAL,"
+                       "meter_update_time TEXT,"
+                       "digest_id INTEGER);"
+                       "CREATE UNIQUE INDEX IF NOT EXISTS idx_alert_digest_pending "
+                       "ON alert_digest_items(recipients, condition_key) WHERE digest_id IS NULL;";
+
+    rc = sqlite3_exec(db, sql4, 0, 0, &err_msg);
+    if (rc != SQLITE_OK)
+    {
+        printf("创建警报汇总表失败: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_close(db);
+        return 0;
+    }
+
+    // WAL模式下页面渲染的读事务不会阻塞下一次写入
+    sqlite3_exec(db, "PRAGMA journal_mode=WAL;", 0, 0, 0);
+
+    sqlite3_close(db);
+    printf("数据库初始化成功: %s\n", db_path);
+    return 1;
+}
+
+/* 写入一条读数的语句，save_to_database和入库基准测试共用，参数依次绑定 */
+static const char electric_data_insert_sql[] =
+    "INSERT INTO electric_data (remaining_energy, remaining_amount, total_consumption, price, meter_status, meter_update_time, system_time, record_time, meter_id) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);";
+
+/* 保存电表数据到数据库，成功后回填记录ID和记录时间 */
+int save_to_database(const char *db_path, ElectricMeter *meter)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    int rc;
+
+    TRACE_SPAN("db_open", "database", NULL, 0, rc = sqlite3_open(db_path, &db));
+    if (rc != SQLITE_OK)
+    {
+        write_log("ERROR", "无法打开数据库");
+        return 0;
+    }
+    // 渲染线程和发件箱线程同时持有连接，写锁被占用时等待而不是直接失败
+    sqlite3_busy_timeout(db, 5000);
+    // 模拟数据随时可以重新生成，虚拟时钟下不等待每次提交落盘
+    if (clock_virtual)
+        sqlite3_exec(db, "PRAGMA synchronous=OFF;", 0, 0, 0);
+
+    // 记录时间由程序时钟生成而不是数据库默认值，模拟模式下入库的是虚拟时间
+    char record_time[32];
+    clock_sql_time(record_time, sizeof(record_time), 0);
+    TRACE_SPAN("db_prepare", "database", NULL, 0, rc = sqlite3_prepare_v2(db, electric_data_insert_sql, -1, &stmt, 0));
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        write_log("ERROR", "准备SQL语句失败");
+        return 0;
+    }
+
+    sqlite3_bind_double(stmt, 1, meter->remainingEnergy);
+    sqlite3_bind_double(stmt, 2, meter->remainingAmount);
+    sqlite3_bind_double(stmt, 3, meter->totalConsumption);
+    sqlite3_bind_double(stmt, 4, meter->price);
+    sqlite3_bind_text(stmt, 5, meter->meterStatus, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, meter->meterUpdateTime, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, meter->systemTime, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 8, record_time, -1, SQLITE_STATIC);
+    if (meter->meterId[0])
+        sqlite3_bind_text(stmt, 9, meter->meterId, -1, SQLITE_STATIC);
+    else
+        sqlite3_bind_null(stmt, 9);
+
+    TRACE_SPAN("db_step", "database", "rc", rc, rc = sqlite3_step(stmt));
+    if (rc != SQLITE_DONE)
+    {
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+        write_log("ERROR", "执行SQL语句失败");
+        return 0;
+    }
+
+    sqlite3_finalize(stmt);
+
+    meter->id = (int)sqlite3_last_insert_rowid(db);
+    snprintf(meter->record_time, sizeof(meter->record_time), "%s", record_time);
+
+    sqlite3_close(db);
+    write_log("INFO", "电表数据保存到数据库成功");
+    return 1;
+}
+
+/* 保存警报到数据库，message为空时使用默认的低电量说明；alert不为空时按render_alert_json所用的格式回填这条警报 */
+int save_alert_to_database(const char *db_path, const ElectricMeter *meter, double threshold, const char *message, ElectricMeter *alert)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    int rc;
+
+    TRACE_SPAN("db_open", "database", NULL, 0, rc = sqlite3_open(db_path, &db));
+    if (rc != SQLITE_OK)
+    {
+        write_log("ERROR", "无法打开数据库保存警报");
+        return 0;
+    }
+    sqlite3_busy_timeout(db, 5000); // 与采集、发件箱并发写入时等待锁，否则警报ID取不到，去重键会退回到按时间生成
+
+    char alert_msg[256];
+    if (message)
+        snprintf(alert_msg, sizeof(alert_msg), "%s", message);
+    else
+        snprintf(alert_msg, sizeof(alert_msg), "低电量警报: 剩余%.2f度电", meter->remainingEnergy);
+
+    char alert_time[32];
+    clock_sql_time(alert_time, sizeof(alert_time), 0);
+    const char *sql = "INSERT INTO low_energy_alerts (remaining_energy, threshold, alert_message, meter_update_time, alert_time) VALUES (?, ?, ?, ?, ?);";
+
+    TRACE_SPAN("db_prepare", "database", NULL, 0, rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0));
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        write_log("ERROR", "准备警报SQL语句失败");
+        return 0;
+    }
+
+    sqlite3_bind_double(stmt, 1, meter->remainingEnergy);
+    sqlite3_bind_double(stmt, 2, threshold);
+    sqlite3_bind_text(stmt, 3, alert_msg, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, meter->meterUpdateTime, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, alert_time, -1, SQLITE_STATIC);
+
+    TRACE_SPAN("db_step", "database", "rc", rc, rc = sqlite3_step(stmt));
+    if (rc != SQLITE_DONE)
+    {
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+        write_log("ERROR", "执行警报SQL语句失败");
+        return 0;
+    }
+
+    sqlite3_finalize(stmt);
+
+    if (alert)
+    {
+        memset(alert, 0, sizeof(ElectricMeter));
+        alert->id = (int)sqlite3_last_insert_rowid(db);
+        snprintf(alert->record_time, sizeof(alert->record_time), "%s", alert_time);
+        alert->remainingEnergy = meter->remainingEnergy;
+        alert->price = threshold; // price字段存储threshold
+        strncpy(alert->meterStatus, alert_msg, sizeof(alert->meterStatus) - 1);
+        strncpy(alert->meterUpdateTime, meter->meterUpdateTime, sizeof(alert->meterUpdateTime) - 1);
+    }
+
+    sqlite3_close(db);
+    write_log("ALERT", "低电量警报保存到数据库");
+    return 1;
+}
+
+/* 从curl命令中提取URL和参数 */
+void parse_curl_command(const char *curl_cmd, char *url, char *post_data, char *headers)
+{
+    url[0] = '\0';
+    post_data[0] = '\0';
+    headers[0] = '\0';
+
+    const char *url_start = strstr(curl_cmd, "\"http");
+    if (!url_start)
+        return;
+
+    const char *url_end = strchr(url_start + 1, '\"');
+    if (!url_end)
+        return;
+
+    int url_len = url_end - url_start - 1;
+    strncpy(url, url_start + 1, url_len);
+    url[url_len] = '\0';
+
+    const char *data_start = strstr(curl_cmd, "--data-raw");
+    if (data_start)
+    {
+        data_start = strchr(data_start, '\"');
+        if (data_start)
+        {
+            const char *data_end = strchr(data_start + 1, '\"');
+            if (data_end)
+            {
+                int data_len = data_end - data_start - 1;
+                strncpy(post_data, data_start + 1, data_len);
+                post_data[data_len] = '\0';
+            }
+        }
+    }
+}
+
+/* 使用WinINet发送HTTP请求 */
+int http_post_request(const char *url, const char *post_data, const char *headers, char *response, int response_size)
+{
+    HINTERNET hInternet = NULL;
+    HINTERNET hConnect = NULL;
+    HINTERNET hRequest = NULL;
+
+    int result = 0;
+    DWORD bytesRead;
+    DWORD totalBytesRead = 0;
+    char buffer[1024];
+
+    ULONGLONG started = GetTickCount64();
+    hInternet = InternetOpenA("ElectricMonitor", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+    if (!hInternet)
+    {
+        log_event(EVENT_HTTP_ERROR, 1, GetLastError(), 0);
+        write_log("ERROR", "InternetOpenA 失败");
+        return 0;
+    }
+
+    URL_COMPONENTSA urlComp;
+    memset(&urlComp, 0, sizeof(urlComp));
+    urlComp.dwStructSize = sizeof(urlComp);
+
+    char host[256] = {0};
+    char path[1024] = {0};
+    urlComp.lpszHostName = host;
+    urlComp.dwHostNameLength = sizeof(host);
+    urlComp.lpszUrlPath = path;
+    urlComp.dwUrlPathLength = sizeof(path);
+
+    if (!InternetCrackUrlA(url, (DWORD)strlen(url), 0, &urlComp))
+    {
+        log_event(EVENT_HTTP_ERROR, 2, GetLastError(), 0);
+        write_log("ERROR", "InternetCrackUrlA 失败");
+        InternetCloseHandle(hInternet);
+        return 0;
+    }
+
+    hConnect = InternetConnectA(hInternet, host, urlComp.nPort, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
+    if (!hConnect)
+    {
+        log_event(EVENT_HTTP_ERROR, 3, GetLastError(), 0);
+        write_log("ERROR", "InternetConnectA 失败");
+        InternetCloseHandle(hInternet);
+        return 0;
+    }
+
+    DWORD flags = INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE;
+    if (urlComp.nPort == 443)
+    {
+        flags |= INTERNET_FLAG_SECURE;
+    }
+
+    hRequest = HttpOpenRequestA(hConnect, "POST", path, NULL, NULL, NULL, flags, 0);
+    if (!hRequest)
+    {
+        log_event(EVENT_HTTP_ERROR, 4, GetLastError(), 0);
+        write_log("ERROR", "HttpOpenRequestA 失败");
+        InternetCloseHandle(hConnect);
+        InternetCloseHandle(hInternet);
+        return 0;
+    }
+
+    char full_headers[2048] = "Content-Type: application/x-www-form-urlencoded\r\n";
+    if (headers && strlen(headers) > 0)
+    {
+        strcat(full_headers, headers);
+    }
+
+    HttpAddRequestHeadersA(hRequest, full_headers, (DWORD)strlen(full_headers), HTTP_ADDREQ_FLAG_ADD);
+
+    if (!HttpSendRequestA(hRequest, NULL, 0, (LPVOID)post_data, (DWORD)strlen(post_data)))
+    {
+        DWORD error = GetLastError();
+        log_event(EVENT_HTTP_ERROR, 5, error, 0);
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "HttpSendRequestA 失败，错误代码: %lu", error);
+        write_log("ERROR", error_msg);
+        InternetCloseHandle(hRequest);
+        InternetCloseHandle(hConnect);
+        InternetCloseHandle(hInternet);
+        return 0;
+    }
+
+    // 非2xx的状态码算HTTP请求失败，不把错误页面交给JSON解析
+    DWORD status = 0;
+    DWORD status_length = sizeof(status);
+    if (HttpQueryInfoA(hRequest, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &status_length, NULL) &&
+        (status < 200 || status >= 300))
+    {
+        log_event(EVENT_HTTP_ERROR, 6, status, 0);
+        char error_msg[128];
+        snprintf(error_msg, sizeof(error_msg), "HTTP请求返回状态码 %lu", (unsigned long)status);
+        write_log("ERROR", error_msg);
+        InternetCloseHandle(hRequest);
+        InternetCloseHandle(hConnect);
+        InternetCloseHandle(hInternet);
+        return 0;
+    }
+
+    int truncated = 0;
+    while (InternetReadFile(hRequest, buffer, sizeof(buffer) - 1, &bytesRead) && bytesRead > 0)
+    {
+        if (totalBytesRead + bytesRead < (DWORD)response_size)
+        {
+            memcpy(response + totalBytesRead, buffer, bytesRead);
+            totalBytesRead += bytesRead;
+        }
+        else
+        {
+            truncated = 1;
+            break;
+        }
+    }
+
+    response[totalBytesRead] = '\0';
+    result = 1;
+    log_event(EVENT_HTTP_RESPONSE, totalBytesRead, (long long)(GetTickCount64() - started), 0);
+    if (truncated)
+    {
+        // 只保留前面能放下的部分，字段通常在前面，仍交给解析；记录下来以便发现接口响应变大
+        log_event(EVENT_HTTP_ERROR, 7, response_size, 0);
+        char error_msg[128];
+        snprintf(error_msg, sizeof(error_msg), "HTTP响应超过 %d 字节，超出部分已丢弃", response_size - 1);
+        write_log("WARN", error_msg);
+    }
+
+    if (hRequest)
+        InternetCloseHandle(hRequest);
+    if (hConnect)
+        InternetCloseHandle(hConnect);
+    if (hInternet)
+        InternetCloseHandle(hInternet);
+
+    return result;
+}
+
+/* 解析JSON响应 */
+int parse_json_response(const char *json_str, ElectricMeter *meter)
+{
+    memset(meter, 0, sizeof(ElectricMeter));
+
+    if (strlen(json_str) == 0)
+    {
+        write_log("ERROR", "JSON响应为空");
+        return 0;
+    }
+
+    // 查找data字段
+    const char *data_start = strstr(json_str, "\"data\"");
+    if (!data_start)
+    {
+        write_log("ERROR", "未找到data字段");
+        return 0;
+    }
+
+    const char *shengyu_str = strstr(data_start, "\"shengyu\"");
+    const char *leiji_str = strstr(data_start, "\"leiji\"");
+    const char *price_str = strstr(data_start, "\"price\"");
+    const char *zhuangtai_str = strstr(data_start, "\"zhuangtai\"");
+    const char *meterid_str = strstr(data_start, "\"meterid\"");
+
+    if (shengyu_str)
+    {
+        char shengyu_value[50];
+        if (sscanf(shengyu_str, "\"shengyu\":\"%[^\"]\"", shengyu_value) == 1)
+        {
+            meter->remainingEnergy = atof(shengyu_value);
+        }
+    }
+    else
+    {
+        write_log("ERROR", "未找到剩余电量字段");
+        return 0;
+    }
+
+    if (leiji_str)
+    {
+        char leiji_value[50];
+        if (sscanf(leiji_str, "\"leiji\":\"%[^\"]\"", leiji_value) == 1)
+        {
+            meter->totalConsumption = atof(leiji_value);
+        }
+    }
+
+    if (price_str)
+    {
+        char price_value[50];
+        if (sscanf(price_str, "\"price\":\"%[^\"]\"", price_value) == 1)
+        {
+            meter->price = atof(price_value);
+            meter->remainingAmount = meter->remainingEnergy * meter->price;
+        }
+    }
+
+    if (zhuangtai_str)
+    {
+        const char *status_start = strchr(zhuangtai_str, ':');
+        if (status_start)
+        {
+            status_start++;
+            const char *quote1 = strchr(status_start, '\"');
+            if (quote1)
+            {
+                const char *quote2 = strchr(quote1 + 1, '\"');
+                if (quote2)
+                {
+                    size_t len = quote2 - quote1 - 1;
+                    if (len < sizeof(meter->meterStatus) - 1)
+                    {
+                        strncpy(meter->meterStatus, quote1 + 1, len);
+                        meter->meterStatus[len] = '\0';
+                    }
+                }
+            }
+        }
+    }
+
+    if (meterid_str)
+        sscanf(meterid_str, "\"meterid\":\"%31[^\"]\"", meter->meterId);
+
+    SYSTEMTIME st;
+    clock_local_time(&st);
+    sprintf(meter->systemTime, "%04d-%02d-%02d %02d:%02d:%02d",
+            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+
+    strcpy(meter->meterUpdateTime, meter->systemTime);
+
+    return 1;
+}
+
+/* 压缩每条响应时使用的预置字典：单条响应只有一百多字节，靠字典里常见的键名才能压缩到二三十字节。
+   回放依赖同一份字典，修改后旧的捕获文件会因CRC不符而无法回放 */
+static const char capture_dictionary[] =
+    "{\"code\":500,\"msg\":\"error\"}<html>502 Bad Gateway</html>"
+    "{\"code\":200,\"msg\":\"success\",\"data\":{\"shengyu\":\"\",\"leiji\":\"\","
+    "\"price\":\"0.5469\",\"zhuangtai\":\"正常\",\"meterid\":\"\",\"room\":\"\"}}";
+
+/* 打开响应捕获文件（追加模式）。每条记录单独压缩、自带长度和校验，
+   上次运行异常退出留下的半条记录只影响它自己，回放时会跳过 */
+int start_capture(const char *path)
+{
+    capture_file = fopen(path, "ab");
+    if (!capture_file)
+        return 0;
+    capture_records = 0;
+    return 1;
+}
+
+/* 追加一条原始响应：不压缩的记录头（标记、长度、CRC、Unix毫秒时间）后跟用预置字典单独压缩的响应正文。
+   记录头和正文一次写出并刷新，进程崩溃时最多丢失最后一条；只由轮询线程调用 */
+void capture_response(const char *response, size_t length)
+{
+    if (!capture_file)
+        return;
+
+    unsigned char record[sizeof(CaptureHeader) + BUFFER_SIZE + 64];
+    CaptureHeader header;
+    header.magic = CAPTURE_MAGIC;
+    header.rawLength = (unsigned int)length;
+    header.unixMs = clock_now_ms();
+    header.crc = (unsigned int)crc32(crc32(0L, (const Bytef *)&header.unixMs, sizeof(header.unixMs)),
+                                     (const Bytef *)response, (uInt)length);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    int ok = length <= BUFFER_SIZE &&
+             deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    if (ok)
+    {
+        deflateSetDictionary(&stream, (const Bytef *)capture_dictionary, (uInt)(sizeof(capture_dictionary) - 1));
+        stream.next_in = (Bytef *)response;
+        stream.avail_in = (uInt)length;
+        stream.next_out = record + sizeof(CaptureHeader);
+        stream.avail_out = (uInt)(sizeof(record) - sizeof(CaptureHeader));
+        ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+        header.length = (unsigned int)stream.total_out;
+        deflateEnd(&stream);
+    }
+    if (!ok)
+    {
+        write_log("WARN", "响应过长或压缩失败，本条未捕获");
+        return;
+    }
+
+    memcpy(record, &header, sizeof(header));
+    size_t record_length = sizeof(CaptureHeader) + header.length;
+    if (fwrite(record, 1, record_length, capture_file) != record_length || fflush(capture_file) != 0)
+    {
+        write_log("ERROR", "写入响应捕获文件失败，停止捕获");
+        fclose(capture_file);
+        capture_file = NULL;
+        return;
+    }
+    capture_records++;
+}
+
+/* 关闭响应捕获文件 */
+void finish_capture(void)
+{
+    if (!capture_file)
+        return;
+    fclose(capture_file);
+    capture_file = NULL;
+
+    char capture_msg[96];
+    snprintf(capture_msg, sizeof(capture_msg), "本次运行捕获了 %ld 条原始响应", capture_records);
+    write_log("INFO", capture_msg);
+}
+
+/* 获取电表数据（带重试机制） */
+int get_electric_meter_data_with_retry(const Config *config, ElectricMeter *meter)
+{
+    char url[512] = {0};
+    char post_data[512] = {0};
+    char headers[1024] = {0};
+    char response[BUFFER_SIZE] = {0};
+
+    parse_curl_command(config->curlCommand, url, post_data, headers);
+
+    if (strlen(url) == 0)
+    {
+        write_log("ERROR", "无法从CURL命令中解析URL");
+        return 0;
+    }
+
+    // 启用事件日志时，每次尝试的过程信息只记为二进制事件，文本日志只保留错误
+    int text_progress = !event_log_enabled;
+    for (int attempt = 1; attempt <= MAX_RETRY_COUNT; attempt++)
+    {
+        ULONGLONG attempt_span = trace_begin();
+        ULONGLONG attempt_started = GetTickCount64();
+        log_event(EVENT_FETCH_ATTEMPT, attempt, 0, 0);
+        metric_add(METRIC_FETCH_ATTEMPTS, 1);
+        if (attempt > 1)
+            metric_add(METRIC_FETCH_RETRIES, 1);
+        printf("第%d次尝试获取数据 (共%d次)...\n", attempt, MAX_RETRY_COUNT);
+        if (text_progress)
+        {
+            char attempt_msg[128];
+            snprintf(attempt_msg, sizeof(attempt_msg), "第%d次尝试获取数据 (共%d次)...", attempt, MAX_RETRY_COUNT);
+            write_log("INFO", attempt_msg);
+        }
+
+        ULONGLONG stage_started = metric_clock();
+        int requested;
+        TRACE_SPAN("http_request", "fetch", "ok", requested,
+                   requested = http_post_request(url, post_data, headers, response, BUFFER_SIZE));
+        metric_observe(METRIC_STAGE_HTTP, stage_started);
+        if (requested)
+        {
+            // 解析之前先捕获，解析失败的响应同样可以回放复现
+            capture_response(response, strlen(response));
+            stage_started = metric_clock();
+            int parsed;
+            TRACE_SPAN("parse_json", "fetch", "ok", parsed, parsed = parse_json_response(response, meter));
+            metric_observe(METRIC_STAGE_PARSE, stage_started);
+            if (parsed)
+            {
+                log_event(EVENT_FETCH_OK, attempt, (long long)(GetTickCount64() - attempt_started), 0);
+                printf("✅ 数据获取成功 (第%d次尝试)\n", attempt);
+                if (text_progress)
+                {
+                    char success_msg[128];
+                    snprintf(success_msg, sizeof(success_msg), "数据获取成功 (第%d次尝试)", attempt);
+                    write_log("INFO", success_msg);
+                }
+                trace_end("fetch_attempt", "fetch", attempt_span, "attempt", attempt);
+                return 1;
+            }
+            else
+            {
+                log_event(EVENT_FETCH_FAILED, attempt, 2, 0);
+                char parse_error_msg[128];
+                snprintf(parse_error_msg, sizeof(parse_error_msg), "JSON解析失败 (第%d次尝试)", attempt);
+                write_log("ERROR", parse_error_msg);
+                printf("❌ %s\n", parse_error_msg);
+            }
+        }
+        else
+        {
+            log_event(EVENT_FETCH_FAILED, attempt, 1, 0);
+            char http_error_msg[128];
+            snprintf(http_error_msg, sizeof(http_error_msg), "HTTP请求失败 (第%d次尝试)", attempt);
+            write_log("ERROR", http_error_msg);
+            printf("❌ %s\n", http_error_msg);
+        }
+        trace_end("fetch_attempt", "fetch", attempt_span, "attempt", attempt);
+
+        // 如果不是最后一次尝试，等待后重试
+        if (attempt < MAX_RETRY_COUNT)
+        {
+            printf("⏳ 等待3秒后重试...\n");
+            if (text_progress)
+                write_log("INFO", "等待3秒后重试");
+            TRACE_SPAN("retry_wait", "fetch", NULL, 0, clock_sleep(3000)); // 等待3秒
+        }
+    }
+
+    log_event(EVENT_FETCH_GAVE_UP, MAX_RETRY_COUNT, 0, 0);
+    metric_add(METRIC_FETCH_FAILURES, 1);
+    write_log("ERROR", "所有重试次数已用完，数据获取失败");
+    printf("❌ 所有%d次重试均已失败，跳过本次数据获取\n", MAX_RETRY_COUNT);
+    return 0;
+}
+
+/* Base64编码（追加到缓冲区末尾），line_length大于0时每行最多line_length个字符并以CRLF换行 */
+int base64_encode(PageBuffer *out, const unsigned char *data, size_t length, int line_length)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t encoded = (length + 2) / 3 * 4;
+    size_t lines = line_length > 0 ? encoded / line_length + 1 : 0;
+    if (!page_buffer_reserve(out, encoded + lines * 2))
+        return 0;
+
+    char *p = out->data + out->length;
+    int column = 0;
+    for (size_t i = 0; i < length; i += 3)
+    {
+        unsigned int value = (unsigned int)data[i] << 16;
+        if (i + 1 < length)
+            value |= (unsigned int)data[i + 1] << 8;
+        if (i + 2 < length)
+            value |= data[i + 2];
+
+        *p++ = alphabet[(value >> 18) & 63];
+        *p++ = alphabet[(value >> 12) & 63];
+        *p++ = i + 1 < length ? alphabet[(value >> 6) & 63] : '=';
+        *p++ = i + 2 < length ? alphabet[value & 63] : '=';
+
+        column += 4;
+        if (line_length > 0 && column >= line_length)
+        {
+            *p++ = '\r';
+            *p++ = '\n';
+            column = 0;
+        }
+    }
+    if (line_length > 0 && column > 0)
+    {
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    out->length = p - out->data;
+    out->data[out->length] = '\0';
+    return 1;
+}
+
+/* 追加RFC 2047编码的邮件头文本：按UTF-8字符边界切分，每段编码后不超过75个字符 */
+int append_encoded_header(PageBuffer *out, const char *text)
+{
+    const unsigned char *p = (const unsigned char *)text;
+    size_t remaining = strlen(text);
+    int first = 1;
+
+    while (remaining > 0)
+    {
+        size_t chunk = remaining < 45 ? remaining : 45;
+        while (chunk < remaining && (p[chunk] & 0xC0) == 0x80)
+            chunk--;
+
+        page_buffer_printf(out, "%s=?UTF-8?B?", first ? "" : "\r\n ");
+        base64_encode(out, p, chunk, 0);
+        page_buffer_append(out, "?=", 2);
+        p += chunk;
+        remaining -= chunk;
+        first = 0;
+    }
+    return 1;
+}
+
+/* 在进程启动时初始化一次Winsock，SMTP会话、通知出口、内置HTTP服务和伪上游共用，进程退出时清理 */
+int winsock_init(void)
+{
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    {
+        write_log("ERROR", "Winsock初始化失败");
+        return 0;
+    }
+    atexit(winsock_cleanup);
+    return 1;
+}
+
+/* 进程退出时释放Winsock */
+void winsock_cleanup(void)
+{
+    WSACleanup();
+}
+
+/* 发送全部数据（阻塞套接字） */
+int socket_send_all(SOCKET socket, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        int sent = send(socket, data, (int)length, 0);
+        if (sent <= 0)
+            return 0;
+        data += sent;
+        length -= sent;
+    }
+    return 1;
+}
+
+/* 向服务器写数据：TLS会话按最大记录长度分块加密后发送 */
+int smtp_write(SmtpSession *session, const char *data, size_t length)
+{
+    if (!session->tls)
+        return socket_send_all(session->socket, data, length);
+
+    size_t record_size = session->sizes.cbHeader + session->sizes.cbMaximumMessage + session->sizes.cbTrailer;
+    char *record = malloc(record_size);
+    if (!record)
+        return 0;
+
+    int ok = 1;
+    while (ok && length > 0)
+    {
+        size_t chunk = length < session->sizes.cbMaximumMessage ? length : session->sizes.cbMaximumMessage;
+        memcpy(record + session->sizes.cbHeader, data, chunk);
+
+        SecBuffer buffers[4];
+        buffers[0].BufferType = SECBUFFER_STREAM_HEADER;
+        buffers[0].pvBuffer = record;
+        buffers[0].cbBuffer = session->sizes.cbHeader;
+        buffers[1].BufferType = SECBUFFER_DATA;
+        buffers[1].pvBuffer = record + session->sizes.cbHeader;
+        buffers[1].cbBuffer = (unsigned long)chunk;
+        buffers[2].BufferType = SECBUFFER_STREAM_TRAILER;
+        buffers[2].pvBuffer = record + session->sizes.cbHeader + chunk;
+        buffers[2].cbBuffer = session->sizes.cbTrailer;
+        buffers[3].BufferType = SECBUFFER_EMPTY;
+        buffers[3].pvBuffer = NULL;
+        buffers[3].cbBuffer = 0;
+        SecBufferDesc desc = {SECBUFFER_VERSION, 4, buffers};
+
+        ok = EncryptMessage(&session->context, 0, &desc, 0) == SEC_E_OK &&
+             socket_send_all(session->socket, record, buffers[0].cbBuffer + buffers[1].cbBuffer + buffers[2].cbBuffer);
+        data += chunk;
+        length -= chunk;
+    }
+    free(record);
+    return ok;
+}
+
+/* 从服务器读取更多明文到输入缓冲区：TLS会话先解密已收到的密文，不够一条记录时再接收 */
+int smtp_fill(SmtpSession *session)
+{
+    size_t space = sizeof(session->in) - session->inLength - 1;
+    if (space == 0)
+    {
+        write_log("ERROR", "SMTP应答行过长");
+        return 0;
+    }
+
+    if (!session->tls)
+    {
+        int received = recv(session->socket, session->in + session->inLength, (int)space, 0);
+        if (received <= 0)
+            return 0;
+        session->inLength += received;
+        return 1;
+    }
+
+    while (1)
+    {
+        if (session->tlsInLength > 0)
+        {
+            SecBuffer buffers[4];
+            buffers[0].BufferType = SECBUFFER_DATA;
+            buffers[0].pvBuffer = session->tlsIn;
+            buffers[0].cbBuffer = (unsigned long)session->tlsInLength;
+            for (int i = 1; i < 4; i++)
+            {
+                buffers[i].BufferType = SECBUFFER_EMPTY;
+                buffers[i].pvBuffer = NULL;
+                buffers[i].cbBuffer = 0;
+            }
+            SecBufferDesc desc = {SECBUFFER_VERSION, 4, buffers};
+
+            SECURITY_STATUS status = DecryptMessage(&session->context, &desc, 0, NULL);
+            if (status == SEC_E_OK)
+            {
+                size_t plain_length = 0;
+                SecBuffer *extra = NULL;
+                for (int i = 1; i < 4; i++)
+                {
+                    if (buffers[i].BufferType == SECBUFFER_DATA)
+                    {
+                        // 解密出的明文放不下时按出错处理，丢弃会让应答被截断或与下一条错位
+                        if (buffers[i].cbBuffer > space)
+                        {
+                            write_log("ERROR", "SMTP应答超出输入缓冲区");
+                            return 0;
+                        }
+                        memcpy(session->in + session->inLength, buffers[i].pvBuffer, buffers[i].cbBuffer);
+                        plain_length = buffers[i].cbBuffer;
+                    }
+                    else if (buffers[i].BufferType == SECBUFFER_EXTRA)
+                    {
+                        extra = &buffers[i];
+                    }
+                }
+
+                // 解密是就地进行的，未处理的下一条记录留在密文缓冲区末尾
+                if (extra)
+                {
+                    memmove(session->tlsIn, session->tlsIn + session->tlsInLength - extra->cbBuffer, extra->cbBuffer);
+                    session->tlsInLength = extra->cbBuffer;
+                }
+                else
+                {
+                    session->tlsInLength = 0;
+                }
+
+                if (plain_length > 0)
+                {
+                    session->inLength += plain_length;
+                    return 1;
+                }
+                continue;
+            }
+            if (status != SEC_E_INCOMPLETE_MESSAGE)
+                return 0; // 对端关闭TLS或要求重新协商，SMTP会话中都按断开处理
+        }
+
+        if (session->tlsInLength == SMTP_BUFFER_SIZE)
+            return 0;
+        int received = recv(session->socket, session->tlsIn + session->tlsInLength,
+                            (int)(SMTP_BUFFER_SIZE - session->tlsInLength), 0);
+        if (received <= 0)
+            return 0;
+        session->tlsInLength += received;
+    }
+}
+
+/* 读取一条（可能多行的）应答，返回三位应答码，连接出错时返回0；应答文本保存在session->reply中 */
+int smtp_read_reply(SmtpSession *session)
+{
+    size_t reply_length = 0;
+    session->reply[0] = '\0';
+
+    while (1)
+    {
+        session->in[session->inLength] = '\0';
+        char *end = strstr(session->in, "\r\n");
+        if (!end)
+        {
+            if (!smtp_fill(session))
+                return 0;
+            continue;
+        }
+
+        size_t line_length = end - session->in;
+        if (reply_length + line_length + 2 < sizeof(session->reply))
+        {
+            memcpy(session->reply + reply_length, session->in, line_length);
+            reply_length += line_length;
+            session->reply[reply_length++] = '\n';
+            session->reply[reply_length] = '\0';
+        }
+
+        int code = atoi(session->in);
+        int more = line_length > 3 && session->in[3] == '-';
+        session->inLength -= line_length + 2;
+        memmove(session->in, end + 2, session->inLength);
+
+        if (!more)
+            return code;
+    }
+}
+
+/* 发送一条命令并读取应答 */
+int smtp_command(SmtpSession *session, const char *format, ...)
+{
+    char command[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(command, sizeof(command) - 2, format, args);
+    va_end(args);
+    if (length < 0 || length >= (int)sizeof(command) - 2)
+        return 0;
+
+    memcpy(command + length, "\r\n", 3);
+    if (!smtp_write(session, command, length + 2))
+        return 0;
+    return smtp_read_reply(session);
+}
+
+/* 在已连接的套接字上完成TLS客户端握手（SChannel），证书由系统自动校验 */
+int smtp_tls_handshake(SmtpSession *session, const char *host)
+{
+    SCHANNEL_CRED credentials;
+    memset(&credentials, 0, sizeof(credentials));
+    credentials.dwVersion = SCHANNEL_CRED_VERSION;
+    credentials.dwFlags = SCH_CRED_AUTO_CRED_VALIDATION | SCH_CRED_NO_DEFAULT_CREDS | SCH_USE_STRONG_CRYPTO;
+
+    if (AcquireCredentialsHandleA(NULL, UNISP_NAME_A, SECPKG_CRED_OUTBOUND, NULL, &credentials,
+                                  NULL, NULL, &session->credentials, NULL) != SEC_E_OK)
+    {
+        write_log("ERROR", "无法获取TLS凭据");
+        return 0;
+    }
+    session->hasCredentials = 1;
+    session->tlsPending = 1;
+
+    session->tlsIn = malloc(SMTP_BUFFER_SIZE);
+    if (!session->tlsIn)
+        return 0;
+    session->tlsInLength = 0;
+
+    DWORD flags = ISC_REQ_SEQUENCE_DETECT | ISC_REQ_REPLAY_DETECT | ISC_REQ_CONFIDENTIALITY |
+                  ISC_REQ_ALLOCATE_MEMORY | ISC_REQ_STREAM | ISC_REQ_EXTENDED_ERROR;
+    DWORD attributes;
+    SECURITY_STATUS status = SEC_I_CONTINUE_NEEDED;
+    int first = 1;
+
+    while (status == SEC_I_CONTINUE_NEEDED || status == SEC_E_INCOMPLETE_MESSAGE)
+    {
+        // 除第一轮外都需要服务器的握手数据
+        if (!first && (session->tlsInLength == 0 || status == SEC_E_INCOMPLETE_MESSAGE))
+        {
+            if (session->tlsInLength == SMTP_BUFFER_SIZE)
+                break;
+            int received = recv(session->socket, session->tlsIn + session->tlsInLength,
+                                (int)(SMTP_BUFFER_SIZE - session->tlsInLength), 0);
+            if (received <= 0)
+                break;
+            session->tlsInLength += received;
+        }
+
+        SecBuffer in_buffers[2];
+        in_buffers[0].BufferType = SECBUFFER_TOKEN;
+        in_buffers[0].pvBuffer = session->tlsIn;
+        in_buffers[0].cbBuffer = (unsigned long)session->tlsInLength;
+        in_buffers[1].BufferType = SECBUFFER_EMPTY;
+        in_buffers[1].pvBuffer = NULL;
+        in_buffers[1].cbBuffer = 0;
+        SecBufferDesc in_desc = {SECBUFFER_VERSION, 2, in_buffers};
+
+        SecBuffer out_buffer = {0, SECBUFFER_TOKEN, NULL};
+        SecBufferDesc out_desc = {SECBUFFER_VERSION, 1, &out_buffer};
+
+        status = InitializeSecurityContextA(&session->credentials, first ? NULL : &session->context,
+                                            (SEC_CHAR *)host, flags, 0, 0, first ? NULL : &in_desc, 0,
+                                            first ? &session->context : NULL, &out_desc, &attributes, NULL);
+        if (first)
+            session->hasContext = 1;
+        first = 0;
+
+        if (status == SEC_E_INCOMPLETE_MESSAGE)
+            continue;
+
+        if (out_buffer.cbBuffer > 0 && out_buffer.pvBuffer)
+        {
+            int sent = socket_send_all(session->socket, out_buffer.pvBuffer, out_buffer.cbBuffer);
+            FreeContextBuffer(out_buffer.pvBuffer);
+            if (!sent)
+                break;
+        }
+
+        // 服务器可能把握手结束后的数据和最后一段握手数据一起发来
+        if (in_buffers[1].BufferType == SECBUFFER_EXTRA && in_buffers[1].cbBuffer > 0)
+        {
+            memmove(session->tlsIn, session->tlsIn + session->tlsInLength - in_buffers[1].cbBuffer, in_buffers[1].cbBuffer);
+            session->tlsInLength = in_buffers[1].cbBuffer;
+        }
+        else
+        {
+            session->tlsInLength = 0;
+        }
+    }
+
+    if (status != SEC_E_OK ||
+        QueryContextAttributesA(&session->context, SECPKG_ATTR_STREAM_SIZES, &session->sizes) != SEC_E_OK)
+    {
+        char error_msg[128];
+        snprintf(error_msg, sizeof(error_msg), "TLS握手失败: 0x%08lx", (unsigned long)status);
+        write_log("ERROR", error_msg);
+        return 0;
+    }
+
+    session->tls = 1;
+    session->tlsPending = 0;
+    return 1;
+}
+
+/* 判断SMTP连接的对端是否为本机回环地址，只有这种连接允许不加密登录 */
+int smtp_peer_is_loopback(const SmtpSession *session)
+{
+    struct sockaddr_storage address;
+    int address_length = sizeof(address);
+    if (getpeername(session->socket, (struct sockaddr *)&address, &address_length) != 0)
+        return 0;
+
+    if (address.ss_family == AF_INET)
+        return (ntohl(((struct sockaddr_in *)&address)->sin_addr.s_addr) >> 24) == 127;
+    if (address.ss_family == AF_INET6)
+        return IN6_IS_ADDR_LOOPBACK(&((struct sockaddr_in6 *)&address)->sin6_addr);
+    return 0;
+}
+
+/* 发送EHLO并记录服务器支持的扩展 */
+int smtp_ehlo(SmtpSession *session)
+{
+    char hostname[256];
+    if (gethostname(hostname, sizeof(hostname)) != 0)
+        strcpy(hostname, "localhost");
+
+    if (smtp_command(session, "EHLO %s", hostname) != 250)
+        return 0;
+
+    session->pipelining = strstr(session->reply, "PIPELINING") != NULL;
+    session->startTls = strstr(session->reply, "STARTTLS") != NULL;
+    const char *auth = strstr(session->reply, "AUTH");
+    const char *auth_end = auth ? strchr(auth, '\n') : NULL;
+    session->authPlain = 0;
+    session->authLogin = 0;
+    if (auth)
+    {
+        const char *plain = strstr(auth, "PLAIN");
+        const char *login = strstr(auth, "LOGIN");
+        session->authPlain = plain && (!auth_end || plain < auth_end);
+        session->authLogin = login && (!auth_end || login < auth_end);
+    }
+    return 1;
+}
+
+/* 登录：优先AUTH PLAIN（一次往返），否则AUTH LOGIN */
+int smtp_authenticate(SmtpSession *session, const char *user, const char *password)
+{
+    PageBuffer encoded;
+    page_buffer_take(&encoded);
+    int code = 0;
+
+    if (session->authPlain)
+    {
+        char credentials[256];
+        size_t user_length = strlen(user);
+        size_t password_length = strlen(password);
+        if (user_length + password_length + 2 <= sizeof(credentials))
+        {
+            credentials[0] = '\0';
+            memcpy(credentials + 1, user, user_length + 1);
+            memcpy(credentials + 2 + user_length, password, password_length);
+            base64_encode(&encoded, (const unsigned char *)credentials, user_length + password_length + 2, 0);
+            code = smtp_command(session, "AUTH PLAIN %s", encoded.data);
+        }
+    }
+    else if (session->authLogin && smtp_command(session, "AUTH LOGIN") == 334)
+    {
+        base64_encode(&encoded, (const unsigned char *)user, strlen(user), 0);
+        if (smtp_command(session, "%s", encoded.data) == 334)
+        {
+            encoded.length = 0;
+            base64_encode(&encoded, (const unsigned char *)password, strlen(password), 0);
+            code = smtp_command(session, "%s", encoded.data);
+        }
+    }
+
+    page_buffer_return(&encoded);
+    return code == 235;
+}
+
+/* 建立SMTP会话：连接、（隐式TLS或STARTTLS）、EHLO、登录 */
+int smtp_open(SmtpSession *session, const Config *config)
+{
+    memset(session, 0, sizeof(SmtpSession));
+    session->socket = INVALID_SOCKET;
+
+    char port[16];
+    snprintf(port, sizeof(port), "%d", config->smtpPort);
+    struct addrinfo hints;
+    struct addrinfo *addresses = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (getaddrinfo(config->smtpServer, port, &hints, &addresses) != 0)
+    {
+        write_log("ERROR", "无法解析SMTP服务器地址");
+        return 0;
+    }
+
+    for (struct addrinfo *address = addresses; address; address = address->ai_next)
+    {
+        SOCKET socket_handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket_handle == INVALID_SOCKET)
+            continue;
+
+        DWORD timeout = SMTP_TIMEOUT_MS;
+        setsockopt(socket_handle, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+        setsockopt(socket_handle, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+        // 命令、正文和结束符分几次写出，关闭Nagle避免与延迟确认叠加造成停顿
+        int no_delay = 1;
+        setsockopt(socket_handle, IPPROTO_TCP, TCP_NODELAY, (const char *)&no_delay, sizeof(no_delay));
+        if (connect(socket_handle, address->ai_addr, (int)address->ai_addrlen) == 0)
+        {
+            session->socket = socket_handle;
+            break;
+        }
+        closesocket(socket_handle);
+    }
+    freeaddrinfo(addresses);
+
+    if (session->socket == INVALID_SOCKET)
+    {
+        write_log("ERROR", "无法连接SMTP服务器");
+        return 0;
+    }
+
+    if (config->smtpSecurity == SMTP_SECURITY_SSL && !smtp_tls_handshake(session, config->smtpServer))
+        return 0;
+
+    if (smtp_read_reply(session) != 220 || !smtp_ehlo(session))
+    {
+        write_log("ERROR", "SMTP服务器握手失败");
+        return 0;
+    }
+
+    if (config->smtpSecurity == SMTP_SECURITY_STARTTLS)
+    {
+        // 服务器不支持STARTTLS时不发送凭据，避免授权码明文传输
+        if (!session->startTls || smtp_command(session, "STARTTLS") != 220)
+        {
+            write_log("ERROR", "SMTP服务器不支持STARTTLS");
+            return 0;
+        }
+        if (!smtp_tls_handshake(session, config->smtpServer) || !smtp_ehlo(session))
+            return 0;
+    }
+
+    // SMTP_SECURITY=none时授权码会以明文发出，只允许发给本机的中继
+    if (strlen(config->emailAuthCode) > 0 && !session->tls && !smtp_peer_is_loopback(session))
+    {
+        write_log("ERROR", "未加密的SMTP连接不允许登录，请设置SMTP_SECURITY为ssl或starttls");
+        return 0;
+    }
+
+    if (strlen(config->emailAuthCode) > 0 &&
+        !smtp_authenticate(session, config->emailAccount, config->emailAuthCode))
+    {
+        char error_msg[1200];
+        snprintf(error_msg, sizeof(error_msg), "SMTP登录失败: %s", session->reply);
+        write_log("ERROR", error_msg);
+        return 0;
+    }
+    return 1;
+}
+
+/* 在已登录的会话上发送一封邮件给所有收件人，返回服务器接受的收件人数；
+   服务器支持PIPELINING时MAIL/RCPT/DATA一次写出，只等待一个往返 */
+int smtp_send_mail(SmtpSession *session, const char *from, char **recipients, int recipient_count, const PageBuffer *message)
+{
+    PageBuffer commands;
+    page_buffer_take(&commands);
+
+    int command_count = recipient_count + 2;
+    int replies = 0; // 已读取应答的命令数
+    int mail_ok = 0;
+    int data_ok = 0;
+    int accepted = 0;
+    int ok = 1;
+    for (int i = 0; ok && i < command_count; i++)
+    {
+        if (i == 0)
+            page_buffer_printf(&commands, "MAIL FROM:<%s>\r\n", from);
+        else if (i <= recipient_count)
+            page_buffer_printf(&commands, "RCPT TO:<%s>\r\n", recipients[i - 1]);
+        else
+            page_buffer_printf(&commands, "DATA\r\n");
+
+        // 支持管道时攒到DATA再一起发送，否则每条命令发送后立即等待应答
+        if (session->pipelining && i < command_count - 1)
+            continue;
+        ok = smtp_write(session, commands.data, commands.length);
+        commands.length = 0;
+
+        // 已发送命令的应答按发送顺序读取
+        for (; ok && replies <= i; replies++)
+        {
+            int code = smtp_read_reply(session);
+            if (code == 0)
+            {
+                ok = 0;
+            }
+            else if (replies == 0)
+            {
+                mail_ok = code == 250;
+            }
+            else if (replies <= recipient_count)
+            {
+                if (code == 250 || code == 251)
+                {
+                    accepted++;
+                }
+                else
+                {
+                    char error_msg[1200];
+                    snprintf(error_msg, sizeof(error_msg), "收件人被拒绝 %s: %s", recipients[replies - 1], session->reply);
+                    write_log("ERROR", error_msg);
+                }
+            }
+            else
+            {
+                data_ok = code == 354;
+            }
+        }
+    }
+    page_buffer_return(&commands);
+    if (!ok)
+        return 0;
+
+    if (!data_ok)
+    {
+        char error_msg[1200];
+        snprintf(error_msg, sizeof(error_msg), "SMTP服务器拒绝邮件: %s", session->reply);
+        write_log("ERROR", error_msg);
+        return 0;
+    }
+
+    // 没有收件人被接受但服务器仍进入DATA状态时，发送空邮件结束符放弃本封邮件
+    if (!mail_ok || accepted == 0)
+    {
+        smtp_write(session, ".\r\n", 3);
+        smtp_read_reply(session);
+        return 0;
+    }
+
+    if (!smtp_write_data(session, message->data, message->length) || smtp_read_reply(session) != 250)
+    {
+        char error_msg[1200];
+        snprintf(error_msg, sizeof(error_msg), "SMTP服务器未接受邮件内容: %s", session->reply);
+        write_log("ERROR", error_msg);
+        return 0;
+    }
+    return accepted;
+}
+
+/* 发送邮件内容并以"."行结束：以'.'开头的行前再加一个'.'（RFC 5321 4.5.2），内容末尾没有换行时补上。
+   build_mime_message生成的正文是Base64编码，通常整封邮件都不需要转义，一次写出 */
+int smtp_write_data(SmtpSession *session, const char *data, size_t length)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (data[i] != '.' || (i > 0 && data[i - 1] != '\n'))
+            continue;
+        // 写出这一行之前的内容和多加的'.'，行首原有的'.'随下一段写出
+        if ((i > start && !smtp_write(session, data + start, i - start)) || !smtp_write(session, ".", 1))
+            return 0;
+        start = i;
+    }
+    if (length > start && !smtp_write(session, data + start, length - start))
+        return 0;
+    if (length > 0 && data[length - 1] != '\n' && !smtp_write(session, "\r\n", 2))
+        return 0;
+    return smtp_write(session, ".\r\n", 3);
+}
+
+/* 结束SMTP会话并释放TLS资源 */
+void smtp_close(SmtpSession *session)
+{
+    if (session->socket != INVALID_SOCKET)
+    {
+        // TLS握手中途失败时对端不再接受明文，发送QUIT只会空等超时
+        if (!session->tlsPending)
+            smtp_command(session, "QUIT");
+        closesocket(session->socket);
+        session->socket = INVALID_SOCKET;
+    }
+    if (session->hasContext)
+        DeleteSecurityContext(&session->context);
+    if (session->hasCredentials)
+        FreeCredentialsHandle(&session->credentials);
+    free(session->tlsIn);
+    session->tlsIn = NULL;
+    session->tls = 0;
+    session->tlsPending = 0;
+    session->hasContext = 0;
+    session->hasCredentials = 0;
+}
+
+/* 生成警报提醒邮件的HTML正文，reason是触发规则的说明 */
+int render_alert_email(PageBuffer *html, const ElectricMeter *meter, const char *rule_name, const char *reason)
+{
+    return page_buffer_printf(html,
+             "<!DOCTYPE html>\n"
+             "<html>\n"
+             "<head>\n"
+             "    <meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\">\n"
+             "    <title>Electric Meter Low Energy Alert</title>\n"
+             "    <style>\n"
+             "        body { font-family: Arial, sans-serif; margin: 20px; background-color: #f5f5f5; }\n"
+             "        .container { background: white; padding: 30px; border-radius: 10px; box-shadow: 0 2px 10px rgba(0,0,0,0.1); max-width: 600px; margin: 0 auto; }\n"
+             "        .header { color: #d63031; font-size: 28px; font-weight: bold; margin-bottom: 25px; text-align: center; border-bottom: 3px solid #d63031; padding-bottom: 15px; }\n"
+             "        .info-table { border-collapse: collapse; width: 100%%; margin: 25px 0; font-size: 16px; }\n"
+             "        .info-table th, .info-table td { border: 2px solid #ddd; padding: 15px; text-align: left; }\n"
+             "        .info-table th { background-color: #f8f9fa; font-weight: bold; width: 30%%; color: #2d3436; }\n"
+             "        .info-table td { background-color: #fff; }\n"
+             "        .warning { color: #d63031; font-weight: bold; font-size: 20px; margin: 25px 0; text-align: center; background: #ffebee; padding: 15px; border-radius: 8px; border-left: 5px solid #d63031; }\n"
+             "        .critical { background-color: #fff5f5 !important; font-weight: bold; color: #d63031; }\n"
+             "        .footer { margin-top: 30px; padding-top: 20px; border-top: 1px solid #ddd; color: #636e72; font-size: 14px; text-align: center; }\n"
+             "        .energy-value { font-size: 24px; font-weight: bold; color: #d63031; }\n"
+             "    </style>\n"
+             "</head>\n"
+             "<body>\n"
+             "    <div class=\"container\">\n"
+             "        <div class=\"header\">⚠️ 电表%s提醒 Electric Meter Alert</div>\n"
+             "        <p>系统检测到：%s，请及时充值！Alert rule triggered, please recharge!</p>\n"
+             "        <table class=\"info-table\">\n"
+             "            <tr><th>剩余电量 Remaining Energy</th><td class=\"critical\"><span class=\"energy-value\">%.2f 度 kWh</span></td></tr>\n"
+             "            <tr><th>剩余金额 Remaining Amount</th><td>%.2f 元 CNY</td></tr>\n"
+             "            <tr><th>累计用电 Total Consumption</th><td>%.2f kWh</td></tr>\n"
+             "            <tr><th>当前电价 Current Price</th><td>%.4f 元/度 CNY/kWh</td></tr>\n"
+             "            <tr><th>电表状态 Meter Status</th><td>%s</td></tr>\n"
+             "            <tr><th>数据更新时间 Data Update Time</th><td>%s</td></tr>\n"
+             "            <tr><th>系统记录时间 System Time</th><td>%s</td></tr>\n"
+             "            <tr><th>触发规则 Alert Rule</th><td>%s</td></tr>\n"
+             "        </table>\n"
+             "        <div class=\"warning\">⚠️ 紧急：请及时充值以避免断电！Urgent: please recharge to avoid power outage!</div>\n"
+             "        <div class=\"footer\">此邮件由山东石油化工学院电表监控系统自动生成<br>Auto-generated by Shandong Institute of Petroleum and Chemical Technology Electric Monitor System</div>\n"
+             "    </div>\n"
+             "</body>\n"
+             "</html>\n",
+             rule_name,
+             reason,
+             meter->remainingEnergy,
+             meter->remainingAmount,
+             meter->totalConsumption,
+             meter->price,
+             meter->meterStatus,
+             meter->meterUpdateTime,
+             meter->systemTime,
+             rule_name);
+}
+
+/* 组装MIME邮件（UTF-8 HTML正文，Base64传输编码），message_id不含尖括号 */
+int build_mime_message(PageBuffer *message, const char *from, char **recipients, int recipient_count,
+                       const char *subject, const PageBuffer *html, const char *message_id)
+{
+    static const char *days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    SYSTEMTIME st;
+    clock_system_time(&st);
+
+    page_buffer_printf(message, "From: <%s>\r\nTo: ", from);
+    for (int i = 0; i < recipient_count; i++)
+        page_buffer_printf(message, "%s<%s>", i > 0 ? ",\r\n " : "", recipients[i]);
+    page_buffer_printf(message, "\r\nSubject: ");
+    append_encoded_header(message, subject);
+    page_buffer_printf(message,
+                       "\r\nDate: %s, %02d %s %04d %02d:%02d:%02d +0000\r\n"
+                       "Message-ID: <%s>\r\n"
+                       "MIME-Version: 1.0\r\n"
+                       "Content-Type: text/html; charset=UTF-8\r\n"
+                       "Content-Transfer-Encoding: base64\r\n"
+                       "\r\n",
+                       days[st.wDayOfWeek % 7], st.wDay, months[(st.wMonth + 11) % 12], st.wYear,
+                       st.wHour, st.wMinute, st.wSecond,
+                       message_id);
+    return base64_encode(message, (const unsigned char *)html->data, html->length, 76);
+}
+
+/* 拆分逗号分隔的收件人列表（就地修改list），返回收件人数 */
+int parse_recipients(char *list, char **recipients, int max_recipients)
+{
+    int count = 0;
+    for (char *token = strtok(list, ","); token && count < max_recipients; token = strtok(NULL, ","))
+    {
+        while (*token == ' ' || *token == '\t')
+            token++;
+        char *end = token + strlen(token);
+        while (end > token && (end[-1] == ' ' || end[-1] == '\t'))
+            *--end = '\0';
+        if (*token)
+            recipients[count++] = token;
+    }
+    return count;
+}
+
+/* 在已打开的连接上插入一封发件箱邮件，返回1为新入队，0为dedup_key已存在，-1为失败 */
+int outbox_insert(sqlite3 *db, const char *dedup_key, const char *recipients, const char *subject, const PageBuffer *html)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT OR IGNORE INTO email_outbox (dedup_key, created_at, next_attempt, recipients, subject, body) "
+                      "VALUES (?, ?, ?, ?, ?, ?);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备发件箱SQL语句失败");
+        return -1;
+    }
+
+    sqlite3_int64 now = (sqlite3_int64)clock_now();
+    sqlite3_bind_text(stmt, 1, dedup_key, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, now);
+    sqlite3_bind_int64(stmt, 3, now);
+    sqlite3_bind_text(stmt, 4, recipients, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, subject, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, html->data, (int)html->length, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    int inserted = sqlite3_changes(db);
+    sqlite3_finalize(stmt);
+
+    if (rc != SQLITE_DONE)
+    {
+        write_log("ERROR", "邮件写入发件箱失败");
+        return -1;
+    }
+
+    char log_msg[160];
+    snprintf(log_msg, sizeof(log_msg), inserted ? "邮件已加入发件箱: %s" : "发件箱中已有相同邮件，不重复入队: %s", dedup_key);
+    write_log("INFO", log_msg);
+    return inserted;
+}
+
+/* 把一封邮件写入发件箱并唤醒投递线程；dedup_key相同的邮件只入队一次 */
+int enqueue_email(const char *db_path, const char *dedup_key, const char *recipients, const char *subject, const PageBuffer *html)
+{
+    sqlite3 *db;
+    if (sqlite3_open(db_path, &db) != SQLITE_OK)
+    {
+        write_log("ERROR", "无法打开数据库写入发件箱");
+        sqlite3_close(db);
+        return 0;
+    }
+    sqlite3_busy_timeout(db, 5000);
+
+    int inserted;
+    TRACE_SPAN("db_outbox_insert", "database", "inserted", inserted,
+               inserted = outbox_insert(db, dedup_key, recipients, subject, html));
+    sqlite3_close(db);
+
+    if (inserted < 0)
+        return 0;
+    if (inserted && outbox_wakeup)
+        SetEvent(outbox_wakeup);
+    return 1;
+}
+
+/* 把一条警报加入汇总表，等汇总窗口结束后与同一收件人的其他警报合并成一封邮件；
+   同一规则在窗口内再次触发只更新读数和次数，不会重复列出 */
+int queue_alert_digest(const Config *config, const ElectricMeter *meter, const char *rule_name, const char *reason)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    if (sqlite3_open(config->dbPath, &db) != SQLITE_OK)
+    {
+        write_log("ERROR", "无法打开数据库写入警报汇总");
+        sqlite3_close(db);
+        return 0;
+    }
+    sqlite3_busy_timeout(db, 5000);
+
+    const char *sql = "INSERT INTO alert_digest_items (recipients, condition_key, created_at, updated_at, rule_name, reason, "
+                      "remaining_energy, remaining_amount, meter_update_time) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?) "
+                      "ON CONFLICT(recipients, condition_key) WHERE digest_id IS NULL DO UPDATE SET "
+                      "updated_at = excluded.updated_at, hits = hits + 1, reason = excluded.reason, "
+                      "remaining_energy = excluded.remaining_energy, remaining_amount = excluded.remaining_amount, "
+                      "meter_update_time = excluded.meter_update_time;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备警报汇总SQL语句失败");
+        sqlite3_close(db);
+        return 0;
+    }
+
+    sqlite3_int64 now = (sqlite3_int64)clock_now();
+    sqlite3_bind_text(stmt, 1, config->emailReceivers, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, rule_name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, now);
+    sqlite3_bind_int64(stmt, 4, now);
+    sqlite3_bind_text(stmt, 5, rule_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, reason, -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 7, meter->remainingEnergy);
+    sqlite3_bind_double(stmt, 8, meter->remainingAmount);
+    sqlite3_bind_text(stmt, 9, meter->meterUpdateTime, -1, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    if (rc != SQLITE_DONE)
+    {
+        write_log("ERROR", "警报写入汇总表失败");
+        return 0;
+    }
+
+    // 唤醒投递线程按新的窗口结束时间重新计算等待
+    if (outbox_wakeup)
+        SetEvent(outbox_wakeup);
+    printf("📨 警报已加入汇总，%d 分钟内的警报合并为一封邮件\n", config->digestWindow);
+    return 1;
+}
+
+/* 生成警报提醒邮件并写入发件箱（配置了汇总窗口时先进入汇总表），实际发送由投递线程完成，调用方不等待SMTP */
+int queue_alert_email(const Config *config, const ElectricMeter *meter, const char *rule_name, const char *reason, const char *dedup_key)
+{
+    // 检查邮箱配置是否完整
+    if (strlen(config->emailAccount) == 0 || strlen(config->emailReceivers) == 0 ||
+        (strlen(config->emailAuthCode) == 0 && config->smtpSecurity != SMTP_SECURITY_NONE))
+    {
+        printf("邮箱配置不完整，跳过邮件发送\n");
+        printf("需要配置: EMAIL_ACCOUNT, EMAIL_AUTH_CODE, EMAIL_RECEIVERS\n");
+        return 0;
+    }
+
+    if (config->digestWindow > 0)
+        return queue_alert_digest(config, meter, rule_name, reason);
+
+    char subject[160];
+    snprintf(subject, sizeof(subject), "电表%s提醒 - 剩余%.2f度电（山东石油化工学院）", rule_name, meter->remainingEnergy);
+
+    PageBuffer html;
+    page_buffer_take(&html);
+    render_alert_email(&html, meter, rule_name, reason);
+    int queued = html.data && enqueue_email(config->dbPath, dedup_key, config->emailReceivers, subject, &html);
+    page_buffer_return(&html);
+
+    if (queued)
+        printf("📨 提醒邮件已加入发件箱，后台发送\n");
+    return queued;
+}
+
+/* 记录一次投递结果：成功标记为已发送；失败按指数退避安排下次尝试，超过次数后放弃 */
+void finish_outbox_attempt(sqlite3 *db, const OutboxMessage *message, int delivered, sqlite3_int64 now, const char *error)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = delivered
+        ? "UPDATE email_outbox SET status = 'sent', sent_at = ?, attempts = attempts + 1, last_error = NULL WHERE id = ?;"
+        : "UPDATE email_outbox SET status = ?, next_attempt = ?, attempts = attempts + 1, last_error = ? WHERE id = ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备发件箱投递结果SQL语句失败");
+        return;
+    }
+
+    char log_msg[256];
+    if (delivered)
+    {
+        sqlite3_bind_int64(stmt, 1, now);
+        sqlite3_bind_int64(stmt, 2, message->id);
+        outbox_last_latency = (long)(now - message->createdAt);
+        snprintf(log_msg, sizeof(log_msg), "发件箱邮件 #%lld 已送达（第%d次尝试，排队 %ld 秒）",
+                 (long long)message->id, message->attempts + 1, outbox_last_latency);
+        write_log("SUCCESS", log_msg);
+    }
+    else
+    {
+        int attempts = message->attempts + 1;
+        int give_up = attempts >= OUTBOX_MAX_ATTEMPTS;
+        long long delay = OUTBOX_RETRY_BASE;
+        for (int i = 1; i < attempts && delay < OUTBOX_RETRY_MAX; i++)
+            delay *= 2;
+        if (delay > OUTBOX_RETRY_MAX)
+            delay = OUTBOX_RETRY_MAX;
+
+        sqlite3_bind_text(stmt, 1, give_up ? "failed" : "pending", -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, now + delay);
+        sqlite3_bind_text(stmt, 3, error, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 4, message->id);
+        if (give_up)
+            snprintf(log_msg, sizeof(log_msg), "发件箱邮件 #%lld 已尝试%d次仍失败，放弃发送", (long long)message->id, attempts);
+        else
+            snprintf(log_msg, sizeof(log_msg), "发件箱邮件 #%lld 第%d次发送失败，%lld 秒后重试",
+                     (long long)message->id, attempts, delay);
+        write_log("ERROR", log_msg);
+    }
+    int rc;
+    TRACE_SPAN("db_outbox_update", "database", "rc", rc, rc = sqlite3_step(stmt));
+    if (rc != SQLITE_DONE)
+    {
+        snprintf(log_msg, sizeof(log_msg), "记录发件箱邮件 #%lld 的投递结果失败: %s", (long long)message->id, sqlite3_errmsg(db));
+        write_log("ERROR", log_msg);
+    }
+    sqlite3_finalize(stmt);
+}
+
+/* 通过已建立的会话发送一封发件箱邮件，Message-ID由发件箱ID决定，重发时收件服务器可据此去重 */
+int send_outbox_message(SmtpSession *session, const Config *config, OutboxMessage *message)
+{
+    char *recipients[SMTP_MAX_RECIPIENTS];
+    int recipient_count = parse_recipients(message->recipients, recipients, SMTP_MAX_RECIPIENTS);
+    if (recipient_count == 0)
+        return 0;
+
+    char message_id[128];
+    const char *domain = strchr(config->emailAccount, '@');
+    snprintf(message_id, sizeof(message_id), "outbox-%lld-%lld@%s", (long long)message->id,
+             (long long)message->createdAt, domain ? domain + 1 : "localhost");
+
+    PageBuffer mime;
+    page_buffer_take(&mime);
+    build_mime_message(&mime, config->emailAccount, recipients, recipient_count, message->subject, &message->body, message_id);
+    int accepted = smtp_send_mail(session, config->emailAccount, recipients, recipient_count, &mime);
+    page_buffer_return(&mime);
+    return accepted > 0;
+}
+
+/* 读出最多OUTBOX_BATCH_SIZE封到期的邮件，返回读出的封数 */
+int load_outbox_batch(sqlite3 *db, OutboxMessage *batch)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT id, created_at, attempts, recipients, subject, body FROM email_outbox "
+                      "WHERE status = 'pending' AND next_attempt <= ? ORDER BY id LIMIT ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+        return 0;
+
+    int count = 0;
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)clock_now());
+    sqlite3_bind_int(stmt, 2, OUTBOX_BATCH_SIZE);
+    while (count < OUTBOX_BATCH_SIZE && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        OutboxMessage *message = &batch[count];
+        const char *recipients = (const char *)sqlite3_column_text(stmt, 3);
+        const char *subject = (const char *)sqlite3_column_text(stmt, 4);
+        message->id = sqlite3_column_int64(stmt, 0);
+        message->createdAt = sqlite3_column_int64(stmt, 1);
+        message->attempts = sqlite3_column_int(stmt, 2);
+        snprintf(message->recipients, sizeof(message->recipients), "%s", recipients ? recipients : "");
+        snprintf(message->subject, sizeof(message->subject), "%s", subject ? subject : "");
+        page_buffer_take(&message->body);
+        page_buffer_append(&message->body, (const char *)sqlite3_column_blob(stmt, 5), sqlite3_column_bytes(stmt, 5));
+        count++;
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+/* 投递一批到期的邮件：所有邮件共用一个SMTP会话；返回处理的邮件数 */
+int deliver_outbox_batch(sqlite3 *db, const Config *config)
+{
+    OutboxMessage batch[OUTBOX_BATCH_SIZE];
+    int count;
+    TRACE_SPAN("db_outbox_select", "database", "messages", count, count = load_outbox_batch(db, batch));
+    if (count == 0)
+        return 0;
+
+    SmtpSession session;
+    int connected;
+    TRACE_SPAN("smtp_open", "email", "ok", connected, connected = smtp_open(&session, config));
+    for (int i = 0; i < count; i++)
+    {
+        ULONGLONG send_started = metric_clock();
+        int delivered;
+        TRACE_SPAN("send_email", "email", "id", batch[i].id,
+                   delivered = connected && send_outbox_message(&session, config, &batch[i]));
+        metric_observe(METRIC_STAGE_EMAIL, send_started);
+        metric_add(delivered ? METRIC_EMAILS_SENT : METRIC_EMAILS_FAILED, 1);
+        log_event(EVENT_EMAIL, batch[i].id, delivered, batch[i].attempts + 1);
+        finish_outbox_attempt(db, &batch[i], delivered, (sqlite3_int64)clock_now(),
+                              delivered ? NULL : connected ? session.reply : "无法建立SMTP会话");
+        page_buffer_return(&batch[i].body);
+
+        // MAIL/RCPT/DATA中途失败后服务器仍停在本封邮件的事务里，先RSET再发下一封，
+        // 否则后面的邮件都会收到503并白白消耗重试次数；RSET也失败时重新建立会话
+        if (connected && !delivered && i + 1 < count && smtp_command(&session, "RSET") != 250)
+        {
+            smtp_close(&session);
+            connected = smtp_open(&session, config);
+        }
+    }
+    smtp_close(&session);
+    return count;
+}
+
+/* 统计发件箱状态，写入日志并以 api/outbox.json 提供给内置HTTP服务 */
+void publish_outbox_stats(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT "
+                      "(SELECT COUNT(*) FROM email_outbox WHERE status = 'pending'), "
+                      "(SELECT COUNT(*) FROM email_outbox WHERE status = 'sent'), "
+                      "(SELECT COUNT(*) FROM email_outbox WHERE status = 'failed'), "
+                      "(SELECT MIN(created_at) FROM email_outbox WHERE status = 'pending');";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+        return;
+
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        int pending = sqlite3_column_int(stmt, 0);
+        int sent = sqlite3_column_int(stmt, 1);
+        int failed = sqlite3_column_int(stmt, 2);
+        long oldest = sqlite3_column_type(stmt, 3) == SQLITE_NULL
+            ? 0 : (long)((sqlite3_int64)clock_now() - sqlite3_column_int64(stmt, 3));
+
+        PageBuffer json;
+        page_buffer_take(&json);
+        page_buffer_printf(&json, "{\"pending\":%d,\"sent\":%d,\"failed\":%d,\"oldestPendingSeconds\":%ld,\"lastLatencySeconds\":%ld}",
+                           pending, sent, failed, oldest, outbox_last_latency);
+        cache_rendered_page("api/outbox.json", &json);
+        page_buffer_return(&json);
+
+        char log_msg[160];
+        snprintf(log_msg, sizeof(log_msg), "发件箱: 待发送 %d 封（最早已等待 %ld 秒），已发送 %d 封，放弃 %d 封，最近投递延迟 %ld 秒",
+                 pending, oldest, sent, failed, outbox_last_latency);
+        write_log("INFO", log_msg);
+    }
+    sqlite3_finalize(stmt);
+}
+
+/* 把一个收件人列表下所有未汇总的警报渲染成一封汇总邮件写入发件箱，并在同一事务中把这些警报标记为已汇总 */
+int flush_alert_digest_group(sqlite3 *db, const char *recipients)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT id, created_at, hits, rule_name, reason, remaining_energy, remaining_amount, meter_update_time "
+                      "FROM alert_digest_items WHERE digest_id IS NULL AND recipients = ? ORDER BY id;";
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) != SQLITE_OK)
+        return 0;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, recipients, -1, SQLITE_STATIC);
+
+    PageBuffer html;
+    page_buffer_take(&html);
+    page_buffer_printf(&html,
+             "<!DOCTYPE html>\n"
+             "<html>\n"
+             "<head>\n"
+             "    <meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\">\n"
+             "    <title>Electric Meter Alert Digest</title>\n"
+             "    <style>\n"
+             "        body { font-family: Arial, sans-serif; margin: 20px; background-color: #f5f5f5; }\n"
+             "        .container { background: white; padding: 30px; border-radius: 10px; box-shadow: 0 2px 10px rgba(0,0,0,0.1); max-width: 800px; margin: 0 auto; }\n"
+             "        .header { color: #d63031; font-size: 28px; font-weight: bold; margin-bottom: 25px; text-align: center; border-bottom: 3px solid #d63031; padding-bottom: 15px; }\n"
+             "        .info-table { border-collapse: collapse; width: 100%%; margin: 25px 0; font-size: 15px; }\n"
+             "        .info-table th, .info-table td { border: 2px solid #ddd; padding: 10px; text-align: left; }\n"
+             "        .info-table th { background-color: #f8f9fa; font-weight: bold; color: #2d3436; }\n"
+             "        .footer { margin-top: 30px; padding-top: 20px; border-top: 1px solid #ddd; color: #636e72; font-size: 14px; text-align: center; }\n"
+             "    </style>\n"
+             "</head>\n"
+             "<body>\n"
+             "    <div class=\"container\">\n"
+             "        <div class=\"header\">⚠️ 电表警报汇总 Electric Meter Alert Digest</div>\n"
+             "        <p>以下警报在汇总时段内触发，请及时处理！The following alerts were raised, please recharge!</p>\n"
+             "        <table class=\"info-table\">\n"
+             "            <tr><th>规则 Rule</th><th>说明 Reason</th><th>剩余电量 Energy</th><th>剩余金额 Amount</th><th>数据更新时间 Update Time</th><th>触发次数 Hits</th></tr>\n");
+
+    sqlite3_int64 first_id = 0, last_id = 0;
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char *rule_name = (const char *)sqlite3_column_text(stmt, 3);
+        const char *reason = (const char *)sqlite3_column_text(stmt, 4);
+        const char *update_time = (const char *)sqlite3_column_text(stmt, 7);
+        if (count == 0)
+            first_id = sqlite3_column_int64(stmt, 0);
+        last_id = sqlite3_column_int64(stmt, 0);
+        page_buffer_printf(&html,
+                           "            <tr><td>%s</td><td>%s</td><td>%.2f 度</td><td>%.2f 元</td><td>%s</td><td>%d</td></tr>\n",
+                           rule_name ? rule_name : "", reason ? reason : "",
+                           sqlite3_column_double(stmt, 5), sqlite3_column_double(stmt, 6),
+                           update_time ? update_time : "", sqlite3_column_int(stmt, 2));
+        count++;
+    }
+    sqlite3_finalize(stmt);
+
+    page_buffer_printf(&html,
+             "        </table>\n"
+             "        <div class=\"footer\">此邮件由山东石油化工学院电表监控系统自动生成<br>Auto-generated by Shandong Institute of Petroleum and Chemical Technology Electric Monitor System</div>\n"
+             "    </div>\n"
+             "</body>\n"
+             "</html>\n");
+
+    int queued = 0;
+    if (count > 0 && html.data)
+    {
+        char subject[160];
+        char dedup_key[96];
+        snprintf(subject, sizeof(subject), "电表警报汇总 - %d 项警报（山东石油化工学院）", count);
+        snprintf(dedup_key, sizeof(dedup_key), "digest-%lld-%lld", (long long)first_id, (long long)last_id);
+
+        // 同一批警报的dedup_key固定，即使标记失败后重试也不会重复入队
+        if (outbox_insert(db, dedup_key, recipients, subject, &html) >= 0 &&
+            sqlite3_prepare_v2(db, "UPDATE alert_digest_items SET digest_id = (SELECT id FROM email_outbox WHERE dedup_key = ?) "
+                                   "WHERE digest_id IS NULL AND recipients = ? AND id <= ?;", -1, &stmt, 0) == SQLITE_OK)
+        {
+            sqlite3_bind_text(stmt, 1, dedup_key, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, recipients, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 3, last_id);
+            queued = (sqlite3_step(stmt) == SQLITE_DONE);
+            sqlite3_finalize(stmt);
+        }
+    }
+    page_buffer_return(&html);
+
+    sqlite3_exec(db, queued ? "COMMIT;" : "ROLLBACK;", 0, 0, 0);
+    if (queued)
+    {
+        char log_msg[160];
+        snprintf(log_msg, sizeof(log_msg), "已生成警报汇总邮件: %d 项警报", count);
+        write_log("INFO", log_msg);
+    }
+    return queued;
+}
+
+/* 汇总窗口已到期的收件人组（最早一条未汇总警报已等待满窗口），返回生成的汇总邮件数 */
+int flush_alert_digests(sqlite3 *db, const Config *config)
+{
+    sqlite3_stmt *stmt;
+    char groups[DIGEST_MAX_GROUPS][512];
+    int group_count = 0;
+    const char *sql = "SELECT recipients FROM alert_digest_items WHERE digest_id IS NULL "
+                      "GROUP BY recipients HAVING MIN(created_at) <= ? LIMIT ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+        return 0;
+
+    // 关闭汇总后（窗口为0）遗留的未汇总警报立即发出
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)clock_now() - (sqlite3_int64)config->digestWindow * 60);
+    sqlite3_bind_int(stmt, 2, DIGEST_MAX_GROUPS);
+    while (group_count < DIGEST_MAX_GROUPS && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char *recipients = (const char *)sqlite3_column_text(stmt, 0);
+        snprintf(groups[group_count++], sizeof(groups[0]), "%s", recipients ? recipients : "");
+    }
+    sqlite3_finalize(stmt);
+
+    int flushed = 0;
+    for (int i = 0; i < group_count; i++)
+        flushed += flush_alert_digest_group(db, groups[i]);
+    return flushed;
+}
+
+/* 距下一封待发邮件到期的毫秒数（没有待发邮件时返回最长等待时间） */
+DWORD outbox_next_wait(sqlite3 *db, const Config *config)
+{
+    sqlite3_stmt *stmt;
+    DWORD wait = OUTBOX_IDLE_WAIT_MS;
+    const char *sql = "SELECT MIN(due) FROM ("
+                      "SELECT MIN(next_attempt) AS due FROM email_outbox WHERE status = 'pending' UNION ALL "
+                      "SELECT MIN(created_at) + ? FROM alert_digest_items WHERE digest_id IS NULL);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+        return wait;
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)config->digestWindow * 60);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+    {
+        sqlite3_int64 due = sqlite3_column_int64(stmt, 0) - (sqlite3_int64)clock_now();
+        if (due <= 0)
+            wait = 0;
+        else if (due * 1000 < OUTBOX_IDLE_WAIT_MS)
+            wait = (DWORD)(due * 1000);
+    }
+    sqlite3_finalize(stmt);
+    return wait;
+}
+
+/* 发件箱投递线程：启动时先发送上次退出前未发出的邮件，之后被新邮件唤醒或等到重试时间 */
+DWORD WINAPI outbox_thread(LPVOID param)
+{
+    const Config *config = (const Config *)param;
+    trace_name_thread("发件箱线程");
+    sqlite3 *db;
+    if (sqlite3_open(config->dbPath, &db) != SQLITE_OK)
+    {
+        write_log("ERROR", "发件箱投递线程无法打开数据库");
+        sqlite3_close(db);
+        return 1;
+    }
+    sqlite3_busy_timeout(db, 5000);
+
+    while (!outbox_stopping)
+    {
+        flush_alert_digests(db, config);
+        int processed = deliver_outbox_batch(db, config);
+        // 每次唤醒都刷新统计，没有投递时待发送邮件的等待时长也要更新
+        publish_outbox_stats(db);
+        if (processed > 0)
+            continue; // 可能还有更多到期邮件
+        WaitForSingleObject(outbox_wakeup, outbox_next_wait(db, config));
+    }
+
+    sqlite3_close(db);
+    return 0;
+}
+
+/* 启动发件箱投递线程 */
+int start_outbox_worker(const Config *config)
+{
+    outbox_wakeup = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!outbox_wakeup)
+        return 0;
+
+    outbox_stopping = 0;
+    outbox_thread_handle = CreateThread(NULL, 0, outbox_thread, (LPVOID)config, 0, NULL);
+    if (!outbox_thread_handle)
+    {
+        CloseHandle(outbox_wakeup);
+        outbox_wakeup = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* 停止发件箱投递线程，未发出的邮件留在发件箱中，下次启动后继续发送 */
+void stop_outbox_worker(void)
+{
+    if (!outbox_thread_handle)
+        return;
+
+    InterlockedExchange(&outbox_stopping, 1);
+    SetEvent(outbox_wakeup);
+    WaitForSingleObject(outbox_thread_handle, INFINITE);
+    CloseHandle(outbox_thread_handle);
+    CloseHandle(outbox_wakeup);
+    outbox_thread_handle = NULL;
+    outbox_wakeup = NULL;
+}
+
+/* 把一个事件以NDJSON行的形式放进每个通知出口的待发队列；队列满时丢弃并计数，调用方从不等待网络 */
+void notify_publish(const char *type, const PageBuffer *data)
+{
+    if (!notify_thread_handle || !data->data)
+        return;
+
+    for (int i = 0; i < notify_sink_count; i++)
+    {
+        NotifySink *sink = &notify_sinks[i];
+        size_t needed = strlen(type) + data->length + 24;
+        EnterCriticalSection(&sink->lock);
+        if (sink->pending.length + sink->inflightLength + needed > NOTIFY_QUEUE_LIMIT)
+        {
+            InterlockedIncrement(&sink->dropped);
+        }
+        else
+        {
+            page_buffer_printf(&sink->pending, "{\"type\":\"%s\",\"data\":", type);
+            page_buffer_append(&sink->pending, data->data, data->length);
+            page_buffer_append(&sink->pending, "}\n", 2);
+        }
+        LeaveCriticalSection(&sink->lock);
+    }
+    SetEvent(notify_wakeup);
+}
+
+/* 通过AF_UNIX流套接字投递一批事件，连接断开后在下次投递时重连 */
+int notify_unix_deliver(NotifySink *sink, const PageBuffer *batch)
+{
+    if (sink->socket == INVALID_SOCKET)
+    {
+        SOCKET socket_handle = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket_handle == INVALID_SOCKET)
+            return 0;
+
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, sink->target, sizeof(address.sun_path) - 1);
+        DWORD timeout = NOTIFY_TIMEOUT_MS;
+        setsockopt(socket_handle, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+        if (connect(socket_handle, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            closesocket(socket_handle);
+            return 0;
+        }
+        sink->socket = socket_handle;
+    }
+
+    if (socket_send_all(sink->socket, batch->data, batch->length))
+        return 1;
+
+    closesocket(sink->socket);
+    sink->socket = INVALID_SOCKET;
+    return 0;
+}
+
+/* 把一批事件作为一个NDJSON请求体POST到webhook，收到2xx即视为送达 */
+int notify_webhook_deliver(NotifySink *sink, const PageBuffer *batch)
+{
+    struct addrinfo hints;
+    struct addrinfo *addresses = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (getaddrinfo(sink->host, sink->port, &hints, &addresses) != 0)
+        return 0;
+
+    SOCKET socket_handle = INVALID_SOCKET;
+    for (struct addrinfo *address = addresses; address; address = address->ai_next)
+    {
+        socket_handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket_handle == INVALID_SOCKET)
+            continue;
+        DWORD timeout = NOTIFY_TIMEOUT_MS;
+        setsockopt(socket_handle, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+        setsockopt(socket_handle, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+        if (connect(socket_handle, address->ai_addr, (int)address->ai_addrlen) == 0)
+            break;
+        closesocket(socket_handle);
+        socket_handle = INVALID_SOCKET;
+    }
+    freeaddrinfo(addresses);
+    if (socket_handle == INVALID_SOCKET)
+        return 0;
+
+    char head[512];
+    int head_length = snprintf(head, sizeof(head),
+                               "POST %s HTTP/1.1\r\n"
+                               "Host: %s:%s\r\n"
+                               "Content-Type: application/x-ndjson\r\n"
+                               "Content-Length: %lu\r\n"
+                               "Connection: close\r\n"
+                               "\r\n",
+                               sink->path, sink->host, sink->port, (unsigned long)batch->length);
+
+    int status = 0;
+    if (socket_send_all(socket_handle, head, head_length) &&
+        socket_send_all(socket_handle, batch->data, batch->length))
+    {
+        char reply[64] = "";
+        int received = 0;
+        while (received < (int)sizeof(reply) - 1 && !strchr(reply, '\n'))
+        {
+            int n = recv(socket_handle, reply + received, (int)sizeof(reply) - 1 - received, 0);
+            if (n <= 0)
+                break;
+            received += n;
+            reply[received] = '\0';
+        }
+        reply[received] = '\0';
+        sscanf(reply, "HTTP/%*s %d", &status);
+    }
+    closesocket(socket_handle);
+    return status >= 200 && status < 300;
+}
+
+/* 按配置添加一个通知出口；webhook只支持明文http（本机收集器） */
+int notify_sink_add(int kind, const char *target)
+{
+    if (notify_sink_count >= NOTIFY_MAX_SINKS)
+        return 0;
+
+    NotifySink *sink = &notify_sinks[notify_sink_count];
+    memset(sink, 0, sizeof(NotifySink));
+    sink->socket = INVALID_SOCKET;
+    strncpy(sink->target, target, sizeof(sink->target) - 1);
+
+    if (kind == NOTIFY_SINK_WEBHOOK)
+    {
+        if (strncmp(target, "http://", 7) != 0)
+        {
+            write_log("ERROR", "通知webhook只支持http://地址");
+            return 0;
+        }
+        const char *host = target + 7;
+        size_t host_length = strcspn(host, ":/");
+        if (host_length == 0 || host_length >= sizeof(sink->host))
+            return 0;
+        memcpy(sink->host, host, host_length);
+        const char *rest = host + host_length;
+        strcpy(sink->port, "80");
+        if (*rest == ':')
+        {
+            size_t port_length = strcspn(rest + 1, "/");
+            if (port_length == 0 || port_length >= sizeof(sink->port))
+                return 0;
+            memcpy(sink->port, rest + 1, port_length);
+            sink->port[port_length] = '\0';
+            rest += 1 + port_length;
+        }
+        snprintf(sink->path, sizeof(sink->path), "%s", *rest ? rest : "/");
+        sink->deliver = notify_webhook_deliver;
+    }
+    else
+    {
+        sink->deliver = notify_unix_deliver;
+    }
+
+    page_buffer_init(&sink->pending);
+    page_buffer_init(&sink->inflight);
+    InitializeCriticalSection(&sink->lock);
+    notify_sink_count++;
+    return 1;
+}
+
+/* 通知投递线程：每个出口一次取走全部待发事件作为一批发送，失败的批次保留并按退避间隔重试 */
+DWORD WINAPI notify_thread(LPVOID param)
+{
+    (void)param;
+    while (1)
+    {
+        int stopping = notify_stopping;
+        ULONGLONG now = GetTickCount64();
+        DWORD wait = INFINITE;
+
+        for (int i = 0; i < notify_sink_count; i++)
+        {
+            NotifySink *sink = &notify_sinks[i];
+            if (sink->inflight.length == 0)
+            {
+                // 交换两块缓冲区，持锁时间与队列长度无关
+                EnterCriticalSection(&sink->lock);
+                PageBuffer swap = sink->inflight;
+                sink->inflight = sink->pending;
+                sink->pending = swap;
+                sink->inflightLength = sink->inflight.length;
+                LeaveCriticalSection(&sink->lock);
+            }
+
+            if (sink->inflight.length > 0 && now >= sink->retryAt)
+            {
+                if (sink->deliver(sink, &sink->inflight))
+                {
+                    sink->inflight.length = 0;
+                    EnterCriticalSection(&sink->lock);
+                    sink->inflightLength = 0;
+                    LeaveCriticalSection(&sink->lock);
+                    sink->failures = 0;
+                    wait = 0; // 发送期间可能又有新事件
+                }
+                else
+                {
+                    if (sink->failures++ == 0)
+                    {
+                        char log_msg[320];
+                        snprintf(log_msg, sizeof(log_msg), "通知投递失败，稍后重试: %s", sink->target);
+                        write_log("WARN", log_msg);
+                    }
+                    DWORD backoff = NOTIFY_RETRY_MIN_MS << (sink->failures < 7 ? sink->failures - 1 : 6);
+                    sink->retryAt = now + (backoff < NOTIFY_RETRY_MAX_MS ? backoff : NOTIFY_RETRY_MAX_MS);
+                }
+            }
+            if (sink->inflight.length > 0 && wait != 0)
+            {
+                DWORD due = sink->retryAt > now ? (DWORD)(sink->retryAt - now) : 0;
+                if (due < wait)
+                    wait = due;
+            }
+
+            LONG dropped = InterlockedExchange(&sink->dropped, 0);
+            if (dropped > 0)
+            {
+                char log_msg[320];
+                snprintf(log_msg, sizeof(log_msg), "通知队列已满，丢弃 %ld 个事件: %s", (long)dropped, sink->target);
+                write_log("WARN", log_msg);
+            }
+        }
+
+        // 停止前已经尽力把剩余事件发出一次
+        if (stopping)
+            break;
+        WaitForSingleObject(notify_wakeup, wait);
+    }
+    return 0;
+}
+
+/* 启动通知投递线程（未配置NOTIFY_SOCKET和NOTIFY_WEBHOOK时不启用） */
+int start_notify_sinks(const Config *config)
+{
+    notify_sink_count = 0;
+    if (config->notifySocket[0])
+        notify_sink_add(NOTIFY_SINK_UNIX, config->notifySocket);
+    if (config->notifyWebhook[0])
+        notify_sink_add(NOTIFY_SINK_WEBHOOK, config->notifyWebhook);
+    if (notify_sink_count == 0)
+        return 1;
+
+    notify_wakeup = CreateEventA(NULL, FALSE, FALSE, NULL);
+    notify_stopping = 0;
+    notify_thread_handle = notify_wakeup ? CreateThread(NULL, 0, notify_thread, NULL, 0, NULL) : NULL;
+    if (!notify_thread_handle)
+    {
+        if (notify_wakeup)
+            CloseHandle(notify_wakeup);
+        notify_wakeup = NULL;
+        return 0;
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "本地通知已启用: %d 个出口", notify_sink_count);
+    write_log("INFO", log_msg);
+    return 1;
+}
+
+/* 停止通知投递线程并释放各出口的队列和连接 */
+void stop_notify_sinks(void)
+{
+    if (!notify_thread_handle)
+        return;
+
+    InterlockedExchange(&notify_stopping, 1);
+    SetEvent(notify_wakeup);
+    WaitForSingleObject(notify_thread_handle, INFINITE);
+    CloseHandle(notify_thread_handle);
+    CloseHandle(notify_wakeup);
+    notify_thread_handle = NULL;
+    notify_wakeup = NULL;
+
+    for (int i = 0; i < notify_sink_count; i++)
+    {
+        NotifySink *sink = &notify_sinks[i];
+        if (sink->socket != INVALID_SOCKET)
+            closesocket(sink->socket);
+        page_buffer_free(&sink->pending);
+        page_buffer_free(&sink->inflight);
+        DeleteCriticalSection(&sink->lock);
+    }
+    notify_sink_count = 0;
+}
+
+/* 取本线程的只读渲染连接（无互斥锁），还没有或数据库路径不同时打开 */
+sqlite3 *render_connection(const char *db_path)
+{
+    if (render_db && strcmp(render_db_path, db_path) == 0)
+        return render_db;
+
+    render_connection_close();
+    if (sqlite3_open_v2(db_path, &render_db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+    {
+        write_log("ERROR", "无法打开数据库生成页面");
+        sqlite3_close(render_db);
+        render_db = NULL;
+        return NULL;
+    }
+    sqlite3_busy_timeout(render_db, 5000);
+    snprintf(render_db_path, sizeof(render_db_path), "%s", db_path);
+    return render_db;
+}
+
+/* 关闭本线程的只读渲染连接：线程退出前，或数据库文件将被替换时调用 */
+void render_connection_close(void)
+{
+    if (render_db)
+    {
+        sqlite3_close(render_db);
+        render_db = NULL;
+    }
+    render_db_path[0] = '\0';
+}
+
+/* 打开本轮渲染的数据库快照：在本线程的渲染连接上开启读事务，并一次查出各页面共用的统计数据 */
+int render_snapshot_open(RenderSnapshot *snapshot, const char *db_path)
+{
+    memset(snapshot, 0, sizeof(RenderSnapshot));
+    snapshot->dbPath = db_path;
+    sqlite3 *db = render_connection(db_path);
+    if (!db)
+        return 0;
+
+    // 统计查询都在这个读事务中，看到同一时刻的数据
+    if (sqlite3_exec(db, "BEGIN;", 0, 0, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "无法开启数据库读事务");
+        return 0;
+    }
+    snapshot->db = db;
+
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT COUNT(*), IFNULL(MAX(id), 0), "
+                      "(SELECT remaining_energy FROM electric_data ORDER BY id DESC LIMIT 1), "
+                      "(SELECT total_consumption FROM electric_data ORDER BY id DESC LIMIT 1), "
+                      "(SELECT COUNT(*) FROM low_energy_alerts), "
+                      "(SELECT IFNULL(MAX(id), 0) FROM low_energy_alerts) "
+                      "FROM electric_data;";
+    if (sqlite3_prepare_v2(snapshot->db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备页面统计查询失败");
+        render_snapshot_close(snapshot);
+        return 0;
+    }
+    int rc;
+    TRACE_SPAN("db_snapshot_stats", "database", "rc", rc, rc = sqlite3_step(stmt));
+    if (rc == SQLITE_ROW)
+    {
+        snapshot->recordCount = sqlite3_column_int(stmt, 0);
+        snapshot->maxId = sqlite3_column_int(stmt, 1);
+        snapshot->latestEnergy = sqlite3_column_double(stmt, 2);
+        snapshot->latestConsumption = sqlite3_column_double(stmt, 3);
+        snapshot->alertCount = sqlite3_column_int(stmt, 4);
+        snapshot->maxAlertId = sqlite3_column_int(stmt, 5);
+    }
+    sqlite3_finalize(stmt);
+
+    TRACE_SPAN("db_snapshot_daily", "database", NULL, 0,
+               snapshot->dailyConsumption = calculate_daily_consumption_from_db(snapshot->db));
+    TRACE_SPAN("db_snapshot_weekly", "database", NULL, 0,
+               snapshot->weeklyConsumption = calculate_weekly_consumption_from_db(snapshot->db));
+    return 1;
+}
+
+/* 工作线程加入一轮渲染时打开快照的副本：在本线程自己的渲染连接上开启读事务，
+   与其他线程的查询真正并行；本轮领取的所有任务共用这个事务，副本用render_snapshot_close关闭 */
+int render_snapshot_connect(const RenderSnapshot *snapshot, RenderSnapshot *view)
+{
+    *view = *snapshot;
+    view->db = render_connection(snapshot->dbPath);
+    if (!view->db)
+        return 0;
+    if (sqlite3_exec(view->db, "BEGIN;", 0, 0, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "渲染工作线程无法开启数据库读事务");
+        view->db = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* 结束读事务；连接属于当前线程，留到下一轮继续使用 */
+void render_snapshot_close(RenderSnapshot *snapshot)
+{
+    if (snapshot->db)
+    {
+        sqlite3_exec(snapshot->db, "COMMIT;", 0, 0, 0);
+        snapshot->db = NULL;
+    }
+}
+
+/* 生成静态外壳页面app.html（内容不变时不会重写） */
+int generate_dashboard_shell(const char *web_path)
+{
+    PageBuffer page;
+    page_buffer_take(&page);
+    page_buffer_printf(&page, dashboard_shell_html, app_css_name, app_js_name);
+    int result = publish_page_if_changed(web_path, "app.html", &page);
+    page_buffer_return(&page);
+    return result;
+}
+
+/* 生成一页历史记录JSON（history-N.json），第N页包含ID在((N-1)*页大小, N*页大小]内的记录 */
+int generate_history_json_page(sqlite3 *db, const char *web_path, int page_number, int max_id)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT id, record_time, remaining_energy, remaining_amount, "
+                      "total_consumption, price, meter_status, meter_update_time "
+                      "FROM electric_data WHERE id > ? AND id <= ? ORDER BY id;";
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备历史分页SQL语句失败");
+        return 0;
+    }
+
+    sqlite3_bind_int(stmt, 1, (page_number - 1) * HISTORY_PAGE_SIZE);
+    sqlite3_bind_int(stmt, 2, page_number * HISTORY_PAGE_SIZE < max_id ? page_number * HISTORY_PAGE_SIZE : max_id);
+
+    PageBuffer page;
+    page_buffer_take(&page);
+    page_buffer_printf(&page, "{\"page\":%d,\"rows\":[", page_number);
+
+    int row_count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char *record_time = (const char *)sqlite3_column_text(stmt, 1);
+        const char *meter_status = (const char *)sqlite3_column_text(stmt, 6);
+        const char *meter_update_time = (const char *)sqlite3_column_text(stmt, 7);
+
+        page_buffer_printf(&page, "%s[%d,", row_count > 0 ? "," : "", sqlite3_column_int(stmt, 0));
+        page_buffer_append_json_string(&page, record_time ? record_time : "");
+        page_buffer_printf(&page, ",%.2f,%.2f,%.2f,%.4f,",
+                           sqlite3_column_double(stmt, 2),
+                           sqlite3_column_double(stmt, 3),
+                           sqlite3_column_double(stmt, 4),
+                           sqlite3_column_double(stmt, 5));
+        page_buffer_append_json_string(&page, meter_status ? meter_status : "");
+        page_buffer_append(&page, ",", 1);
+        page_buffer_append_json_string(&page, meter_update_time ? meter_update_time : "");
+        page_buffer_append(&page, "]", 1);
+        row_count++;
+    }
+    sqlite3_finalize(stmt);
+
+    page_buffer_printf(&page, "]}");
+
+    char name[64];
+    snprintf(name, sizeof(name), "history-%d.json", page_number);
+    int result = publish_page(web_path, name, &page);
+    page_buffer_return(&page);
+    return result;
+}
+
+/* 生成警报记录JSON（alerts.json），与警报页面一样最多包含最近1000条 */
+int generate_alerts_json(sqlite3 *db, const char *web_path, int max_alert_id)
+{
+    sqlite3_stmt *stmt;
+    int total = 0;
+
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM low_energy_alerts WHERE id <= ?;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int(stmt, 1, max_alert_id);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            total = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    const char *sql = "SELECT id, alert_time, remaining_energy, threshold, alert_message, meter_update_time "
+                      "FROM low_energy_alerts WHERE id <= ? ORDER BY alert_time DESC, id DESC LIMIT ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备警报SQL语句失败");
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, max_alert_id);
+    sqlite3_bind_int(stmt, 2, ALERTS_MAX_ROWS);
+
+    PageBuffer page;
+    page_buffer_take(&page);
+    page_buffer_printf(&page, "{\"count\":%d,\"rows\":[", total);
+
+    int row_count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char *alert_time = (const char *)sqlite3_column_text(stmt, 1);
+        const char *alert_message = (const char *)sqlite3_column_text(stmt, 4);
+        const char *meter_update_time = (const char *)sqlite3_column_text(stmt, 5);
+
+        page_buffer_printf(&page, "%s[%d,", row_count > 0 ? "," : "", sqlite3_column_int(stmt, 0));
+        page_buffer_append_json_string(&page, alert_time ? alert_time : "");
+        page_buffer_printf(&page, ",%.2f,%.1f,", sqlite3_column_double(stmt, 2), sqlite3_column_double(stmt, 3));
+        page_buffer_append_json_string(&page, alert_message ? alert_message : "");
+        page_buffer_append(&page, ",", 1);
+        page_buffer_append_json_string(&page, meter_update_time ? meter_update_time : "");
+        page_buffer_append(&page, "]", 1);
+        row_count++;
+    }
+    sqlite3_finalize(stmt);
+
+    page_buffer_printf(&page, "]}");
+
+    // 警报很少变化，内容相同则不重写
+    int result = publish_page_if_changed(web_path, "alerts.json", &page);
+    page_buffer_return(&page);
+    return result;
+}
+
+/* 生成JSON数据文件：latest.json、history-N.json分页、history-index.json、alerts.json
+   已写满的历史分页不会再变化，每轮只重写最新的一页和几个小文件 */
+int generate_data_files(const char *web_path, const RenderSnapshot *snapshot, const ElectricMeter *meter, double threshold)
+{
+    create_directory(web_path);
+    publish_static_assets(web_path);
+    generate_dashboard_shell(web_path);
+
+    PageBuffer page;
+    page_buffer_take(&page);
+    render_meter_json(&page, meter, threshold);
+    publish_page(web_path, "latest.json", &page);
+
+    sqlite3 *db = snapshot->db;
+    int record_count = snapshot->recordCount;
+    int max_id = snapshot->maxId;
+
+    // 只重写包含新记录的分页（程序启动后的第一轮会写出全部分页）
+    int first_page = json_history_last_id / HISTORY_PAGE_SIZE + 1;
+    int page_count = (max_id + HISTORY_PAGE_SIZE - 1) / HISTORY_PAGE_SIZE;
+    int pages_ok = 1;
+    for (int n = first_page; n <= page_count; n++)
+    {
+        if (!generate_history_json_page(db, web_path, n, max_id))
+            pages_ok = 0;
+    }
+    if (pages_ok)
+        json_history_last_id = max_id;
+
+    page.length = 0;
+    page.failed = 0;
+    page_buffer_printf(&page, "{\"pageSize\":%d,\"pages\":%d,\"count\":%d,\"lastId\":%d}",
+                       HISTORY_PAGE_SIZE, page_count, record_count, max_id);
+    publish_page_if_changed(web_path, "history-index.json", &page);
+    page_buffer_return(&page);
+
+    generate_alerts_json(db, web_path, snapshot->maxAlertId);
+
+    write_log("INFO", "JSON数据文件生成完成");
+    return 1;
+}
+
+/* 清空一条曲线的降采样状态 */
+void chart_series_reset(ChartSeries *series)
+{
+    free(series->points);
+    free(series->pending);
+    memset(series, 0, sizeof(ChartSeries));
+}
+
+/* 在候选点中选出与顶点a、下一桶平均点c构成三角形面积最大的点（LTTB） */
+ChartPoint chart_select_point(const ChartPoint *a, const ChartPoint *candidates, int count, double c_time, double c_value)
+{
+    ChartPoint best = candidates[0];
+    double best_area = -1;
+    for (int i = 0; i < count; i++)
+    {
+        double area = fabs((double)(a->time - candidates[i].time) * (c_value - a->value) -
+                           (a->time - c_time) * (candidates[i].value - a->value));
+        if (area > best_area)
+        {
+            best_area = area;
+            best = candidates[i];
+        }
+    }
+    return best;
+}
+
+/* 返回pending中从start开始的同一个桶的结束位置 */
+int chart_bucket_end(const ChartSeries *series, long long width, int start)
+{
+    long long bucket = series->pending[start].time / width;
+    int end = start + 1;
+    while (end < series->pendingCount && series->pending[end].time / width == bucket)
+        end++;
+    return end;
+}
+
+/* 追加一个读数；当后一个桶也已完整时，前一个桶即可定稿 */
+int chart_series_add(ChartSeries *series, long long width, long long time, double value)
+{
+    if (series->pendingCount > 0 && series->pending[series->pendingCount - 1].time / width != time / width)
+    {
+        int first_end = chart_bucket_end(series, width, 0);
+        if (first_end < series->pendingCount)
+        {
+            int second_end = chart_bucket_end(series, width, first_end);
+            double c_time = 0, c_value = 0;
+            for (int i = first_end; i < second_end; i++)
+            {
+                c_time += series->pending[i].time;
+                c_value += series->pending[i].value;
+            }
+            c_time /= second_end - first_end;
+            c_value /= second_end - first_end;
+
+            // 第一个桶保留首个读数，之后每个桶按LTTB选点
+            ChartPoint chosen = series->hasSelected
+                                    ? chart_select_point(&series->selected, series->pending, first_end, c_time, c_value)
+                                    : series->pending[0];
+            if (series->count == series->capacity)
+            {
+                int new_capacity = series->capacity ? series->capacity * 2 : CHART_POINTS;
+                ChartPoint *grown = realloc(series->points, new_capacity * sizeof(ChartPoint));
+                if (!grown)
+                    return 0;
+                series->points = grown;
+                series->capacity = new_capacity;
+            }
+            series->points[series->count++] = chosen;
+            series->selected = chosen;
+            series->hasSelected = 1;
+
+            series->pendingCount -= first_end;
+            memmove(series->pending, series->pending + first_end, series->pendingCount * sizeof(ChartPoint));
+        }
+    }
+
+    if (series->pendingCount == series->pendingCapacity)
+    {
+        int new_capacity = series->pendingCapacity ? series->pendingCapacity * 2 : 16;
+        ChartPoint *grown = realloc(series->pending, new_capacity * sizeof(ChartPoint));
+        if (!grown)
+            return 0;
+        series->pending = grown;
+        series->pendingCapacity = new_capacity;
+    }
+    series->pending[series->pendingCount].time = time;
+    series->pending[series->pendingCount].value = value;
+    series->pendingCount++;
+    return 1;
+}
+
+/* 计算未定稿部分的临时点（最多两个：倒数第二个桶的选点和最新读数），返回点数 */
+int chart_series_tail(const ChartSeries *series, long long width, ChartPoint *out)
+{
+    if (series->pendingCount == 0)
+        return 0;
+
+    int count = 0;
+    int first_end = chart_bucket_end(series, width, 0);
+    if (first_end < series->pendingCount)
+    {
+        double c_time = 0, c_value = 0;
+        for (int i = first_end; i < series->pendingCount; i++)
+        {
+            c_time += series->pending[i].time;
+            c_value += series->pending[i].value;
+        }
+        c_time /= series->pendingCount - first_end;
+        c_value /= series->pendingCount - first_end;
+        out[count++] = series->hasSelected
+                           ? chart_select_point(&series->selected, series->pending, first_end, c_time, c_value)
+                           : series->pending[0];
+    }
+    out[count++] = series->pending[series->pendingCount - 1];
+    return count;
+}
+
+/* 丢弃时间范围之外的已定稿点 */
+void chart_series_trim(ChartSeries *series, long long start)
+{
+    int drop = 0;
+    while (drop < series->count && series->points[drop].time < start)
+        drop++;
+    if (drop > 0)
+    {
+        series->count -= drop;
+        memmove(series->points, series->points + drop, series->count * sizeof(ChartPoint));
+    }
+}
+
+/* 读取自上次以来的新记录，增量更新各时间范围的降采样曲线 */
+int update_chart_series(sqlite3 *db, int max_id)
+{
+    // 记录时间随ID递增，首尾两条记录即可确定数据跨度
+    long long first_time = 0, last_time = 0;
+    sqlite3_stmt *stmt;
+    const char *span_sql = "SELECT (SELECT CAST(strftime('%s', record_time) AS INTEGER) FROM electric_data ORDER BY id LIMIT 1), "
+                           "(SELECT CAST(strftime('%s', record_time) AS INTEGER) FROM electric_data WHERE id <= ? ORDER BY id DESC LIMIT 1);";
+    if (sqlite3_prepare_v2(db, span_sql, -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int(stmt, 1, max_id);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            first_time = sqlite3_column_int64(stmt, 0);
+            last_time = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    const char *sql = "SELECT id, CAST(strftime('%s', record_time) AS INTEGER), remaining_energy, total_consumption "
+                      "FROM electric_data WHERE id > ? AND id <= ? AND CAST(strftime('%s', record_time) AS INTEGER) >= ? ORDER BY id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备图表数据查询失败");
+        return 0;
+    }
+
+    for (int r = 0; r < CHART_RANGE_COUNT; r++)
+    {
+        ChartRange *range = &chart_ranges[r];
+
+        // 固定范围桶宽不变；全部数据的桶宽随跨度成倍增大，增大时从头重新计算
+        long long width;
+        if (range->seconds > 0)
+        {
+            width = range->seconds / CHART_POINTS;
+        }
+        else
+        {
+            width = range->width > 0 ? range->width : CHART_MIN_BUCKET;
+            while ((last_time - first_time) / width >= CHART_POINTS)
+                width *= 2;
+        }
+        if (width != range->width)
+        {
+            chart_series_reset(&range->energy);
+            chart_series_reset(&range->consumption);
+            range->width = width;
+            range->lastId = 0;
+        }
+
+        long long start = range->seconds > 0 ? last_time - range->seconds - 2 * width : 0;
+        sqlite3_reset(stmt);
+        sqlite3_bind_int64(stmt, 1, range->lastId);
+        sqlite3_bind_int(stmt, 2, max_id);
+        sqlite3_bind_int64(stmt, 3, start);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            long long time = sqlite3_column_int64(stmt, 1);
+            chart_series_add(&range->energy, width, time, sqlite3_column_double(stmt, 2));
+            chart_series_add(&range->consumption, width, time, sqlite3_column_double(stmt, 3));
+            range->lastId = sqlite3_column_int64(stmt, 0);
+        }
+        range->latestTime = last_time;
+
+        if (range->seconds > 0)
+        {
+            chart_series_trim(&range->energy, last_time - range->seconds);
+            chart_series_trim(&range->consumption, last_time - range->seconds);
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    return 1;
+}
+
+/* 输出一条曲线：[时间, 数值, 时间, 数值, ...] */
+void render_chart_series(PageBuffer *buffer, const ChartRange *range, const ChartSeries *series)
+{
+    long long start = range->seconds > 0 ? range->latestTime - range->seconds : 0;
+    ChartPoint tail[2];
+    int tail_count = chart_series_tail(series, range->width, tail);
+    int written = 0;
+
+    page_buffer_append(buffer, "[", 1);
+    for (int i = 0; i < series->count + tail_count; i++)
+    {
+        const ChartPoint *point = (i < series->count) ? &series->points[i] : &tail[i - series->count];
+        if (point->time < start)
+            continue;
+        page_buffer_printf(buffer, "%s%lld,%.2f", written++ > 0 ? "," : "", point->time, point->value);
+    }
+    page_buffer_append(buffer, "]", 1);
+}
+
+/* 输出各时间范围的降采样图表数据（JSON） */
+int render_chart_json(PageBuffer *buffer)
+{
+    page_buffer_printf(buffer, "{\"points\":%d,\"ranges\":[", CHART_POINTS);
+    for (int r = 0; r < CHART_RANGE_COUNT; r++)
+    {
+        const ChartRange *range = &chart_ranges[r];
+        page_buffer_printf(buffer, "%s{\"name\":\"%s\",\"label\":\"%s\",\"energy\":",
+                           r > 0 ? "," : "", range->name, range->label);
+        render_chart_series(buffer, range, &range->energy);
+        page_buffer_append(buffer, ",\"consumption\":", 15);
+        render_chart_series(buffer, range, &range->consumption);
+        page_buffer_append(buffer, "}", 1);
+    }
+    return page_buffer_append(buffer, "]}", 2);
+}
+
+/* 计算精确的日均用电量 */
+double calculate_daily_consumption_from_db(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int rc;
+    double daily_consumption = 5.0; // 默认值
+
+    // 获取最近144条记录（假设每10分钟一条，约24小时数据）
+    const char *sql = "SELECT record_time, total_consumption FROM electric_data "
+                      "ORDER BY id DESC LIMIT 144;";
+
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
+    if (rc != SQLITE_OK) {
+        return daily_consumption;
+    }
+
+    int record_count = 0;
+    double oldest_consumption = 0;
+    double newest_consumption = 0;
+    char oldest_time[50] = {0};
+    char newest_time[50] = {0};
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *record_time = (const char *)sqlite3_column_text(stmt, 0);
+        double consumption = sqlite3_column_double(stmt, 1);
+        
+        if (record_count == 0) {
+            // 最新记录
+            newest_consumption = consumption;
+            strncpy(newest_time, record_time, sizeof(newest_time) - 1);
+        }
+        // 最后一条记录（最老的）
+        oldest_consumption = consumption;
+        strncpy(oldest_time, record_time, sizeof(oldest_time) - 1);
+        record_count++;
+    }
+
+    sqlite3_finalize(stmt);
+
+    // 如果有足够的数据计算
+    if (record_count >= 2 && newest_consumption > oldest_consumption) {
+        double total_used = newest_consumption - oldest_consumption;
+        
+        // 计算时间差（小时）
+        // 简化处理：假设记录间隔固定，使用记录数量估算小时数
+        double hours_covered = record_count * 10.0 / 60.0; // 假设每10分钟一条记录
+        
+        if (hours_covered >= 1.0) {
+            double hourly_consumption = total_used / hours_covered;
+            daily_consumption = hourly_consumption * 24.0;
+            
+            // 限制在合理范围内
+            if (daily_consumption < 1.0) daily_consumption = 1.0;
+            if (daily_consumption > 50.0) daily_consumption = 50.0;
+            
+            char log_msg[256];
+            snprintf(log_msg, sizeof(log_msg), "精确计算日均用电量: %.2f度/天 (基于%d条记录, %.1f小时数据)", 
+                    daily_consumption, record_count, hours_covered);
+            write_log("INFO", log_msg);
+        }
+    }
+
+    return daily_consumption;
+}
+
+/* 计算周均用电量 */
+double calculate_weekly_consumption_from_db(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int rc;
+    double weekly_consumption = 35.0; // 默认值
+
+    // 获取最近7天的数据
+    const char *sql = "SELECT record_time, total_consumption FROM electric_data "
+                      "WHERE record_time >= ? "
+                      "ORDER BY id;";
 
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
     if (rc != SQLITE_OK) {
+        return weekly_consumption;
+    }
+    char since[32];
+    clock_sql_time(since, sizeof(since), -7LL * 24 * 3600);
+    sqlite3_bind_text(stmt, 1, since, -1, SQLITE_TRANSIENT);
+
+    int record_count = 0;
+    double oldest_consumption = 0;
+    double newest_consumption = 0;
+    char oldest_time[50] = {0};
+    char newest_time[50] = {0};
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *record_time = (const char *)sqlite3_column_text(stmt, 0);
+        double consumption = sqlite3_column_double(stmt, 1);
+        
+        if (record_count == 0) {
+            // 第一条记录（最老的）
+            oldest_consumption = consumption;
+            strncpy(oldest_time, record_time, sizeof(oldest_time) - 1);
+        }
+        // 最后一条记录（最新的）
+        newest_consumption = consumption;
+        strncpy(newest_time, record_time, sizeof(newest_time) - 1);
+        record_count++;
+    }
+
+    sqlite3_finalize(stmt);
+
+    // 如果有足够的数据计算
+    if (record_count >= 2 && newest_consumption > oldest_consumption) {
+        double total_used = newest_consumption - oldest_consumption;
+        
+        // 假设数据覆盖了7天
+        weekly_consumption = total_used;
+        
+        // 限制在合理范围内
+        if (weekly_consumption < 7.0) weekly_consumption = 7.0;  // 至少每天1度
+        if (weekly_consumption > 350.0) weekly_consumption = 350.0; // 最多每天50度
+        
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg), "计算周均用电量: %.2f度/周 (基于%d条记录)", 
+                weekly_consumption, record_count);
+        write_log("INFO", log_msg);
+    }
+
+    return weekly_consumption;
+}
+/* 生成实时监控HTML页面 */
+/* 生成实时监控HTML页面 */
+int generate_index_html(const char *web_path, const ElectricMeter *meter, double threshold, const RenderSnapshot *snapshot)
+{
+    char filepath[512];
+    sprintf(filepath, "%s/index.html", web_path);
+
+    PageBuffer page;
+    page_buffer_take(&page);
+
+    const char *status_class = (meter->remainingEnergy <= threshold) ? "low-energy" : "normal";
+    const char *status_text = (meter->remainingEnergy <= threshold) ? "低电量" : "正常";
+    const char *status_emoji = (meter->remainingEnergy <= threshold) ? "⚠️" : "✅";
+
+    // 精确计算预估可用天数
+    double estimated_days = 0;  // 确保在这里声明变量
+    double daily_consumption = 0;
+    
+    if (meter->remainingEnergy > 0)
+    {
+        // 首先使用快照中从数据库精确计算的日均用电量
+        daily_consumption = snapshot->dailyConsumption;
+        
+        // 如果精确计算失败，使用基于总用电量的估算
+        if (daily_consumption <= 0.1) {
+            if (meter->totalConsumption > 1000) {
+                daily_consumption = 20.0; // 家庭用电
+            } else if (meter->totalConsumption > 500) {
+                daily_consumption = 15.0; // 中等家庭用电
+            } else if (meter->totalConsumption > 100) {
+                daily_consumption = 8.0;  // 小型用电
+            } else if (meter->totalConsumption > 50) {
+                daily_consumption = 4.0;  // 低用电
+            } else {
+                daily_consumption = 2.0;  // 极低用电
+            }
+            
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "使用估算日均用电量: %.2f度/天", daily_consumption);
+            write_log("INFO", log_msg);
+        }
+        
+        // 计算预估天数
+        estimated_days = meter->remainingEnergy / daily_consumption;
+        
+        // 限制显示范围，避免不合理的数值
+        if (estimated_days > 365) estimated_days = 365;
+        if (estimated_days < 0.1) estimated_days = 0.1;
+    }
+
+    // 现在在HTML中使用 estimated_days 变量
+    page_buffer_printf(&page,
+            "<!DOCTYPE html>\n"
+            "<html lang=\"zh-CN\">\n"
+            "<head>\n"
+            "    <meta charset=\"UTF-8\">\n"
+            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+            "    <title>电表定时时监控</title>\n"
+            "    <link rel=\"stylesheet\" href=\"%s\">\n"
+            "</head>\n"
+            "<body class=\"page-index\">\n"
+            "    <div class=\"container\">\n"
+            "        <div class=\"header\">\n"
+            "            <h1>⚡ 电表监控系统</h1>\n"
+            "            <div>实时电力监控</div>\n"
+            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"nav\">\n"
+            "            <a href=\"index.html\" style=\"background:rgba(255,255,255,0.2);\">实时监控</a>\n"
+            "            <a href=\"history.html\">历史记录</a>\n"
+            "            <a href=\"alerts.html\">警报记录</a>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"content\">\n"
+            "            <div class=\"status-card %s\" id=\"status-card\">\n"
+            "                <div class=\"status-header\">\n"
+            "                    <div class=\"status-title\">当前电表状态</div>\n"
+            "                    <div class=\"status-badge %s\" id=\"status-badge\">%s %s</div>\n"
+            "                </div>\n",
+            app_css_name,
+            status_class,
+            (meter->remainingEnergy <= threshold) ? "badge-low" : "badge-normal",
+            status_emoji, status_text);
+
+    if (meter->remainingEnergy <= threshold)
+    {
+        page_buffer_printf(&page,
+                "                <div class=\"alert-banner\" id=\"alert-banner\">\n"
+                "                    <strong>⚠️ 低电量警告！</strong> 剩余 %.2f 度电，请及时充值！\n"
+                "                </div>\n",
+                meter->remainingEnergy);
+    }
+
+    page_buffer_printf(&page,
+            "            </div>\n"
+            "            \n"
+            "            <div class=\"stats-grid\">\n"
+            "                <div class=\"stat-card energy\">\n"
+            "                    <div class=\"stat-label\">剩余电量</div>\n"
+            "                    <div class=\"stat-value energy-value\" id=\"live-energy\">%.2f 度</div>\n"
+            "                    <div>Remaining Energy</div>\n"
+            "                </div>\n"
+            "                <div class=\"stat-card amount\">\n"
+            "                    <div class=\"stat-label\">剩余金额</div>\n"
+            "                    <div class=\"stat-value amount-value\" id=\"live-amount\">%.2f 元</div>\n"
+            "                    <div>Remaining Amount</div>\n"
+            "                </div>\n"
+            "                <div class=\"stat-card consumption\">\n"
+            "                    <div class=\"stat-label\">累计用电</div>\n"
+            "                    <div class=\"stat-value consumption-value\" id=\"live-consumption\">%.2f kWh</div>\n"
+            "                    <div>Total Consumption</div>\n"
+            "                </div>\n"
+            "                <div class=\"stat-card price\">\n"
+            "                    <div class=\"stat-label\">当前电价</div>\n"
+            "                    <div class=\"stat-value price-value\" id=\"live-price\">%.4f 元/度</div>\n"
+            "                    <div>Current Price</div>\n"
+            "                </div>\n"
+            "            </div>\n"
+            "            \n"
+            "            <table class=\"info-table\">\n"
+            "                <tr><th>项目</th><th>数值</th><th>说明</th></tr>\n"
+            "                <tr><td>电表状态</td><td id=\"live-status\">%s</td><td>当前电表工作状态</td></tr>\n"
+            "                <tr><td>数据更新时间</td><td id=\"live-update-time\">%s</td><td>电表数据最后更新时间</td></tr>\n"
+            "                <tr><td>系统记录时间</td><td id=\"live-system-time\">%s</td><td>系统获取数据时间</td></tr>\n"
+            "                <tr><td>低电量阈值</td><td>%.1f 度</td><td>触发警报的阈值</td></tr>\n"
+            "                <tr><td>预估可用天数</td><td>%.1f 天</td><td>基于历史用电量估算</td></tr>\n"
+            "            </table>\n",
+            meter->remainingEnergy,
+            meter->remainingAmount,
+            meter->totalConsumption,
+            meter->price,
+            meter->meterStatus,
+            meter->meterUpdateTime,
+            meter->systemTime,
+            threshold,
+            estimated_days);  // 这里使用 estimated_days 变量
+
+    page_buffer_printf(&page,
+            "            \n"
+            "            <div class=\"update-time\">\n"
+            "                页面最后更新: <span id=\"live-page-time\">%s</span>\n"
+            "            </div>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"footer\">\n"
+            "            <p>QAQmolingQAQ</p>\n"
+            "            <p>https://github.com/QAQmolingQAQ/sdipct_electric_monitor-</p>\n"
+            "        </div>\n"
+            "    </div>\n"
+            "    \n"
+            "    <script src=\"%s\"></script>\n"
+            "    <script>\n"
+            "        connectLiveUpdates({ reading: applyReading });\n"
+            "    </script>\n"
+            "</body>\n"
+            "</html>",
+            get_current_time(), app_js_name);
+    int published = publish_page(web_path, "index.html", &page);
+    page_buffer_return(&page);
+    if (!published)
+    {
+        write_log("ERROR", "无法创建实时监控HTML文件");
+        return 0;
+    }
+
+    char success_msg[256];
+    snprintf(success_msg, sizeof(success_msg), "实时监控页面已生成: %s", filepath);
+    write_log("INFO", success_msg);
+    return 1;
+}
+
+/* 生成历史记录HTML页面：记录按ID倒序直接从数据库游标逐行写入页面，每攒够PAGE_STREAM_CHUNK字节就写出到文件和gzip流 */
+int generate_history_html(const char *web_path, const RenderSnapshot *snapshot)
+{
+    char filepath[512];
+    sprintf(filepath, "%s/history.html", web_path);
+
+    // 页面顶部的统计信息来自快照：记录总数和最新一条记录的电量
+    int total_count = snapshot->recordCount;
+    double latest_energy = snapshot->latestEnergy;
+    double total_consumption = snapshot->latestConsumption;
+    int count = total_count < HISTORY_MAX_ROWS ? total_count : HISTORY_MAX_ROWS;
+
+    PageStream stream;
+    if (!page_stream_open(&stream, web_path, "history.html"))
+        return 0;
+    PageBuffer page;
+    page_buffer_take(&page);
+
+    // 精确计算预估可用天数
+    double estimated_days = 0;
+    double daily_consumption = 0;
+    double weekly_consumption = 0;
+    
+    if (count > 0 && latest_energy > 0)
+    {
+        // 日均、周均用电量
+        daily_consumption = snapshot->dailyConsumption;
+        weekly_consumption = snapshot->weeklyConsumption;
+        
+        // 优先使用精确计算的日均用电量
+        if (daily_consumption > 0.1) {
+            estimated_days = latest_energy / daily_consumption;
+        } else {
+            // 使用周均用电量估算日均
+            double estimated_daily = weekly_consumption / 7.0;
+            if (estimated_daily > 0.1) {
+                estimated_days = latest_energy / estimated_daily;
+            } else {
+                // 最终回退到基于总用电量的估算
+                if (total_consumption > 500) {
+                    estimated_days = latest_energy / 15.0;
+                } else {
+                    estimated_days = latest_energy / 5.0;
+                }
+            }
+        }
+        
+        // 限制显示范围
+        if (estimated_days > 365) estimated_days = 365;
+        if (estimated_days < 0.1) estimated_days = 0.1;
+    }
+
+    page_buffer_printf(&page,
+            "<!DOCTYPE html>\n"
+            "<html lang=\"zh-CN\">\n"
+            "<head>\n"
+            "    <meta charset=\"UTF-8\">\n"
+            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+            "    <title>电表历史记录</title>\n"
+            "    <link rel=\"stylesheet\" href=\"%s\">\n"
+            "</head>\n"
+            "<body class=\"page-history\">\n"
+            "    <div class=\"container\">\n"
+            "        <div class=\"header\">\n"
+            "            <h1>⚡ 电表监控系统 - 历史记录</h1>\n"
+            "            <div>电力数据历史记录</div>\n"
+            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"nav\">\n"
+            "            <a href=\"index.html\">实时监控</a>\n"
+            "            <a href=\"history.html\" style=\"background:rgba(255,255,255,0.2);\">历史记录</a>\n"
+            "            <a href=\"alerts.html\">警报记录</a>\n"
+            "        </div>\n"
+            "        \n"
+            "            <div class=\"section-title\">📊 电量统计</div>\n"
+            "            <div class=\"stats-grid\">\n"
+            "                <div class=\"stat-card records\">\n"
+            "                    <div class=\"stat-label\">总记录数</div>\n"
+            "                    <div class=\"stat-value\" id=\"history-count\">%d 条</div>\n"
+            "                    <div>Total Records</div>\n"
+            "                </div>\n"
+            "                <div class=\"stat-card consumption\">\n"
+            "                    <div class=\"stat-label\">累计用电</div>\n"
+            "                    <div class=\"stat-value\" id=\"history-consumption\">%.2f kWh</div>\n"
+            "                    <div>Total Consumption</div>\n"
+            "                </div>\n"
+            "               <div class=\"stat-card\">\n"
+            "                    <div class=\"stat-label\">日均用电量</div>\n"
+            "                    <div class=\"stat-value\">%.2f 度/天</div>\n"
+            "                    <div>Daily Consumption</div>\n"
+            "                </div>\n"
+            "                <div class=\"stat-card\">\n"
+            "                    <div class=\"stat-label\">周均用电量</div>\n"
+            "                    <div class=\"stat-value\">%.2f 度/周</div>\n"
+            "                    <div>Weekly Consumption</div>\n"
+            "                </div>\n"
+            "                <div class=\"stat-card\">\n"
+            "                    <div class=\"stat-label\">预估可用天数</div>\n"
+            "                    <div class=\"stat-value\">%.1f 天</div>\n"
+            "                    <div>Estimated Days</div>\n"
+            "                </div>\n"
+            "            </div>\n"
+            "            \n"
+            "            <div class=\"section-title\">📉 用电趋势</div>\n"
+            "            <div class=\"chart-ranges\" id=\"chart-ranges\"></div>\n"
+            "            <div class=\"chart-grid\">\n"
+            "                <div class=\"chart-card\">\n"
+            "                    <div class=\"stat-label\">剩余电量 (度)</div>\n"
+            "                    <canvas id=\"energy-chart\"></canvas>\n"
+            "                </div>\n"
+            "                <div class=\"chart-card\">\n"
+            "                    <div class=\"stat-label\">累计用电 (kWh)</div>\n"
+            "                    <canvas id=\"consumption-chart\"></canvas>\n"
+            "                </div>\n"
+            "            </div>\n"
+            "            \n"
+            "            <div class=\"section-title\">📈 详细历史记录（最近%d条）</div>\n"
+            "            <div class=\"table-container\">\n"
+            "                <table class=\"history-table\">\n"
+            "                    <thead>\n"
+            "                        <tr>\n"
+            "                            <th>ID</th>\n"
+            "                            <th>记录时间</th>\n"
+            "                            <th>剩余电量 (度)</th>\n"
+            "                            <th>剩余金额 (元)</th>\n"
+            "                            <th>累计用电 (kWh)</th>\n"
+            "                            <th>电价 (元/度)</th>\n"
+            "                            <th>电表状态</th>\n"
+            "                            <th>数据更新时间</th>\n"
+            "                        </tr>\n"
+            "                    </thead>\n"
+            "                    <tbody>\n",
+            app_css_name, total_count, total_consumption, daily_consumption, weekly_consumption, estimated_days, count);
+
+    // 表格行由浏览器按需生成，这里只输出紧凑的记录数据：
+    // [id, 记录时间, 剩余电量, 剩余金额, 累计用电, 电价, 状态, 更新时间]
+    page_buffer_printf(&page,
+            "                    </tbody>\n"
+            "                </table>\n"
+            "            </div>\n"
+            "            <script type=\"application/json\" id=\"history-data\">[");
+    // 按ID倒序即按时间倒序，沿主键索引逐行读取，无需排序临时表
+    const char *sql = "SELECT id, record_time, remaining_energy, remaining_amount, "
+                      "total_consumption, price, meter_status, meter_update_time "
+                      "FROM electric_data WHERE id <= ? ORDER BY id DESC LIMIT ?;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(snapshot->db, sql, -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int(stmt, 1, snapshot->maxId);
+        sqlite3_bind_int(stmt, 2, count);
+        int row = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            const char *record_time = (const char *)sqlite3_column_text(stmt, 1);
+            const char *meter_status = (const char *)sqlite3_column_text(stmt, 6);
+            const char *meter_update_time = (const char *)sqlite3_column_text(stmt, 7);
+
+            page_buffer_printf(&page, "%s\n[%d,", row++ > 0 ? "," : "", sqlite3_column_int(stmt, 0));
+            page_buffer_append_json_string(&page, record_time ? record_time : "");
+            page_buffer_printf(&page, ",%.2f,%.2f,%.2f,%.4f,",
+                               sqlite3_column_double(stmt, 2),
+                               sqlite3_column_double(stmt, 3),
+                               sqlite3_column_double(stmt, 4),
+                               sqlite3_column_double(stmt, 5));
+            page_buffer_append_json_string(&page, meter_status ? meter_status : "");
+            page_buffer_append(&page, ",", 1);
+            page_buffer_append_json_string(&page, meter_update_time ? meter_update_time : "");
+            page_buffer_append(&page, "]", 1);
+            if (page.length >= PAGE_STREAM_CHUNK)
+                page_stream_write(&stream, &page);
+        }
+        sqlite3_finalize(stmt);
+    }
+    else
+    {
+        write_log("ERROR", "准备历史记录查询失败");
+    }
+    page_buffer_printf(&page, "]</script>\n"
+            "            <script type=\"application/json\" id=\"chart-data\">");
+    render_chart_json(&page);
+
+    page_buffer_printf(&page,
+            "</script>\n"
+            "            \n"
+            "            <div class=\"update-time\">\n"
+            "                页面生成时间: %s\n"
+            "            </div>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"footer\">\n"
+            "            <p>历史记录页面</p>\n"
+            "            <p></p>\n"
+            "        </div>\n"
+            "    </div>\n"
+            "    \n"
+            "    <script src=\"%s\"></script>\n"
+            "    <script>\n"
+            "        const historyTable = createHistoryTable(document.querySelector('.history-table'),\n"
+            "                                                JSON.parse(document.getElementById('history-data').textContent));\n"
+            "        const historyCharts = createHistoryCharts(JSON.parse(document.getElementById('chart-data').textContent));\n"
+            "        connectLiveUpdates({ reading: function(r) { addHistoryRow(historyTable, historyCharts, r); } });\n"
+            "    </script>\n"
+            "</body>\n"
+            "</html>",
+            get_current_time(), app_js_name);
+
+    int published = page_stream_publish(&stream, &page);
+    page_buffer_return(&page);
+    if (!published)
+    {
+        write_log("ERROR", "无法创建历史记录HTML文件");
+        return 0;
+    }
+
+    char success_msg[256];
+    snprintf(success_msg, sizeof(success_msg), "历史记录页面已生成: %s", filepath);
+    write_log("INFO", success_msg);
+    return 1;
+}
+
+/* 生成警报记录HTML页面：与alerts.json相同，最近的ALERTS_MAX_ROWS条警报按时间倒序直接从数据库游标逐行写入页面 */
+int generate_alerts_html(const char *web_path, const RenderSnapshot *snapshot)
+{
+    char filepath[512];
+    sprintf(filepath, "%s/alerts.html", web_path);
+
+    int count = snapshot->alertCount;
+
+    PageBuffer page;
+    page_buffer_take(&page);
+
+    page_buffer_printf(&page,
+            "<!DOCTYPE html>\n"
+            "<html lang=\"zh-CN\">\n"
+            "<head>\n"
+            "    <meta charset=\"UTF-8\">\n"
+            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+            "    <title>电表警报记录</title>\n"
+            "    <link rel=\"stylesheet\" href=\"%s\">\n"
+            "</head>\n"
+            "<body class=\"page-alerts\">\n"
+            "    <div class=\"container\">\n"
+            "        <div class=\"header\">\n"
+            "            <h1>警报记录</h1>\n"
+            "            <div>低电量警报历史记录</div>\n"
+            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"nav\">\n"
+            "            <a href=\"index.html\">实时监控</a>\n"
+            "            <a href=\"history.html\">历史记录</a>\n"
+            "            <a href=\"alerts.html\" style=\"background:rgba(255,255,255,0.2);\">警报记录</a>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"content\">\n"
+            "            <div class=\"stats-card\">\n"
+            "                <div class=\"stats-value\" id=\"alert-count\">%d 次</div>\n"
+            "                <div class=\"stats-label\">总警报次数</div>\n"
+            "            </div>\n"
+            "            \n"
+            "            <div class=\"section-title\">📋 警报记录详情</div>\n"
+            "            <table class=\"alerts-table\">\n"
+            "                <thead>\n"
+            "                    <tr>\n"
+            "                        <th>ID</th>\n"
+            "                        <th>警报时间</th>\n"
+            "                        <th>剩余电量</th>\n"
+            "                        <th>阈值</th>\n"
+            "                        <th>警报信息</th>\n"
+            "                        <th>数据更新时间</th>\n"
+            "                    </tr>\n"
+            "                </thead>\n"
+            "                <tbody>\n",
+            app_css_name, count);
+
+    // 输出警报数据
+    const char *sql = "SELECT id, alert_time, remaining_energy, threshold, alert_message, meter_update_time "
+                      "FROM low_energy_alerts WHERE id <= ? ORDER BY alert_time DESC, id DESC LIMIT ?;";
+    sqlite3_stmt *stmt;
+    if (count > 0 && sqlite3_prepare_v2(snapshot->db, sql, -1, &stmt, 0) == SQLITE_OK)
+    {
+        sqlite3_bind_int(stmt, 1, snapshot->maxAlertId);
+        sqlite3_bind_int(stmt, 2, ALERTS_MAX_ROWS);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            const char *alert_time = (const char *)sqlite3_column_text(stmt, 1);
+            const char *alert_message = (const char *)sqlite3_column_text(stmt, 4);
+            const char *meter_update_time = (const char *)sqlite3_column_text(stmt, 5);
+            page_buffer_printf(&page,
+                    "                    <tr class=\"alert-critical\">\n"
+                    "                        <td>%d</td>\n"
+                    "                        <td>%s</td>\n"
+                    "                        <td>%.2f 度</td>\n"
+                    "                        <td>%.1f 度</td>\n"
+                    "                        <td>%s</td>\n"
+                    "                        <td>%s</td>\n"
+                    "                    </tr>\n",
+                    sqlite3_column_int(stmt, 0),
+                    alert_time ? alert_time : "",
+                    sqlite3_column_double(stmt, 2),
+                    sqlite3_column_double(stmt, 3),
+                    alert_message ? alert_message : "",
+                    meter_update_time ? meter_update_time : "");
+        }
+        sqlite3_finalize(stmt);
+    }
+    else
+    {
+        page_buffer_printf(&page,
+                "                    <tr id=\"no-alerts\">\n"
+                "                        <td colspan=\"6\" style=\"text-align: center; color: var(--text-secondary);\">暂无警报记录</td>\n"
+                "                    </tr>\n");
+    }
+
+    page_buffer_printf(&page,
+            "                </tbody>\n"
+            "            </table>\n"
+            "            \n"
+            "            <div class=\"update-time\">\n"
+            "                页面生成时间: %s\n"
+            "            </div>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"footer\">\n"
+            "            <p>警报记录页面</p>\n"
+            "            <p></p>\n"
+            "        </div>\n"
+            "    </div>\n"
+            "    \n"
+            "    <script src=\"%s\"></script>\n"
+            "    <script>\n"
+            "        connectLiveUpdates({ alert: addAlertRow });\n"
+            "    </script>\n"
+            "</body>\n"
+            "</html>",
+            get_current_time(), app_js_name);
+
+    int published = publish_page(web_path, "alerts.html", &page);
+    page_buffer_return(&page);
+    if (!published)
+    {
+        write_log("ERROR", "无法创建警报记录HTML文件");
+        return 0;
+    }
+
+    char success_msg[256];
+    snprintf(success_msg, sizeof(success_msg), "警报记录页面已生成: %s", filepath);
+    write_log("INFO", success_msg);
+    return 1;
+}
+
+/* 输出归档分页的页头和表头 */
+void archive_page_begin(PageBuffer *page, const ArchiveMonth *month, int page_number)
+{
+    page->length = 0; // 工作线程复用同一块缓冲区
+    page->failed = 0;
+    page_buffer_printf(page,
+            "<!DOCTYPE html>\n"
+            "<html lang=\"zh-CN\">\n"
+            "<head>\n"
+            "    <meta charset=\"UTF-8\">\n"
+            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+            "    <title>电表历史归档 %s 第%d页</title>\n"
+            "    <link rel=\"stylesheet\" href=\"../%s\">\n"
+            "</head>\n"
+            "<body class=\"page-history\">\n"
+            "    <div class=\"container\">\n"
+            "        <div class=\"header\">\n"
+            "            <h1>⚡ 电表历史归档 - %s</h1>\n"
+            "            <div>第 %d 页</div>\n"
+            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"nav\">\n"
+            "            <a href=\"../index.html\">实时监控</a>\n"
+            "            <a href=\"../history.html\">历史记录</a>\n"
+            "            <a href=\"index.html\" style=\"background:rgba(255,255,255,0.2);\">归档目录</a>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"content\">\n"
+            "            <table class=\"history-table\">\n"
+            "                <thead>\n"
+            "                    <tr>\n"
+            "                        <th>ID</th>\n"
+            "                        <th>记录时间</th>\n"
+            "                        <th>剩余电量 (度)</th>\n"
+            "                        <th>剩余金额 (元)</th>\n"
+            "                        <th>累计用电 (kWh)</th>\n"
+            "                        <th>电价 (元/度)</th>\n"
+            "                        <th>电表状态</th>\n"
+            "                        <th>数据更新时间</th>\n"
+            "                    </tr>\n"
+            "                </thead>\n"
+            "                <tbody>\n",
+            month->month, page_number, app_css_name, month->month, page_number);
+}
+
+/* 输出归档分页的翻页链接和页尾；只链接相邻分页，新增分页时旧分页内容不变 */
+void archive_page_end(PageBuffer *page, const ArchiveMonth *month, int page_number)
+{
+    page_buffer_printf(page,
+            "                </tbody>\n"
+            "            </table>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"nav\">\n");
+    if (page_number > 1)
+        page_buffer_printf(page, "            <a href=\"%s-%d.html\">上一页</a>\n", month->month, page_number - 1);
+    page_buffer_printf(page, "            <a href=\"index.html\">归档目录</a>\n");
+    if (page_number < month->pageCount)
+        page_buffer_printf(page, "            <a href=\"%s-%d.html\">下一页</a>\n", month->month, page_number + 1);
+    page_buffer_printf(page,
+            "        </div>\n"
+            "    </div>\n"
+            "    \n"
+            "    <script src=\"../%s\"></script>\n"
+            "</body>\n"
+            "</html>",
+            app_js_name);
+}
+
+/* 按文件名比较清单项（qsort/bsearch使用） */
+int compare_archive_entries(const void *a, const void *b)
+{
+    return strcmp(((const ArchiveEntry *)a)->name, ((const ArchiveEntry *)b)->name);
+}
+
+/* 发布一个归档页面：内容哈希与上次清单相同且文件仍在时跳过压缩和写入 */
+int publish_archive_page(const ArchiveBuild *build, const char *name, const PageBuffer *page, PageBuffer *compressed, unsigned long long *hash_out, int *written)
+{
+    char filepath[512];
+    char gz_path[520];
+    snprintf(filepath, sizeof(filepath), "%s/%s", build->archivePath, name);
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", filepath);
+
+    *hash_out = hash_bytes(page->data, page->length);
+    *written = 0;
+
+    ArchiveEntry key;
+    snprintf(key.name, sizeof(key.name), "%s", name);
+    const ArchiveEntry *previous = build->previousCount > 0
+        ? bsearch(&key, build->previous, build->previousCount, sizeof(ArchiveEntry), compare_archive_entries)
+        : NULL;
+    if (previous && previous->hash == *hash_out && GetFileAttributesA(filepath) != INVALID_FILE_ATTRIBUTES)
+        return 1;
+
+    if (page->failed)
+    {
+        char error_msg[600];
+        snprintf(error_msg, sizeof(error_msg), "归档页面渲染不完整，跳过: %s", filepath);
+        write_log("ERROR", error_msg);
+        return 0;
+    }
+
+    // 归档页面数量多且只在批处理中生成，直接写文件，不放入内存页面缓存；
+    // 写入后基本不再改变，用最高压缩级别。先替换HTML，再替换.gz，与publish_page相同
+    if (!write_file_atomic(filepath, page->data, page->length))
+    {
+        char error_msg[600];
+        snprintf(error_msg, sizeof(error_msg), "无法写入归档页面: %s", filepath);
+        write_log("ERROR", error_msg);
+        return 0;
+    }
+    if (!gzip_compress(page->data, page->length, Z_BEST_COMPRESSION, compressed) ||
+        !write_file_atomic(gz_path, compressed->data, compressed->length))
+        DeleteFileA(gz_path);
+    *written = 1;
+    return 1;
+}
+
+/* 渲染一个月份的全部分页：沿主键范围逐行读取，每ARCHIVE_PAGE_SIZE条切分一页 */
+void render_archive_month(ArchiveBuild *build, sqlite3_stmt *stmt, ArchiveMonth *month, PageBuffer *page, PageBuffer *compressed)
+{
+    char name[32];
+    int page_number = 0;
+    int rows_in_page = 0;
+
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, month->firstId);
+    sqlite3_bind_int64(stmt, 2, month->lastId);
+    sqlite3_bind_int64(stmt, 3, build->snapshotId);
+    sqlite3_bind_text(stmt, 4, month->month, -1, SQLITE_STATIC);
+
+    while (page_number <= month->pageCount)
+    {
+        int has_row = sqlite3_step(stmt) == SQLITE_ROW;
+        if (has_row && rows_in_page == 0)
+            archive_page_begin(page, month, ++page_number);
+
+        if (has_row)
+        {
+            const char *record_time = (const char *)sqlite3_column_text(stmt, 1);
+            const char *meter_status = (const char *)sqlite3_column_text(stmt, 6);
+            const char *meter_update_time = (const char *)sqlite3_column_text(stmt, 7);
+            page_buffer_printf(page,
+                    "                    <tr><td>%d</td><td>%s</td><td>%.2f</td><td>%.2f</td><td>%.2f</td><td>%.4f</td><td>%s</td><td>%s</td></tr>\n",
+                    sqlite3_column_int(stmt, 0),
+                    record_time ? record_time : "",
+                    sqlite3_column_double(stmt, 2),
+                    sqlite3_column_double(stmt, 3),
+                    sqlite3_column_double(stmt, 4),
+                    sqlite3_column_double(stmt, 5),
+                    meter_status ? meter_status : "",
+                    meter_update_time ? meter_update_time : "");
+            rows_in_page++;
+        }
+
+        if (rows_in_page > 0 && (!has_row || rows_in_page == ARCHIVE_PAGE_SIZE))
+        {
+            int written = 0;
+            archive_page_end(page, month, page_number);
+            snprintf(name, sizeof(name), "%s-%d.html", month->month, page_number);
+            if (page_number <= month->pageCount &&
+                publish_archive_page(build, name, page, compressed, &month->pageHashes[page_number - 1], &written))
+                month->written += written;
+            else
+                month->failed++;
+            rows_in_page = 0;
+        }
+
+        if (!has_row)
+            break;
+    }
+}
+
+/* 归档工作线程：各自持有一个只读连接和一组输出缓冲区，不断领取下一个月份 */
+DWORD WINAPI archive_worker(LPVOID param)
+{
+    ArchiveBuild *build = (ArchiveBuild *)param;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    if (sqlite3_open_v2(build->dbPath, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+    {
+        write_log("ERROR", "归档线程无法打开数据库");
         sqlite3_close(db);
-        return daily_consumption;
+        return 1;
+    }
+    sqlite3_busy_timeout(db, 5000);
+
+    // 月份按记录时间归属，主键范围只用于缩小扫描范围；snapshotId之后写入的记录不读取
+    const char *sql = "SELECT id, record_time, remaining_energy, remaining_amount, "
+                      "total_consumption, price, meter_status, meter_update_time "
+                      "FROM electric_data WHERE id BETWEEN ? AND ? AND id <= ? AND substr(record_time, 1, 7) = ? "
+                      "ORDER BY id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备归档查询失败");
+        sqlite3_close(db);
+        return 1;
+    }
+
+    PageBuffer page;
+    PageBuffer compressed;
+    page_buffer_init(&page);
+    page_buffer_init(&compressed);
+
+    LONG index;
+    while ((index = InterlockedIncrement(&build->nextMonth) - 1) < build->monthCount)
+    {
+        sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+        render_archive_month(build, stmt, &build->months[index], &page, &compressed);
+        sqlite3_reset(stmt);
+        sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+    }
+
+    page_buffer_free(&page);
+    page_buffer_free(&compressed);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return 0;
+}
+
+/* 生成归档目录页：每个月份一行，列出统计数据和全部分页链接 */
+int render_archive_index(PageBuffer *page, const ArchiveBuild *build)
+{
+    page_buffer_printf(page,
+            "<!DOCTYPE html>\n"
+            "<html lang=\"zh-CN\">\n"
+            "<head>\n"
+            "    <meta charset=\"UTF-8\">\n"
+            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+            "    <title>电表历史归档</title>\n"
+            "    <link rel=\"stylesheet\" href=\"../%s\">\n"
+            "</head>\n"
+            "<body class=\"page-history\">\n"
+            "    <div class=\"container\">\n"
+            "        <div class=\"header\">\n"
+            "            <h1>⚡ 电表监控系统 - 历史归档</h1>\n"
+            "            <div>按月份归档的全部历史记录</div>\n"
+            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"nav\">\n"
+            "            <a href=\"../index.html\">实时监控</a>\n"
+            "            <a href=\"../history.html\">历史记录</a>\n"
+            "            <a href=\"index.html\" style=\"background:rgba(255,255,255,0.2);\">归档目录</a>\n"
+            "        </div>\n"
+            "        \n"
+            "        <div class=\"content\">\n"
+            "            <table class=\"alerts-table\">\n"
+            "                <thead>\n"
+            "                    <tr>\n"
+            "                        <th>月份</th>\n"
+            "                        <th>记录数</th>\n"
+            "                        <th>本月用电 (kWh)</th>\n"
+            "                        <th>最低电量 (度)</th>\n"
+            "                        <th>最高电量 (度)</th>\n"
+            "                        <th>分页</th>\n"
+            "                    </tr>\n"
+            "                </thead>\n"
+            "                <tbody>\n",
+            app_css_name);
+
+    for (int i = 0; i < build->monthCount; i++)
+    {
+        const ArchiveMonth *month = &build->months[i];
+        page_buffer_printf(page,
+                "                    <tr>\n"
+                "                        <td><a href=\"%s-1.html\">%s</a></td>\n"
+                "                        <td>%d</td>\n"
+                "                        <td>%.2f</td>\n"
+                "                        <td>%.2f</td>\n"
+                "                        <td>%.2f</td>\n"
+                "                        <td>",
+                month->month, month->month, month->recordCount, month->consumption,
+                month->minEnergy, month->maxEnergy);
+        for (int p = 1; p <= month->pageCount; p++)
+            page_buffer_printf(page, "<a href=\"%s-%d.html\">%d</a> ", month->month, p, p);
+        page_buffer_printf(page, "</td>\n                    </tr>\n");
+    }
+
+    return page_buffer_printf(page,
+            "                </tbody>\n"
+            "            </table>\n"
+            "        </div>\n"
+            "    </div>\n"
+            "    \n"
+            "    <script src=\"../%s\"></script>\n"
+            "</body>\n"
+            "</html>",
+            app_js_name);
+}
+
+/* 读取上次构建的归档清单（每行: 文件名 内容哈希），按文件名排序供二分查找 */
+int load_archive_manifest(ArchiveBuild *build)
+{
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/manifest.txt", build->archivePath);
+
+    build->previous = NULL;
+    build->previousCount = 0;
+
+    FILE *file = fopen(filepath, "r");
+    if (!file)
+        return 0;
+
+    int capacity = 0;
+    ArchiveEntry entry;
+    while (fscanf(file, "%31s %llx", entry.name, &entry.hash) == 2)
+    {
+        if (build->previousCount == capacity)
+        {
+            int new_capacity = capacity ? capacity * 2 : 256;
+            ArchiveEntry *grown = realloc(build->previous, new_capacity * sizeof(ArchiveEntry));
+            if (!grown)
+                break;
+            build->previous = grown;
+            capacity = new_capacity;
+        }
+        build->previous[build->previousCount++] = entry;
+    }
+    fclose(file);
+
+    if (build->previousCount > 0)
+        qsort(build->previous, build->previousCount, sizeof(ArchiveEntry), compare_archive_entries);
+    return 1;
+}
+
+/* 写出本次构建的归档清单，写入失败的分页不记录哈希，下次会重新生成 */
+int save_archive_manifest(const ArchiveBuild *build, const ArchiveEntry *index_entry)
+{
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/manifest.txt", build->archivePath);
+
+    PageBuffer manifest;
+    page_buffer_init(&manifest);
+    page_buffer_printf(&manifest, "%s %016llx\n", index_entry->name, index_entry->hash);
+    for (int i = 0; i < build->monthCount; i++)
+    {
+        const ArchiveMonth *month = &build->months[i];
+        if (month->failed)
+            continue;
+        for (int p = 0; p < month->pageCount; p++)
+            page_buffer_printf(&manifest, "%s-%d.html %016llx\n", month->month, p + 1, month->pageHashes[p]);
+    }
+
+    int result = manifest.data && write_file_atomic(filepath, manifest.data, manifest.length);
+    page_buffer_free(&manifest);
+    if (!result)
+        write_log("ERROR", "无法写入归档清单");
+    return result;
+}
+
+/* 批处理模式：从整个数据库生成按月分页的静态历史归档（web/archive/），
+   月份分给多个工作线程并行渲染，内容未变的页面按哈希跳过 */
+int build_history_archive(const Config *config)
+{
+    ULONGLONG started = GetTickCount64();
+    ArchiveBuild build;
+    memset(&build, 0, sizeof(build));
+    build.dbPath = config->dbPath;
+    snprintf(build.archivePath, sizeof(build.archivePath), "%s/archive", config->webPath);
+
+    create_directory(config->webPath);
+    create_directory(build.archivePath);
+    publish_static_assets(config->webPath);
+
+    // 先在一个读事务中取最大记录ID并确定月份列表和各月的主键范围。
+    // electric_data只追加不修改，ID自增，"ID不超过snapshotId的记录"就是这一时刻的快照：
+    // 工作线程各自的连接都按这个上界读取，之后新写入的记录不会出现在任何月份页面或目录中
+    sqlite3 *db;
+    if (sqlite3_open_v2(config->dbPath, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        write_log("ERROR", "无法打开数据库生成历史归档");
+        sqlite3_close(db);
+        return 0;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COALESCE(MAX(id), 0) FROM electric_data;", -1, &stmt, 0) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            build.snapshotId = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    const char *sql = "SELECT substr(record_time, 1, 7) AS month, COUNT(*), MIN(id), MAX(id), "
+                      "MIN(remaining_energy), MAX(remaining_energy), "
+                      "MAX(total_consumption) - MIN(total_consumption) "
+                      "FROM electric_data WHERE record_time IS NOT NULL AND id <= ? "
+                      "GROUP BY month ORDER BY month DESC;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        write_log("ERROR", "准备归档月份查询失败");
+        sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+        sqlite3_close(db);
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, build.snapshotId);
+
+    int capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        if (build.monthCount == capacity)
+        {
+            int new_capacity = capacity ? capacity * 2 : 64;
+            ArchiveMonth *grown = realloc(build.months, new_capacity * sizeof(ArchiveMonth));
+            if (!grown)
+                break;
+            build.months = grown;
+            capacity = new_capacity;
+        }
+        ArchiveMonth *month = &build.months[build.monthCount];
+        memset(month, 0, sizeof(ArchiveMonth));
+        const char *text = (const char *)sqlite3_column_text(stmt, 0);
+        snprintf(month->month, sizeof(month->month), "%s", text ? text : "");
+        month->recordCount = sqlite3_column_int(stmt, 1);
+        month->firstId = sqlite3_column_int64(stmt, 2);
+        month->lastId = sqlite3_column_int64(stmt, 3);
+        month->minEnergy = sqlite3_column_double(stmt, 4);
+        month->maxEnergy = sqlite3_column_double(stmt, 5);
+        month->consumption = sqlite3_column_double(stmt, 6);
+        month->pageCount = (month->recordCount + ARCHIVE_PAGE_SIZE - 1) / ARCHIVE_PAGE_SIZE;
+        month->pageHashes = calloc(month->pageCount, sizeof(unsigned long long));
+        if (!month->pageHashes)
+            break;
+        build.monthCount++;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+    sqlite3_close(db);
+
+    load_archive_manifest(&build);
+
+    // 每个CPU核心一个工作线程，各自打开只读连接（WAL模式下互不阻塞）
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    int worker_count = (int)system_info.dwNumberOfProcessors;
+    if (worker_count > build.monthCount)
+        worker_count = build.monthCount;
+    if (worker_count > ARCHIVE_MAX_WORKERS)
+        worker_count = ARCHIVE_MAX_WORKERS;
+    if (worker_count < 1)
+        worker_count = 1;
+
+    HANDLE workers[ARCHIVE_MAX_WORKERS];
+    int started_count = 0;
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[started_count] = CreateThread(NULL, 0, archive_worker, &build, 0, NULL);
+        if (workers[started_count])
+            started_count++;
+    }
+    if (started_count == 0)
+        archive_worker(&build); // 无法创建线程时在当前线程完成全部工作
+    for (int i = 0; i < started_count; i++)
+    {
+        WaitForSingleObject(workers[i], INFINITE);
+        CloseHandle(workers[i]);
+    }
+
+    // 目录页在所有月份完成后生成
+    PageBuffer page;
+    PageBuffer compressed;
+    page_buffer_init(&page);
+    page_buffer_init(&compressed);
+    ArchiveEntry index_entry;
+    int index_written = 0;
+    snprintf(index_entry.name, sizeof(index_entry.name), "index.html");
+    render_archive_index(&page, &build);
+    int index_ok = publish_archive_page(&build, index_entry.name, &page, &compressed, &index_entry.hash, &index_written);
+    page_buffer_free(&page);
+    page_buffer_free(&compressed);
+
+    int total_pages = 0;
+    int written_pages = index_written;
+    int failed_pages = index_ok ? 0 : 1;
+    for (int i = 0; i < build.monthCount; i++)
+    {
+        total_pages += build.months[i].pageCount;
+        written_pages += build.months[i].written;
+        failed_pages += build.months[i].failed;
+    }
+    save_archive_manifest(&build, &index_entry);
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "历史归档生成完成: %d 个月份, %d 个分页, 重写 %d 个, 未变跳过 %d 个, 失败 %d 个, %d 个线程, 耗时 %llu ms",
+             build.monthCount, total_pages + 1, written_pages, total_pages + 1 - written_pages - failed_pages,
+             failed_pages, started_count > 0 ? started_count : 1, (unsigned long long)(GetTickCount64() - started));
+    write_log("INFO", log_msg);
+
+    for (int i = 0; i < build.monthCount; i++)
+        free(build.months[i].pageHashes);
+    free(build.months);
+    free(build.previous);
+    return failed_pages == 0;
+}
+
+/* 显示电表信息 */
+void display_meter_info(const ElectricMeter *meter, double threshold)
+{
+    printf("\n=== 电表信息 ===\n");
+    printf("更新时间: %s\n", meter->meterUpdateTime);
+    printf("剩余电量: %.2f 度", meter->remainingEnergy);
+    if (meter->remainingEnergy <= threshold)
+    {
+        printf(" (低电量!)\n");
+    }
+    else
+    {
+        printf("\n");
+    }
+    printf("剩余金额: %.2f 元\n", meter->remainingAmount);
+    printf("累计用电: %.2f kWh\n", meter->totalConsumption);
+    printf("当前电价: %.4f 元/度\n", meter->price);
+    if (strlen(meter->meterStatus) > 0)
+    {
+        printf("电表状态: %s\n", meter->meterStatus);
+    }
+    printf("================\n");
+}
+
+/* 启动内置HTTP服务（HTTP_PORT为0时不启用） */
+int start_http_server(const Config *config)
+{
+    if (config->httpPort <= 0)
+        return 1;
+
+    SOCKET listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_socket == INVALID_SOCKET)
+    {
+        write_log("ERROR", "创建HTTP监听套接字失败");
+        return 0;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((unsigned short)config->httpPort);
+
+    if (bind(listen_socket, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listen_socket, SOMAXCONN) == SOCKET_ERROR)
+    {
+        char error_msg[128];
+        snprintf(error_msg, sizeof(error_msg), "HTTP服务无法监听端口 %d", config->httpPort);
+        write_log("ERROR", error_msg);
+        closesocket(listen_socket);
+        return 0;
+    }
+
+    unsigned long non_blocking = 1;
+    ioctlsocket(listen_socket, FIONBIO, &non_blocking);
+    http_listen_socket = listen_socket;
+
+    InitializeCriticalSection(&sse_lock);
+    page_buffer_init(&sse_pending);
+
+    http_server_thread_handle = CreateThread(NULL, 0, http_server_thread, NULL, 0, NULL);
+    if (!http_server_thread_handle)
+    {
+        write_log("ERROR", "创建HTTP服务线程失败");
+        closesocket(listen_socket);
+        http_listen_socket = INVALID_SOCKET;
+        return 0;
+    }
+
+    char success_msg[128];
+    snprintf(success_msg, sizeof(success_msg), "内置HTTP服务已启动: http://localhost:%d/", config->httpPort);
+    write_log("INFO", success_msg);
+    return 1;
+}
+
+/* 停止内置HTTP服务，等待服务线程退出 */
+void stop_http_server(void)
+{
+    if (!http_server_thread_handle)
+        return;
+
+    // 服务线程每秒检查一次keep_running
+    WaitForSingleObject(http_server_thread_handle, INFINITE);
+    CloseHandle(http_server_thread_handle);
+    http_server_thread_handle = NULL;
+
+    closesocket(http_listen_socket);
+    http_listen_socket = INVALID_SOCKET;
+
+    page_buffer_free(&sse_pending);
+    DeleteCriticalSection(&sse_lock);
+    write_log("INFO", "内置HTTP服务已停止");
+}
+
+/* 在请求头中查找指定字段（不区分大小写），找到返回1 */
+int http_get_header(const char *request, const char *name, char *value, size_t value_size)
+{
+    size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");
+
+    while (line && line[2] != '\r' && line[2] != '\0')
+    {
+        line += 2;
+        if (_strnicmp(line, name, name_len) == 0 && line[name_len] == ':')
+        {
+            const char *start = line + name_len + 1;
+            while (*start == ' ' || *start == '\t')
+                start++;
+            const char *end = strstr(start, "\r\n");
+            size_t len = end ? (size_t)(end - start) : strlen(start);
+            if (len >= value_size)
+                len = value_size - 1;
+            memcpy(value, start, len);
+            value[len] = '\0';
+            return 1;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    value[0] = '\0';
+    return 0;
+}
+
+/* 解析缓冲区中的一个完整请求并准备响应，请求不完整时返回0 */
+int http_client_prepare_response(HttpClient *client)
+{
+    char *header_end = strstr(client->request, "\r\n\r\n");
+    if (!header_end)
+    {
+        if (client->requestLength >= HTTP_REQUEST_SIZE - 1)
+        {
+            // 请求头过大，直接返回错误并关闭连接
+            page_buffer_printf(&client->head,
+                               "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                               "Content-Length: 0\r\nConnection: close\r\n\r\n");
+            client->closeAfterSend = 1;
+            client->requestLength = 0;
+            client->request[0] = '\0';
+            return 1;
+        }
+        return 0;
+    }
+
+    size_t request_size = (size_t)(header_end - client->request) + 4;
+    char saved = client->request[request_size];
+    client->request[request_size] = '\0';
+
+    char method[16] = {0};
+    char target[512] = {0};
+    char version[16] = {0};
+    sscanf(client->request, "%15s %511s %15s", method, target, version);
+
+    char connection[64];
+    char accept_encoding[256];
+    char if_none_match[256];
+    http_get_header(client->request, "Connection", connection, sizeof(connection));
+    http_get_header(client->request, "Accept-Encoding", accept_encoding, sizeof(accept_encoding));
+    http_get_header(client->request, "If-None-Match", if_none_match, sizeof(if_none_match));
+
+    // HTTP/1.1默认保持连接，HTTP/1.0需显式要求
+    if (strcmp(version, "HTTP/1.1") == 0)
+        client->closeAfterSend = (_stricmp(connection, "close") == 0);
+    else
+        client->closeAfterSend = (_stricmp(connection, "keep-alive") != 0);
+
+    // 移除已处理的请求，保留流水线中的后续请求
+    client->request[request_size] = saved;
+    memmove(client->request, client->request + request_size, client->requestLength - request_size);
+    client->requestLength -= request_size;
+    client->request[client->requestLength] = '\0';
+
+    const char *connection_header = client->closeAfterSend ? "close" : "keep-alive";
+    int is_head = (strcmp(method, "HEAD") == 0);
+
+    if (strcmp(method, "GET") != 0 && !is_head)
+    {
+        page_buffer_printf(&client->head,
+                           "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET, HEAD\r\n"
+                           "Content-Length: 0\r\nConnection: %s\r\n\r\n",
+                           connection_header);
+        return 1;
+    }
+
+    char *query = strchr(target, '?');
+    if (query)
+        *query = '\0';
+    const char *name = (strcmp(target, "/") == 0) ? "index.html" : target + 1;
+
+    // 事件流：保持连接，之后由服务线程持续推送新读数和警报
+    if (strcmp(name, "events") == 0 && !is_head)
+    {
+        page_buffer_printf(&client->head,
+                           "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream; charset=utf-8\r\n"
+                           "Cache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n"
+                           "retry: 10000\n\n");
+        client->eventStream = 1;
+        client->closeAfterSend = 0;
+        return 1;
+    }
+
+    // 运行指标：每次抓取时汇总各线程分片，存为快照后按普通页面返回
+    if (strcmp(name, "metrics") == 0)
+    {
+        PageBuffer metrics;
+        page_buffer_take(&metrics);
+        if (render_metrics(&metrics))
+            cache_rendered_page(name, &metrics);
+        page_buffer_return(&metrics);
+    }
+
+    PageSnapshot *snapshot = page_cache_acquire(name);
+    if (!snapshot && strcmp(target, "/") == 0)
+    {
+        // 仅输出JSON数据时没有index.html，首页改用静态外壳页面
+        snapshot = page_cache_acquire("app.html");
+    }
+    if (!snapshot)
+    {
+        static const char not_found[] = "404 Not Found";
+        page_buffer_printf(&client->head,
+                           "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n"
+                           "Content-Length: %d\r\nConnection: %s\r\n\r\n",
+                           (int)(sizeof(not_found) - 1), connection_header);
+        if (!is_head)
+            page_buffer_append(&client->head, not_found, sizeof(not_found) - 1);
+        return 1;
+    }
+
+    // 页面未变化时只返回304，浏览器继续使用本地缓存
+    if (if_none_match[0] && strstr(if_none_match, snapshot->etag))
+    {
+        page_buffer_printf(&client->head,
+                           "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nCache-Control: %s\r\n"
+                           "Connection: %s\r\n\r\n",
+                           snapshot->etag, snapshot->cacheControl, connection_header);
+        page_snapshot_release(snapshot);
+        return 1;
     }
 
-    int record_count = 0;
-    double oldest_consumption = 0;
-    double newest_consumption = 0;
-    char oldest_time[50] = {0};
-    char newest_time[50] = {0};
-    
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *record_time = (const char *)sqlite3_column_text(stmt, 0);
-        double consumption = sqlite3_column_double(stmt, 1);
-        
-        if (record_count == 0) {
-            // 最新记录
-            newest_consumption = consumption;
-            strncpy(newest_time, record_time, sizeof(newest_time) - 1);
+    int use_gzip = snapshot->gzip && strstr(accept_encoding, "gzip") != NULL;
+    client->snapshot = snapshot;
+    client->body = use_gzip ? snapshot->gzip : snapshot->body;
+    client->bodyLength = use_gzip ? snapshot->gzipLength : snapshot->bodyLength;
+    client->bodySent = 0;
+
+    page_buffer_printf(&client->head,
+                       "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %lu\r\n"
+                       "ETag: %s\r\nCache-Control: %s\r\nVary: Accept-Encoding\r\n"
+                       "%sConnection: %s\r\n\r\n",
+                       snapshot->contentType,
+                       (unsigned long)client->bodyLength,
+                       snapshot->etag,
+                       snapshot->cacheControl,
+                       use_gzip ? "Content-Encoding: gzip\r\n" : "",
+                       connection_header);
+
+    if (is_head)
+        client->bodyLength = 0;
+    return 1;
+}
+
+/* 发送待发数据，返回-1表示连接出错，0表示还有数据未发完，1表示发送完毕 */
+int http_client_send(HttpClient *client)
+{
+    while (client->headSent < client->head.length)
+    {
+        int sent = send(client->socket, client->head.data + client->headSent,
+                        (int)(client->head.length - client->headSent), 0);
+        if (sent == SOCKET_ERROR)
+            return (WSAGetLastError() == WSAEWOULDBLOCK) ? 0 : -1;
+        client->headSent += sent;
+    }
+
+    while (client->bodySent < client->bodyLength)
+    {
+        int sent = send(client->socket, client->body + client->bodySent,
+                        (int)(client->bodyLength - client->bodySent), 0);
+        if (sent == SOCKET_ERROR)
+            return (WSAGetLastError() == WSAEWOULDBLOCK) ? 0 : -1;
+        client->bodySent += sent;
+    }
+
+    // 响应发送完毕，释放快照引用，准备处理下一个请求
+    page_snapshot_release(client->snapshot);
+    client->snapshot = NULL;
+    client->body = NULL;
+    client->bodyLength = 0;
+    client->bodySent = 0;
+    client->head.length = 0;
+    client->headSent = 0;
+    return 1;
+}
+
+/* 关闭客户端连接并释放资源 */
+void http_client_close(HttpClient *client)
+{
+    closesocket(client->socket);
+    page_snapshot_release(client->snapshot);
+    page_buffer_free(&client->head);
+    free(client);
+}
+
+/* HTTP服务线程：单线程select事件循环，支持大量保持连接的客户端 */
+DWORD WINAPI http_server_thread(LPVOID param)
+{
+    (void)param;
+    HttpClient *clients[HTTP_MAX_CLIENTS];
+    int client_count = 0;
+
+    while (keep_running)
+    {
+        fd_set read_set;
+        fd_set write_set;
+        FD_ZERO(&read_set);
+        FD_ZERO(&write_set);
+        SOCKET max_socket = http_listen_socket;
+
+        if (client_count < HTTP_MAX_CLIENTS)
+            FD_SET(http_listen_socket, &read_set);
+
+        for (int i = 0; i < client_count; i++)
+        {
+            SOCKET s = clients[i]->socket;
+            if (clients[i]->head.length > 0)
+                FD_SET(s, &write_set);
+            else
+                FD_SET(s, &read_set);
+            if (s > max_socket)
+                max_socket = s;
+        }
+
+        struct timeval timeout = {1, 0};
+        int ready = select((int)max_socket + 1, &read_set, &write_set, NULL, &timeout);
+        if (ready == SOCKET_ERROR)
+        {
+            Sleep(100);
+            continue;
+        }
+
+        ULONGLONG now = GetTickCount64();
+
+        // 取出本轮待推送的事件，追加到每个事件流连接的发送队列
+        PageBuffer events;
+        page_buffer_init(&events);
+        EnterCriticalSection(&sse_lock);
+        if (sse_pending.length > 0)
+        {
+            events = sse_pending;
+            page_buffer_init(&sse_pending);
+        }
+        LeaveCriticalSection(&sse_lock);
+
+        if (FD_ISSET(http_listen_socket, &read_set))
+        {
+            while (client_count < HTTP_MAX_CLIENTS)
+            {
+                SOCKET s = accept(http_listen_socket, NULL, NULL);
+                if (s == INVALID_SOCKET)
+                    break;
+
+                HttpClient *client = calloc(1, sizeof(HttpClient));
+                if (!client)
+                {
+                    closesocket(s);
+                    break;
+                }
+
+                unsigned long non_blocking = 1;
+                ioctlsocket(s, FIONBIO, &non_blocking);
+                client->socket = s;
+                client->lastActive = now;
+                page_buffer_init(&client->head);
+                clients[client_count++] = client;
+            }
+        }
+
+        for (int i = 0; i < client_count; i++)
+        {
+            HttpClient *client = clients[i];
+            int keep = 1;
+
+            if (FD_ISSET(client->socket, &read_set))
+            {
+                int received = recv(client->socket, client->request + client->requestLength,
+                                    (int)(HTTP_REQUEST_SIZE - 1 - client->requestLength), 0);
+                if (received <= 0)
+                {
+                    keep = (received == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK);
+                }
+                else if (client->eventStream)
+                {
+                    // 事件流连接上客户端不应再发送数据，直接丢弃
+                    client->requestLength = 0;
+                }
+                else
+                {
+                    client->requestLength += received;
+                    client->request[client->requestLength] = '\0';
+                    client->lastActive = now;
+                }
+            }
+
+            if (keep && client->eventStream)
+            {
+                if (events.length > 0)
+                {
+                    page_buffer_append(&client->head, events.data, events.length);
+                    client->lastActive = now;
+                }
+                else if (client->head.length == 0 && now - client->lastActive > SSE_PING_INTERVAL * 1000ULL)
+                {
+                    // 定期发送注释行，防止代理或防火墙断开空闲连接
+                    page_buffer_printf(&client->head, ": ping\n\n");
+                    client->lastActive = now;
+                }
+
+                // 消费过慢的客户端积压过多时断开，由浏览器自动重连
+                if (client->head.length - client->headSent > SSE_MAX_BACKLOG)
+                    keep = 0;
+                else if (client->head.length > 0 && http_client_send(client) < 0)
+                    keep = 0;
+            }
+
+            // 依次处理缓冲区中的请求（支持流水线），发送阻塞时等待下次可写
+            while (keep && !client->eventStream && client->head.length == 0 && http_client_prepare_response(client))
+            {
+                int result = http_client_send(client);
+                if (result < 0)
+                    keep = 0;
+                else if (result == 0)
+                    break;
+                else if (client->closeAfterSend)
+                    keep = 0;
+                client->lastActive = now;
+            }
+
+            if (keep && client->head.length > 0 && FD_ISSET(client->socket, &write_set))
+            {
+                int result = http_client_send(client);
+                if (result < 0 || (result > 0 && client->closeAfterSend))
+                    keep = 0;
+                client->lastActive = now;
+            }
+
+            if (keep && !client->eventStream && now - client->lastActive > HTTP_KEEPALIVE_TIMEOUT * 1000ULL)
+                keep = 0;
+
+            if (!keep)
+            {
+                http_client_close(client);
+                clients[i] = clients[--client_count];
+                i--;
+            }
+        }
+
+        page_buffer_free(&events);
+    }
+
+    for (int i = 0; i < client_count; i++)
+        http_client_close(clients[i]);
+    return 0;
+}
+
+/* 渲染一轮页面：本轮所有页面和数据文件共用一个数据库读快照，
+   只渲染数据有变化的页面，各页面任务分给渲染工作线程并行执行 */
+void render_cycle(const Config *config, const ElectricMeter *meter, double threshold)
+{
+    RenderSnapshot snapshot;
+    if (!render_snapshot_open(&snapshot, config->dbPath))
+        return;
+
+    ULONGLONG span = trace_begin();
+    ULONGLONG metric_started = metric_clock();
+    InterlockedExchange(&render_pages_published, 0);
+    create_directory(config->webPath);
+    publish_static_assets(config->webPath);
+
+    RenderBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.config = config;
+    batch.snapshot = &snapshot;
+    batch.meter = meter;
+    batch.threshold = threshold;
+
+    // 历史记录最耗时，排在最前面尽早开始
+    if (config->renderMode & RENDER_MODE_HTML)
+    {
+        if (snapshot.maxId != rendered_max_id)
+            batch.tasks[batch.taskCount++] = RENDER_TASK_HISTORY;
+        batch.tasks[batch.taskCount++] = RENDER_TASK_INDEX;
+        if (snapshot.maxAlertId != rendered_max_alert_id)
+            batch.tasks[batch.taskCount++] = RENDER_TASK_ALERTS;
+    }
+    if (config->renderMode & RENDER_MODE_JSON)
+        batch.tasks[batch.taskCount++] = RENDER_TASK_DATA_FILES;
+
+    run_render_batch(&batch);
+
+    // 只有页面成功发布后才记下它的数据版本，失败的页面下一轮重新渲染
+    int failed = 0;
+    for (int i = 0; i < batch.taskCount; i++)
+    {
+        if (!batch.results[i])
+            failed++;
+        else if (batch.tasks[i] == RENDER_TASK_HISTORY)
+            rendered_max_id = snapshot.maxId;
+        else if (batch.tasks[i] == RENDER_TASK_ALERTS)
+            rendered_max_alert_id = snapshot.maxAlertId;
+    }
+    render_snapshot_close(&snapshot);
+    metric_observe(METRIC_STAGE_RENDER, metric_started);
+    trace_end("render_cycle", "render", span, "tasks", batch.taskCount);
+
+    double elapsed_ms = (double)(metric_clock() - metric_started) * 1000.0 / (double)metric_frequency;
+    LONG pages = InterlockedExchange(&render_pages_published, 0);
+    log_event(EVENT_RENDER, batch.taskCount, pages, (long long)elapsed_ms);
+    char log_msg[160];
+    snprintf(log_msg, sizeof(log_msg), "本轮渲染: %d 个任务（失败 %d 个）, 发布 %ld 个页面, %d 个线程, 耗时 %.1f ms",
+             batch.taskCount, failed, (long)pages, render_worker_count + 1, elapsed_ms);
+    write_log(failed ? "WARNING" : "INFO", log_msg);
+}
+
+/* 执行一轮渲染任务：唤醒工作线程一起领取任务，当前线程也参与，全部完成后返回 */
+void run_render_batch(RenderBatch *batch)
+{
+    int helpers = render_worker_count < batch->taskCount - 1 ? render_worker_count : batch->taskCount - 1;
+    if (helpers > 0)
+        batch->done = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (!batch->done)
+        helpers = 0;
+
+    batch->participants = helpers + 1;
+    if (helpers > 0)
+    {
+        render_batch = batch;
+        ReleaseSemaphore(render_pool_wakeup, helpers, NULL);
+    }
+
+    // 当前线程直接在快照的读事务中执行任务
+    render_batch_work(batch, batch->snapshot);
+
+    // 被唤醒的工作线程都退出本轮后才能释放任务表
+    if (InterlockedDecrement(&batch->participants) > 0)
+        WaitForSingleObject(batch->done, INFINITE);
+    render_batch = NULL;
+    if (batch->done)
+        CloseHandle(batch->done);
+}
+
+/* 领取并执行本轮剩余的任务，直到任务表取完 */
+void render_batch_work(RenderBatch *batch, const RenderSnapshot *view)
+{
+    static const char *task_names[RENDER_TASK_COUNT] = {"render_index", "render_history", "render_alerts", "render_data_files"};
+    LONG index;
+    while ((index = InterlockedIncrement(&batch->nextTask) - 1) < batch->taskCount)
+    {
+        int task = batch->tasks[index];
+        TRACE_SPAN(task_names[task], "render", "ok", batch->results[index],
+                   batch->results[index] = run_render_task(batch, task, view));
+    }
+}
+
+/* 执行一个页面任务，view是当前线程的快照（已在读事务中），返回0表示页面没有发布 */
+int run_render_task(const RenderBatch *batch, int task, const RenderSnapshot *view)
+{
+    const char *web_path = batch->config->webPath;
+    int ok = 0;
+    switch (task)
+    {
+    case RENDER_TASK_INDEX:
+    {
+        ok = generate_index_html(web_path, batch->meter, batch->threshold, view);
+
+        // 最新读数的JSON接口，只保存在内存中供内置HTTP服务使用
+        PageBuffer json;
+        page_buffer_take(&json);
+        render_meter_json(&json, batch->meter, batch->threshold);
+        cache_rendered_page("api/latest.json", &json);
+        page_buffer_return(&json);
+        break;
+    }
+    case RENDER_TASK_HISTORY:
+        update_chart_series(view->db, view->maxId);
+        ok = generate_history_html(web_path, view);
+        break;
+    case RENDER_TASK_ALERTS:
+        ok = generate_alerts_html(web_path, view);
+        break;
+    case RENDER_TASK_DATA_FILES:
+        ok = generate_data_files(web_path, view, batch->meter, batch->threshold);
+        break;
+    }
+    return ok;
+}
+
+/* 渲染工作线程：被唤醒后在自己的连接上开启读事务，领取当前一轮中剩余的页面任务 */
+DWORD WINAPI render_worker(LPVOID param)
+{
+    (void)param;
+    trace_name_thread("渲染工作线程");
+    while (1)
+    {
+        WaitForSingleObject(render_pool_wakeup, INFINITE);
+        if (render_pool_stopping)
+            break;
+
+        // 打不开连接时本线程不领取任务，剩下的任务由其他线程完成
+        RenderBatch *batch = render_batch;
+        RenderSnapshot view;
+        if (render_snapshot_connect(batch->snapshot, &view))
+        {
+            render_batch_work(batch, &view);
+            render_snapshot_close(&view);
+        }
+        if (InterlockedDecrement(&batch->participants) == 0)
+            SetEvent(batch->done);
+    }
+
+    // 线程退出前关闭渲染连接，释放本线程缓存的缓冲区
+    render_connection_close();
+    while (page_buffer_pool_count > 0)
+        page_buffer_free(&page_buffer_pool[--page_buffer_pool_count]);
+    return 0;
+}
+
+/* 启动渲染工作线程池（CPU核心数减一，渲染线程自身也参与渲染） */
+int start_render_pool(void)
+{
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    int count = (int)system_info.dwNumberOfProcessors - 1;
+    if (count > RENDER_MAX_WORKERS)
+        count = RENDER_MAX_WORKERS;
+    if (count <= 0)
+        return 1;
+
+    render_pool_wakeup = CreateSemaphoreA(NULL, 0, RENDER_MAX_WORKERS, NULL);
+    if (!render_pool_wakeup)
+        return 0;
+
+    render_pool_stopping = 0;
+    render_worker_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        render_workers[render_worker_count] = CreateThread(NULL, 0, render_worker, NULL, 0, NULL);
+        if (render_workers[render_worker_count])
+            render_worker_count++;
+    }
+    return render_worker_count > 0;
+}
+
+/* 停止渲染工作线程池 */
+void stop_render_pool(void)
+{
+    if (render_worker_count == 0)
+        return;
+
+    InterlockedExchange(&render_pool_stopping, 1);
+    ReleaseSemaphore(render_pool_wakeup, render_worker_count, NULL);
+    for (int i = 0; i < render_worker_count; i++)
+    {
+        WaitForSingleObject(render_workers[i], INFINITE);
+        CloseHandle(render_workers[i]);
+    }
+    CloseHandle(render_pool_wakeup);
+    render_pool_wakeup = NULL;
+    render_worker_count = 0;
+}
+
+/* 启动后台渲染线程 */
+int start_render_thread(const Config *config)
+{
+    render_wakeup = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!render_wakeup)
+        return 0;
+
+    render_stopping = 0;
+    render_thread_handle = CreateThread(NULL, 0, render_thread, (LPVOID)config, 0, NULL);
+    if (!render_thread_handle)
+    {
+        CloseHandle(render_wakeup);
+        render_wakeup = NULL;
+        return 0;
+    }
+
+    // 工作线程池启动失败时由渲染线程独自完成各页面
+    if (!start_render_pool())
+        write_log("ERROR", "渲染工作线程池启动失败，页面将串行渲染");
+    return 1;
+}
+
+/* 停止后台渲染线程，邮箱中尚未渲染的读数会先渲染完 */
+void stop_render_thread(void)
+{
+    // 渲染线程未启动时由当前线程同步渲染，关闭当前线程的渲染连接
+    render_connection_close();
+    if (!render_thread_handle)
+        return;
+
+    InterlockedExchange(&render_stopping, 1);
+    SetEvent(render_wakeup);
+    WaitForSingleObject(render_thread_handle, INFINITE);
+    CloseHandle(render_thread_handle);
+    CloseHandle(render_wakeup);
+    render_thread_handle = NULL;
+    render_wakeup = NULL;
+    stop_render_pool();
+}
+
+/* 把最新读数放入渲染邮箱，替换掉还没来得及渲染的旧读数；渲染线程未运行时返回0 */
+int post_render_job(const ElectricMeter *meter, double threshold)
+{
+    if (!render_thread_handle)
+        return 0;
+
+    RenderJob *job = malloc(sizeof(RenderJob));
+    if (!job)
+        return 0;
+    job->meter = *meter;
+    job->threshold = threshold;
+    job->postedAt = GetTickCount64();
+
+    RenderJob *stale = InterlockedExchangePointer((PVOID volatile *)&render_mailbox, job);
+    if (stale)
+    {
+        InterlockedIncrement(&render_superseded);
+        free(stale);
+    }
+    SetEvent(render_wakeup);
+    return 1;
+}
+
+/* 渲染线程：每次取走邮箱中最新的读数进行渲染 */
+DWORD WINAPI render_thread(LPVOID param)
+{
+    const Config *config = (const Config *)param;
+    trace_name_thread("渲染线程");
+
+    while (1)
+    {
+        RenderJob *job = InterlockedExchangePointer((PVOID volatile *)&render_mailbox, NULL);
+        if (!job)
+        {
+            if (render_stopping)
+                break;
+            WaitForSingleObject(render_wakeup, INFINITE);
+            continue;
+        }
+
+        ULONGLONG started = GetTickCount64();
+        render_cycle(config, &job->meter, job->threshold);
+        ULONGLONG finished = GetTickCount64();
+
+        char log_msg[160];
+        LONG superseded = InterlockedExchange(&render_superseded, 0);
+        snprintf(log_msg, sizeof(log_msg), "页面渲染耗时: %llu ms（排队 %llu ms，跳过旧读数 %ld 次）",
+                 (unsigned long long)(finished - started), (unsigned long long)(started - job->postedAt),
+                 (long)superseded);
+        write_log("INFO", log_msg);
+        free(job);
+    }
+    render_connection_close();
+    return 0;
+}
+
+/* 把一条ALERT_RULE配置编译成规则，格式: 名称,指标,触发值,恢复值,最多提醒次数[,urgent] */
+int compile_alert_rule(const char *text, AlertRule *rule)
+{
+    static const char *metric_names[ALERT_METRIC_COUNT] = {"energy", "amount", "rate", "eta"};
+    char name[32], metric[16], flag[16] = "";
+    double trigger, clear;
+    int max_notify;
+
+    if (sscanf(text, " %31[^,], %15[^, ] , %lf , %lf , %d , %15s", name, metric, &trigger, &clear, &max_notify, flag) < 5)
+        return 0;
+
+    char *end = name + strlen(name);
+    while (end > name && (end[-1] == ' ' || end[-1] == '\t'))
+        *--end = '\0';
+
+    memset(rule, 0, sizeof(AlertRule));
+    rule->metric = -1;
+    for (int i = 0; i < ALERT_METRIC_COUNT; i++)
+    {
+        if (strcmp(metric, metric_names[i]) == 0)
+            rule->metric = i;
+    }
+    if (rule->metric < 0 || name[0] == '\0' || max_notify < 1)
+        return 0;
+    if (flag[0] != '\0' && strcmp(flag, "urgent") != 0)
+        return 0;
+
+    // 速率越高越危险，其余指标越低越危险；恢复值必须留出回差，不能比触发值更"危险"
+    rule->sign = (rule->metric == ALERT_METRIC_RATE) ? -1.0 : 1.0;
+    if (rule->sign * clear < rule->sign * trigger)
+        return 0;
+
+    strcpy(rule->name, name);
+    rule->trigger = rule->sign * trigger;
+    rule->clear = rule->sign * clear;
+    rule->maxNotify = max_notify;
+    rule->urgent = (flag[0] != '\0');
+    return 1;
+}
+
+/* 重置警报规则的运行状态 */
+void alert_state_init(AlertState *state)
+{
+    memset(state, 0, sizeof(AlertState));
+    state->rate = NAN;
+    for (int i = 0; i < ALERT_METRIC_COUNT; i++)
+        state->values[i] = NAN;
+}
+
+/* 用新读数更新用电速率并算出各指标的当前值；速率还未知时相关指标为NAN，不会触发也不会恢复 */
+void alert_update_metrics(AlertState *state, const ElectricMeter *meter, long long now)
+{
+    if (state->hasLast && meter->totalConsumption < state->lastConsumption)
+    {
+        state->rate = NAN; // 累计读数回退（换表或清零），重新估计
+    }
+    else if (state->hasLast && now > state->lastTime)
+    {
+        double rate = (meter->totalConsumption - state->lastConsumption) * 86400.0 / (double)(now - state->lastTime);
+        state->rate = isnan(state->rate) ? rate : state->rate + ALERT_RATE_SMOOTHING * (rate - state->rate);
+    }
+    state->hasLast = 1;
+    state->lastTime = now;
+    state->lastConsumption = meter->totalConsumption;
+
+    state->values[ALERT_METRIC_ENERGY] = meter->remainingEnergy;
+    state->values[ALERT_METRIC_AMOUNT] = meter->remainingAmount;
+    state->values[ALERT_METRIC_RATE] = state->rate;
+    if (isnan(state->rate))
+        state->values[ALERT_METRIC_ETA] = NAN;
+    else if (state->rate > 0)
+        state->values[ALERT_METRIC_ETA] = meter->remainingEnergy / state->rate * 24.0;
+    else
+        state->values[ALERT_METRIC_ETA] = INFINITY;
+}
+
+/* 判断给定小时是否处于静默时段，支持跨零点（如23-7） */
+int in_quiet_hours(const Config *config, int hour)
+{
+    if (config->quietStart == config->quietEnd)
+        return 0;
+    if (config->quietStart < config->quietEnd)
+        return hour >= config->quietStart && hour < config->quietEnd;
+    return hour >= config->quietStart || hour < config->quietEnd;
+}
+
+/* 按新读数评估全部规则，把本次需要提醒的规则序号写入fired，返回个数；每条规则只做常数次比较 */
+int evaluate_alert_rules(const Config *config, AlertState *state, const ElectricMeter *meter, long long now, int hour, int *fired)
+{
+    alert_update_metrics(state, meter, now);
+    int quiet = in_quiet_hours(config, hour);
+    int fired_count = 0;
+
+    for (int i = 0; i < config->alertRuleCount; i++)
+    {
+        const AlertRule *rule = &config->alertRules[i];
+        double value = rule->sign * state->values[rule->metric];
+
+        if (!state->active[i] && value <= rule->trigger)
+        {
+            state->active[i] = 1;
+            state->notified[i] = 0;
+        }
+        else if (state->active[i] && value > rule->clear)
+        {
+            state->active[i] = 0;
+            log_event(EVENT_ALERT_CLEARED, i, 0, 0);
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "警报规则[%s]已恢复正常", rule->name);
+            write_log("INFO", log_msg);
+            printf("✅ %s\n", log_msg);
+            continue;
+        }
+
+        // 处于回差区间时保持触发状态但不重复提醒；静默时段内不消耗提醒次数，静默结束后仍越限就补发
+        if (state->active[i] && value <= rule->trigger && state->notified[i] < rule->maxNotify && (!quiet || rule->urgent))
+        {
+            state->notified[i]++;
+            fired[fired_count++] = i;
+        }
+    }
+    return fired_count;
+}
+
+/* 生成规则触发原因的文字说明，value是指标当前值 */
+void describe_alert_rule(const AlertRule *rule, double value, char *out, size_t out_size)
+{
+    double threshold = rule->sign * rule->trigger;
+    switch (rule->metric)
+    {
+    case ALERT_METRIC_AMOUNT:
+        snprintf(out, out_size, "剩余金额 %.2f 元，低于 %.2f 元", value, threshold);
+        break;
+    case ALERT_METRIC_RATE:
+        snprintf(out, out_size, "日均用电 %.1f 度/天，高于 %.1f 度/天", value, threshold);
+        break;
+    case ALERT_METRIC_ETA:
+        snprintf(out, out_size, "按当前用电速率约 %.1f 小时后用完，少于 %.0f 小时", value, threshold);
+        break;
+    default:
+        snprintf(out, out_size, "剩余电量 %.2f 度，低于 %.1f 度", value, threshold);
+        break;
+    }
+}
+
+/* 处理一条新读数：入库、推送、判断警报并写入发件箱。
+   interactive为1时（监控循环）在控制台显示读数并交给渲染线程，为0时（模拟模式）由调用方决定何时渲染 */
+void process_reading(const Config *config, AlertState *alert_state, ElectricMeter *meter, int interactive)
+{
+    ULONGLONG save_started = metric_clock();
+    TRACE_SPAN("save_database", "database", NULL, 0, save_to_database(config->dbPath, meter));
+    metric_observe(METRIC_STAGE_SAVE, save_started);
+    log_event(EVENT_READING, event_double(meter->remainingEnergy), event_double(meter->remainingAmount),
+              event_double(meter->totalConsumption));
+    if (interactive)
+        display_meter_info(meter, config->lowEnergyThreshold);
+
+    // 通过事件流把新读数推送给已打开的页面
+    PageBuffer event_data;
+    page_buffer_init(&event_data);
+    render_meter_json(&event_data, meter, config->lowEnergyThreshold);
+    sse_broadcast("reading", &event_data);
+    notify_publish("reading", &event_data);
+
+    SYSTEMTIME now_local;
+    clock_local_time(&now_local);
+    int fired[ALERT_MAX_RULES];
+    int fired_count;
+    TRACE_SPAN("evaluate_alerts", "alert", "fired", fired_count,
+               fired_count = evaluate_alert_rules(config, alert_state, meter, clock_now(), now_local.wHour, fired));
+    for (int i = 0; i < fired_count; i++)
+    {
+        const AlertRule *rule = &config->alertRules[fired[i]];
+        char reason[160];
+        char alert_msg[256];
+        describe_alert_rule(rule, alert_state->values[rule->metric], reason, sizeof(reason));
+        metric_add(METRIC_ALERTS, 1);
+        log_event(EVENT_ALERT, fired[i], event_double(alert_state->values[rule->metric]), alert_state->notified[fired[i]]);
+        snprintf(alert_msg, sizeof(alert_msg), "%s警报: %s (第%d次警报)", rule->name, reason, alert_state->notified[fired[i]]);
+        write_log("ALERT", alert_msg);
+
+        if (interactive)
+            printf("🚨 %s\n", alert_msg);
+        ElectricMeter alert;
+        char dedup_key[96];
+        // 警报表的阈值列按"度"展示，非电量规则记录低电量阈值，具体条件写在说明里
+        double threshold = (rule->metric == ALERT_METRIC_ENERGY) ? rule->trigger : config->lowEnergyThreshold;
+        if (save_alert_to_database(config->dbPath, meter, threshold, alert_msg, &alert))
+        {
+            event_data.length = 0;
+            render_alert_json(&event_data, &alert);
+            sse_broadcast("alert", &event_data);
+            notify_publish("alert", &event_data);
+            snprintf(dedup_key, sizeof(dedup_key), "alert-%d", alert.id);
+        }
+        else
+        {
+            snprintf(dedup_key, sizeof(dedup_key), "rule%d-%s", fired[i], meter->meterUpdateTime);
+        }
+        // 只写入发件箱，轮询循环不等待SMTP
+        queue_alert_email(config, meter, rule->name, reason, dedup_key);
+    }
+
+    page_buffer_free(&event_data);
+
+    // 警报也已入库后再交给渲染线程，本轮页面包含最新警报
+    if (interactive)
+    {
+        TRACE_SPAN("post_render", "render", NULL, 0,
+                   if (!post_render_job(meter, config->lowEnergyThreshold))
+                       render_cycle(config, meter, config->lowEnergyThreshold));
+    }
+}
+
+/* 主监控循环 */
+void start_monitoring(const Config *config)
+{
+    write_log("INFO", "开始电表监控");
+
+    printf("开始电表监控\n");
+    printf("监控间隔: %d 分钟\n", config->monitorInterval);
+    printf("低电量阈值: %.1f 度\n", config->lowEnergyThreshold);
+    printf("警报规则: %d 条\n", config->alertRuleCount);
+    if (config->quietStart != config->quietEnd)
+        printf("静默时段: %02d:00-%02d:00\n", config->quietStart, config->quietEnd);
+    printf("数据库: %s\n", config->dbPath);
+    printf("网页路径: %s\n", config->webPath);
+    printf("最大重试次数: %d 次\n", MAX_RETRY_COUNT);
+    printf("按 Ctrl+C 停止监控\n\n");
+
+    int count = 0;
+    AlertState alert_state;
+    alert_state_init(&alert_state);
+
+    // 页面在后台线程渲染，写网页目录的耗时不再拖慢轮询
+    if (!start_render_thread(config))
+        write_log("WARN", "后台渲染线程启动失败，改为在轮询循环中直接渲染");
+
+    if (!start_outbox_worker(config))
+        write_log("ERROR", "发件箱投递线程启动失败，警报邮件将留在发件箱中");
+
+    if (!start_notify_sinks(config))
+        write_log("ERROR", "本地通知线程启动失败，读数和警报不会推送给本地接收方");
+
+    if (config->captureFile[0] && !start_capture(config->captureFile))
+        printf("⚠️ 无法打开响应捕获文件: %s\n", config->captureFile);
+
+    metric_interval_seconds = config->monitorInterval * 60;
+    trace_name_thread("轮询循环");
+    write_log("INFO", "监控系统已启动，开始循环...");
+
+    while (keep_running)
+    {
+        count++;
+        printf("\n=== 第 %d 次查询 ===\n", count);
+        printf("当前时间: %s\n", get_current_time());
+
+        ElectricMeter meter;
+        memset(&meter, 0, sizeof(meter));
+
+        printf("正在获取电表数据...\n");
+        ULONGLONG cycle_span = trace_begin();
+        ULONGLONG cycle_started = metric_clock();
+        ULONGLONG fetch_started = GetTickCount64();
+        int fetched = get_electric_meter_data_with_retry(config, &meter);
+        ULONGLONG fetch_ms = GetTickCount64() - fetch_started;
+        if (fetched)
+        {
+            printf("✅ 数据获取成功（耗时 %llu ms）\n", (unsigned long long)fetch_ms);
+            char fetch_msg[64];
+            snprintf(fetch_msg, sizeof(fetch_msg), "数据获取耗时: %llu ms", (unsigned long long)fetch_ms);
+            write_log("INFO", fetch_msg);
+
+            process_reading(config, &alert_state, &meter, 1);
+        }
+        else
+        {
+            printf("❌ 数据获取失败，跳过本次处理\n");
         }
-        // 最后一条记录（最老的）
-        oldest_consumption = consumption;
-        strncpy(oldest_time, record_time, sizeof(oldest_time) - 1);
-        record_count++;
-    }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+        // 本轮耗时接近轮询间隔时，抓取方可以从 last_cycle_seconds / interval_seconds 发现
+        metric_observe(METRIC_STAGE_CYCLE, cycle_started);
+        metric_last_cycle_us = (LONG64)((metric_clock() - cycle_started) * 1000000ULL / (ULONGLONG)metric_frequency);
+        trace_end("poll_cycle", "poll", cycle_span, "cycle", count);
+        if (config->metricsFile[0])
+            write_metrics_file(config->metricsFile);
 
-    // 如果有足够的数据计算
-    if (record_count >= 2 && newest_consumption > oldest_consumption) {
-        double total_used = newest_consumption - oldest_consumption;
-        
-        // 计算时间差（小时）
-        // 简化处理：假设记录间隔固定，使用记录数量估算小时数
-        double hours_covered = record_count * 10.0 / 60.0; // 假设每10分钟一条记录
-        
-        if (hours_covered >= 1.0) {
-            double hourly_consumption = total_used / hours_covered;
-            daily_consumption = hourly_consumption * 24.0;
-            
-            // 限制在合理范围内
-            if (daily_consumption < 1.0) daily_consumption = 1.0;
-            if (daily_consumption > 50.0) daily_consumption = 50.0;
-            
-            char log_msg[256];
-            snprintf(log_msg, sizeof(log_msg), "精确计算日均用电量: %.2f度/天 (基于%d条记录, %.1f小时数据)", 
-                    daily_consumption, record_count, hours_covered);
-            write_log("INFO", log_msg);
+        if (keep_running)
+        {
+            printf("⏰ 等待 %d 分钟...\n", config->monitorInterval);
+
+            // 分段等待，便于响应Ctrl+C
+            clock_wait(config->monitorInterval * 60);
         }
     }
 
-    return daily_consumption;
+    stop_render_thread();
+    stop_outbox_worker();
+    stop_notify_sinks();
+    finish_capture();
+    write_log("INFO", "监控系统已停止");
 }
 
-/* 计算周均用电量 */
-double calculate_weekly_consumption_from_db(const char *db_path) {
+/* 基准测试用的电表接口响应样本：普通响应和带大量附加字段的响应 */
+static const char bench_payload_small[] =
+    "{\"code\":200,\"msg\":\"success\",\"data\":{\"shengyu\":\"86.42\",\"leiji\":\"3521.77\","
+    "\"price\":\"0.5469\",\"zhuangtai\":\"正常\",\"meterid\":\"0301-1217\",\"room\":\"3号楼217\"}}";
+
+/* 基准测试中的一组插入：所有变体共用一个连接和一条预编译的写入语句，每次调用在一个事务中插入rows行 */
+typedef struct
+{
+    const char *dbPath;
     sqlite3 *db;
     sqlite3_stmt *stmt;
-    int rc;
-    double weekly_consumption = 35.0; // 默认值
+    int rows;
+    ElectricMeter meter;
+} BenchInsert;
 
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK) {
-        return weekly_consumption;
+/* 基准测试中的一次读取或渲染 */
+typedef struct
+{
+    sqlite3 *db;
+    RenderSnapshot *snapshot;
+    const char *webPath;
+    const char *payload;
+    const char *dbPath;
+} BenchRead;
+
+/* 从计数起点到现在的秒数 */
+double bench_seconds(ULONGLONG started)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return (double)(metric_clock() - started) / (double)frequency.QuadPart;
+}
+
+/* qsort用的double比较函数 */
+int bench_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* 运行一项基准：预热一次，按至少BENCH_MIN_SAMPLE_MS确定每个样本的重复次数，
+   输出一行JSON（每次操作的中位/最小/最大纳秒数），便于不同版本之间比较 */
+int bench_run(FILE *out, const char *name, const char *variant, long long rows, int (*run)(void *), void *arg)
+{
+    printf("运行 %s [%s]...\n", name, variant);
+    if (!run(arg))
+    {
+        printf("❌ %s [%s] 执行失败\n", name, variant);
+        return 0;
     }
 
-    // 获取最近7天的数据
-    const char *sql = "SELECT record_time, total_consumption FROM electric_data "
-                      "WHERE record_time >= datetime('now', '-7 days') "
-                      "ORDER BY record_time;";
+    double samples[BENCH_SAMPLES];
+    long long ops = 1;
+    for (;;)
+    {
+        ULONGLONG started = metric_clock();
+        for (long long i = 0; i < ops; i++)
+            run(arg);
+        samples[0] = bench_seconds(started);
+        if (samples[0] * 1000.0 >= BENCH_MIN_SAMPLE_MS || ops >= (1 << 24))
+            break;
+        ops *= 2;
+    }
+    for (int s = 1; s < BENCH_SAMPLES; s++)
+    {
+        ULONGLONG started = metric_clock();
+        for (long long i = 0; i < ops; i++)
+            run(arg);
+        samples[s] = bench_seconds(started);
+    }
+    for (int s = 0; s < BENCH_SAMPLES; s++)
+        samples[s] = samples[s] * 1e9 / (double)ops;
+    qsort(samples, BENCH_SAMPLES, sizeof(double), bench_compare_double);
+
+    fprintf(out, "{\"benchmark\":\"%s\",\"variant\":\"%s\",\"rows\":%lld,\"samples\":%d,\"ops_per_sample\":%lld,"
+                 "\"median_ns\":%.0f,\"min_ns\":%.0f,\"max_ns\":%.0f}\n",
+            name, variant, rows, BENCH_SAMPLES, ops,
+            samples[BENCH_SAMPLES / 2], samples[0], samples[BENCH_SAMPLES - 1]);
+    fflush(out);
+    return 1;
+}
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK) {
+/* 生成rows条按10分钟间隔、时间连续的合成记录 */
+int bench_build_database(const char *path, int rows)
+{
+    // 数据库文件将被替换，先关闭本线程缓存的渲染连接
+    render_connection_close();
+    remove(path);
+    if (!init_database(path))
+        return 0;
+
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    if (sqlite3_open(path, &db) != SQLITE_OK)
+    {
         sqlite3_close(db);
-        return weekly_consumption;
+        return 0;
     }
-
-    int record_count = 0;
-    double oldest_consumption = 0;
-    double newest_consumption = 0;
-    char oldest_time[50] = {0};
-    char newest_time[50] = {0};
-    
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *record_time = (const char *)sqlite3_column_text(stmt, 0);
-        double consumption = sqlite3_column_double(stmt, 1);
-        
-        if (record_count == 0) {
-            // 第一条记录（最老的）
-            oldest_consumption = consumption;
-            strncpy(oldest_time, record_time, sizeof(oldest_time) - 1);
-        }
-        // 最后一条记录（最新的）
-        newest_consumption = consumption;
-        strncpy(newest_time, record_time, sizeof(newest_time) - 1);
-        record_count++;
+    const char *sql = "INSERT INTO electric_data (record_time, remaining_energy, remaining_amount, total_consumption, price, meter_status, meter_update_time, system_time) "
+                      "VALUES (?, ?, ?, ?, 0.5469, '正常', ?, ?);";
+    if (sqlite3_exec(db, "BEGIN;", 0, 0, 0) != SQLITE_OK || sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return 0;
     }
 
+    time_t now = time(NULL);
+    int ok = 1;
+    for (int i = 0; i < rows && ok; i++)
+    {
+        time_t at = now - (time_t)(rows - i) * 600;
+        struct tm utc;
+        char stamp[32];
+        gmtime_s(&utc, &at);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &utc);
+        double energy = 200.0 - fmod(i * 0.02, 190.0);
+        sqlite3_bind_text(stmt, 1, stamp, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_double(stmt, 2, energy);
+        sqlite3_bind_double(stmt, 3, energy * 0.5469);
+        sqlite3_bind_double(stmt, 4, i * 0.02);
+        sqlite3_bind_text(stmt, 5, stamp, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 6, stamp, -1, SQLITE_TRANSIENT);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    }
     sqlite3_finalize(stmt);
+    ok = (sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", 0, 0, 0) == SQLITE_OK) && ok;
     sqlite3_close(db);
+    return ok;
+}
 
-    // 如果有足够的数据计算
-    if (record_count >= 2 && newest_consumption > oldest_consumption) {
-        double total_used = newest_consumption - oldest_consumption;
-        
-        // 假设数据覆盖了7天
-        weekly_consumption = total_used;
-        
-        // 限制在合理范围内
-        if (weekly_consumption < 7.0) weekly_consumption = 7.0;  // 至少每天1度
-        if (weekly_consumption > 350.0) weekly_consumption = 350.0; // 最多每天50度
-        
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "计算周均用电量: %.2f度/周 (基于%d条记录)", 
-                weekly_consumption, record_count);
-        write_log("INFO", log_msg);
+int bench_parse(void *arg)
+{
+    ElectricMeter meter;
+    return parse_json_response(((BenchRead *)arg)->payload, &meter);
+}
+
+int bench_insert(void *arg)
+{
+    // 语句和绑定与save_to_database相同（electric_data_insert_sql），只是不在每次调用时打开连接和编译语句，
+    // 各变体之间只有每个事务的行数不同
+    BenchInsert *insert = (BenchInsert *)arg;
+    sqlite3_stmt *stmt = insert->stmt;
+    if (sqlite3_exec(insert->db, "BEGIN;", 0, 0, 0) != SQLITE_OK)
+        return 0;
+    int ok = 1;
+    for (int i = 0; i < insert->rows && ok; i++)
+    {
+        char record_time[32];
+        clock_sql_time(record_time, sizeof(record_time), 0);
+        sqlite3_bind_double(stmt, 1, insert->meter.remainingEnergy);
+        sqlite3_bind_double(stmt, 2, insert->meter.remainingAmount);
+        sqlite3_bind_double(stmt, 3, insert->meter.totalConsumption);
+        sqlite3_bind_double(stmt, 4, insert->meter.price);
+        sqlite3_bind_text(stmt, 5, insert->meter.meterStatus, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 6, insert->meter.meterUpdateTime, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 7, insert->meter.systemTime, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 8, record_time, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 9, insert->meter.meterId, -1, SQLITE_STATIC);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
     }
+    return (sqlite3_exec(insert->db, ok ? "COMMIT;" : "ROLLBACK;", 0, 0, 0) == SQLITE_OK) && ok;
+}
 
-    return weekly_consumption;
+int bench_daily(void *arg)
+{
+    calculate_daily_consumption_from_db(((BenchRead *)arg)->db);
+    return 1;
 }
-/* 生成实时监控HTML页面 */
-/* 生成实时监控HTML页面 */
-int generate_index_html(const char *web_path, const ElectricMeter *meter, double threshold)
+
+int bench_weekly(void *arg)
 {
-    char filepath[512];
-    sprintf(filepath, "%s/index.html", web_path);
+    calculate_weekly_consumption_from_db(((BenchRead *)arg)->db);
+    return 1;
+}
 
-    FILE *file = fopen(filepath, "w");
-    if (!file)
-    {
-        write_log("ERROR", "无法创建实时监控HTML文件");
+int bench_snapshot(void *arg)
+{
+    RenderSnapshot snapshot;
+    if (!render_snapshot_open(&snapshot, ((BenchRead *)arg)->dbPath))
         return 0;
-    }
+    render_snapshot_close(&snapshot);
+    return 1;
+}
 
-    const char *status_class = (meter->remainingEnergy <= threshold) ? "low-energy" : "normal";
-    const char *status_text = (meter->remainingEnergy <= threshold) ? "低电量" : "正常";
-    const char *status_emoji = (meter->remainingEnergy <= threshold) ? "⚠️" : "✅";
+int bench_history(void *arg)
+{
+    BenchRead *read = (BenchRead *)arg;
+    return generate_history_html(read->webPath, read->snapshot);
+}
 
-    // 精确计算预估可用天数
-    double estimated_days = 0;  // 确保在这里声明变量
-    double daily_consumption = 0;
-    
-    if (meter->remainingEnergy > 0)
+/* 基准测试模式：不需要配置文件和网络，在BENCH_DIR下生成合成数据库，
+   对解析、入库、统计查询和历史页面生成计时，结果以JSON行写到out_path（为空时写到BENCH_RESULTS） */
+int run_benchmarks(const char *out_path, int rows)
+{
+    create_directory(BENCH_DIR);
+    if (!out_path)
+        out_path = BENCH_RESULTS;
+    FILE *out = fopen(out_path, "w");
+    if (!out)
     {
-        // 首先尝试从数据库精确计算日均用电量
-        daily_consumption = calculate_daily_consumption_from_db("electric_data.db");
-        
-        // 如果精确计算失败，使用基于总用电量的估算
-        if (daily_consumption <= 0.1) {
-            if (meter->totalConsumption > 1000) {
-                daily_consumption = 20.0; // 家庭用电
-            } else if (meter->totalConsumption > 500) {
-                daily_consumption = 15.0; // 中等家庭用电
-            } else if (meter->totalConsumption > 100) {
-                daily_consumption = 8.0;  // 小型用电
-            } else if (meter->totalConsumption > 50) {
-                daily_consumption = 4.0;  // 低用电
-            } else {
-                daily_consumption = 2.0;  // 极低用电
-            }
-            
-            char log_msg[128];
-            snprintf(log_msg, sizeof(log_msg), "使用估算日均用电量: %.2f度/天", daily_consumption);
-            write_log("INFO", log_msg);
-        }
-        
-        // 计算预估天数
-        estimated_days = meter->remainingEnergy / daily_consumption;
-        
-        // 限制显示范围，避免不合理的数值
-        if (estimated_days > 365) estimated_days = 365;
-        if (estimated_days < 0.1) estimated_days = 0.1;
+        printf("❌ 无法写入基准测试结果: %s\n", out_path);
+        return 0;
     }
 
-    // 现在在HTML中使用 estimated_days 变量
-    fprintf(file,
-            "<!DOCTYPE html>\n"
-            "<html lang=\"zh-CN\">\n"
-            "<head>\n"
-            "    <meta charset=\"UTF-8\">\n"
-            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
-            "    <title>电表定时时监控</title>\n"
-            "    <style>\n"
-            "        :root {\n"
-            "            --bg-primary: #f5f5f5;\n"
-            "            --bg-secondary: white;\n"
-            "            --text-primary: #2c3e50;\n"
-            "            --text-secondary: #7f8c8d;\n"
-            "            --border-color: #ecf0f1;\n"
-            "            --header-bg: #2c3e50;\n"
-            "            --nav-bg: #34495e;\n"
-            "            --card-shadow: 0 2px 10px rgba(0,0,0,0.1);\n"
-            "        }\n"
-            "        \n"
-            "        .dark-mode {\n"
-            "            --bg-primary: #1a1a1a;\n"
-            "            --bg-secondary: #2d2d2d;\n"
-            "            --text-primary: #ffffff;\n"
-            "            --text-secondary: #b0b0b0;\n"
-            "            --border-color: #404040;\n"
-            "            --header-bg: #1a1a1a;\n"
-            "            --nav-bg: #2d2d2d;\n"
-            "            --card-shadow: 0 2px 10px rgba(0,0,0,0.3);\n"
-            "        }\n"
-            "        \n"
-            "        * { margin: 0; padding: 0; box-sizing: border-box; transition: background-color 0.3s, color 0.3s; }\n"
-            "        body { font-family: 'Microsoft YaHei', Arial, sans-serif; background: var(--bg-primary); color: var(--text-primary); min-height: 100vh; padding: 20px; }\n"
-            "        .container { max-width: 1000px; margin: 0 auto; background: var(--bg-secondary); border-radius: 10px; box-shadow: var(--card-shadow); overflow: hidden; }\n"
-            "        .header { background: var(--header-bg); color: white; padding: 20px; text-align: center; position: relative; }\n"
-            "        .header h1 { font-size: 2em; margin-bottom: 10px; }\n"
-            "        .theme-toggle { position: absolute; top: 20px; right: 20px; background: rgba(255,255,255,0.2); border: none; color: white; padding: 8px 12px; border-radius: 20px; cursor: pointer; font-size: 14px; }\n"
-            "        .theme-toggle:hover { background: rgba(255,255,255,0.3); }\n"
-            "        .nav { background: var(--nav-bg); padding: 10px; text-align: center; }\n"
-            "        .nav a { color: white; text-decoration: none; margin: 0 15px; padding: 5px 10px; border-radius: 3px; }\n"
-            "        .nav a:hover { background: rgba(255,255,255,0.2); }\n"
-            "        .content { padding: 20px; }\n"
-            "        .status-card { background: var(--bg-secondary); border-radius: 8px; padding: 20px; margin-bottom: 20px; border-left: 5px solid #3498db; box-shadow: 0 2px 5px rgba(0,0,0,0.1); }\n"
-            "        .status-card.low-energy { border-left-color: #e74c3c; background: var(--bg-secondary); }\n"
-            "        .status-header { display: flex; justify-content: space-between; align-items: center; margin-bottom: 15px; }\n"
-            "        .status-title { font-size: 1.5em; color: var(--text-primary); font-weight: bold; }\n"
-            "        .status-badge { padding: 5px 10px; border-radius: 15px; font-weight: bold; }\n"
-            "        .badge-normal { background: #27ae60; color: white; }\n"
-            "        .badge-low { background: #e74c3c; color: white; }\n"
-            "        .stats-grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(200px, 1fr)); gap: 15px; margin-bottom: 20px; }\n"
-            "        .stat-card { background: var(--bg-secondary); padding: 15px; border-radius: 8px; box-shadow: 0 2px 5px rgba(0,0,0,0.1); text-align: center; border-top: 4px solid #3498db; }\n"
-            "        .stat-card.energy { border-top-color: #e74c3c; }\n"
-            "        .stat-card.amount { border-top-color: #27ae60; }\n"
-            "        .stat-card.consumption { border-top-color: #f39c12; }\n"
-            "        .stat-card.price { border-top-color: #9b59b6; }\n"
-            "        .stat-value { font-size: 1.8em; font-weight: bold; margin: 8px 0; }\n"
-            "        .energy-value { color: #e74c3c; }\n"
-            "        .amount-value { color: #27ae60; }\n"
-            "        .consumption-value { color: #f39c12; }\n"
-            "        .price-value { color: #9b59b6; }\n"
-            "        .stat-label { color: var(--text-secondary); font-size: 0.9em; }\n"
-            "        .info-table { width: 100%%; border-collapse: collapse; background: var(--bg-secondary); border-radius: 8px; overflow: hidden; box-shadow: 0 2px 5px rgba(0,0,0,0.1); }\n"
-            "        .info-table th, .info-table td { padding: 12px; text-align: left; border-bottom: 1px solid var(--border-color); }\n"
-            "        .info-table th { background: var(--nav-bg); color: white; font-weight: 600; }\n"
-            "        .footer { background: var(--header-bg); color: white; text-align: center; padding: 15px; margin-top: 20px; }\n"
-            "        .update-time { text-align: center; color: var(--text-secondary); margin: 10px 0; }\n"
-            "        .alert-banner { background: #e74c3c; color: white; padding: 12px; text-align: center; border-radius: 6px; margin: 15px 0; }\n"
-            "    </style>\n"
-            "</head>\n"
-            "<body>\n"
-            "    <div class=\"container\">\n"
-            "        <div class=\"header\">\n"
-            "            <h1>⚡ 电表监控系统</h1>\n"
-            "            <div>实时电力监控</div>\n"
-            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"nav\">\n"
-            "            <a href=\"index.html\" style=\"background:rgba(255,255,255,0.2);\">实时监控</a>\n"
-            "            <a href=\"history.html\">历史记录</a>\n"
-            "            <a href=\"alerts.html\">警报记录</a>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"content\">\n"
-            "            <div class=\"status-card %s\">\n"
-            "                <div class=\"status-header\">\n"
-            "                    <div class=\"status-title\">当前电表状态</div>\n"
-            "                    <div class=\"status-badge %s\">%s %s</div>\n"
-            "                </div>\n",
-            status_class,
-            (meter->remainingEnergy <= threshold) ? "badge-low" : "badge-normal",
-            status_emoji, status_text);
+    log_set_level(LOG_LEVEL_ERROR);
+    create_directory(BENCH_DIR "/web");
+    page_cache_init();
+    init_static_assets();
+
+    fprintf(out, "{\"benchmark\":\"build\",\"built\":\"%s %s\",\"sqlite\":\"%s\",\"rows\":%d}\n",
+            __DATE__, __TIME__, sqlite3_libversion(), rows);
+
+    int ok = 1;
+    BenchRead read;
+    memset(&read, 0, sizeof(read));
+
+    // JSON解析
+    static char bench_payload_large[16384];
+    int length = snprintf(bench_payload_large, sizeof(bench_payload_large), "{\"code\":200,\"msg\":\"success\",\"extra\":[");
+    for (int i = 0; length < (int)sizeof(bench_payload_large) - 512; i++)
+        length += snprintf(bench_payload_large + length, sizeof(bench_payload_large) - length, "%s{\"k\":\"field%d\",\"v\":\"%d\"}", i ? "," : "", i, i * 7);
+    snprintf(bench_payload_large + length, sizeof(bench_payload_large) - length, "],%s", bench_payload_small + 1);
+    read.payload = bench_payload_small;
+    ok &= bench_run(out, "parse_json_response", "small", 0, bench_parse, &read);
+    read.payload = bench_payload_large;
+    ok &= bench_run(out, "parse_json_response", "large_16k", 0, bench_parse, &read);
+
+    // 入库：每个事务1行（与save_to_database一样每行提交一次）、100行、10000行，
+    // 三个变体共用同一个连接和预编译语句，差别只在事务大小
+    BenchInsert insert;
+    memset(&insert, 0, sizeof(insert));
+    insert.dbPath = BENCH_DIR "/insert.db";
+    if (parse_json_response(bench_payload_small, &insert.meter) && bench_build_database(insert.dbPath, 0) &&
+        sqlite3_open(insert.dbPath, &insert.db) == SQLITE_OK &&
+        sqlite3_prepare_v2(insert.db, electric_data_insert_sql, -1, &insert.stmt, 0) == SQLITE_OK)
+    {
+        insert.rows = 1;
+        ok &= bench_run(out, "save_to_database", "rows_per_txn=1", 1, bench_insert, &insert);
+        insert.rows = 100;
+        ok &= bench_run(out, "save_to_database", "rows_per_txn=100", 100, bench_insert, &insert);
+        insert.rows = 10000;
+        ok &= bench_run(out, "save_to_database", "rows_per_txn=10000", 10000, bench_insert, &insert);
+    }
+    else
+    {
+        ok = 0;
+    }
+    sqlite3_finalize(insert.stmt);
+    sqlite3_close(insert.db);
+
+    // 大数据库上的统计查询和渲染快照
+    char variant[32];
+    snprintf(variant, sizeof(variant), "rows=%d", rows);
+    read.dbPath = BENCH_DIR "/large.db";
+    printf("生成 %d 行合成数据...\n", rows);
+    if (bench_build_database(read.dbPath, rows) && sqlite3_open(read.dbPath, &read.db) == SQLITE_OK)
+    {
+        ok &= bench_run(out, "calculate_daily_consumption_from_db", variant, rows, bench_daily, &read);
+        ok &= bench_run(out, "calculate_weekly_consumption_from_db", variant, rows, bench_weekly, &read);
+        ok &= bench_run(out, "render_snapshot_open", variant, rows, bench_snapshot, &read);
+    }
+    else
+    {
+        ok = 0;
+    }
+    sqlite3_close(read.db);
+    read.db = NULL;
+
+    // 历史页面生成
+    static const int history_rows[] = {1000, 100000};
+    read.webPath = BENCH_DIR "/web";
+    read.dbPath = BENCH_DIR "/history.db";
+    for (int i = 0; i < (int)(sizeof(history_rows) / sizeof(history_rows[0])); i++)
+    {
+        RenderSnapshot snapshot;
+        snprintf(variant, sizeof(variant), "rows=%d", history_rows[i]);
+        if (!bench_build_database(read.dbPath, history_rows[i]) || !render_snapshot_open(&snapshot, read.dbPath))
+        {
+            ok = 0;
+            continue;
+        }
+        read.snapshot = &snapshot;
+        ok &= bench_run(out, "generate_history_html", variant, history_rows[i], bench_history, &read);
+        render_snapshot_close(&snapshot);
+    }
 
-    if (meter->remainingEnergy <= threshold)
+    fclose(out);
+    printf("%s 基准测试结果已写入 %s\n", ok ? "✅" : "⚠️ 部分项目失败，", out_path);
+    return ok;
+}
+
+/* 伪上游：处理一个连接，读完请求后按配置延迟，返回电表响应、HTTP 500或缺少字段的响应，然后关闭连接 */
+DWORD WINAPI fake_upstream_connection(LPVOID param)
+{
+    SOCKET client = (SOCKET)(uintptr_t)param;
+    const LoadTestOptions *options = fake_upstream_options;
+    char request[HTTP_REQUEST_SIZE];
+    int length = 0;
+    int expected = -1;
+
+    while (length < (int)sizeof(request) - 1)
     {
-        fprintf(file,
-                "                <div class=\"alert-banner\">\n"
-                "                    <strong>⚠️ 低电量警告！</strong> 剩余 %.2f 度电，请及时充值！\n"
-                "                </div>\n",
-                meter->remainingEnergy);
+        int received = recv(client, request + length, (int)sizeof(request) - 1 - length, 0);
+        if (received <= 0)
+            break;
+        length += received;
+        request[length] = '\0';
+
+        char *header_end = strstr(request, "\r\n\r\n");
+        if (header_end && expected < 0)
+        {
+            char *content_length = strstr(request, "Content-Length:");
+            if (!content_length)
+                content_length = strstr(request, "content-length:");
+            expected = (int)(header_end + 4 - request) + (content_length && content_length < header_end ? atoi(content_length + 15) : 0);
+        }
+        if (expected >= 0 && length >= expected)
+            break;
     }
 
-    fprintf(file,
-            "            </div>\n"
-            "            \n"
-            "            <div class=\"stats-grid\">\n"
-            "                <div class=\"stat-card energy\">\n"
-            "                    <div class=\"stat-label\">剩余电量</div>\n"
-            "                    <div class=\"stat-value energy-value\">%.2f 度</div>\n"
-            "                    <div>Remaining Energy</div>\n"
-            "                </div>\n"
-            "                <div class=\"stat-card amount\">\n"
-            "                    <div class=\"stat-label\">剩余金额</div>\n"
-            "                    <div class=\"stat-value amount-value\">%.2f 元</div>\n"
-            "                    <div>Remaining Amount</div>\n"
-            "                </div>\n"
-            "                <div class=\"stat-card consumption\">\n"
-            "                    <div class=\"stat-label\">累计用电</div>\n"
-            "                    <div class=\"stat-value consumption-value\">%.2f kWh</div>\n"
-            "                    <div>Total Consumption</div>\n"
-            "                </div>\n"
-            "                <div class=\"stat-card price\">\n"
-            "                    <div class=\"stat-label\">当前电价</div>\n"
-            "                    <div class=\"stat-value price-value\">%.4f 元/度</div>\n"
-            "                    <div>Current Price</div>\n"
-            "                </div>\n"
-            "            </div>\n"
-            "            \n"
-            "            <table class=\"info-table\">\n"
-            "                <tr><th>项目</th><th>数值</th><th>说明</th></tr>\n"
-            "                <tr><td>电表状态</td><td>%s</td><td>当前电表工作状态</td></tr>\n"
-            "                <tr><td>数据更新时间</td><td>%s</td><td>电表数据最后更新时间</td></tr>\n"
-            "                <tr><td>系统记录时间</td><td>%s</td><td>系统获取数据时间</td></tr>\n"
-            "                <tr><td>低电量阈值</td><td>%.1f 度</td><td>触发警报的阈值</td></tr>\n"
-            "                <tr><td>预估可用天数</td><td>%.1f 天</td><td>基于历史用电量估算</td></tr>\n"
-            "            </table>\n",
-            meter->remainingEnergy,
-            meter->remainingAmount,
-            meter->totalConsumption,
-            meter->price,
-            meter->meterStatus,
-            meter->meterUpdateTime,
-            meter->systemTime,
-            threshold,
-            estimated_days);  // 这里使用 estimated_days 变量
+    int meter = 0;
+    char *path = strchr(request, ' ');
+    if (path)
+    {
+        char *id = strstr(path, "/meter/");
+        if (id)
+            meter = atoi(id + 7);
+    }
 
-    fprintf(file,
-            "            \n"
-            "            <div class=\"update-time\">\n"
-            "                页面最后更新: %s\n"
-            "            </div>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"footer\">\n"
-            "            <p>QAQmolingQAQ</p>\n"
-            "            <p>https://github.com/QAQmolingQAQ/sdipct_electric_monitor-</p>\n"
-            "        </div>\n"
-            "    </div>\n"
-            "    \n"
-            "    <script>\n"
-            "        // 主题切换功能\n"
-            "        function toggleTheme() {\n"
-            "            document.body.classList.toggle('dark-mode');\n"
-            "            const button = document.querySelector('.theme-toggle');\n"
-            "            if (document.body.classList.contains('dark-mode')) {\n"
-            "                button.textContent = '☀️ 明亮模式';\n"
-            "                localStorage.setItem('theme', 'dark');\n"
-            "            } else {\n"
-            "                button.textContent = '🌙 暗黑模式';\n"
-            "                localStorage.setItem('theme', 'light');\n"
-            "            }\n"
-            "        }\n"
-            "        \n"
-            "        // 加载保存的主题\n"
-            "        document.addEventListener('DOMContentLoaded', function() {\n"
-            "            const savedTheme = localStorage.getItem('theme');\n"
-            "            if (savedTheme === 'dark') {\n"
-            "                document.body.classList.add('dark-mode');\n"
-            "                document.querySelector('.theme-toggle').textContent = '☀️ 明亮模式';\n"
-            "            }\n"
-            "        });\n"
-            "        \n"
-            "        // 自动刷新页面（每5分钟）\n"
-            "        setTimeout(function() {\n"
-            "            location.reload();\n"
-            "        }, 300000);\n"
-            "    </script>\n"
-            "</body>\n"
-            "</html>",
-            get_current_time());
-    fclose(file);
+    // 按请求序号生成确定性的伪随机数，同样的参数得到同样的错误分布和延迟
+    LONG sequence = InterlockedIncrement(&fake_upstream_requests);
+    unsigned int random = (unsigned int)sequence * 2654435761u;
+    random ^= random >> 16;
+    int delay = options->latencyMs + (options->jitterMs > 0 ? (int)(random % (unsigned int)(options->jitterMs + 1)) : 0);
+    if (delay > 0)
+        Sleep(delay);
+
+    PageBuffer response;
+    page_buffer_take(&response);
+    int failure = (int)((random >> 8) % 1000) < options->errorPerMille;
+    if (failure && (random & 1))
+    {
+        static const char body[] = "{\"code\":500,\"msg\":\"internal error\"}";
+        page_buffer_printf(&response, "HTTP/1.1 500 Internal Server Error\r\nContent-Type: application/json\r\n"
+                                      "Content-Length: %d\r\nConnection: close\r\n\r\n%s",
+                           (int)(sizeof(body) - 1), body);
+    }
+    else
+    {
+        PageBuffer body;
+        page_buffer_take(&body);
+        if (failure)
+        {
+            page_buffer_printf(&body, "{\"code\":200,\"msg\":\"success\",\"data\":{\"meterid\":\"%d\"}}", meter);
+        }
+        else
+        {
+            double consumption = meter * 37.0 + sequence * 0.01;
+            page_buffer_printf(&body, "{\"code\":200,\"msg\":\"success\",\"data\":{\"shengyu\":\"%.2f\",\"leiji\":\"%.2f\","
+                                      "\"price\":\"0.5469\",\"zhuangtai\":\"正常\",\"meterid\":\"%d\",\"padding\":\"",
+                               200.0 - fmod(consumption, 190.0), consumption, meter);
+            while ((int)body.length < options->payloadBytes - 3)
+                page_buffer_append(&body, "x", 1);
+            page_buffer_append(&body, "\"}}", 3);
+        }
+        page_buffer_printf(&response, "HTTP/1.1 200 OK\r\nContent-Type: application/json; charset=utf-8\r\n"
+                                      "Content-Length: %lu\r\nConnection: close\r\n\r\n",
+                           (unsigned long)body.length);
+        page_buffer_append(&response, body.data, body.length);
+        page_buffer_return(&body);
+    }
 
-    char success_msg[256];
-    snprintf(success_msg, sizeof(success_msg), "实时监控页面已生成: %s", filepath);
-    write_log("INFO", success_msg);
-    return 1;
+    socket_send_all(client, response.data, response.length);
+    page_buffer_return(&response);
+    shutdown(client, SD_SEND);
+    closesocket(client);
+    return 0;
 }
 
-int generate_history_html(const char *web_path, ElectricMeter *records, int count, ElectricMeter *alerts, int alert_count)
+/* 伪上游监听线程：每个连接交给一个线程处理，注入的延迟不会串行化 */
+DWORD WINAPI fake_upstream_thread(LPVOID param)
 {
-    char filepath[512];
-    sprintf(filepath, "%s/history.html", web_path);
+    (void)param;
+    while (!fake_upstream_stopping)
+    {
+        SOCKET client = accept(fake_upstream_socket, NULL, NULL);
+        if (client == INVALID_SOCKET)
+            continue;
+        HANDLE thread = CreateThread(NULL, 64 * 1024, fake_upstream_connection, (LPVOID)(uintptr_t)client, 0, NULL);
+        if (thread)
+            CloseHandle(thread);
+        else
+            closesocket(client);
+    }
+    return 0;
+}
 
-    FILE *file = fopen(filepath, "w");
-    if (!file)
+/* 在127.0.0.1上启动伪上游，端口为0时由系统分配，实际端口写回options->port */
+int start_fake_upstream(LoadTestOptions *options)
+{
+    fake_upstream_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fake_upstream_socket == INVALID_SOCKET)
+        return 0;
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((u_short)options->port);
+    int address_length = sizeof(address);
+    if (bind(fake_upstream_socket, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fake_upstream_socket, SOMAXCONN) != 0 ||
+        getsockname(fake_upstream_socket, (struct sockaddr *)&address, &address_length) != 0)
     {
-        write_log("ERROR", "无法创建历史记录HTML文件");
+        write_log("ERROR", "伪上游无法监听端口");
+        closesocket(fake_upstream_socket);
+        fake_upstream_socket = INVALID_SOCKET;
         return 0;
     }
+    options->port = ntohs(address.sin_port);
 
-    // 计算统计信息
-    double min_energy = 999999, max_energy = 0, avg_energy = 0;
-    double min_amount = 999999, max_amount = 0, avg_amount = 0;
-    double total_consumption = 0;
+    fake_upstream_options = options;
+    fake_upstream_stopping = 0;
+    fake_upstream_thread_handle = CreateThread(NULL, 0, fake_upstream_thread, NULL, 0, NULL);
+    if (!fake_upstream_thread_handle)
+    {
+        closesocket(fake_upstream_socket);
+        fake_upstream_socket = INVALID_SOCKET;
+        return 0;
+    }
+    return 1;
+}
 
-    // 精确计算预估可用天数
-    double estimated_days = 0;
-    double daily_consumption = 0;
-    double weekly_consumption = 0;
-    
-    if (count > 0 && records[0].remainingEnergy > 0)
+/* 关闭监听套接字使accept返回，等待监听线程退出 */
+void stop_fake_upstream(void)
+{
+    if (!fake_upstream_thread_handle)
+        return;
+    InterlockedExchange(&fake_upstream_stopping, 1);
+    closesocket(fake_upstream_socket);
+    WaitForSingleObject(fake_upstream_thread_handle, INFINITE);
+    CloseHandle(fake_upstream_thread_handle);
+    fake_upstream_thread_handle = NULL;
+    fake_upstream_socket = INVALID_SOCKET;
+}
+
+/* 汇总各线程指标分片中某一阶段的次数和总耗时（微秒） */
+LONG64 metric_stage_total(int stage, LONG64 *sum)
+{
+    LONG64 count = 0, total = 0;
+    LONG shard_count = metric_shard_count < METRIC_MAX_THREADS ? metric_shard_count : METRIC_MAX_THREADS;
+    for (LONG i = 0; i <= shard_count; i++)
     {
-        // 计算日均用电量
-        daily_consumption = calculate_daily_consumption_from_db("electric_data.db");
-        
-        // 计算周均用电量
-        weekly_consumption = calculate_weekly_consumption_from_db("electric_data.db");
-        
-        // 优先使用精确计算的日均用电量
-        if (daily_consumption > 0.1) {
-            estimated_days = records[0].remainingEnergy / daily_consumption;
-        } else {
-            // 使用周均用电量估算日均
-            double estimated_daily = weekly_consumption / 7.0;
-            if (estimated_daily > 0.1) {
-                estimated_days = records[0].remainingEnergy / estimated_daily;
-            } else {
-                // 最终回退到基于总用电量的估算
-                if (records[0].totalConsumption > 500) {
-                    estimated_days = records[0].remainingEnergy / 15.0;
-                } else {
-                    estimated_days = records[0].remainingEnergy / 5.0;
-                }
-            }
-        }
-        
-        // 限制显示范围
-        if (estimated_days > 365) estimated_days = 365;
-        if (estimated_days < 0.1) estimated_days = 0.1;
+        const MetricShard *shard = (i < shard_count) ? metric_shards[i] : &metric_overflow;
+        if (!shard)
+            continue;
+        for (int b = 0; b < METRIC_BUCKETS; b++)
+            count += shard->counts[stage][b];
+        total += shard->sum[stage];
+    }
+    if (sum)
+        *sum = total;
+    return count;
+}
+
+/* 汇总各线程指标分片中的某个计数器 */
+LONG64 metric_counter_total(int counter)
+{
+    LONG64 total = 0;
+    LONG shard_count = metric_shard_count < METRIC_MAX_THREADS ? metric_shard_count : METRIC_MAX_THREADS;
+    for (LONG i = 0; i <= shard_count; i++)
+    {
+        const MetricShard *shard = (i < shard_count) ? metric_shards[i] : &metric_overflow;
+        if (shard)
+            total += shard->counters[counter];
     }
+    return total;
+}
+
+/* 负载测试工作线程：轮流领取电表，对伪上游执行真实的获取→解析→入库→发布单表JSON，
+   每轮（所有电表各一次）结束时把最新读数交给后台渲染线程 */
+DWORD WINAPI load_test_worker(LPVOID param)
+{
+    LoadWorker *worker = (LoadWorker *)param;
+    const LoadTestOptions *options = worker->options;
+    char *response = malloc(BUFFER_SIZE);
+    if (!response)
+        return 1;
 
-    if (count > 0)
+    while (keep_running && metric_clock() < worker->deadline)
     {
-        for (int i = 0; i < count; i++)
+        LONG sequence = InterlockedIncrement(worker->next) - 1;
+        int meter_id = (int)(sequence % worker->meters);
+        char url[128];
+        snprintf(url, sizeof(url), "http://127.0.0.1:%d/meter/%d", options->port, meter_id);
+
+        // 读数带着伪上游返回的电表编号入库，各电表的记录在同一张表中按meter_id区分
+        ULONGLONG started = metric_clock();
+        ElectricMeter meter;
+        int ok = 0;
+        if (!http_post_request(url, "", "", response, BUFFER_SIZE))
+            worker->httpErrors++;
+        else if (!parse_json_response(response, &meter))
+            worker->parseErrors++;
+        else if (!save_to_database(worker->config->dbPath, &meter))
+            worker->saveErrors++;
+        else
+            ok = 1;
+        if (ok)
         {
-            if (records[i].remainingEnergy < min_energy)
-                min_energy = records[i].remainingEnergy;
-            if (records[i].remainingEnergy > max_energy)
-                max_energy = records[i].remainingEnergy;
-            if (records[i].remainingAmount < min_amount)
-                min_amount = records[i].remainingAmount;
-            if (records[i].remainingAmount > max_amount)
-                max_amount = records[i].remainingAmount;
-            avg_energy += records[i].remainingEnergy;
-            avg_amount += records[i].remainingAmount;
-            total_consumption = records[i].totalConsumption;
+            PageBuffer json;
+            char name[64];
+            page_buffer_take(&json);
+            render_meter_json(&json, &meter, worker->config->lowEnergyThreshold);
+            snprintf(name, sizeof(name), "api/meters/%d.json", meter_id);
+            cache_rendered_page(name, &json);
+            page_buffer_return(&json);
+
+            if (meter_id == worker->meters - 1)
+                post_render_job(&meter, worker->config->lowEnergyThreshold);
         }
-        avg_energy /= count;
-        avg_amount /= count;
+
+        LONG64 elapsed = (LONG64)((metric_clock() - started) * 1000000ULL / (ULONGLONG)metric_frequency);
+        worker->latency[metric_bucket_index((unsigned long long)elapsed)]++;
+        if (ok)
+            worker->completed++;
     }
 
-    // 在HTML中添加更多统计信息
+    free(response);
+    return 0;
+}
 
+/* 按直方图求分位数（毫秒） */
+double load_test_quantile(const LONG64 *counts, LONG64 total, double quantile)
+{
+    if (total == 0)
+        return 0;
+    LONG64 rank = (LONG64)ceil(quantile * total), seen = 0;
+    int b = 0;
+    while (b < METRIC_BUCKETS - 1 && seen + counts[b] < rank)
+        seen += counts[b++];
+    return metric_bucket_upper(b) / 1000.0;
+}
 
-    fprintf(file,
-            "<!DOCTYPE html>\n"
-            "<html lang=\"zh-CN\">\n"
-            "<head>\n"
-            "    <meta charset=\"UTF-8\">\n"
-            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
-            "    <title>电表历史记录</title>\n"
-            "    <style>\n"
-            "        :root {\n"
-            "            --bg-primary: #f5f5f5;\n"
-            "            --bg-secondary: white;\n"
-            "            --text-primary: #2c3e50;\n"
-            "            --text-secondary: #7f8c8d;\n"
-            "            --border-color: #ecf0f1;\n"
-            "            --header-bg: #2c3e50;\n"
-            "            --nav-bg: #34495e;\n"
-            "            --card-shadow: 0 2px 10px rgba(0,0,0,0.1);\n"
-            "        }\n"
-            "        \n"
-            "        .dark-mode {\n"
-            "            --bg-primary: #1a1a1a;\n"
-            "            --bg-secondary: #2d2d2d;\n"
-            "            --text-primary: #ffffff;\n"
-            "            --text-secondary: #b0b0b0;\n"
-            "            --border-color: #404040;\n"
-            "            --header-bg: #1a1a1a;\n"
-            "            --nav-bg: #2d2d2d;\n"
-            "            --card-shadow: 0 2px 10px rgba(0,0,0,0.3);\n"
-            "        }\n"
-            "        \n"
-            "        * { margin: 0; padding: 0; box-sizing: border-box; transition: background-color 0.3s, color 0.3s; }\n"
-            "        body { font-family: 'Microsoft YaHei', Arial, sans-serif; background: var(--bg-primary); color: var(--text-primary); min-height: 100vh; padding: 20px; }\n"
-            "        .container { max-width: 1400px; margin: 0 auto; background: var(--bg-secondary); border-radius: 10px; box-shadow: var(--card-shadow); overflow: hidden; }\n"
-            "        .header { background: var(--header-bg); color: white; padding: 20px; text-align: center; position: relative; }\n"
-            "        .header h1 { font-size: 2em; margin-bottom: 10px; }\n"
-            "        .theme-toggle { position: absolute; top: 20px; right: 20px; background: rgba(255,255,255,0.2); border: none; color: white; padding: 8px 12px; border-radius: 20px; cursor: pointer; font-size: 14px; }\n"
-            "        .theme-toggle:hover { background: rgba(255,255,255,0.3); }\n"
-            "        .nav { background: var(--nav-bg); padding: 10px; text-align: center; }\n"
-            "        .nav a { color: white; text-decoration: none; margin: 0 15px; padding: 5px 10px; border-radius: 3px; }\n"
-            "        .nav a:hover { background: rgba(255,255,255,0.2); }\n"
-            "        .content { padding: 20px; }\n"
-            "        .stats-grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(200px, 1fr)); gap: 15px; margin-bottom: 20px; }\n"
-            "        .stat-card { background: var(--bg-secondary); padding: 15px; border-radius: 8px; box-shadow: 0 2px 5px rgba(0,0,0,0.1); text-align: center; border-top: 4px solid #3498db; }\n"
-            "        .stat-card.records { border-top-color: #3498db; }\n"
-            "        .stat-card.alerts { border-top-color: #e74c3c; }\n"
-            "        .stat-card.consumption { border-top-color: #f39c12; }\n"
-            "        .stat-card.energy { border-top-color: #27ae60; }\n"
-            "        .stat-value { font-size: 1.8em; font-weight: bold; margin: 8px 0; }\n"
-            "        .stat-label { color: var(--text-secondary); font-size: 0.9em; }\n"
-            "        .history-table { width: 100%%; border-collapse: collapse; background: var(--bg-secondary); border-radius: 8px; overflow: hidden; box-shadow: 0 2px 5px rgba(0,0,0,0.1); margin-bottom: 20px; }\n"
-            "        .history-table th, .history-table td { padding: 12px; text-align: left; border-bottom: 1px solid var(--border-color); }\n"
-            "        .history-table th { background: var(--nav-bg); color: white; font-weight: 600; position: sticky; top: 0; }\n"
-            "        .history-table tr:hover { background: var(--bg-primary); }\n"
-            "        .low-energy { background-color: rgba(231, 76, 60, 0.1) !important; }\n"
-            "        .table-container { max-height: 600px; overflow-y: auto; margin-bottom: 30px; }\n"
-            "        .footer { background: var(--header-bg); color: white; text-align: center; padding: 15px; margin-top: 20px; }\n"
-            "        .update-time { text-align: center; color: var(--text-secondary); margin: 10px 0; }\n"
-            "        .section-title { font-size: 1.5em; color: var(--text-primary); margin: 20px 0 15px 0; padding-bottom: 10px; border-bottom: 2px solid var(--border-color); }\n"
-            "    </style>\n"
-            "</head>\n"
-            "<body>\n"
-            "    <div class=\"container\">\n"
-            "        <div class=\"header\">\n"
-            "            <h1>⚡ 电表监控系统 - 历史记录</h1>\n"
-            "            <div>电力数据历史记录</div>\n"
-            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"nav\">\n"
-            "            <a href=\"index.html\">实时监控</a>\n"
-            "            <a href=\"history.html\" style=\"background:rgba(255,255,255,0.2);\">历史记录</a>\n"
-            "            <a href=\"alerts.html\">警报记录</a>\n"
-            "        </div>\n"
-            "        \n"
-            "            <div class=\"section-title\">📊 电量统计</div>\n"
-            "            <div class=\"stats-grid\">\n"
-            "                <div class=\"stat-card records\">\n"
-            "                    <div class=\"stat-label\">总记录数</div>\n"
-            "                    <div class=\"stat-value\">%d 条</div>\n"
-            "                    <div>Total Records</div>\n"
-            "                </div>\n"
-            "                <div class=\"stat-card consumption\">\n"
-            "                    <div class=\"stat-label\">累计用电</div>\n"
-            "                    <div class=\"stat-value\">%.2f kWh</div>\n"
-            "                    <div>Total Consumption</div>\n"
-            "                </div>\n"
-            "               <div class=\"stat-card\">\n"
-            "                    <div class=\"stat-label\">日均用电量</div>\n"
-            "                    <div class=\"stat-value\">%.2f 度/天</div>\n"
-            "                    <div>Daily Consumption</div>\n"
-            "                </div>\n"
-            "                <div class=\"stat-card\">\n"
-            "                    <div class=\"stat-label\">周均用电量</div>\n"
-            "                    <div class=\"stat-value\">%.2f 度/周</div>\n"
-            "                    <div>Weekly Consumption</div>\n"
-            "                </div>\n"
-            "                <div class=\"stat-card\">\n"
-            "                    <div class=\"stat-label\">预估可用天数</div>\n"
-            "                    <div class=\"stat-value\">%.1f 天</div>\n"
-            "                    <div>Estimated Days</div>\n"
-            "                </div>\n"
-            "            </div>\n"
-            "            \n"
-            "            <div class=\"section-title\">📈 详细历史记录（最近%d条）</div>\n"
-            "            <div class=\"table-container\">\n"
-            "                <table class=\"history-table\">\n"
-            "                    <thead>\n"
-            "                        <tr>\n"
-            "                            <th>ID</th>\n"
-            "                            <th>记录时间</th>\n"
-            "                            <th>剩余电量 (度)</th>\n"
-            "                            <th>剩余金额 (元)</th>\n"
-            "                            <th>累计用电 (kWh)</th>\n"
-            "                            <th>电价 (元/度)</th>\n"
-            "                            <th>电表状态</th>\n"
-            "                            <th>数据更新时间</th>\n"
-            "                        </tr>\n"
-            "                    </thead>\n"
-            "                    <tbody>\n",
-            count, total_consumption, daily_consumption, weekly_consumption, estimated_days, count);
+/* 以meters个模拟电表运行一档负载，结果写一行JSON并打印摘要 */
+int run_load_step(FILE *out, LoadTestOptions *options, int meters)
+{
+    Config config;
+    memset(&config, 0, sizeof(config));
+    snprintf(config.dbPath, sizeof(config.dbPath), "%s/load-%d.db", LOAD_DIR, meters);
+    snprintf(config.webPath, sizeof(config.webPath), "%s/web-%d", LOAD_DIR, meters);
+    config.renderMode = RENDER_MODE_HTML;
+    config.lowEnergyThreshold = LOAD_LOW_ENERGY_THRESHOLD;
+    config.monitorInterval = 1;
+
+    remove(config.dbPath);
+    if (!init_database(config.dbPath) || !start_render_thread(&config))
+        return 0;
 
-    // 输出记录数据
-    for (int i = 0; i < count; i++)
+    LoadWorker workers[LOAD_MAX_WORKERS];
+    HANDLE threads[LOAD_MAX_WORKERS];
+    volatile LONG next = 0;
+    LONG64 render_sum_before, render_sum_after;
+    LONG64 renders_before = metric_stage_total(METRIC_STAGE_RENDER, &render_sum_before);
+    LONG requests_before = fake_upstream_requests;
+
+    FILETIME created, exited, kernel_before, user_before, kernel_after, user_after;
+    GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel_before, &user_before);
+    ULONGLONG started = metric_clock();
+    ULONGLONG deadline = started + (ULONGLONG)options->seconds * (ULONGLONG)metric_frequency;
+
+    int thread_count = 0;
+    for (int i = 0; i < options->workers; i++)
     {
-        const char *row_class = (records[i].remainingEnergy < 50) ? "class=\"low-energy\"" : "";
-        fprintf(file,
-                "                        <tr %s>\n"
-                "                            <td>%d</td>\n"
-                "                            <td>%s</td>\n"
-                "                            <td>%.2f</td>\n"
-                "                            <td>%.2f</td>\n"
-                "                            <td>%.2f</td>\n"
-                "                            <td>%.4f</td>\n"
-                "                            <td>%s</td>\n"
-                "                            <td>%s</td>\n"
-                "                        </tr>\n",
-                row_class,
-                records[i].id,
-                records[i].record_time,
-                records[i].remainingEnergy,
-                records[i].remainingAmount,
-                records[i].totalConsumption,
-                records[i].price,
-                records[i].meterStatus,
-                records[i].meterUpdateTime);
-    }
-
-    fprintf(file,
-            "                    </tbody>\n"
-            "                </table>\n"
-            "            </div>\n"
-            "            \n"
-            "            <div class=\"update-time\">\n"
-            "                页面生成时间: %s\n"
-            "            </div>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"footer\">\n"
-            "            <p>历史记录页面</p>\n"
-            "            <p></p>\n"
-            "        </div>\n"
-            "    </div>\n"
-            "    \n"
-            "    <script>\n"
-            "        // 主题切换功能\n"
-            "        function toggleTheme() {\n"
-            "            document.body.classList.toggle('dark-mode');\n"
-            "            const button = document.querySelector('.theme-toggle');\n"
-            "            if (document.body.classList.contains('dark-mode')) {\n"
-            "                button.textContent = '☀️ 明亮模式';\n"
-            "                localStorage.setItem('theme', 'dark');\n"
-            "            } else {\n"
-            "                button.textContent = '🌙 暗黑模式';\n"
-            "                localStorage.setItem('theme', 'light');\n"
-            "            }\n"
-            "        }\n"
-            "        \n"
-            "        // 加载保存的主题\n"
-            "        document.addEventListener('DOMContentLoaded', function() {\n"
-            "            const savedTheme = localStorage.getItem('theme');\n"
-            "            if (savedTheme === 'dark') {\n"
-            "                document.body.classList.add('dark-mode');\n"
-            "                document.querySelector('.theme-toggle').textContent = '☀️ 明亮模式';\n"
-            "            }\n"
-            "            \n"
-            "            // 表格排序功能\n"
-            "            const table = document.querySelector('.history-table');\n"
-            "            const headers = table.querySelectorAll('th');\n"
-            "            \n"
-            "            headers.forEach((header, index) => {\n"
-            "                header.style.cursor = 'pointer';\n"
-            "                header.addEventListener('click', () => {\n"
-            "                    sortTable(index);\n"
-            "                });\n"
-            "            });\n"
-            "            \n"
-            "            function sortTable(column) {\n"
-            "                const tbody = table.querySelector('tbody');\n"
-            "                const rows = Array.from(tbody.querySelectorAll('tr'));\n"
-            "                \n"
-            "                rows.sort((a, b) => {\n"
-            "                    const aText = a.cells[column].textContent.trim();\n"
-            "                    const bText = b.cells[column].textContent.trim();\n"
-            "                    \n"
-            "                    // 尝试转换为数字比较\n"
-            "                    const aNum = parseFloat(aText);\n"
-            "                    const bNum = parseFloat(bText);\n"
-            "                    \n"
-            "                    if (!isNaN(aNum) && !isNaN(bNum)) {\n"
-            "                        return aNum - bNum;\n"
-            "                    } else {\n"
-            "                        return aText.localeCompare(bText);\n"
-            "                    }\n"
-            "                });\n"
-            "                \n"
-            "                // 清空并重新添加排序后的行\n"
-            "                rows.forEach(row => tbody.appendChild(row));\n"
-            "            }\n"
-            "        });\n"
-            "        \n"
-            "        // 自动刷新页面（每5分钟）\n"
-            "        setTimeout(function() {\n"
-            "            location.reload();\n"
-            "        }, 300000);\n"
-            "    </script>\n"
-            "</body>\n"
-            "</html>",
-            get_current_time());
+        memset(&workers[i], 0, sizeof(LoadWorker));
+        workers[i].options = options;
+        workers[i].config = &config;
+        workers[i].meters = meters;
+        workers[i].next = &next;
+        workers[i].deadline = deadline;
+        threads[thread_count] = CreateThread(NULL, 0, load_test_worker, &workers[i], 0, NULL);
+        if (threads[thread_count])
+            thread_count++;
+    }
+    WaitForMultipleObjects(thread_count, threads, TRUE, INFINITE);
+    for (int i = 0; i < thread_count; i++)
+        CloseHandle(threads[i]);
+    double elapsed = (double)(metric_clock() - started) / (double)metric_frequency;
+    stop_render_thread();
+
+    GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel_after, &user_after);
+    double cpu = ((((ULONGLONG)kernel_after.dwHighDateTime << 32) | kernel_after.dwLowDateTime) -
+                  (((ULONGLONG)kernel_before.dwHighDateTime << 32) | kernel_before.dwLowDateTime) +
+                  (((ULONGLONG)user_after.dwHighDateTime << 32) | user_after.dwLowDateTime) -
+                  (((ULONGLONG)user_before.dwHighDateTime << 32) | user_before.dwLowDateTime)) / 1e7;
+    PROCESS_MEMORY_COUNTERS memory;
+    memset(&memory, 0, sizeof(memory));
+    GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory));
+    DWORD handles = 0;
+    GetProcessHandleCount(GetCurrentProcess(), &handles);
+
+    static LONG64 latency[METRIC_BUCKETS];
+    memset(latency, 0, sizeof(latency));
+    long long completed = 0, http_errors = 0, parse_errors = 0, save_errors = 0;
+    for (int i = 0; i < options->workers; i++)
+    {
+        for (int b = 0; b < METRIC_BUCKETS; b++)
+            latency[b] += workers[i].latency[b];
+        completed += workers[i].completed;
+        http_errors += workers[i].httpErrors;
+        parse_errors += workers[i].parseErrors;
+        save_errors += workers[i].saveErrors;
+    }
+    long long failed = http_errors + parse_errors + save_errors;
+    LONG64 total = completed + failed;
+    LONG64 renders = metric_stage_total(METRIC_STAGE_RENDER, &render_sum_after) - renders_before;
+    double render_ms = renders > 0 ? (render_sum_after - render_sum_before) / 1000.0 / renders : 0;
+
+    fprintf(out, "{\"meters\":%d,\"workers\":%d,\"seconds\":%.2f,\"latency_ms\":%d,\"jitter_ms\":%d,\"error_per_mille\":%d,"
+                 "\"payload_bytes\":%d,\"completed\":%lld,\"failed\":%lld,\"http_errors\":%lld,\"parse_errors\":%lld,\"save_errors\":%lld,"
+                 "\"upstream_requests\":%ld,\"meters_per_sec\":%.1f,"
+                 "\"p50_ms\":%.2f,\"p90_ms\":%.2f,\"p99_ms\":%.2f,\"p999_ms\":%.2f,\"renders\":%lld,\"render_avg_ms\":%.2f,"
+                 "\"cpu_seconds\":%.2f,\"cpu_cores\":%.2f,\"peak_working_set_mb\":%.1f,\"working_set_mb\":%.1f,\"handles\":%lu}\n",
+            meters, options->workers, elapsed, options->latencyMs, options->jitterMs, options->errorPerMille,
+            options->payloadBytes, completed, failed, http_errors, parse_errors, save_errors,
+            (long)(fake_upstream_requests - requests_before),
+            completed / elapsed,
+            load_test_quantile(latency, total, 0.5), load_test_quantile(latency, total, 0.9),
+            load_test_quantile(latency, total, 0.99), load_test_quantile(latency, total, 0.999),
+            (long long)renders, render_ms, cpu, cpu / elapsed,
+            memory.PeakWorkingSetSize / 1048576.0, memory.WorkingSetSize / 1048576.0, (unsigned long)handles);
+    fflush(out);
+
+    printf("%6d 个电表: %8.1f 表/秒  p50 %7.2f ms  p99 %8.2f ms  失败 %lld (HTTP %lld/解析 %lld/入库 %lld)  "
+           "渲染 %lld 轮(平均 %.1f ms)  CPU %.2f 核  峰值内存 %.1f MB\n",
+           meters, completed / elapsed, load_test_quantile(latency, total, 0.5), load_test_quantile(latency, total, 0.99),
+           failed, http_errors, parse_errors, save_errors, (long long)renders, render_ms, cpu / elapsed, memory.PeakWorkingSetSize / 1048576.0);
+    return 1;
+}
+
+/* 负载测试模式：启动本机伪上游，依次以不同数量的模拟电表运行真实流水线，
+   报告持续吞吐（表/秒）、尾延迟和资源占用，结果以JSON行写到out_path（为空时写到LOAD_RESULTS） */
+int run_load_test(LoadTestOptions *options, const char *out_path)
+{
+    create_directory(LOAD_DIR);
+    if (!out_path)
+        out_path = LOAD_RESULTS;
+    FILE *out = fopen(out_path, "w");
+    if (!out)
+    {
+        printf("❌ 无法写入负载测试结果: %s\n", out_path);
+        return 0;
+    }
+
+    log_set_level(LOG_LEVEL_ERROR);
+    page_cache_init();
+    init_static_assets();
+    signal(SIGINT, signal_handler);
 
-    fclose(file);
+    if (!start_fake_upstream(options))
+    {
+        printf("❌ 伪上游启动失败\n");
+        fclose(out);
+        return 0;
+    }
+    printf("伪上游: http://127.0.0.1:%d/meter/<编号>，延迟 %d±%d ms，错误率 %.1f%%，响应 %d 字节\n",
+           options->port, options->latencyMs, options->jitterMs, options->errorPerMille / 10.0, options->payloadBytes);
+    printf("每档运行 %d 秒，%d 个工作线程\n", options->seconds, options->workers);
+
+    int ok = 1;
+    for (int i = 0; i < options->meterCountCount && keep_running; i++)
+        ok &= run_load_step(out, options, options->meterCounts[i]);
+
+    stop_fake_upstream();
+    fclose(out);
+    printf("%s 负载测试结果已写入 %s\n", ok ? "✅" : "⚠️ 部分档位失败，", out_path);
+    return ok;
+}
 
-    char success_msg[256];
-    snprintf(success_msg, sizeof(success_msg), "历史记录页面已生成: %s", filepath);
-    write_log("INFO", success_msg);
+/* 解析--load-test的参数：不以--开头的参数是结果文件路径（只能有一个），未知选项或缺少取值时报错 */
+int parse_load_test_options(int argc, char *argv[], LoadTestOptions *options, const char **out_path)
+{
+    memset(options, 0, sizeof(LoadTestOptions));
+    static const int default_counts[] = {1, 10, 100, 1000};
+    for (int i = 0; i < (int)(sizeof(default_counts) / sizeof(default_counts[0])); i++)
+        options->meterCounts[options->meterCountCount++] = default_counts[i];
+    options->seconds = 10;
+    options->workers = 8;
+    options->latencyMs = 50;
+    options->jitterMs = 20;
+    options->errorPerMille = 10;
+    options->payloadBytes = 512;
+    *out_path = NULL;
+
+    for (int i = 0; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--meters") == 0 && value)
+        {
+            options->meterCountCount = 0;
+            char list[256];
+            snprintf(list, sizeof(list), "%s", value);
+            for (char *item = strtok(list, ","); item && options->meterCountCount < LOAD_MAX_STEPS; item = strtok(NULL, ","))
+            {
+                if (atoi(item) > 0)
+                    options->meterCounts[options->meterCountCount++] = atoi(item);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && value)
+            options->seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--workers") == 0 && value)
+            options->workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--latency") == 0 && value)
+            options->latencyMs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--jitter") == 0 && value)
+            options->jitterMs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--error-rate") == 0 && value)
+            options->errorPerMille = (int)(atof(argv[++i]) * 10);
+        else if (strcmp(argv[i], "--payload") == 0 && value)
+            options->payloadBytes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--port") == 0 && value)
+            options->port = atoi(argv[++i]);
+        else if (strncmp(argv[i], "--", 2) != 0 && !*out_path)
+            *out_path = argv[i];
+        else
+        {
+            printf("❌ 未知的负载测试参数或缺少取值: %s\n", argv[i]);
+            return 0;
+        }
+    }
+
+    if (options->meterCountCount == 0 || options->seconds <= 0 || options->workers <= 0 || options->workers > LOAD_MAX_WORKERS)
+    {
+        printf("❌ 负载测试参数无效（工作线程数1-%d，运行秒数和电表数需大于0）\n", LOAD_MAX_WORKERS);
+        return 0;
+    }
+    // 响应体要能完整放进http_post_request的接收缓冲区，否则测到的是截断后的解析失败
+    if (options->payloadBytes <= 0 || options->payloadBytes >= BUFFER_SIZE)
+    {
+        printf("❌ --payload 需在1-%d字节之间\n", BUFFER_SIZE - 1);
+        return 0;
+    }
+    if (options->latencyMs < 0 || options->jitterMs < 0 || options->errorPerMille < 0 || options->errorPerMille > 1000 ||
+        options->port < 0 || options->port > 65535)
+    {
+        printf("❌ 负载测试参数无效（延迟和抖动不能为负，错误率0-100，端口0-65535）\n");
+        return 0;
+    }
     return 1;
 }
 
-/* 生成警报记录HTML页面 */
-int generate_alerts_html(const char *web_path, ElectricMeter *alerts, int count)
+/* 模拟模式的伪随机数（xorshift32），相同种子得到相同的用电曲线 */
+unsigned int simulation_random(unsigned int *state)
 {
-    char filepath[512];
-    sprintf(filepath, "%s/alerts.html", web_path);
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
 
-    FILE *file = fopen(filepath, "w");
-    if (!file)
+/* 按虚拟时钟的本地小时给出平均用电功率（千瓦）：夜间低谷、白天平稳、傍晚高峰 */
+double simulation_load_kw(int hour)
+{
+    if (hour < 6)
+        return 0.12;
+    if (hour < 8)
+        return 0.45;
+    if (hour < 18)
+        return 0.30;
+    if (hour < 23)
+        return 0.95;
+    return 0.25;
+}
+
+/* 模拟模式：用虚拟时钟把几个月的轮询压缩到几秒内跑完。
+   合成的电表响应与真实接口格式相同，经parse_json_response、process_reading走完入库、警报判断和发件箱流程，
+   数据和页面写到SIM_DIR下的独立数据库和网页目录，不会影响正式数据，发件箱中的邮件也不会被投递 */
+int run_simulation(Config *config, const SimulationOptions *options)
+{
+    create_directory(SIM_DIR);
+    remove(SIM_DB);
+    remove(SIM_DB "-wal");
+    remove(SIM_DB "-shm");
+    snprintf(config->dbPath, sizeof(config->dbPath), "%s", SIM_DB);
+    snprintf(config->webPath, sizeof(config->webPath), "%s", SIM_WEB);
+    create_directory(config->webPath);
+    config->httpPort = 0;
+    config->monitorInterval = options->interval;
+
+    if (!init_database(config->dbPath))
     {
-        write_log("ERROR", "无法创建警报记录HTML文件");
+        printf("❌ 模拟数据库初始化失败\n");
         return 0;
     }
 
-    fprintf(file,
-            "<!DOCTYPE html>\n"
-            "<html lang=\"zh-CN\">\n"
-            "<head>\n"
-            "    <meta charset=\"UTF-8\">\n"
-            "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
-            "    <title>电表警报记录</title>\n"
-            "    <style>\n"
-            "        :root {\n"
-            "            --bg-primary: #f5f5f5;\n"
-            "            --bg-secondary: white;\n"
-            "            --text-primary: #2c3e50;\n"
-            "            --text-secondary: #7f8c8d;\n"
-            "            --border-color: #ecf0f1;\n"
-            "            --header-bg: #e74c3c;\n"
-            "            --nav-bg: #c0392b;\n"
-            "            --card-shadow: 0 2px 10px rgba(0,0,0,0.1);\n"
-            "        }\n"
-            "        \n"
-            "        .dark-mode {\n"
-            "            --bg-primary: #1a1a1a;\n"
-            "            --bg-secondary: #2d2d2d;\n"
-            "            --text-primary: #ffffff;\n"
-            "            --text-secondary: #b0b0b0;\n"
-            "            --border-color: #404040;\n"
-            "            --header-bg: #c0392b;\n"
-            "            --nav-bg: #a93226;\n"
-            "            --card-shadow: 0 2px 10px rgba(0,0,0,0.3);\n"
-            "        }\n"
-            "        \n"
-            "        * { margin: 0; padding: 0; box-sizing: border-box; transition: background-color 0.3s, color 0.3s; }\n"
-            "        body { font-family: 'Microsoft YaHei', Arial, sans-serif; background: var(--bg-primary); color: var(--text-primary); min-height: 100vh; padding: 20px; }\n"
-            "        .container { max-width: 1200px; margin: 0 auto; background: var(--bg-secondary); border-radius: 10px; box-shadow: var(--card-shadow); overflow: hidden; }\n"
-            "        .header { background: var(--header-bg); color: white; padding: 20px; text-align: center; position: relative; }\n"
-            "        .header h1 { font-size: 2em; margin-bottom: 10px; }\n"
-            "        .theme-toggle { position: absolute; top: 20px; right: 20px; background: rgba(255,255,255,0.2); border: none; color: white; padding: 8px 12px; border-radius: 20px; cursor: pointer; font-size: 14px; }\n"
-            "        .theme-toggle:hover { background: rgba(255,255,255,0.3); }\n"
-            "        .nav { background: var(--nav-bg); padding: 10px; text-align: center; }\n"
-            "        .nav a { color: white; text-decoration: none; margin: 0 15px; padding: 5px 10px; border-radius: 3px; }\n"
-            "        .nav a:hover { background: rgba(255,255,255,0.2); }\n"
-            "        .content { padding: 20px; }\n"
-            "        .stats-card { background: rgba(231, 76, 60, 0.1); padding: 20px; border-radius: 8px; border-left: 5px solid #e74c3c; margin-bottom: 20px; }\n"
-            "        .stats-value { font-size: 2em; font-weight: bold; color: #e74c3c; }\n"
-            "        .stats-label { color: var(--text-secondary); font-size: 1em; }\n"
-            "        .alerts-table { width: 100%%; border-collapse: collapse; background: var(--bg-secondary); border-radius: 8px; overflow: hidden; box-shadow: 0 2px 5px rgba(0,0,0,0.1); }\n"
-            "        .alerts-table th, .alerts-table td { padding: 12px; text-align: left; border-bottom: 1px solid var(--border-color); }\n"
-            "        .alerts-table th { background: var(--nav-bg); color: white; font-weight: 600; }\n"
-            "        .alerts-table tr:hover { background: var(--bg-primary); }\n"
-            "        .alert-critical { background-color: rgba(231, 76, 60, 0.1) !important; font-weight: bold; color: #e74c3c; }\n"
-            "        .footer { background: var(--header-bg); color: white; text-align: center; padding: 15px; margin-top: 20px; }\n"
-            "        .update-time { text-align: center; color: var(--text-secondary); margin: 10px 0; }\n"
-            "        .section-title { font-size: 1.5em; color: #e74c3c; margin: 20px 0 15px 0; padding-bottom: 10px; border-bottom: 2px solid var(--border-color); }\n"
-            "    </style>\n"
-            "</head>\n"
-            "<body>\n"
-            "    <div class=\"container\">\n"
-            "        <div class=\"header\">\n"
-            "            <h1>警报记录</h1>\n"
-            "            <div>低电量警报历史记录</div>\n"
-            "            <button class=\"theme-toggle\" onclick=\"toggleTheme()\">🌙 暗黑模式</button>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"nav\">\n"
-            "            <a href=\"index.html\">实时监控</a>\n"
-            "            <a href=\"history.html\">历史记录</a>\n"
-            "            <a href=\"alerts.html\" style=\"background:rgba(255,255,255,0.2);\">警报记录</a>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"content\">\n"
-            "            <div class=\"stats-card\">\n"
-            "                <div class=\"stats-value\">%d 次</div>\n"
-            "                <div class=\"stats-label\">总警报次数</div>\n"
-            "            </div>\n"
-            "            \n"
-            "            <div class=\"section-title\">📋 警报记录详情</div>\n"
-            "            <table class=\"alerts-table\">\n"
-            "                <thead>\n"
-            "                    <tr>\n"
-            "                        <th>ID</th>\n"
-            "                        <th>警报时间</th>\n"
-            "                        <th>剩余电量</th>\n"
-            "                        <th>阈值</th>\n"
-            "                        <th>警报信息</th>\n"
-            "                        <th>数据更新时间</th>\n"
-            "                    </tr>\n"
-            "                </thead>\n"
-            "                <tbody>\n",
-            count);
-
-    // 输出警报数据
-    if (count > 0)
+    log_set_level(LOG_LEVEL_WARN);
+    clock_use_virtual(options->start * 1000);
+    metric_interval_seconds = options->interval * 60;
+
+    long long cycles = (long long)options->days * 24 * 60 / options->interval;
+    // 默认每个模拟日渲染一次；轮询间隔超过一天时整除结果为0，改为每轮都渲染
+    int render_every = options->renderEvery > 0 ? options->renderEvery : 24 * 60 / options->interval;
+    if (render_every < 1)
+        render_every = 1;
+    unsigned int random_state = options->seed ? options->seed : 1;
+    double energy = 150.0;
+    double consumption = 3000.0;
+    double price = 0.5469;
+    long long parsed = 0, renders = 0, recharges = 0;
+    LONG64 alerts_before = metric_counter_total(METRIC_ALERTS);
+
+    AlertState alert_state;
+    alert_state_init(&alert_state);
+    ElectricMeter meter;
+    memset(&meter, 0, sizeof(meter));
+
+    printf("模拟 %d 天，每 %d 分钟一次，共 %lld 次轮询，每 %d 次渲染一轮页面\n",
+           options->days, options->interval, cycles, render_every);
+    printf("数据库: %s  网页路径: %s\n", config->dbPath, config->webPath);
+
+    ULONGLONG started = metric_clock();
+    for (long long cycle = 1; cycle <= cycles && keep_running; cycle++)
     {
-        for (int i = 0; i < count; i++)
+        // 按本轮所处时段的功率和±30%的波动计算这段时间的用电量
+        SYSTEMTIME now_local;
+        clock_local_time(&now_local);
+        double noise = 0.7 + (simulation_random(&random_state) % 601) / 1000.0;
+        double used = simulation_load_kw(now_local.wHour) * options->interval / 60.0 * noise;
+        energy = energy > used ? energy - used : 0;
+        consumption += used;
+
+        // 余量低于阈值后每轮有1/8的概率充值100度，期间会触发低电量警报
+        if (energy < config->lowEnergyThreshold && simulation_random(&random_state) % 8 == 0)
         {
-            fprintf(file,
-                    "                    <tr class=\"alert-critical\">\n"
-                    "                        <td>%d</td>\n"
-                    "                        <td>%s</td>\n"
-                    "                        <td>%.2f 度</td>\n"
-                    "                        <td>%.1f 度</td>\n"
-                    "                        <td>%s</td>\n"
-                    "                        <td>%s</td>\n"
-                    "                    </tr>\n",
-                    alerts[i].id,
-                    alerts[i].record_time,
-                    alerts[i].remainingEnergy,
-                    alerts[i].price,       // 使用price字段存储threshold
-                    alerts[i].meterStatus, // 使用meter_status字段存储alert_message
-                    alerts[i].meterUpdateTime);
+            energy += 100.0;
+            recharges++;
+        }
+
+        char payload[512];
+        snprintf(payload, sizeof(payload),
+                 "{\"code\":200,\"msg\":\"success\",\"data\":{\"shengyu\":\"%.2f\",\"leiji\":\"%.2f\","
+                 "\"price\":\"%.4f\",\"zhuangtai\":\"%s\"}}",
+                 energy, consumption, price, energy > 0 ? "正常" : "欠费");
+
+        memset(&meter, 0, sizeof(meter));
+        ULONGLONG parse_started = metric_clock();
+        if (parse_json_response(payload, &meter))
+        {
+            metric_observe(METRIC_STAGE_PARSE, parse_started);
+            parsed++;
+            process_reading(config, &alert_state, &meter, 0);
+            if (cycle % render_every == 0)
+            {
+                render_cycle(config, &meter, config->lowEnergyThreshold);
+                renders++;
+            }
         }
+
+        clock_wait(options->interval * 60);
     }
-    else
+
+    if (parsed > 0)
     {
-        fprintf(file,
-                "                    <tr>\n"
-                "                        <td colspan=\"6\" style=\"text-align: center; color: var(--text-secondary);\">暂无警报记录</td>\n"
-                "                    </tr>\n");
+        render_cycle(config, &meter, config->lowEnergyThreshold);
+        renders++;
     }
+    double elapsed = (double)(metric_clock() - started) / (double)metric_frequency;
+
+    LONG64 alerts = metric_counter_total(METRIC_ALERTS) - alerts_before;
+
+    char end_time[32];
+    format_time(end_time, sizeof(end_time));
+    printf("✅ 模拟完成: %lld 次轮询（虚拟时间至 %s），%lld 轮渲染，%lld 次充值，%lld 次警报\n",
+           parsed, end_time, renders, recharges, (long long)alerts);
+    printf("实际耗时 %.2f 秒，%.0f 次轮询/秒，相当于 %.0f 倍速\n",
+           elapsed, elapsed > 0 ? parsed / elapsed : 0,
+           elapsed > 0 ? parsed * options->interval * 60.0 / elapsed : 0);
+    return parsed > 0;
+}
 
-    fprintf(file,
-            "                </tbody>\n"
-            "            </table>\n"
-            "            \n"
-            "            <div class=\"update-time\">\n"
-            "                页面生成时间: %s\n"
-            "            </div>\n"
-            "        </div>\n"
-            "        \n"
-            "        <div class=\"footer\">\n"
-            "            <p>警报记录页面</p>\n"
-            "            <p></p>\n"
-            "        </div>\n"
-            "    </div>\n"
-            "    \n"
-            "    <script>\n"
-            "        // 主题切换功能\n"
-            "        function toggleTheme() {\n"
-            "            document.body.classList.toggle('dark-mode');\n"
-            "            const button = document.querySelector('.theme-toggle');\n"
-            "            if (document.body.classList.contains('dark-mode')) {\n"
-            "                button.textContent = '☀️ 明亮模式';\n"
-            "                localStorage.setItem('theme', 'dark');\n"
-            "            } else {\n"
-            "                button.textContent = '🌙 暗黑模式';\n"
-            "                localStorage.setItem('theme', 'light');\n"
-            "            }\n"
-            "        }\n"
-            "        \n"
-            "        // 加载保存的主题\n"
-            "        document.addEventListener('DOMContentLoaded', function() {\n"
-            "            const savedTheme = localStorage.getItem('theme');\n"
-            "            if (savedTheme === 'dark') {\n"
-            "                document.body.classList.add('dark-mode');\n"
-            "                document.querySelector('.theme-toggle').textContent = '☀️ 明亮模式';\n"
-            "            }\n"
-            "        });\n"
-            "        \n"
-            "        // 自动刷新页面（每5分钟）\n"
-            "        setTimeout(function() {\n"
-            "            location.reload();\n"
-            "        }, 300000);\n"
-            "    </script>\n"
-            "</body>\n"
-            "</html>",
-            get_current_time());
+/* 解析--simulate的参数 */
+int parse_simulation_options(int argc, char *argv[], SimulationOptions *options)
+{
+    memset(options, 0, sizeof(SimulationOptions));
+    options->days = SIM_DEFAULT_DAYS;
+    options->interval = 10;
+    options->seed = 1;
+    int year = 2025, month = 1, day = 1;
 
-    fclose(file);
+    for (int i = 0; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--days") == 0 && value)
+            options->days = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--interval") == 0 && value)
+            options->interval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--render-every") == 0 && value)
+            options->renderEvery = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && value)
+            options->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--start") == 0 && value)
+        {
+            if (sscanf(argv[++i], "%d-%d-%d", &year, &month, &day) != 3)
+            {
+                printf("❌ 起始日期格式应为 YYYY-MM-DD\n");
+                return 0;
+            }
+        }
+        else
+        {
+            printf("❌ 未知的模拟参数: %s\n", argv[i]);
+            return 0;
+        }
+    }
 
-    char success_msg[256];
-    snprintf(success_msg, sizeof(success_msg), "警报记录页面已生成: %s", filepath);
-    write_log("INFO", success_msg);
+    struct tm start;
+    memset(&start, 0, sizeof(start));
+    start.tm_year = year - 1900;
+    start.tm_mon = month - 1;
+    start.tm_mday = day;
+    start.tm_isdst = -1;
+    options->start = (long long)mktime(&start);
+
+    if (options->days <= 0 || options->interval <= 0 || options->start < 0)
+    {
+        printf("❌ 模拟参数无效（天数和轮询间隔需大于0）\n");
+        return 0;
+    }
     return 1;
 }
 
-/* 生成HTML页面 - 保持原有函数兼容性 */
-int generate_html_page(const char *web_path, const ElectricMeter *meter, double threshold)
+/* 读取并解压一条捕获记录，response以'\0'结尾；返回1成功，0文件正常结束，-1记录损坏或不完整 */
+int capture_read_record(FILE *capture, z_stream *stream, CaptureHeader *header, char *response, size_t size)
 {
-    // 调用新的完整页面生成函数
-    return generate_complete_html_pages(web_path, meter, threshold);
+    static unsigned char compressed[BUFFER_SIZE + 64];
+    size_t got = fread(header, 1, sizeof(CaptureHeader), capture);
+    if (got == 0)
+        return 0;
+    if (got < sizeof(CaptureHeader) || header->magic != CAPTURE_MAGIC ||
+        header->length > sizeof(compressed) || header->rawLength >= size ||
+        fread(compressed, 1, header->length, capture) != header->length)
+        return -1;
+
+    inflateReset(stream);
+    inflateSetDictionary(stream, (const Bytef *)capture_dictionary, (uInt)(sizeof(capture_dictionary) - 1));
+    stream->next_in = compressed;
+    stream->avail_in = header->length;
+    stream->next_out = (Bytef *)response;
+    stream->avail_out = header->rawLength;
+    if (inflate(stream, Z_FINISH) != Z_STREAM_END || stream->total_out != header->rawLength ||
+        crc32(crc32(0L, (const Bytef *)&header->unixMs, sizeof(header->unixMs)),
+              (const Bytef *)response, header->rawLength) != header->crc)
+        return -1;
+    response[header->rawLength] = '\0';
+    return 1;
 }
 
-/* 显示电表信息 */
-void display_meter_info(const ElectricMeter *meter, double threshold)
+/* 解析 --replay 之后的参数：捕获文件 [--render-every N]，未知参数报错 */
+int parse_replay_options(int argc, char *argv[], const char **capture_path, int *render_every)
 {
-    printf("\n=== 电表信息 ===\n");
-    printf("更新时间: %s\n", meter->meterUpdateTime);
-    printf("剩余电量: %.2f 度", meter->remainingEnergy);
-    if (meter->remainingEnergy <= threshold)
-    {
-        printf(" (低电量!)\n");
-    }
-    else
+    *capture_path = NULL;
+    *render_every = 0;
+    for (int i = 0; i < argc; i++)
     {
-        printf("\n");
+        if (strcmp(argv[i], "--render-every") == 0 && i + 1 < argc)
+        {
+            *render_every = atoi(argv[++i]);
+            if (*render_every <= 0)
+            {
+                printf("❌ --render-every 需大于0\n");
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--", 2) != 0 && !*capture_path)
+        {
+            *capture_path = argv[i];
+        }
+        else
+        {
+            printf("❌ 未知的回放参数: %s\n", argv[i]);
+            return 0;
+        }
     }
-    printf("剩余金额: %.2f 元\n", meter->remainingAmount);
-    printf("累计用电: %.2f kWh\n", meter->totalConsumption);
-    printf("当前电价: %.4f 元/度\n", meter->price);
-    if (strlen(meter->meterStatus) > 0)
+
+    if (!*capture_path)
     {
-        printf("电表状态: %s\n", meter->meterStatus);
+        printf("❌ 用法: --replay 捕获文件 [--render-every N]\n");
+        return 0;
     }
-    printf("================\n");
+    return 1;
 }
 
-/* 主监控循环 */
-void start_monitoring(const Config *config)
+/* 回放模式：把CAPTURE_FILE捕获的原始响应按顺序重新送入parse_json_response、process_reading和页面渲染，
+   虚拟时钟设为每条记录的捕获时间，入库时间和页面与当时一致；不等待，尽可能快地处理。
+   结束时输出吞吐、各阶段平均耗时和读数摘要，同一捕获文件在不同版本上的摘要不同说明解析或计算结果变了 */
+int run_replay(Config *config, const char *capture_path, int render_every)
 {
-    write_log("INFO", "开始电表监控");
-
-    printf("开始电表监控\n");
-    printf("监控间隔: %d 分钟\n", config->monitorInterval);
-    printf("低电量阈值: %.1f 度\n", config->lowEnergyThreshold);
-    printf("数据库: %s\n", config->dbPath);
-    printf("网页路径: %s\n", config->webPath);
-    printf("最大重试次数: %d 次\n", MAX_RETRY_COUNT);
-    printf("按 Ctrl+C 停止监控\n\n");
+    FILE *capture = fopen(capture_path, "rb");
+    if (!capture)
+    {
+        printf("❌ 无法打开捕获文件: %s\n", capture_path);
+        return 0;
+    }
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+    {
+        fclose(capture);
+        return 0;
+    }
 
-    int count = 0;
-    int alert_count = 0;
-    const int max_alerts = 3;
-    int was_low = 0;
+    create_directory(REPLAY_DIR);
+    remove(REPLAY_DB);
+    remove(REPLAY_DB "-wal");
+    remove(REPLAY_DB "-shm");
+    snprintf(config->dbPath, sizeof(config->dbPath), "%s", REPLAY_DB);
+    snprintf(config->webPath, sizeof(config->webPath), "%s", REPLAY_WEB);
+    create_directory(config->webPath);
+    config->httpPort = 0;
 
-    write_log("INFO", "监控系统已启动，开始循环...");
+    if (!init_database(config->dbPath))
+    {
+        printf("❌ 回放数据库初始化失败\n");
+        inflateEnd(&stream);
+        fclose(capture);
+        return 0;
+    }
 
+    log_set_level(LOG_LEVEL_WARN);
+
+    static char response[BUFFER_SIZE];
+    AlertState alert_state;
+    alert_state_init(&alert_state);
+    ElectricMeter meter;
+    memset(&meter, 0, sizeof(meter));
+    long long records = 0, parsed = 0, renders = 0;
+    long long first_ms = 0, last_ms = 0;
+    unsigned int digest = 2166136261u; // FNV-1a
+    int last_day = -1;
+    LONG64 alerts_before = metric_counter_total(METRIC_ALERTS);
+    LONG64 parse_sum_before, save_sum_before, render_sum_before;
+    LONG64 parse_before = metric_stage_total(METRIC_STAGE_PARSE, &parse_sum_before);
+    LONG64 save_before = metric_stage_total(METRIC_STAGE_SAVE, &save_sum_before);
+    LONG64 render_before = metric_stage_total(METRIC_STAGE_RENDER, &render_sum_before);
+
+    printf("回放 %s → 数据库 %s，网页路径 %s\n", capture_path, config->dbPath, config->webPath);
+    ULONGLONG started = metric_clock();
+    CaptureHeader header;
     while (keep_running)
     {
-        count++;
-        printf("\n=== 第 %d 次查询 ===\n", count);
-        printf("当前时间: %s\n", get_current_time());
-
-        ElectricMeter meter;
-        memset(&meter, 0, sizeof(meter));
-
-        printf("正在获取电表数据...\n");
-        if (get_electric_meter_data_with_retry(config, &meter))
+        long record_start = ftell(capture);
+        int result = capture_read_record(capture, &stream, &header, response, sizeof(response));
+        if (result == 0)
+            break;
+        if (result < 0)
         {
-            printf("✅ 数据获取成功\n");
-
-            save_to_database(config->dbPath, &meter);
-            generate_complete_html_pages(config->webPath, &meter, config->lowEnergyThreshold);
-            display_meter_info(&meter, config->lowEnergyThreshold);
-
-            if (meter.remainingEnergy <= config->lowEnergyThreshold)
+            // 从这条记录头的下一个字节开始找下一个记录标记（文件按小端写入）
+            fseek(capture, record_start + 1, SEEK_SET);
+            unsigned int window = 0;
+            long scanned = 0;
+            int c;
+            while ((c = fgetc(capture)) != EOF)
             {
-                if (alert_count < max_alerts)
-                {
-                    char alert_msg[128];
-                    snprintf(alert_msg, sizeof(alert_msg), "低电量警报! (第%d次警报)", alert_count + 1);
-                    write_log("ALERT", alert_msg);
-
-                    printf("🚨 %s\n", alert_msg);
-                    send_email(config, &meter, config->lowEnergyThreshold);
-                    save_alert_to_database(config->dbPath, &meter, config->lowEnergyThreshold);
-                    alert_count++;
-                }
-                was_low = 1;
+                window = (window >> 8) | ((unsigned int)c << 24);
+                if (++scanned >= 4 && window == CAPTURE_MAGIC)
+                    break;
             }
-            else
+            if (c == EOF)
             {
-                if (was_low)
-                {
-                    write_log("INFO", "电量已恢复正常");
-                    printf("✅ 电量已恢复正常\n");
-                    was_low = 0;
-                    alert_count = 0;
-                }
+                printf("⚠️ 第 %lld 条记录之后的 %ld 字节不完整或已损坏，已忽略\n", records, ftell(capture) - record_start);
+                break;
             }
+            fseek(capture, -4, SEEK_CUR);
+            printf("⚠️ 第 %lld 条记录之后有 %ld 字节损坏，已跳到下一条记录\n", records, ftell(capture) - record_start);
+            continue;
         }
-        else
+        records++;
+        if (records == 1)
+            first_ms = header.unixMs;
+        last_ms = header.unixMs;
+        clock_use_virtual(header.unixMs);
+
+        memset(&meter, 0, sizeof(meter));
+        ULONGLONG parse_started = metric_clock();
+        int ok = parse_json_response(response, &meter);
+        metric_observe(METRIC_STAGE_PARSE, parse_started);
+        if (!ok)
         {
-            printf("❌ 数据获取失败，跳过本次处理\n");
+            char parse_error_msg[128];
+            snprintf(parse_error_msg, sizeof(parse_error_msg), "回放第 %lld 条记录JSON解析失败", records);
+            write_log("WARN", parse_error_msg);
+            continue;
         }
-
-        if (keep_running)
+        parsed++;
+
+        char reading[160];
+        int reading_length = snprintf(reading, sizeof(reading), "%lld|%.2f|%.2f|%.2f|%.4f|%s\n", header.unixMs,
+                                      meter.remainingEnergy, meter.remainingAmount, meter.totalConsumption,
+                                      meter.price, meter.meterStatus);
+        for (int i = 0; i < reading_length && i < (int)sizeof(reading) - 1; i++)
+            digest = (digest ^ (unsigned char)reading[i]) * 16777619u;
+
+        process_reading(config, &alert_state, &meter, 0);
+
+        // 默认在捕获时间跨过本地日期时渲染一轮，与每天查看页面的频率相当
+        SYSTEMTIME now_local;
+        clock_local_time(&now_local);
+        int render_now = render_every > 0 ? (parsed % render_every == 0) : (last_day >= 0 && now_local.wDay != last_day);
+        last_day = now_local.wDay;
+        if (render_now)
         {
-            printf("⏰ 等待 %d 分钟...\n", config->monitorInterval);
-
-            // 分段等待，便于响应Ctrl+C
-            int total_wait = config->monitorInterval * 60; // 转换为秒
-            for (int i = 0; i < total_wait && keep_running; i++)
-            {
-                Sleep(1000); // 每秒检查一次
-            }
+            render_cycle(config, &meter, config->lowEnergyThreshold);
+            renders++;
         }
     }
+    inflateEnd(&stream);
+    fclose(capture);
 
-    write_log("INFO", "监控系统已停止");
+    if (parsed > 0)
+    {
+        render_cycle(config, &meter, config->lowEnergyThreshold);
+        renders++;
+    }
+    double elapsed = (double)(metric_clock() - started) / (double)metric_frequency;
+
+    LONG64 parse_sum, save_sum, render_sum;
+    LONG64 parse_count = metric_stage_total(METRIC_STAGE_PARSE, &parse_sum) - parse_before;
+    LONG64 save_count = metric_stage_total(METRIC_STAGE_SAVE, &save_sum) - save_before;
+    LONG64 render_count = metric_stage_total(METRIC_STAGE_RENDER, &render_sum) - render_before;
+
+    printf("✅ 回放完成: %lld 条记录（跨度 %.1f 天），解析成功 %lld 条，失败 %lld 条，%lld 次警报，%lld 轮渲染\n",
+           records, (last_ms - first_ms) / 86400000.0, parsed, records - parsed,
+           (long long)(metric_counter_total(METRIC_ALERTS) - alerts_before), renders);
+    printf("实际耗时 %.2f 秒，%.0f 条/秒；平均解析 %.1f us，入库 %.1f us，渲染 %.1f ms\n",
+           elapsed, elapsed > 0 ? records / elapsed : 0,
+           parse_count > 0 ? (double)(parse_sum - parse_sum_before) / parse_count : 0,
+           save_count > 0 ? (double)(save_sum - save_sum_before) / save_count : 0,
+           render_count > 0 ? (render_sum - render_sum_before) / 1000.0 / render_count : 0);
+    printf("读数摘要: %08x\n", digest);
+    return records > 0;
+}
+
+/* 程序退出前停止全部后台线程：先停渲染、发件箱、通知和HTTP服务这些写日志的线程，等它们退出后再停止日志线程，
+   它们退出时写的日志也能进入日志文件。各停止函数在线程未启动时直接返回，任何模式下都可以调用 */
+void shutdown_threads(void)
+{
+    stop_render_thread();
+    stop_outbox_worker();
+    stop_notify_sinks();
+    stop_http_server();
+    stop_logger();
 }
 
 /* 主函数 */
-int main(void)
+/* 用法: 电表查询.exe [--build-archive]
+   --build-archive  从数据库重新生成完整的按月历史归档后退出，不进入监控循环
+   --benchmark [--rows N] [结果文件]  离线运行基准测试，结果为JSON行
+   --load-test [--meters 1,10,100,1000] [--seconds 10] [--workers 8] [--latency 50] [--jitter 20]
+               [--error-rate 1] [--payload 512] [--port 0] [结果文件]
+                    对本机伪上游运行真实流水线，测量不同电表数量下的吞吐、尾延迟和资源占用
+   --simulate [--days 90] [--interval 10] [--start 2025-01-01] [--render-every N] [--seed 1]
+                    用虚拟时钟和合成读数快速重放数月的轮询，写入simulation目录
+   --replay 捕获文件 [--render-every N]
+                    把CAPTURE_FILE捕获的原始响应重新送入解析、入库和渲染，写入replay目录 */
+int main(int argc, char *argv[])
 {
     set_console_utf8();
+    metric_init();
+    if (!winsock_init())
+        return 1;
+
+    // 解码二进制事件日志，不需要配置文件
+    if (argc > 2 && strcmp(argv[1], "--decode-events") == 0)
+        return decode_event_log(argv[2], argc > 3 && strcmp(argv[3], "--json") == 0) ? 0 : 1;
+
+    // 基准测试，同样不需要配置文件和网络
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+    {
+        int rows = BENCH_DEFAULT_ROWS;
+        const char *out_path = NULL;
+        for (int i = 2; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc)
+                rows = atoi(argv[++i]);
+            else
+                out_path = argv[i];
+        }
+        return run_benchmarks(out_path, rows > 0 ? rows : BENCH_DEFAULT_ROWS) ? 0 : 1;
+    }
+
+    // 负载测试，对本机伪上游运行，不需要配置文件
+    if (argc > 1 && strcmp(argv[1], "--load-test") == 0)
+    {
+        LoadTestOptions options;
+        const char *out_path;
+        if (!parse_load_test_options(argc - 2, argv + 2, &options, &out_path))
+            return 1;
+        return run_load_test(&options, out_path) ? 0 : 1;
+    }
 
     // 注册信号处理
     signal(SIGINT, signal_handler);
@@ -2169,6 +10143,9 @@ int main(void)
     create_directory("temp_mail");
     create_directory("web");
 
+    page_cache_init();
+    init_static_assets();
+
     Config config;
     if (!read_config("config.txt", &config))
     {
@@ -2178,27 +10155,75 @@ int main(void)
         return 1;
     }
 
+    if (!start_logger(&config))
+        printf("⚠️ 日志线程启动失败，日志将直接写入文件\n");
+
     write_log("INFO", "配置加载成功");
     printf("✅ 配置加载成功\n");
     printf("监控间隔: %d 分钟\n", config.monitorInterval);
     printf("低电量阈值: %.1f 度\n", config.lowEnergyThreshold);
     printf("数据库: %s\n", config.dbPath);
     printf("网页路径: %s\n", config.webPath);
+    if (config.httpPort > 0)
+    {
+        printf("内置HTTP端口: %d\n", config.httpPort);
+    }
+
+    // 模拟模式使用config.txt中的警报规则，但数据写到独立的模拟数据库
+    if (argc > 1 && strcmp(argv[1], "--simulate") == 0)
+    {
+        SimulationOptions options;
+        int simulated = parse_simulation_options(argc - 2, argv + 2, &options) && run_simulation(&config, &options);
+        shutdown_threads();
+        return simulated ? 0 : 1;
+    }
+
+    // 回放同样使用独立的数据库，不影响正式数据
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0)
+    {
+        const char *capture_path;
+        int render_every;
+        if (!parse_replay_options(argc - 2, argv + 2, &capture_path, &render_every))
+        {
+            shutdown_threads();
+            return 1;
+        }
+        int replayed = run_replay(&config, capture_path, render_every);
+        shutdown_threads();
+        return replayed ? 0 : 1;
+    }
 
     if (!init_database(config.dbPath))
     {
         write_log("ERROR", "数据库初始化失败");
         printf("❌ 数据库初始化失败\n");
+        shutdown_threads();
         pause_program();
         return 1;
     }
 
+    if (argc > 1 && strcmp(argv[1], "--build-archive") == 0)
+    {
+        printf("正在生成历史归档: %s/archive\n", config.webPath);
+        int archived = build_history_archive(&config);
+        printf(archived ? "✅ 历史归档生成完成\n" : "❌ 历史归档生成失败，详见日志\n");
+        shutdown_threads();
+        return archived ? 0 : 1;
+    }
+
+    if (config.httpPort > 0 && !start_http_server(&config))
+    {
+        printf("⚠️ 内置HTTP服务启动失败，仅生成网页文件\n");
+    }
+
     write_log("INFO", "系统启动完成，开始监控");
     printf("✅ 系统启动完成，开始监控...\n\n");
 
     start_monitoring(&config);
+    stop_http_server();
 
     write_log("INFO", "程序正常退出");
+    shutdown_threads();
     printf("\n程序已退出\n");
     return 0;
 }
\ No newline at end of file